@@ -72,22 +72,17 @@ public class FaceData {
      */
     public Rect                 rect;
 
-    private boolean             isMirrored           = false;
-    private int                 rotationAngleDegrees = 0;
-
-    private int[][]             sinCosValues         = {// sin,cos
-                                                     { 1, 0 }, // 90
-            { 0, -1 }, // 180
-            { -1, 0 }                               // 270
-                                                     };
-
     private int                 recognitionConfidenceValue;  //used only for face recognition, otherwise NOT_PROCESSED
     private int                 personId;      //if face is recognised, then will have a valid id, or else -1 or NOT_PROCESSED
 
     /*
      * Constructor with default access specifier, this will restrict instantiation from other packages.
      */
-    FaceData(boolean isMirrored, int rotationAngle) {
+    /*
+     * Values are set by FacialProcessing.getFaceData once they are mirrored, rotated
+     * and scaled to display coordinates by the native side.
+     */
+    FaceData() {
         smileDegree = FacialProcessingConstants.FP_NOT_PROCESSED;
         lEyeBlink = FacialProcessingConstants.FP_NOT_PROCESSED;
         rEyeBlink = FacialProcessingConstants.FP_NOT_PROCESSED;
@@ -100,8 +95,6 @@ public class FaceData {
         mouth = null;
 
         yaw = pitch = roll = FacialProcessingConstants.FP_NOT_PROCESSED;
-        this.isMirrored = isMirrored;
-        this.rotationAngleDegrees = rotationAngle;
 
         personId = FacialProcessingConstants.FP_NOT_PROCESSED;
         recognitionConfidenceValue = FacialProcessingConstants.FP_NOT_PROCESSED;
@@ -303,232 +296,6 @@ public class FaceData {
     }
 
 
-    protected void doRotationNMirroring(int prevWidth, int prevHeight) {
-        // sequence is dicey
-        if (true == isMirrored) {
-            doMirroring(prevWidth);
-        }
-        if (0 != rotationAngleDegrees) {
-            doRotation(prevWidth, prevHeight);
-        }
-    }
-
-
-    private void doRotation(int prevWidth, int prevHeight) {
-
-        // rotate all values clockwise
-        Point temp = new Point(0, 0);
-
-        int xCenter = prevWidth / 2;
-        int yCenter = prevHeight / 2;
-
-        int cos = 1;
-        int sin = 0;
-        int xDiff = 0;
-        int yDiff = 0;
-        switch (rotationAngleDegrees) {
-        case 90:
-            sin = sinCosValues[0][0];
-            cos = sinCosValues[0][1];
-            xDiff = 0;
-            yDiff = prevHeight;
-            xDiff = xDiff - xCenter;
-            yDiff = yDiff - yCenter;
-            temp.x = (int) ((xDiff * cos) - (yDiff * sin));
-            temp.y = (int) ((xDiff * sin) + (yDiff * cos));
-            xDiff = temp.x + xCenter;
-            yDiff = temp.y + yCenter;
-            break;
-        case 180:
-            sin = sinCosValues[1][0];
-            cos = sinCosValues[1][1];
-            break;
-        case 270:
-            sin = sinCosValues[2][0];
-            cos = sinCosValues[2][1];
-            xDiff = prevWidth - 1;
-            yDiff = 0;
-            xDiff = xDiff - xCenter;
-            yDiff = yDiff - yCenter;
-            temp.x = (int) ((xDiff * cos) - (yDiff * sin));
-            temp.y = (int) ((xDiff * sin) + (yDiff * cos));
-            xDiff = temp.x + xCenter;
-            yDiff = temp.y + yCenter;
-            break;
-        }
-
-        if(leftEye != null){
-            // left eye
-            leftEye.x = leftEye.x - xCenter;
-            leftEye.y = leftEye.y - yCenter;
-            temp.x = (int) ((leftEye.x * cos) - (leftEye.y * sin));
-            temp.y = (int) ((leftEye.x * sin) + (leftEye.y * cos));
-            leftEye.x = temp.x + xCenter - xDiff;
-            leftEye.y = temp.y + yCenter - yDiff;
-
-
-            // right eye
-            rightEye.x = rightEye.x - xCenter;
-            rightEye.y = rightEye.y - yCenter;
-            temp.x = (int) ((rightEye.x * cos) - (rightEye.y * sin));
-            temp.y = (int) ((rightEye.x * sin) + (rightEye.y * cos));
-            rightEye.x = temp.x + xCenter - xDiff;
-            rightEye.y = temp.y + yCenter - yDiff;
-
-            // mouth
-            mouth.x = mouth.x - xCenter;
-            mouth.y = mouth.y - yCenter;
-            temp.x = (int) ((mouth.x * cos) - (mouth.y * sin));
-            temp.y = (int) ((mouth.x * sin) + (mouth.y * cos));
-            mouth.x = temp.x + xCenter - xDiff;
-            mouth.y = temp.y + yCenter - yDiff;
-        }
-
-        // rect
-        int left = 0, top = 0;
-        left = rect.left - xCenter;
-        top = rect.top - yCenter;
-        temp.x = (int) ((left * cos) - (top * sin));
-        temp.y = (int) ((left * sin) + (top * cos));
-        left = temp.x + xCenter - xDiff;
-        top = temp.y + yCenter - yDiff;
-
-        int right = 0, bottom = 0;
-        right = rect.right - xCenter;
-        bottom = rect.bottom - yCenter;
-        temp.x = (int) ((right * cos) - (bottom * sin));
-        temp.y = (int) ((right * sin) + (bottom * cos));
-        right = temp.x + xCenter - xDiff;
-        bottom = temp.y + yCenter - yDiff;
-
-        if (left < right) {
-            rect.left = left;
-            rect.right = right;
-        } else {
-            rect.left = right;
-            rect.right = left;
-        }
-        if (top < bottom) {
-            rect.top = top;
-            rect.bottom = bottom;
-        } else {
-            rect.top = bottom;
-            rect.bottom = top;
-        }
-
-        //roll value correction
-        switch(rotationAngleDegrees){
-        case 90:
-            roll += rotationAngleDegrees;
-            if(roll > 180){
-                int diff = roll - 180;
-                roll = diff - 180;
-            }
-            break;
-
-        case 180:
-            if (roll <= 0) {
-                roll += rotationAngleDegrees;
-            } else {
-                roll -= rotationAngleDegrees;
-            }
-            break;
-
-        case 270:
-            roll -= 90;
-            if(roll < -179){
-                int diff = -179 - roll;
-                roll = 179 + diff;
-            }
-            break;
-        }
-        //end roll value
-
-        //gaze angles
-        switch(rotationAngleDegrees){
-        case 90:
-            int tempInt = -eyeHorizontalGazeAngle;
-            eyeHorizontalGazeAngle = eyeVerticalGazeAngle;
-            eyeVerticalGazeAngle = tempInt;
-            break;
-
-        case 180:
-            eyeHorizontalGazeAngle = -eyeHorizontalGazeAngle;
-            eyeVerticalGazeAngle = -eyeVerticalGazeAngle;
-            break;
-
-        case 270:
-            tempInt = eyeHorizontalGazeAngle;
-            eyeHorizontalGazeAngle = -eyeVerticalGazeAngle;
-            eyeVerticalGazeAngle = tempInt;
-            break;
-        }
-        //end gaze angles
-    }
-
-
-    private void doMirroring(int width) {
-        // yaw, roll, horizontal gaze
-        if(yaw != FacialProcessingConstants.FP_NOT_PROCESSED)
-        {
-            yaw = -yaw;
-            roll = -roll;
-        }
-        if(eyeHorizontalGazeAngle != FacialProcessingConstants.FP_NOT_PROCESSED)
-        {
-            eyeHorizontalGazeAngle = -eyeHorizontalGazeAngle;
-        }
-
-        // mirror blink values
-        if(lEyeBlink != FacialProcessingConstants.FP_NOT_PROCESSED)
-        {
-            int tempInt = lEyeBlink;
-            lEyeBlink = rEyeBlink;
-            rEyeBlink = tempInt;
-        }
-
-        // now flip point coordinates.. newx = width - oldx - 1
-        if(leftEye != null){
-            leftEye.x = width - leftEye.x - 1;
-            rightEye.x = width - rightEye.x - 1;
-            mouth.x = width - mouth.x - 1;
-            {
-                Point temp = leftEye;
-                leftEye = rightEye;
-                rightEye = temp;
-            }
-        }
-        // now flip rect
-        {
-            int tempInt = width - rect.left - 1;
-            rect.left = width - rect.right - 1;
-            rect.right = tempInt;
-        }
-    }
-
-
-    protected void normalizeCoordinates(float scaleX, float scaleY){
-        if(leftEye != null){
-            // Normalize Left Eye Co-ordinate
-            leftEye.x =(int) ((float)leftEye.x*scaleX);
-            leftEye.y =(int) ((float)leftEye.y*scaleY);
-
-            // Normalize Right Eye Co-ordinate
-            rightEye.x =(int) ((float)rightEye.x*scaleX);
-            rightEye.y =(int) ((float)rightEye.y*scaleY);
-
-            // Normalize mouth Co-ordinate
-            mouth.x =(int) ((float)mouth.x*scaleX);
-            mouth.y =(int) ((float)mouth.y*scaleY);
-        }
-
-        // Normalize rect Co-ordinate
-        rect.left =(int) ((float)rect.left*scaleX);
-        rect.top =(int)  ((float)rect.top*scaleY);
-        rect.right =(int) ((float)rect.right*scaleX);
-        rect.bottom =(int)  ((float)rect.bottom*scaleY);
-    }
-
     /**
      * This API returns the personID for the face in the recognition album that matches the input face from the processed frame or bitmap.
      *
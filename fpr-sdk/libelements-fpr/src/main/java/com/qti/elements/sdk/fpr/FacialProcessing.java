@@ -7,6 +7,7 @@
  */
 package com.qti.elements.sdk.fpr;
 
+import java.nio.ByteBuffer;
 import java.util.ArrayList;
 import java.util.EnumSet;
 
@@ -62,8 +63,16 @@ import android.util.Log;
  * </ul>
  *
  * Objects of this class cannot be cloned.
- * Facial Processing class is not thread safe, hence this class is implemented
- * as a singleton.
+ * Each object returned by getInstance() is an independent facial processor with its
+ * own native engine, so several streams can be processed at once, one per object.
+ * Objects share no state: different objects may be used from different threads
+ * concurrently, and each scans on the core of the thread using it. The native
+ * qcff_bench executable measures this on a device. It runs N engines on N threads and
+ * reports their frame rate against N times that of one engine. An object itself is
+ * not thread safe; use it from one thread at a time, or hand it over with the usual
+ * synchronization. The one exception is the listener mode, where submitFrame() may be
+ * called from any thread and the {@link FaceDataListener} is called on a thread of the
+ * framework.
  * When the facial processing object is no longer needed, call the release() function
  * to dispose off the object.
  *
@@ -134,8 +143,6 @@ import android.util.Log;
 public class FacialProcessing {
 
     private static final String TAG                       = "Facial_Processing";
-    private static int totalNumPeople = 0;
-    private static boolean isAllZeroFlag = false;
 
     public enum FEATURE_LIST {
         /**
@@ -172,7 +179,127 @@ public class FacialProcessing {
     private float scaleX = 1.0f;        // Normalization factor for the x-co-ordinates. Initially 1 (i.e. no normalization)
     private float scaleY = 1.0f;        // Normalization factor for the y-co-ordinates. Initially 1 (i.e. no normalization)
 
-    private static final int CONFIG_DOWNSCALE_FACTOR = 1;                   //need to pass to config to native
+    private static final int DOWNSCALE_FACTOR_ONE = 256;                    //downscale factors are passed to native as 8.8 fixed point
+    // In-plane rotations searched for, same values as ROT_ANGLE_* in qcff
+    private static final int ROT_ANGLE_NONE = 0x00000000;
+    private static final int ROT_ANGLE_U45 = 0x00803803;                    //upright, +/-45 degrees
+    private static final int ROT_ANGLE_ALL = 0x00ffffff;
+    private int downscaleFactorQ8 = DOWNSCALE_FACTOR_ONE;                    //need to pass to config to native
+
+    // Information gathered by the native worker, same values as QCFF_INFO_* in qcff
+    private static final int INFO_RECTS = 1 << 0;
+    private static final int INFO_PARTS = 1 << 1;
+    private static final int INFO_DIRECTIONS = 1 << 3;
+    private static final int INFO_SMILES = 1 << 4;
+    private static final int INFO_EYE_OPENS = 1 << 5;
+    private static final int INFO_GAZES = 1 << 6;
+    private static final int ASYNC_HEADER_SIZE = 5;                         //sequence, timestamp (2), dropped frames, faces
+    private static final int ASYNC_POLL_TIMEOUT_MS = 100;                   //bounds the time taken to stop the delivery thread
+    private static final int BATCH_HEADER_SIZE = 3;                         //status, processing time, faces
+    private static final int MAX_THREADS = 64;                              //from qcff, QCFF_MAX_THREADS
+
+    /**
+     * Receives the facial data of the frames passed to
+     * {@link submitFrame(byte[], int, int, boolean, PREVIEW_ROTATION_ANGLE, long)}.
+     * Set it with {@link setFaceDataListener(FaceDataListener, EnumSet)}.
+     */
+    public interface FaceDataListener {
+        /**
+         * Called on a framework thread, once per processed frame. Frames submitted
+         * faster than they are processed are dropped; only the latest one is processed.
+         *
+         * @param faces One entry per detected face, or null if no face is detected.
+         * @param sequence The sequence number of the frame, counted from 0 by submitFrame().
+         * @param timestamp The timestamp passed along with the frame.
+         * @param numDropped The number of frames dropped since the previous call.
+         */
+        void onFaceData(FaceData[] faces, int sequence, long timestamp, int numDropped);
+    }
+
+    /**
+     * Tunable face detection parameters, read with {@link getDetectionParams()} and
+     * applied with {@link setDetectionParams(DetectionParams)}. Face sizes are in
+     * pixels of the frame as scanned, i.e. after downscaling.
+     */
+    public static class DetectionParams {
+        /** Search density for new faces, 1 to 100. Lower values find more faces, slower. */
+        public int searchStep;
+        /** Search density around faces being tracked, 1 to 100. */
+        public int trackingStep;
+        /** Size of the smallest face to detect, at least 20. */
+        public int minFaceSize;
+        /** Size of the largest face to detect, 0 for the frame size. */
+        public int maxFaceSize;
+        /** Number of faces detected at most, 1 to 64. */
+        public int maxFaces;
+        /** Detection threshold for new faces, 1 to 1000, 0 for the engine default. */
+        public int threshold;
+        /** Detection threshold for faces being tracked, 1 to 1000, 0 for the engine default. */
+        public int trackingThreshold;
+        /** Whether faces being tracked are located with high accuracy, which costs time. */
+        public boolean highAccuracy;
+        /** Smallest recognition score for a face to be identified, 0 to 1000. */
+        public int recognitionThreshold;
+    }
+
+    /**
+     * How the search for new faces is spread over the preview frames in
+     * {@link FP_MODES#FP_MODE_VIDEO}; faces already found are tracked on every frame.
+     */
+    public enum TRACKING_SEARCH {
+        /** The whole frame is searched at once, every refreshCount frames. */
+        WHOLE(0),
+        /** A third of the frame is searched on each frame. */
+        PARTITION(1),
+        /** A little of the frame is searched on each frame. This is the default. */
+        GRADUAL(2);
+
+        private int value;
+
+        private TRACKING_SEARCH(int value){
+            this.value = value;
+        }
+
+        protected int getValue(){
+            return value;
+        }
+    }
+
+    /**
+     * Face tracking policy of {@link FP_MODES#FP_MODE_VIDEO}, read with
+     * {@link getTrackingPolicy()} and applied with {@link setTrackingPolicy(TrackingPolicy)}.
+     * Counts left at {@link TRACKING_DEFAULT} keep the value of the detection engine.
+     * A fixed camera can afford a long refresh and hold; a handheld one finds faces
+     * sooner with a short refresh and a larger move rate, at a higher cost per frame.
+     */
+    public static class TrackingPolicy {
+        /** How the frame is searched for new faces. */
+        public TRACKING_SEARCH search = TRACKING_SEARCH.GRADUAL;
+        /** Number of frames a search for new faces takes. */
+        public int refreshCount = TRACKING_DEFAULT;
+        /** Number of frames a lost face is looked for again. */
+        public int faceRetryCount = TRACKING_DEFAULT;
+        /** Number of frames a lost face is looked for again as a head. */
+        public int headRetryCount = TRACKING_DEFAULT;
+        /** Number of frames a lost face is still reported for. */
+        public int holdCount = TRACKING_DEFAULT;
+        /** Correction of the position of tracked faces for their motion. */
+        public int moveRate = TRACKING_DEFAULT;
+
+        public TrackingPolicy(){
+        }
+
+        /**
+         * Creates the policy of a search preset, all counts left to the engine.
+         * @param search How the frame is searched for new faces.
+         */
+        public TrackingPolicy(TRACKING_SEARCH search){
+            this.search = search;
+        }
+    }
+
+    /** Value of a {@link TrackingPolicy} count keeping the engine default. */
+    public static final int TRACKING_DEFAULT = -1;
 
     public enum FP_MODES {
         /**
@@ -271,9 +398,39 @@ public class FacialProcessing {
         }
     };
 
+    /**
+     * This enum is used to denote the pixel format of the image passed to
+     * {@link setFrame(ByteBuffer, int, int, int, Rect, FRAME_FORMAT, boolean, PREVIEW_ROTATION_ANGLE)}.
+     * Only the luma of the image is scanned: it is read straight from the Y plane
+     * of the YUV formats and computed natively from the RGB formats.
+     */
+    public enum FRAME_FORMAT {
+        Y8(0, 1),
+        NV21(1, 1),
+        NV12(2, 1),
+        YV12(3, 1),
+        RGBA_8888(4, 4),        // byte order of a Bitmap.Config.ARGB_8888 bitmap
+        BGR_888(5, 3);
+
+        private int value;
+        private int bytesPerPixel;
+
+        private FRAME_FORMAT(int value, int bytesPerPixel){
+            this.value = value;
+            this.bytesPerPixel = bytesPerPixel;
+        }
+
+        protected int getValue(){
+            return value;
+        }
+
+        protected int getBytesPerPixel(){
+            return bytesPerPixel;
+        }
+    };
 
-    private static int          facialprocHandle          = 0;
-    private static int          featuresSupported         = 0;            // this will accumulate supported features
+
+    private int                 facialprocHandle          = 0;            // native engine of this object, 0 once released
 
     private int previewFrameWidth = PREVIEW_FRAME_WIDTH;
     private int previewFrameHeight = PREVIEW_FRAME_HEIGHT;
@@ -284,9 +441,24 @@ public class FacialProcessing {
     private int presentMode  = FP_MODES.FP_MODE_VIDEO.getValue();
     private int rotationAngleDegrees = PREVIEW_ROTATION_ANGLE.ROT_0.getValue();
 
+    private ByteBuffer borrowedFrame = null;       // frame passed by reference, borrowed by the native side
+
+    private int frameStride = 0;                   // distance between luma rows, 0 when rows are packed
+    private int frameOffset = 0;                   // position of the luma plane in the frame buffer
+    private Rect cropRect = null;                  // region scanned for faces, null for the whole frame
+    private FRAME_FORMAT frameFormat = FRAME_FORMAT.NV21;
+    private ByteBuffer bitmapBuffer = null;        // pixels of the last bitmap, reused across setBitmap() calls
 
-    //private static int instanceCounter = 0;                        //keeps track of how many callers using the instance
-    private static FacialProcessing myInstance = null;             //only instance to be shared by all callers
+    private final Object asyncLock = new Object();             // serialises submitFrame() against starting and stopping
+    private volatile FaceDataListener faceDataListener = null;
+    private EnumSet<FP_DATA> listenerDataSet = null;
+    private volatile Thread deliveryThread = null;             // polls the native worker while a listener is set
+    private int submitSequence = 0;
+
+    private int batchPool = 0;                     // native handle pool of processBatch(), created on first use
+    private int batchPoolSize = 0;                 // 0 for one handle per CPU core
+    private int batchQueueDepth = 0;               // 0 for twice the pool size
+    private int batchDeadlineMs = 0;               // 0 for no limit
 
 
     public Object clone() throws CloneNotSupportedException {
@@ -314,12 +486,10 @@ public class FacialProcessing {
             System.loadLibrary("mmcamera_faceproc");
         } catch (Exception e) {
             android.util.Log.e(TAG, "Base library load failed. The device doesn't have the required library.");
-            facialprocHandle = 0;
             return false;
         }
         catch(UnsatisfiedLinkError e){
             android.util.Log.e(TAG, "Base library load failed. The device doesn't have the required library.");
-            facialprocHandle = 0;
             return false;
         }
      // making sure libfacialproc_jni.so is downloaded and included in the project
@@ -327,13 +497,11 @@ public class FacialProcessing {
             System.loadLibrary("facialproc_jni");
         } catch (Exception e) {
             android.util.Log.e(TAG, "Failed to load facialproc_jni. Make sure that libfacialproc_jni.so is included in your project.");
-            facialprocHandle = 0;
             return false;
         }
         catch(UnsatisfiedLinkError e){
             e.printStackTrace();
             android.util.Log.e(TAG, "Failed to load facialproc_jni. Make sure that libfacialproc_jni.so is included in your project.");
-            facialprocHandle = 0;
             return false;
         }
         return true;
@@ -379,7 +547,6 @@ public class FacialProcessing {
                 }
 
                 default: {
-                    facialprocHandle = 0;
                     android.util.Log.e(TAG, "featureId passed is not valid");
                     return false;
                 }
@@ -403,7 +570,7 @@ public class FacialProcessing {
      */
     private FacialProcessing() throws InstantiationException{
 
-        featuresSupported = featuresSupported | (isFeatureSupported(FEATURE_LIST.FEATURE_FACIAL_PROCESSING) ? FEATURE_LIST.FEATURE_FACIAL_PROCESSING.getValue() : 0);
+        int featuresSupported = isFeatureSupported(FEATURE_LIST.FEATURE_FACIAL_PROCESSING) ? FEATURE_LIST.FEATURE_FACIAL_PROCESSING.getValue() : 0;
 
         //if no feature is supported, then make the constructor throw an exception
         if(featuresSupported == 0){
@@ -429,7 +596,7 @@ public class FacialProcessing {
             presentMode  = FP_MODES.FP_MODE_VIDEO.getValue();
             rotationAngleDegrees = PREVIEW_ROTATION_ANGLE.ROT_0.getValue();
             if(facialprocHandle != 0){
-                config(facialprocHandle, previewFrameWidth, previewFrameHeight, CONFIG_DOWNSCALE_FACTOR);
+                configure();
             }
             else{
                 Log.e(TAG, "Handle creation failed");
@@ -442,33 +609,18 @@ public class FacialProcessing {
 
     /**
      * Creates a new facial processing object and loads the necessary libraries
-     * needed to scan and process images for facial data. However, if an instance of the object
-     * is already in use, then null is returned.
+     * needed to scan and process images for facial data. Every call creates an
+     * independent object; objects may be used concurrently from different threads.
      *
      * You must call {@link release()} when you are done using the facial processing object.
-     * @return instance of FacialProcessing else returns null if instantiation fails or an
-     * instance is already in use.
-     */
-    /*
-     * We have this since facialprocessing doesnt support multiple instantiation.
-     * A single object will be used for all calls.
-     * If getInstance() is called when the instance is already in use, second caller gets a null.
+     * @return instance of FacialProcessing else returns null if instantiation fails.
      */
     public static FacialProcessing getInstance(){
-        //if instance doesnt exist, instantiate and return.
-        if(myInstance == null){
-            try{
-                myInstance = new FacialProcessing();
-            }
-            catch(InstantiationException e){
-                e.printStackTrace();
-                return null;
-            }
-            return myInstance;
+        try{
+            return new FacialProcessing();
         }
-        //if instance exists, return null since it is already in use.
-        else {
-            Log.e(TAG, "Instance already in use");
+        catch(InstantiationException e){
+            e.printStackTrace();
             return null;
         }
     }
@@ -498,6 +650,560 @@ public class FacialProcessing {
     }
 
 
+    /**
+     * Sets the factor by which frames are downscaled before they are scanned.
+     * Larger factors scan faster at the cost of missing small faces; factors
+     * of 2 and 4 are cheapest. Facial data is always reported in the
+     * coordinates of the frame passed in, whatever the factor.
+     * <P>
+     * The factor applies from the next frame on and turns the adaptive mode of
+     * {@link setAdaptiveDownscale(int, int)} off. It cannot be changed while a
+     * {@link FaceDataListener} is set.
+     *
+     * @param factor downscale factor between 1.0 (no downscaling) and 8.0
+     * @return true if the factor is applied, else false.
+     */
+    public boolean setDownscaleFactor(float factor){
+        if (facialprocHandle == 0 || faceDataListener != null){
+            return false;
+        }
+        if(factor < 1.0f || factor > 8.0f){
+            Log.e(TAG, "setDownscaleFactor(): factor out of range "+factor);
+            return false;
+        }
+        downscaleFactorQ8 = Math.round(factor * DOWNSCALE_FACTOR_ONE);
+        return setDownscale(facialprocHandle, downscaleFactorQ8) == 0;
+    }
+
+    /**
+     * Lets the framework pick the downscale factor frame by frame. The largest factor
+     * at which faces of minFaceSize pixels, or smaller faces seen in the last frames,
+     * are still found is used; if scanning a frame takes longer than
+     * detectionBudgetMs on average, frames are downscaled further. The factor only
+     * changes every few frames, and faces are searched for again after a change.
+     * <P>
+     * It cannot be changed while a {@link FaceDataListener} is set.
+     *
+     * @param minFaceSize The size in pixels of the smallest faces of interest, in the
+     * coordinates of the frames passed in. 0 turns the adaptive mode off and restores
+     * the factor of {@link setDownscaleFactor(float)}.
+     * @param detectionBudgetMs The time a frame scan should take, 0 for no limit.
+     * @return true if the mode is applied, else false.
+     */
+    public boolean setAdaptiveDownscale(int minFaceSize, int detectionBudgetMs){
+        if (facialprocHandle == 0 || faceDataListener != null){
+            return false;
+        }
+        if(minFaceSize < 0 || detectionBudgetMs < 0){
+            Log.e(TAG, "setAdaptiveDownscale(): negative argument");
+            return false;
+        }
+        if(minFaceSize == 0){
+            return setDownscale(facialprocHandle, downscaleFactorQ8) == 0;
+        }
+        return setAdaptiveDownscale(facialprocHandle, minFaceSize, detectionBudgetMs * 1000, 0) == 0;
+    }
+
+    /**
+     * Returns the factor the last frame was downscaled by before it was scanned.
+     *
+     * @return the downscale factor, 1.0 when frames are scanned at full resolution.
+     */
+    public float getDownscaleFactor(){
+        if (facialprocHandle == 0){
+            return 1.0f;
+        }
+        return (float)getDownscale(facialprocHandle) / DOWNSCALE_FACTOR_ONE;
+    }
+
+    /**
+     * Skips the face scan of frames showing the same scene as the last scanned one;
+     * the faces found there are reported again, while smile, gaze, blink and the
+     * other per-face data are still read from each new frame. A frame counts as
+     * unchanged when the mean brightness of none of the 16x16 blocks it is divided
+     * into moved by more than threshold levels.
+     * <P>
+     * It cannot be changed while a {@link FaceDataListener} is set.
+     *
+     * @param threshold The largest change of a block brightness, out of 255, for a
+     * frame to count as unchanged. 0 turns skipping off; 2 to 4 absorbs sensor noise.
+     * @param maxSkip The number of frames in a row that may be skipped before a scan
+     * is forced, 0 for no limit.
+     * @return true if the setting is applied, else false.
+     */
+    public boolean setStaticSceneSkip(int threshold, int maxSkip){
+        if (facialprocHandle == 0 || faceDataListener != null){
+            return false;
+        }
+        if(threshold < 0 || maxSkip < 0){
+            Log.e(TAG, "setStaticSceneSkip(): negative argument");
+            return false;
+        }
+        return setStaticSkip(facialprocHandle, threshold, maxSkip) == 0;
+    }
+
+    /**
+     * Restricts the search for new faces to the parts of the frame that changed
+     * since the last scan and to the surroundings of the faces found there, which
+     * saves most of the scan time on large frames with little motion. A frame in
+     * which nothing moved and no face is present is not scanned at all. The whole
+     * frame is still scanned at regular intervals so that faces entering without
+     * motion, such as under a light change, are not missed.
+     * <P>
+     * It cannot be changed while a {@link FaceDataListener} is set.
+     *
+     * @param threshold The change of a block brightness, out of 255, marking the
+     * block as moving. 0 turns the restriction off.
+     * @param fullScanInterval The number of frames between two scans of the whole
+     * frame, 0 for the default of 30.
+     * @return true if the setting is applied, else false.
+     */
+    public boolean setMotionGuidedScan(int threshold, int fullScanInterval){
+        if (facialprocHandle == 0 || faceDataListener != null){
+            return false;
+        }
+        if(threshold < 0 || fullScanInterval < 0){
+            Log.e(TAG, "setMotionGuidedScan(): negative argument");
+            return false;
+        }
+        return setMotionRoi(facialprocHandle, threshold, fullScanInterval) == 0;
+    }
+
+    /**
+     * Searches only for faces held within 45 degrees of upright on the display,
+     * following the rotation and mirroring passed with each frame. By default faces
+     * are searched for at any in-plane rotation; restricting the search this way
+     * takes a fraction of the time and avoids upside down false positives.
+     * <P>
+     * It cannot be changed while a {@link FaceDataListener} is set.
+     *
+     * @param enable true to restrict the search to upright faces, false to search
+     * for faces at any rotation.
+     * @return true if the setting is applied, else false.
+     */
+    public boolean setOrientationGuidedDetection(boolean enable){
+        if (facialprocHandle == 0 || faceDataListener != null){
+            return false;
+        }
+        int frontal = enable ? ROT_ANGLE_U45 : ROT_ANGLE_ALL;
+        if(setDetectableRotation(facialprocHandle, frontal, ROT_ANGLE_U45, ROT_ANGLE_NONE) != 0){
+            return false;
+        }
+        return setDetectableRotationAuto(facialprocHandle, enable) == 0;
+    }
+
+    /**
+     * Returns the number of frames scanned for faces since the last configuration.
+     *
+     * @return the number of frames scanned.
+     */
+    public int getScannedFrameCount(){
+        if (facialprocHandle == 0){
+            return 0;
+        }
+        return getSkipStats(facialprocHandle)[0];
+    }
+
+    /**
+     * Returns the number of frames that reused the faces of an earlier frame since
+     * the last configuration, see {@link setStaticSceneSkip(int, int)}.
+     *
+     * @return the number of frames skipped.
+     */
+    public int getSkippedFrameCount(){
+        if (facialprocHandle == 0){
+            return 0;
+        }
+        return getSkipStats(facialprocHandle)[1];
+    }
+
+    /**
+     * Tells whether the faces of the last frame were taken over from an earlier
+     * frame rather than scanned for.
+     *
+     * @return true if the last frame was skipped, else false.
+     */
+    public boolean isLastFrameSkipped(){
+        if (facialprocHandle == 0){
+            return false;
+        }
+        return getSkipStats(facialprocHandle)[2] != 0;
+    }
+
+    /**
+     * Returns the face detection parameters of this facial processor.
+     *
+     * @return the parameters, or null if the facial processor is released.
+     */
+    public DetectionParams getDetectionParams(){
+        if (facialprocHandle == 0){
+            return null;
+        }
+        int[] values = getParams(facialprocHandle);
+        if (values == null){
+            return null;
+        }
+        DetectionParams params = new DetectionParams();
+        params.searchStep = values[0];
+        params.trackingStep = values[1];
+        params.minFaceSize = values[2];
+        params.maxFaceSize = values[3];
+        params.maxFaces = values[4];
+        params.threshold = values[5];
+        params.trackingThreshold = values[6];
+        params.highAccuracy = values[7] != 0;
+        params.recognitionThreshold = values[8];
+        return params;
+    }
+
+    /**
+     * Applies face detection parameters to this facial processor, from the next frame
+     * on. Start from the parameters returned by {@link getDetectionParams()} and change
+     * the ones of interest. Faces being tracked are kept unless maxFaces changes.
+     * <P>
+     * It cannot be changed while a {@link FaceDataListener} is set.
+     *
+     * @param params The parameters.
+     * @return true if the parameters are applied, false if one is out of range.
+     */
+    public boolean setDetectionParams(DetectionParams params){
+        if (facialprocHandle == 0 || faceDataListener != null || params == null){
+            return false;
+        }
+        int[] values = {
+            params.searchStep,
+            params.trackingStep,
+            params.minFaceSize,
+            params.maxFaceSize,
+            params.maxFaces,
+            params.threshold,
+            params.trackingThreshold,
+            params.highAccuracy ? 1 : 0,
+            params.recognitionThreshold,
+        };
+        if(setParams(facialprocHandle, values) != 0){
+            return false;
+        }
+        // The batch pool takes the parameters when it is created
+        destroyBatchPool();
+        return true;
+    }
+
+    /**
+     * Returns the face tracking policy of this facial processor.
+     *
+     * @return the policy, or null if the facial processor is released.
+     */
+    public TrackingPolicy getTrackingPolicy(){
+        if (facialprocHandle == 0){
+            return null;
+        }
+        int[] values = getTracking(facialprocHandle);
+        if (values == null){
+            return null;
+        }
+        TrackingPolicy policy = new TrackingPolicy(TRACKING_SEARCH.values()[values[0]]);
+        policy.refreshCount = values[1];
+        policy.faceRetryCount = values[2];
+        policy.headRetryCount = values[3];
+        policy.holdCount = values[4];
+        policy.moveRate = values[5];
+        return policy;
+    }
+
+    /**
+     * Applies a face tracking policy to this facial processor. It is used in
+     * {@link FP_MODES#FP_MODE_VIDEO} only, and faces being tracked are dropped when
+     * the search changes.
+     * <P>
+     * It cannot be changed while a {@link FaceDataListener} is set.
+     *
+     * @param policy The policy.
+     * @return true if the policy is applied, false if a count is out of range.
+     */
+    public boolean setTrackingPolicy(TrackingPolicy policy){
+        if (facialprocHandle == 0 || faceDataListener != null || policy == null
+                || policy.search == null){
+            return false;
+        }
+        int[] values = {
+            policy.search.getValue(),
+            policy.refreshCount,
+            policy.faceRetryCount,
+            policy.headRetryCount,
+            policy.holdCount,
+            policy.moveRate,
+        };
+        return setTracking(facialprocHandle, values) == 0;
+    }
+
+    /**
+     * Returns the largest amount of memory the framework held for frame buffers
+     * since it was created. The buffers are reused across configurations and only
+     * grow when a larger frame is configured.
+     *
+     * @return the peak buffer memory in bytes.
+     */
+    public int getPeakMemoryUsage(){
+        if (facialprocHandle == 0){
+            return 0;
+        }
+        return getMemStats(facialprocHandle)[2];
+    }
+
+    /**
+     * Returns the memory the face detector needs for the current configuration, as
+     * reported by the detection engine: its persistent memory plus its largest
+     * working memory.
+     *
+     * @return the detector memory in bytes, 0 if it is not known.
+     */
+    public int getDetectorMemoryRequirement(){
+        if (facialprocHandle == 0){
+            return 0;
+        }
+        int[] stats = getMemStats(facialprocHandle);
+        return stats[3] + stats[5];
+    }
+
+    /**
+     * Bounds the time face detection may take on a frame. The search for new faces
+     * stops after searchMs and the tracking of known faces after trackingMs; the faces
+     * found by then are reported and the next frame is searched again in full. A
+     * slow frame therefore yields fewer faces instead of delaying the frames after it.
+     * <P>
+     * It cannot be changed while a {@link FaceDataListener} is set.
+     *
+     * @param searchMs Time in milliseconds to search for new faces, 0 for no limit.
+     * @param trackingMs Time in milliseconds to track known faces, 0 for no limit.
+     * Tracking only takes place on preview frames.
+     * @return true if the deadline is applied, else false.
+     */
+    public boolean setFrameDeadline(int searchMs, int trackingMs){
+        if (facialprocHandle == 0 || faceDataListener != null){
+            return false;
+        }
+        if(searchMs < 0 || trackingMs < 0){
+            Log.e(TAG, "setFrameDeadline(): negative argument");
+            return false;
+        }
+        return setDeadline(facialprocHandle, searchMs, trackingMs) == 0;
+    }
+
+    /**
+     * Returns the number of frames on which face detection was cut short by the
+     * deadline of {@link setFrameDeadline(int, int)} since the last configuration.
+     *
+     * @return the number of frames cut short.
+     */
+    public int getTimedOutFrameCount(){
+        if (facialprocHandle == 0){
+            return 0;
+        }
+        return getDeadlineStats(facialprocHandle)[0];
+    }
+
+    /**
+     * Returns the number of frames on which face detection took longer than the
+     * deadline of {@link setFrameDeadline(int, int)}, in wall clock time, since the
+     * last configuration. Frames can overrun when the detection thread is preempted.
+     *
+     * @return the number of late frames.
+     */
+    public int getLateFrameCount(){
+        if (facialprocHandle == 0){
+            return 0;
+        }
+        return getDeadlineStats(facialprocHandle)[1];
+    }
+
+    /**
+     * Returns the time face detection took on the last frame it ran on.
+     *
+     * @return the time in microseconds.
+     */
+    public int getLastDetectionTime(){
+        if (facialprocHandle == 0){
+            return 0;
+        }
+        return getDeadlineStats(facialprocHandle)[2];
+    }
+
+    /**
+     * Returns the longest time face detection took on a frame since the last
+     * configuration.
+     *
+     * @return the time in microseconds.
+     */
+    public int getMaxDetectionTime(){
+        if (facialprocHandle == 0){
+            return 0;
+        }
+        return getDeadlineStats(facialprocHandle)[3];
+    }
+
+    /**
+     * Splits large still images into overlapping tiles searched in parallel. Images of
+     * at least minPixels processed pixels are cut into tiles sized after the smallest
+     * face searched for, each searched on its own engine, and faces larger than the
+     * overlap of the tiles are searched for on the image downscaled. Faces found twice
+     * at the seams are reported once. The deadline of
+     * {@link setFrameDeadline(int, int)} applies to each tile.
+     * <P>
+     * It only applies in {@link FP_MODES#FP_MODE_STILL} and cannot be changed while a
+     * {@link FaceDataListener} is set.
+     *
+     * @param minPixels Smallest image, in pixels after downscaling, to split into
+     * tiles; 0 turns tiling off.
+     * @param numThreads Number of threads searching the tiles, up to 64; 0 for one per CPU.
+     * @return true if tiling is set up, else false.
+     */
+    public boolean setTiledDetection(int minPixels, int numThreads){
+        if (facialprocHandle == 0 || faceDataListener != null){
+            return false;
+        }
+        if(minPixels < 0 || numThreads < 0){
+            Log.e(TAG, "setTiledDetection(): negative argument");
+            return false;
+        }
+        if(numThreads > MAX_THREADS){
+            Log.e(TAG, "setTiledDetection(): numThreads out of range "+numThreads);
+            return false;
+        }
+        return setTiling(facialprocHandle, numThreads, minPixels) == 0;
+    }
+
+    /**
+     * Turns coarse-to-fine detection on or off. Faces are first searched for on the
+     * image downscaled by coarseFactor, then searched for again at full resolution
+     * in a square around each face found, marginPercent of the face size wider on
+     * every side. Detection costs little more than at the coarse factor, while the
+     * faces, facial parts and recognition keep the precision of the full resolution,
+     * unlike with {@link setDownscaleFactor(float)}. The coarse factor is lowered as
+     * needed so that faces of the minimum face size are still found.
+     * <P>
+     * It only applies in {@link FP_MODES#FP_MODE_STILL} and cannot be changed while a
+     * {@link FaceDataListener} is set.
+     *
+     * @param coarseFactor downscale factor of the first pass, above 1.0 and up to
+     * 8.0; 0 turns coarse-to-fine detection off.
+     * @param marginPercent margin around the faces of the first pass, between 0 and
+     * 200.
+     * @return true if coarse-to-fine detection is set, else false.
+     */
+    public boolean setCoarseToFineDetection(float coarseFactor, int marginPercent){
+        if (facialprocHandle == 0 || faceDataListener != null){
+            return false;
+        }
+        if((coarseFactor != 0 && (coarseFactor <= 1.0f || coarseFactor > 8.0f))
+                || marginPercent < 0 || marginPercent > 200){
+            Log.e(TAG, "setCoarseToFineDetection(): argument out of range");
+            return false;
+        }
+        return setRefine(facialprocHandle, Math.round(coarseFactor * DOWNSCALE_FACTOR_ONE),
+                marginPercent) == 0;
+    }
+
+    /**
+     * Sets how many threads analyse the faces of a frame. When facial parts, contour,
+     * smile, gaze or blink data is gathered for several faces, the faces are spread
+     * over numThreads threads, the calling one among them, each with its own engines.
+     * The data of every face is the same as with a single thread.
+     * <P>
+     * It cannot be changed while a {@link FaceDataListener} is set.
+     *
+     * @param numThreads number of threads, up to 64; 0 for one per CPU, 1 to analyse
+     * the faces on the calling thread alone.
+     * @return true if the threads are set up, else false.
+     */
+    public boolean setFaceAnalysisThreads(int numThreads){
+        if (facialprocHandle == 0 || faceDataListener != null){
+            return false;
+        }
+        if(numThreads < 0 || numThreads > 64){
+            Log.e(TAG, "setFaceAnalysisThreads(): numThreads out of range "+numThreads);
+            return false;
+        }
+        return setFaceThreads(facialprocHandle, numThreads) == 0;
+    }
+
+    /**
+     * Sets how often the attributes of a tracked face are estimated in video mode.
+     * Between estimates, the smile, gaze, blink and direction of a face are those last
+     * estimated for the same face ID. A face moving or resizing by more than
+     * movePercent of its size, or turning to another pose, is estimated again at once.
+     * Each interval counts frames; 1 estimates on every frame, as without this call.
+     * <P>
+     * It cannot be changed while a {@link FaceDataListener} is set.
+     *
+     * @param smileFrames frames between smile estimates.
+     * @param gazeBlinkFrames frames between gaze and blink estimates.
+     * @param directionFrames frames between face direction estimates.
+     * @param movePercent movement, in percent of the face size, forcing all of them;
+     * 0 for none.
+     * @return true if the refresh rates are set, else false.
+     */
+    public boolean setAttributeRefresh(int smileFrames, int gazeBlinkFrames,
+            int directionFrames, int movePercent){
+        if (facialprocHandle == 0 || faceDataListener != null){
+            return false;
+        }
+        if(smileFrames < 1 || gazeBlinkFrames < 1 || directionFrames < 1 || movePercent < 0){
+            Log.e(TAG, "setAttributeRefresh(): argument out of range");
+            return false;
+        }
+        return setAttrRates(facialprocHandle, smileFrames, gazeBlinkFrames,
+                directionFrames, movePercent) == 0;
+    }
+
+    /**
+     * Sets how long the recognition of a tracked face is reused in video mode. The
+     * person found for a face ID is returned for intervalFrames frames without
+     * matching the face against the album again. The face is matched again sooner
+     * when it turns to another pose, after the tracker lost it, and when users are
+     * added, updated or removed.
+     * <P>
+     * It cannot be changed while a {@link FaceDataListener} is set.
+     *
+     * @param intervalFrames frames between two matches of the same face; 1 to match
+     * on every frame, as without this call.
+     * @return true if the interval is set, else false.
+     */
+    public boolean setRecognitionCache(int intervalFrames){
+        if (facialprocHandle == 0 || faceDataListener != null){
+            return false;
+        }
+        if(intervalFrames < 1){
+            Log.e(TAG, "setRecognitionCache(): intervalFrames out of range "+intervalFrames);
+            return false;
+        }
+        return setRecogCache(facialprocHandle, intervalFrames) == 0;
+    }
+
+    /**
+     * Sets how many faces of a frame are fully analysed. The faces are ranked by size,
+     * closeness to the centre of the frame and, in video mode, how long they have been
+     * tracked. Only the best maxFaces of them get facial parts, smile, gaze, blink,
+     * direction and recognition data; the others only get their rectangle, the rest
+     * of their data being 0 and their person ID FP_NOT_PROCESSED. addPerson() fails
+     * with FP_INTERNAL_ERROR for them, since they are not matched against the album.
+     * <P>
+     * It cannot be changed while a {@link FaceDataListener} is set.
+     *
+     * @param maxFaces number of faces analysed per frame, up to 64; 0 for all of them.
+     * @return true if the budget is set, else false.
+     */
+    public boolean setFaceAnalysisBudget(int maxFaces){
+        if (facialprocHandle == 0 || faceDataListener != null){
+            return false;
+        }
+        if(maxFaces < 0 || maxFaces > 64){
+            Log.e(TAG, "setFaceAnalysisBudget(): maxFaces out of range "+maxFaces);
+            return false;
+        }
+        return setFaceBudget(facialprocHandle, maxFaces) == 0;
+    }
+
     /**
      * Sets the image to be scanned and processed.
      *
@@ -521,7 +1227,8 @@ public class FacialProcessing {
      * Set to true if the image is mirrored and false otherwise.
      * @param PREVIEW_ROTATION_ANGLE The angle to which the facial data will be rotated
      * in a clockwise direction. Pass in ROT_0 if no rotation is required.
-     * @return returns false if image data is not processed, true otherwise.
+     * @return returns false if image data is not processed or a {@link FaceDataListener}
+     * is set, true otherwise.
      *
      */
     /*
@@ -530,7 +1237,7 @@ public class FacialProcessing {
      * Calculations of values is NOT done here.
      */
     public boolean setFrame(byte[] yuvData, int frameWidth, int frameHeight, boolean isMirrored, PREVIEW_ROTATION_ANGLE rotationAngle){
-        if (facialprocHandle == 0 || myInstance == null){
+        if (facialprocHandle == 0 || faceDataListener != null){
             return false;
         }
         int length = frameWidth * frameHeight * 3 / 2;
@@ -539,6 +1246,132 @@ public class FacialProcessing {
             android.util.Log.e(TAG, "Length of the frame does not match the dimensions passed");
             return false;
         }
+        if(!prepareFrame(frameWidth, frameHeight, 0, 0, null, FRAME_FORMAT.NV21, isMirrored, rotationAngle, userPreferredMode)){
+            return false;
+        }
+
+        borrowedFrame = null;
+        setFrame(facialprocHandle, yuvData);
+        return true;
+    }
+
+    /**
+     * Sets the image to be scanned and processed without copying it.
+     *
+     * This behaves like {@link setFrame(byte[], int, int, boolean, PREVIEW_ROTATION_ANGLE)}
+     * except that the luma plane of the passed direct buffer is scanned in place, which
+     * avoids copying every preview frame. Only the first frameWidth * frameHeight bytes
+     * (the Y plane) are read.
+     * <P>
+     * The buffer is borrowed by the framework: it must not be modified or recycled until
+     * the next call to setFrame() or setBitmap(), or until release(), since subsequent
+     * getFaceData() and recognition calls read from it.
+     *
+     * @param yuvData A direct ByteBuffer holding the image, Y plane first.
+     * @param frameWidth The width of the image
+     * @param frameHeight The height of the image
+     * @param isMirrored Set to true if the image is mirrored and false otherwise.
+     * @param PREVIEW_ROTATION_ANGLE The angle to which the facial data will be rotated
+     * in a clockwise direction. Pass in ROT_0 if no rotation is required.
+     * @return returns false if image data is not processed, true otherwise.
+     */
+    public boolean setFrame(ByteBuffer yuvData, int frameWidth, int frameHeight, boolean isMirrored, PREVIEW_ROTATION_ANGLE rotationAngle){
+        return setFrame(yuvData, frameWidth, frameHeight, frameWidth, null, FRAME_FORMAT.NV21, isMirrored, rotationAngle);
+    }
+
+    /**
+     * Sets a padded or cropped image to be scanned and processed without copying it.
+     *
+     * This behaves like {@link setFrame(ByteBuffer, int, int, boolean, PREVIEW_ROTATION_ANGLE)}
+     * for camera buffers whose rows are padded, such as the Y plane of an
+     * android.media.Image. The luma plane starts at the current position of the buffer.
+     * Only the crop rectangle is scanned, but facial data is still reported in the
+     * coordinates of the whole frame.
+     * <P>
+     * The plane is read in place when the buffer holds rowStride * frameHeight bytes.
+     * When its last row stops at the width, as in android.media.Image, the crop is
+     * copied instead and the buffer is not borrowed.
+     *
+     * @param yuvData A direct ByteBuffer holding the image, Y plane first.
+     * @param frameWidth The width of the image
+     * @param frameHeight The height of the image
+     * @param rowStride The distance in bytes between two rows of the Y plane.
+     * @param crop The region of the image to scan, or null for the whole image.
+     * @param isMirrored Set to true if the image is mirrored and false otherwise.
+     * @param PREVIEW_ROTATION_ANGLE The angle to which the facial data will be rotated
+     * in a clockwise direction. Pass in ROT_0 if no rotation is required.
+     * @return returns false if image data is not processed, true otherwise.
+     */
+    public boolean setFrame(ByteBuffer yuvData, int frameWidth, int frameHeight, int rowStride, Rect crop, boolean isMirrored, PREVIEW_ROTATION_ANGLE rotationAngle){
+        return setFrame(yuvData, frameWidth, frameHeight, rowStride, crop, FRAME_FORMAT.NV21, isMirrored, rotationAngle);
+    }
+
+    /**
+     * Sets an image of any supported pixel format to be scanned and processed.
+     *
+     * This behaves like {@link setFrame(ByteBuffer, int, int, int, Rect, boolean, PREVIEW_ROTATION_ANGLE)}
+     * for images in one of the formats of {@link FRAME_FORMAT}. The luma of RGB images is
+     * computed natively while the image is ingested, so the buffer is not borrowed in that case.
+     *
+     * @param data A direct ByteBuffer holding the image, first plane first.
+     * @param frameWidth The width of the image
+     * @param frameHeight The height of the image
+     * @param rowStride The distance in bytes between two rows of the first plane.
+     * @param crop The region of the image to scan, or null for the whole image.
+     * @param format The pixel format of the image.
+     * @param isMirrored Set to true if the image is mirrored and false otherwise.
+     * @param PREVIEW_ROTATION_ANGLE The angle to which the facial data will be rotated
+     * in a clockwise direction. Pass in ROT_0 if no rotation is required.
+     * @return returns false if image data is not processed, true otherwise.
+     */
+    public boolean setFrame(ByteBuffer data, int frameWidth, int frameHeight, int rowStride, Rect crop, FRAME_FORMAT format, boolean isMirrored, PREVIEW_ROTATION_ANGLE rotationAngle){
+        if (facialprocHandle == 0 || faceDataListener != null){
+            return false;
+        }
+        return setFrameBuffer(data, frameWidth, frameHeight, rowStride, crop, format, isMirrored, rotationAngle,
+                userPreferredMode);
+    }
+
+    /*
+     * Passes a frame held in a direct buffer, scanned in the given mode.
+     */
+    private boolean setFrameBuffer(ByteBuffer data, int frameWidth, int frameHeight, int rowStride, Rect crop, FRAME_FORMAT format, boolean isMirrored, PREVIEW_ROTATION_ANGLE rotationAngle, int mode){
+        if(data == null || !data.isDirect() || format == null){
+            android.util.Log.e(TAG, "setFrame(): A direct ByteBuffer and its format are required");
+            return false;
+        }
+        int rowSize = frameWidth * format.getBytesPerPixel();
+        if(frameWidth <= 0 || frameHeight <= 0 || rowStride < rowSize
+                || data.capacity() - data.position() < rowStride * (frameHeight - 1) + rowSize){
+            android.util.Log.e(TAG, "Length of the frame does not match the dimensions passed");
+            return false;
+        }
+        if(crop != null && (crop.isEmpty() || !new Rect(0, 0, frameWidth, frameHeight).contains(crop))){
+            android.util.Log.e(TAG, "setFrame(): Crop rectangle outside of the frame");
+            return false;
+        }
+        int stride = (rowStride == rowSize) ? 0 : rowStride;
+        if(!prepareFrame(frameWidth, frameHeight, stride, data.position(), crop, format, isMirrored, rotationAngle, mode)){
+            return false;
+        }
+
+        // The engines read whole strides in place: a last row cut at the width, as in
+        // android.media.Image planes, is copied out instead of borrowed
+        boolean borrow = data.capacity() - data.position() >= (long) rowStride * frameHeight;
+
+        // Keep the buffer reachable for as long as the native side borrows it
+        borrowedFrame = borrow ? data : null;
+        return setFrameDirect(facialprocHandle, data, borrow) == 0;
+    }
+
+    /*
+     * Common bookkeeping of the setFrame() variants: stores the orientation of the
+     * frame, switches to the mode the frame is scanned in and reconfigures on a
+     * resolution or layout change. The native side keeps the detectors of both modes
+     * and recent resolutions set up, so switching between preview frames and bitmaps
+     * does not set one up again.
+     */
+    private boolean prepareFrame(int frameWidth, int frameHeight, int stride, int offset, Rect crop, FRAME_FORMAT format, boolean isMirrored, PREVIEW_ROTATION_ANGLE rotationAngle, int mode){
         this.isMirrored = isMirrored;
         if(rotationAngle!=null)
         {
@@ -549,21 +1382,192 @@ public class FacialProcessing {
                 Log.e(TAG, "setFrame(): Rotation Angle equals NULL");
                 return false;
         }
+        setOrientation(facialprocHandle, rotationAngleDegrees, isMirrored);
 
 
-        if(presentMode != this.userPreferredMode)
+        if(presentMode != mode)
         {
-                presentMode = this.userPreferredMode;
+                presentMode = mode;
                 setMode(facialprocHandle, presentMode);
         }
 
-        if( (frameHeight != this.previewFrameHeight) || frameWidth != this.previewFrameWidth ) {
+        boolean sameCrop = (crop == null) ? (cropRect == null) : crop.equals(cropRect);
+        if( (frameHeight != this.previewFrameHeight) || frameWidth != this.previewFrameWidth
+                || stride != frameStride || offset != frameOffset || !sameCrop || format != frameFormat ) {
             this.previewFrameHeight = frameHeight;
             this.previewFrameWidth = frameWidth;
-            config(facialprocHandle, previewFrameWidth, previewFrameHeight, CONFIG_DOWNSCALE_FACTOR);
+            this.frameStride = stride;
+            this.frameOffset = offset;
+            this.cropRect = (crop == null) ? null : new Rect(crop);
+            this.frameFormat = format;
+            configure();
         }
+        return true;
+    }
 
-        setFrame(facialprocHandle, yuvData);
+    /*
+     * Passes the frame dimension, layout, format and downscale factor to the native side.
+     */
+    private void configure(){
+        // The native worker restarts on reconfiguration, which must not race a poll
+        boolean delivering = stopDelivery();
+        if(cropRect == null){
+            config(facialprocHandle, previewFrameWidth, previewFrameHeight, downscaleFactorQ8,
+                    frameStride, frameOffset, 0, 0, 0, 0, frameFormat.getValue());
+        }
+        else{
+            config(facialprocHandle, previewFrameWidth, previewFrameHeight, downscaleFactorQ8,
+                    frameStride, frameOffset, cropRect.left, cropRect.top, cropRect.width(), cropRect.height(),
+                    frameFormat.getValue());
+        }
+        if(delivering){
+            startDelivery();
+        }
+    }
+
+    /**
+     * Sets the listener receiving the facial data of the frames passed to
+     * {@link submitFrame(byte[], int, int, boolean, PREVIEW_ROTATION_ANGLE, long)}.
+     * Frames are scanned on a framework thread, so submitting a frame never waits for
+     * the scan; a frame submitted while the previous one is still waiting replaces it.
+     * <P>
+     * While a listener is set, setFrame(), setBitmap(), getFaceData() and the
+     * recognition methods do not operate. FACE_IDENTIFICATION is not supported here.
+     *
+     * @param listener The listener, or null to stop asynchronous processing.
+     * @param dataSet The facial data points to compute for each frame, see
+     * {@link getFaceData(EnumSet)}. Ignored when listener is null.
+     * @return true if the listener is set, else false.
+     */
+    public boolean setFaceDataListener(FaceDataListener listener, EnumSet<FP_DATA> dataSet){
+        if (facialprocHandle == 0){
+            return false;
+        }
+        synchronized(asyncLock){
+            if(faceDataListener != null){
+                stopDelivery();
+                asyncStop(facialprocHandle);
+                faceDataListener = null;
+            }
+            if(listener == null){
+                return true;
+            }
+            if(dataSet == null || dataSet.contains(FP_DATA.FACE_IDENTIFICATION)){
+                Log.e(TAG, "setFaceDataListener(): Invalid data set");
+                return false;
+            }
+
+            if(presentMode != this.userPreferredMode)
+            {
+                presentMode = this.userPreferredMode;
+                setMode(facialprocHandle, presentMode);
+            }
+            if(asyncStart(facialprocHandle, getInfoMask(dataSet)) != 0){
+                Log.e(TAG, "setFaceDataListener(): Native worker failed to start");
+                return false;
+            }
+            listenerDataSet = EnumSet.copyOf(dataSet);
+            faceDataListener = listener;
+            submitSequence = 0;
+            startDelivery();
+        }
+        return true;
+    }
+
+    /*
+     * Native information to gather for the facial data points of dataSet.
+     */
+    private static int getInfoMask(EnumSet<FP_DATA> dataSet){
+        int infoMask = INFO_RECTS;
+        infoMask |= dataSet.contains(FP_DATA.FACE_COORDINATES) ? INFO_PARTS : 0;
+        infoMask |= dataSet.contains(FP_DATA.FACE_ORIENTATION) ? INFO_DIRECTIONS : 0;
+        infoMask |= dataSet.contains(FP_DATA.FACE_SMILE) ? INFO_SMILES : 0;
+        infoMask |= dataSet.contains(FP_DATA.FACE_GAZE) ? INFO_GAZES : 0;
+        infoMask |= dataSet.contains(FP_DATA.FACE_BLINK) ? INFO_EYE_OPENS : 0;
+        return infoMask;
+    }
+
+    /**
+     * Submits a camera preview frame for asynchronous processing. The frame is copied
+     * before this method returns, so the array can be reused right away. Its facial data
+     * is passed to the listener set with {@link setFaceDataListener(FaceDataListener, EnumSet)}.
+     *
+     * @param yuvData The image to be processed in a byte array.
+     * @param frameWidth The width of the image
+     * @param frameHeight The height of the image
+     * @param isMirrored Set to true if the image is mirrored and false otherwise.
+     * @param PREVIEW_ROTATION_ANGLE The angle to which the facial data will be rotated
+     * in a clockwise direction. Pass in ROT_0 if no rotation is required.
+     * @param timestamp Any value identifying the frame, such as its capture time; it is
+     * passed back to the listener.
+     * @return returns false if no listener is set or the image is not accepted, true otherwise.
+     */
+    public boolean submitFrame(byte[] yuvData, int frameWidth, int frameHeight, boolean isMirrored, PREVIEW_ROTATION_ANGLE rotationAngle, long timestamp){
+        if (facialprocHandle == 0 || yuvData == null){
+            return false;
+        }
+        if(yuvData.length != frameWidth * frameHeight * 3 / 2 || yuvData.length == 0){
+            android.util.Log.e(TAG, "Length of the frame does not match the dimensions passed");
+            return false;
+        }
+        synchronized(asyncLock){
+            if(faceDataListener == null){
+                return false;
+            }
+            if(!prepareFrame(frameWidth, frameHeight, 0, 0, null, FRAME_FORMAT.NV21, isMirrored, rotationAngle, userPreferredMode)){
+                return false;
+            }
+            return submitFrame(facialprocHandle, yuvData, submitSequence++, timestamp,
+                    this.isMirrored, rotationAngleDegrees, scaleX, scaleY) == 0;
+        }
+    }
+
+    /*
+     * Starts the thread passing the results of the native worker to the listener.
+     */
+    private void startDelivery(){
+        Thread thread = new Thread(new Runnable(){
+            public void run(){
+                while(deliveryThread == Thread.currentThread()){
+                    int[] result = pollResults(facialprocHandle, ASYNC_POLL_TIMEOUT_MS);
+                    FaceDataListener listener = faceDataListener;
+                    if(result == null || listener == null){
+                        continue;
+                    }
+                    long timestamp = ((long)result[1] << 32) | (result[2] & 0xFFFFFFFFL);
+                    FaceData[] faces = parseFaceData(result, ASYNC_HEADER_SIZE, result[4], listenerDataSet, false);
+                    listener.onFaceData(faces, result[0], timestamp, result[3]);
+                }
+            }
+        }, "FacialProcessing delivery");
+        deliveryThread = thread;
+        thread.start();
+    }
+
+    /*
+     * Stops the delivery thread and waits for it to leave the native side.
+     * Returns true if it was running.
+     */
+    private boolean stopDelivery(){
+        Thread thread = deliveryThread;
+        if(thread == null){
+            return false;
+        }
+        deliveryThread = null;
+        if(thread != Thread.currentThread()){
+            boolean interrupted = false;
+            while(thread.isAlive()){
+                try{
+                    thread.join();
+                }
+                catch(InterruptedException e){
+                    interrupted = true;
+                }
+            }
+            if(interrupted){
+                Thread.currentThread().interrupt();
+            }
+        }
         return true;
     }
 
@@ -585,100 +1589,137 @@ public class FacialProcessing {
      * Calculations of values is NOT done here.
      */
     public boolean setBitmap(Bitmap bitmap){
-        if (facialprocHandle == 0 || myInstance == null || bitmap == null){
+        if (facialprocHandle == 0 || bitmap == null || faceDataListener != null){
             return false;
         }
 
-        //if(this.presentMode == FP_MODES.FP_MODE_VIDEO.getValue())
-        //{
-        //      presentMode = FP_MODES.FP_MODE_STILL.getValue();
-                setMode(facialprocHandle, FP_MODES.FP_MODE_STILL.getValue());
-        //}
         int bitmapWidth = bitmap.getWidth();
         int bitmapHeight = bitmap.getHeight();
         Log.v(TAG, "Bitmap dimension wxh "+bitmapWidth +"x"+bitmapHeight);
 
-        byte[] frameData = bitmapToYuv(bitmap);
+        // The pixels are handed over as is, luma is computed natively
+        Bitmap rgbaBitmap = bitmap;
+        if(bitmap.getConfig() != Bitmap.Config.ARGB_8888){
+            rgbaBitmap = bitmap.copy(Bitmap.Config.ARGB_8888, false);
+            if(rgbaBitmap == null){
+                Log.e(TAG, "setBitmap(): Bitmap conversion failed");
+                return false;
+            }
+        }
+        int rowBytes = rgbaBitmap.getRowBytes();
+        if(bitmapBuffer == null || bitmapBuffer.capacity() < rowBytes * bitmapHeight){
+            bitmapBuffer = ByteBuffer.allocateDirect(rowBytes * bitmapHeight);
+        }
+        bitmapBuffer.clear();
+        rgbaBitmap.copyPixelsToBuffer(bitmapBuffer);
+        bitmapBuffer.rewind();
 
-        return setFrame(frameData, bitmapWidth, bitmapHeight, false, PREVIEW_ROTATION_ANGLE.ROT_0);
+        // Bitmaps are scanned in full, in still mode; the next frame passed to setFrame()
+        // switches back to the user's mode
+        return setFrameBuffer(bitmapBuffer, bitmapWidth, bitmapHeight, rowBytes, null, FRAME_FORMAT.RGBA_8888,
+                false, PREVIEW_ROTATION_ANGLE.ROT_0, FP_MODES.FP_MODE_STILL.getValue());
 
     }
 
-    /*
-     * Converts the inputed Bitmap image into a YUV Image.
-     */
-    private byte[] bitmapToYuv(Bitmap bmp) {
-
-        int width = bmp.getWidth();
-                int height = bmp.getHeight();
-                int yArraySize = width*height;
-                //width*height for the y values, half of that for the uv values
-                byte[] yuv = new byte[yArraySize*3/2];
-
-                int r, g, b;
-                int yIndex;
-                byte y;
-                int color;
-                int doubleI, doubleJ;
-                int j;
-
-                //Go through the bitmap and take 2x2 squares at a time,
-                //converting to YUV format
-                for(int i = 0; i < height/2; i++){
-                        for(j = 0; j < width/2; j++){
-
-                                //doubleI = 2*i, gj = 2*j
-                                doubleI = i<<1; doubleJ = j <<1;
-
-                                //2*i*width + 2*j
-                                yIndex = doubleI*width+doubleJ;
 
-                                //top left pixel
-                                color = bmp.getPixel(doubleJ, doubleI);
-                                r =  (color >>> 16) & 0xFF;
-                                g = (color >>> 8) & 0xFF;
-                                b = color& 0xFF;
-
-                                y = (byte) (( (66*r + 129*g +  25*b + 128) >>> 8) +  16);
-
-                                yuv[yIndex] = y;
-
-                                //top right pixel
-                                color = bmp.getPixel(doubleJ+1, doubleI);
-                                r =  (color >>> 16) & 0xFF;
-                                g = (color >>> 8) & 0xFF;
-                                b = color& 0xFF;
-
-                                y = (byte) (( (66*r + 129*g +  25*b + 128) >>> 8) +  16);
-
-                                yuv[yIndex+1] = y;
-
-                                //bottom left pixel
-                                color = bmp.getPixel(doubleJ, doubleI+1);
-                                r =  (color >>> 16) & 0xFF;
-                                g = (color >>> 8) & 0xFF;
-                                b = color& 0xFF;
-
-                                y = (byte) (( (66*r + 129*g +  25*b + 128) >>> 8) +  16);
-
-                                yuv[yIndex+width] = y;
-
-                                //bottom right pixel
-                                color = bmp.getPixel(doubleJ+1, doubleI+1);
-                                r =  (color >>> 16) & 0xFF;
-                                g = (color >>> 8) & 0xFF;
-                                b = color& 0xFF;
+    /**
+     * Configures the processing of {@link processBatch(Bitmap[], EnumSet, int[])}. The
+     * images of a batch are spread over a pool of native facial processors, each running
+     * on its own thread in FP_MODE_STILL with the detection parameters of this object.
+     * The pool is set up by the next batch.
+     *
+     * @param poolSize Number of images processed at once, up to 64; 0 for one per CPU core.
+     * @param queueDepth Number of images the pool holds at once, up to 64, from being taken
+     * in until their facial data is returned, which bounds the memory pinned by a batch; 0
+     * for twice the pool size. It is never less than the pool size.
+     * @param imageDeadlineMs Detection time allowed per image in milliseconds, 0 for no
+     * limit. The faces found by then are returned.
+     * @return true if the configuration is valid, else false.
+     */
+    public boolean setBatchConfig(int poolSize, int queueDepth, int imageDeadlineMs){
+        if (facialprocHandle == 0 || poolSize < 0 || queueDepth < 0 || imageDeadlineMs < 0){
+            return false;
+        }
+        if(poolSize > MAX_THREADS || queueDepth > MAX_THREADS){
+            Log.e(TAG, "setBatchConfig(): poolSize or queueDepth above "+MAX_THREADS);
+            return false;
+        }
+        destroyBatchPool();
+        batchPoolSize = poolSize;
+        batchQueueDepth = queueDepth;
+        batchDeadlineMs = imageDeadlineMs;
+        return true;
+    }
 
-                                y = (byte) (( (66*r + 129*g +  25*b + 128) >>> 8) +  16);
+    /**
+     * Scans a batch of still images for faces on several threads at once and returns
+     * their facial data in input order. This is the fast way to index a gallery: it
+     * replaces a {@link setBitmap(Bitmap)} and {@link getFaceData(EnumSet)} call per image.
+     * The pixels of ARGB_8888 bitmaps are read in place; others are converted first.
+     * The call returns once the whole batch is processed. See
+     * {@link setBatchConfig(int, int, int)}.
+     *
+     * @param bitmaps The images.
+     * @param dataSet The facial data points to compute for each face, see
+     * {@link getFaceData(EnumSet)}. FACE_IDENTIFICATION is not supported here.
+     * @param imageTimesUs If not null, receives the processing time of each image in
+     * microseconds, or -1 for an image that could not be processed.
+     * @return The facial data of each image, null for an image without faces or that
+     * could not be processed; null if the batch could not be run.
+     */
+    public FaceData[][] processBatch(Bitmap[] bitmaps, EnumSet<FP_DATA> dataSet, int[] imageTimesUs) throws IllegalArgumentException{
+        if(bitmaps == null || dataSet == null || dataSet.contains(FP_DATA.FACE_IDENTIFICATION)
+                || (imageTimesUs != null && imageTimesUs.length < bitmaps.length)){
+            throw new IllegalArgumentException();
+        }
+        if (facialprocHandle == 0){
+            return null;
+        }
+        if(batchPool == 0){
+            batchPool = poolCreate(facialprocHandle, batchPoolSize, batchQueueDepth, batchDeadlineMs);
+            if(batchPool == 0){
+                Log.e(TAG, "processBatch(): Native pool failed to start");
+                return null;
+            }
+        }
 
-                                yuv[yIndex+width+1] = y;
-                        }
+        Bitmap[] rgbaBitmaps = bitmaps;
+        for(int i = 0; i < bitmaps.length; i++){
+            if(bitmaps[i] != null && bitmaps[i].getConfig() != Bitmap.Config.ARGB_8888){
+                if(rgbaBitmaps == bitmaps){
+                    rgbaBitmaps = bitmaps.clone();
                 }
+                rgbaBitmaps[i] = bitmaps[i].copy(Bitmap.Config.ARGB_8888, false);
+            }
+        }
+        int[][] results = processBatch(batchPool, rgbaBitmaps, getInfoMask(dataSet));
+        if(results == null){
+            return null;
+        }
 
-                return yuv;
-
+        FaceData[][] faces = new FaceData[bitmaps.length][];
+        for(int i = 0; i < bitmaps.length; i++){
+            int[] result = results[i];
+            boolean processed = result != null && result[0] == 0;
+            if(processed){
+                faces[i] = parseFaceData(result, BATCH_HEADER_SIZE, result[2], dataSet, false);
+            }
+            if(imageTimesUs != null){
+                imageTimesUs[i] = processed ? result[1] : -1;
+            }
         }
+        return faces;
+    }
 
+    /*
+     * Stops the native pool of processBatch(); the next batch starts it anew.
+     */
+    private void destroyBatchPool(){
+        if(batchPool != 0){
+            poolDestroy(batchPool);
+            batchPool = 0;
+        }
+    }
 
         /**
      * Use to query the framework for the number of faces detected in the image
@@ -688,7 +1729,7 @@ public class FacialProcessing {
      *
      */
     public int getNumFaces() {
-        if (facialprocHandle == 0 || myInstance == null){
+        if (facialprocHandle == 0){
             return 0;
         }
         int[] facesData = getCompleteInfos( facialprocHandle, true,    //Rect info
@@ -697,7 +1738,8 @@ public class FacialProcessing {
                 false,            //Yaw, pitch, roll
                 false,                  //Smile value/degree
                 false,                   //Gaze points
-                false);                 //Blink info
+                false,                  //Blink info
+                false, 0, 1.0f, 1.0f);  //No display transform
 
         if(facesData == null || facesData.length == 0) {
             Log.v(TAG, "getFaceData: No info");
@@ -731,7 +1773,7 @@ public class FacialProcessing {
      *
      */
     public FaceData[] getFaceData() {
-        if (facialprocHandle == 0 || myInstance == null) {
+        if (facialprocHandle == 0) {
             return null;
         } else {
             EnumSet<FP_DATA> set = EnumSet.allOf(FP_DATA.class);
@@ -781,7 +1823,7 @@ public class FacialProcessing {
         if(dataSet == null){
             throw new IllegalArgumentException();
         }
-        if (facialprocHandle == 0 || myInstance == null) {
+        if (facialprocHandle == 0) {
             Log.v(TAG, "getFaceData: Invalid handle");
             return null; //exit point
         }
@@ -807,7 +1849,8 @@ public class FacialProcessing {
                     dataSet.contains(FP_DATA.FACE_ORIENTATION),            //Yaw, pitch, roll
                     dataSet.contains(FP_DATA.FACE_SMILE),                  //Smile value/degree
                     dataSet.contains(FP_DATA.FACE_GAZE),                   //Gaze points
-                    dataSet.contains(FP_DATA.FACE_BLINK));                 //Blink info
+                    dataSet.contains(FP_DATA.FACE_BLINK),                  //Blink info
+                    isMirrored, rotationAngleDegrees, scaleX, scaleY);     //Display transform, applied natively
 
             if(facesData == null || facesData.length == 0) {
                 Log.v(TAG, "getFaceData: No info");
@@ -835,99 +1878,111 @@ public class FacialProcessing {
             {
                 numElemsPerFace+=2;
             }
-            ArrayList<FaceData> faceDataList = new ArrayList<FaceData>((facesData.length)/numElemsPerFace);
-            int j = 0;
+            return parseFaceData(facesData, 0, facesData.length/numElemsPerFace, dataSet, true);
+        }
+    }
+
+    /*
+     * Builds the FaceData objects from the packed native data: numFaces faces starting at
+     * offset, each holding the data points of dataSet in a fixed order. Identification
+     * queries the native side per face and is only possible on the synchronous path.
+     */
+    private FaceData[] parseFaceData(int[] facesData, int offset, int numFaces, EnumSet<FP_DATA> dataSet, boolean identify){
+        if(numFaces <= 0) {
+            return null;
+        }
+        ArrayList<FaceData> faceDataList = new ArrayList<FaceData>(numFaces);
+        int j = offset;
 
-            //do for each face
-            try{ //I fear for arrayindex out of bounds, for j.
-                for(int i = 0; i < (facesData.length)/numElemsPerFace; i++) {
+        //do for each face
+        try{ //I fear for arrayindex out of bounds, for j.
+            for(int i = 0; i < numFaces; i++) {
 
-                                FaceData face = new FaceData(isMirrored, rotationAngleDegrees);
+                            FaceData face = new FaceData();
 
-                        //get rect info
-                        face.rect = new Rect(facesData[j], facesData[j+1], facesData[j]+facesData[j+2], facesData[j+1]+facesData[j+3]);
-                        j+=4;
+                    //get rect info
+                    face.rect = new Rect(facesData[j], facesData[j+1], facesData[j]+facesData[j+2], facesData[j+1]+facesData[j+3]);
+                    j+=4;
 
-                        //get eyes, mouth coodinates. Take only the first 6 values denoting center of two eyes and mouth. Ignore the rest
-                        if( dataSet.contains(FP_DATA.FACE_COORDINATES) ) {
+                    //get eyes, mouth coodinates. Take only the first 6 values denoting center of two eyes and mouth. Ignore the rest
+                    if( dataSet.contains(FP_DATA.FACE_COORDINATES) ) {
 
-                            face.leftEye = new Point(facesData[j+START_LOC_LEFTEYE_IN_PARTS], facesData[j+START_LOC_LEFTEYE_IN_PARTS+1]);
+                        face.leftEye = new Point(facesData[j+START_LOC_LEFTEYE_IN_PARTS], facesData[j+START_LOC_LEFTEYE_IN_PARTS+1]);
 
-                            face.rightEye = new Point(facesData[j+START_LOC_RIGHTEYE_IN_PARTS],  facesData[j+START_LOC_RIGHTEYE_IN_PARTS+1]);
+                        face.rightEye = new Point(facesData[j+START_LOC_RIGHTEYE_IN_PARTS],  facesData[j+START_LOC_RIGHTEYE_IN_PARTS+1]);
 
-                            face.mouth = new Point(facesData[j+START_LOC_MOUTH_IN_PARTS], facesData[j+START_LOC_MOUTH_IN_PARTS+1]);
-                            j+=(NUM_POINTS_IN_PARTS<<1);          //do this to ignore the rest
-                        }
+                        face.mouth = new Point(facesData[j+START_LOC_MOUTH_IN_PARTS], facesData[j+START_LOC_MOUTH_IN_PARTS+1]);
+                        j+=(NUM_POINTS_IN_PARTS<<1);          //do this to ignore the rest
+                    }
 
 
-                        //get yaw, pitch, roll
-                        if( dataSet.contains(FP_DATA.FACE_ORIENTATION) ) {
-                            face.setPitch(facesData[j]);
-                            face.setYaw(facesData[j+1]);
-                            face.setRoll(facesData[j+2]);
-                            j+=3;
-                        }
+                    //get yaw, pitch, roll
+                    if( dataSet.contains(FP_DATA.FACE_ORIENTATION) ) {
+                        face.setPitch(facesData[j]);
+                        face.setYaw(facesData[j+1]);
+                        face.setRoll(facesData[j+2]);
+                        j+=3;
+                    }
 
-                        //get smile value
-                        if( dataSet.contains(FP_DATA.FACE_SMILE) ) {
-                            face.setSmileValue(facesData[j]);
-                            j++;
-                        }
+                    //get smile value
+                    if( dataSet.contains(FP_DATA.FACE_SMILE) ) {
+                        face.setSmileValue(facesData[j]);
+                        j++;
+                    }
 
-                        //get gaze angles
-                        if( dataSet.contains(FP_DATA.FACE_GAZE) ) {
-                            face.setEyeGazeAngles(facesData[j], facesData[j+1]);
-                            j+=2;
-                        }
+                    //get gaze angles
+                    if( dataSet.contains(FP_DATA.FACE_GAZE) ) {
+                        face.setEyeGazeAngles(facesData[j], facesData[j+1]);
+                        j+=2;
+                    }
 
-                        //get blink
-                        if( dataSet.contains(FP_DATA.FACE_BLINK) ) {
-                            face.setBlinkValues(facesData[j], facesData[j+1]);
-                            j+=2;
+                    //get blink
+                    if( dataSet.contains(FP_DATA.FACE_BLINK) ) {
+                        face.setBlinkValues(facesData[j], facesData[j+1]);
+                        j+=2;
+                    }
+                    if(identify && dataSet.contains(FP_DATA.FACE_IDENTIFICATION))
+                    {
+                            int [] faceRecogData = identifyPerson(facialprocHandle, i);// native jni call
+                        if(faceRecogData!=null && faceRecogData.length == 0)
+                        {
+                            // Past the analysis budget: left as not processed
                         }
-                        if(dataSet.contains(FP_DATA.FACE_IDENTIFICATION))
+                        else if(faceRecogData!=null)
                         {
-                                int [] faceRecogData = identifyPerson(facialprocHandle, i);// native jni call
-                            if(faceRecogData!=null)
+                            if(faceRecogData[0] == -1)
                             {
-                                if(faceRecogData[0] == -1)
-                                {
-                                        face.setPersonId(FacialProcessingConstants.FP_PERSON_NOT_REGISTERED);
-                                        face.setRecognitionConfidence(FacialProcessingConstants.FP_PERSON_NOT_REGISTERED);
-                                }
-                                else
-                                {
-                                        face.setPersonId(faceRecogData[0]);
-                                        face.setRecognitionConfidence(faceRecogData[2]);
-                                }
+                                    face.setPersonId(FacialProcessingConstants.FP_PERSON_NOT_REGISTERED);
+                                    face.setRecognitionConfidence(FacialProcessingConstants.FP_PERSON_NOT_REGISTERED);
                             }
                             else
                             {
-                                face.setPersonId(FacialProcessingConstants.FP_PERSON_NOT_REGISTERED);
-                                face.setRecognitionConfidence(FacialProcessingConstants.FP_PERSON_NOT_REGISTERED);
-                                Log.e(TAG, "identifyPersonEnum: faceRecogData[] equals NULL");
+                                    face.setPersonId(faceRecogData[0]);
+                                    face.setRecognitionConfidence(faceRecogData[2]);
                             }
                         }
-
-                        face.doRotationNMirroring(previewFrameWidth, previewFrameHeight);
-
-                        face.normalizeCoordinates(scaleX, scaleY);
-
-                        faceDataList.add(face);
+                        else
+                        {
+                            face.setPersonId(FacialProcessingConstants.FP_PERSON_NOT_REGISTERED);
+                            face.setRecognitionConfidence(FacialProcessingConstants.FP_PERSON_NOT_REGISTERED);
+                            Log.e(TAG, "identifyPersonEnum: faceRecogData[] equals NULL");
                         }
+                    }
 
+                    faceDataList.add(face);
+                    }
 
 
-            }
-            catch(Exception e){
-               // Log.e(TAG, e.getMessage());
-                e.printStackTrace();
-                faceDataList.clear();
-                faceDataList = null;
-                return null;
-            }
-            return faceDataList.toArray( new FaceData[faceDataList.size()]);
+
+        }
+        catch(Exception e){
+           // Log.e(TAG, e.getMessage());
+            e.printStackTrace();
+            faceDataList.clear();
+            faceDataList = null;
+            return null;
         }
+        return faceDataList.toArray( new FaceData[faceDataList.size()]);
     }
 
     /**
@@ -954,6 +2009,11 @@ public class FacialProcessing {
                 else
                 {
                         int [] faceRecogData = identifyPerson(facialprocHandle, faceIndex);
+                        if(faceRecogData == null || faceRecogData.length == 0)
+                        {
+                            Log.e(TAG, "addPerson(): Face could not be matched against the album");
+                            return FacialProcessingConstants.FP_INTERNAL_ERROR;
+                        }
                         if(faceRecogData[0] == -1)// Success ! Face does not exists.
                 {
                     int faceFeature = getFaceFeature(facialprocHandle, faceIndex);// native jni call
@@ -1158,7 +2218,7 @@ public class FacialProcessing {
     public int setRecognitionConfidence(int confidenceValue)throws IllegalArgumentException{
         if(confidenceValue>0 && confidenceValue <100)
         {
-            setConfidenceValue(confidenceValue);
+            setConfidenceValue(facialprocHandle, confidenceValue);
             return FacialProcessingConstants.FP_SUCCESS;
         }
         else
@@ -1182,10 +2242,14 @@ public class FacialProcessing {
      *
      */
     public void release() {
-        if(myInstance != null) {
+        if(facialprocHandle != 0) {
+            setFaceDataListener(null, null);
+            destroyBatchPool();
             destroy(facialprocHandle);
+            facialprocHandle = 0;
+            borrowedFrame = null;
+            bitmapBuffer = null;
             deinitialize();
-            myInstance = null;
         }
     }
 
@@ -1208,7 +2272,7 @@ public class FacialProcessing {
      * As per docs of the base lib used, default mode is Video.
      */
     public boolean setProcessingMode(FP_MODES mode) {
-        if(facialprocHandle == 0 || myInstance == null){
+        if(facialprocHandle == 0){
             android.util.Log.e(TAG, "setMode failed. Mode: "+mode+", handle: "+facialprocHandle);
             return false;
         }
@@ -1233,14 +2297,48 @@ public class FacialProcessing {
     /* Native Functions */
     private native int initialize();
     private native void deinitialize();
-    private native void config(int handle, int width, int height, int downscaleFactor);
+    private native void config(int handle, int width, int height, int downscaleFactorQ8,
+            int stride, int offset, int cropX, int cropY, int cropWidth, int cropHeight, int format);
     private native void setFrame(int handle, byte[] frame);
+    private native int setFrameDirect(int handle, ByteBuffer frame, boolean borrow);
+    private native int setDownscale(int handle, int factorQ8);
+    private native int setAdaptiveDownscale(int handle, int minFaceSize, int targetTimeUs, int maxFactorQ8);
+    private native int getDownscale(int handle);
+    private native int setStaticSkip(int handle, int threshold, int maxSkip);
+    private native int[] getSkipStats(int handle);
+    private native int setMotionRoi(int handle, int threshold, int fullScanInterval);
+    private native int setDetectableRotation(int handle, int frontal, int halfProfile, int profile);
+    private native int setDetectableRotationAuto(int handle, boolean enable);
+    private native int setOrientation(int handle, int rotation, boolean mirrored);
+    private native int[] getMemStats(int handle);
+    private native int[] getParams(int handle);
+    private native int setParams(int handle, int[] params);
+    private native int[] getTracking(int handle);
+    private native int setTracking(int handle, int[] policy);
+    private native int setDeadline(int handle, int nonTrackingMs, int trackingMs);
+    private native int[] getDeadlineStats(int handle);
+    private native int setTiling(int handle, int numThreads, int minPixels);
+    private native int setRefine(int handle, int coarseScaleQ8, int marginPercent);
+    private native int setFaceThreads(int handle, int numThreads);
+    private native int setAttrRates(int handle, int smileInterval, int gazeBlinkInterval,
+            int directionInterval, int movePercent);
+    private native int setRecogCache(int handle, int interval);
+    private native int setFaceBudget(int handle, int maxFaces);
+    private native int asyncStart(int handle, int infoMask);
+    private native void asyncStop(int handle);
+    private native int submitFrame(int handle, byte[] frame, int sequence, long timestamp,
+            boolean isMirrored, int rotationAngle, float scaleX, float scaleY);
+    private native int[] pollResults(int handle, int timeoutMs);
+    private native int poolCreate(int handle, int numHandles, int queueDepth, int deadlineMs);
+    private native void poolDestroy(int pool);
+    private native int[][] processBatch(int pool, Bitmap[] bitmaps, int infoMask);
     private native int getNumFaces(int handle);
     private native int create();
     private native void destroy(int handle);
     private native void setMode(int handle, int mode);
     private native int[] getCompleteInfos(int handle, boolean getRect, boolean getCoOrd,
-            boolean getCoOrdEx, boolean getOrientation, boolean getSmileValue, boolean getGaze, boolean getBlink);
+            boolean getCoOrdEx, boolean getOrientation, boolean getSmileValue, boolean getGaze, boolean getBlink,
+            boolean isMirrored, int rotationAngle, float scaleX, float scaleY);
 
     // Facial Recognition Native calls
     private native int [] identifyPerson(int handle, int faceId);
@@ -1251,7 +2349,7 @@ public class FacialProcessing {
     private native int resetAlbum(int handle);
     private native byte [] serializeAlbum(int handle);
     private native int deserializeAlbum(int handle, int bufferSize, byte[] byteArray);
-    private native int setConfidenceValue(int confidenceValue);
+    private native int setConfidenceValue(int handle, int confidenceValue);
     private native int getNumberOfPeople(int handle);
 
 
@@ -19,6 +19,7 @@ include $(CLEAR_VARS)
 LOCAL_MODULE:= libfacialproc_jni
 
 LOCAL_SRC_FILES:= qcff.c\
+        qcff_img.c\
         qcff_jni.c
 
 LOCAL_SHARED_LIBRARIES := libutils libmmcamera_faceproc
@@ -27,7 +28,13 @@ LOCAL_C_INCLUDES := $(LOCAL_PATH)/inc/
 
 LOCAL_CFLAGS += -Wno-multichar
 
-LOCAL_LDLIBS := -L$(SYSROOT)/usr/lib -llog
+# Vector pixel kernels (qcff_img.c); x86 gets SSE2 by default and picks
+# AVX2 at runtime
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+  LOCAL_ARM_NEON := true
+endif
+
+LOCAL_LDLIBS := -L$(SYSROOT)/usr/lib -llog -ljnigraphics
 
 LOCAL_MODULE_TAGS := optional
 LOCAL_PRELINK_MODULE:= false
@@ -53,3 +60,28 @@ $(warning ARCH_ABI: $(ARCH_ABI))
 
 include $(BUILD_SHARED_LIBRARY)
 
+
+
+# Multi-instance stress benchmark: N handles on N threads, see qcff_bench.c
+include $(CLEAR_VARS)
+LOCAL_MODULE:= qcff_bench
+
+LOCAL_SRC_FILES:= qcff_bench.c\
+        qcff.c\
+        qcff_img.c
+
+LOCAL_SHARED_LIBRARIES := libmmcamera_faceproc
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/inc/
+
+LOCAL_CFLAGS += -Wno-multichar
+
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+  LOCAL_ARM_NEON := true
+endif
+
+LOCAL_LDLIBS := -L$(SYSROOT)/usr/lib -llog
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
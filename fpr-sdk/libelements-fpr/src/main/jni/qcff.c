@@ -7,6 +7,7 @@
  */
 
 #include "qcff_native.h"
+#include "qcff_img.h"
 #include "FaceProcAPI.h"
 #include "FaceProcDef.h"
 #include "FaceProcDtAPI.h"
@@ -20,7 +21,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <dlfcn.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
 
 //#define PROFILING
 #ifdef PROFILING
@@ -73,7 +80,426 @@ typedef struct {
 
 } qcff_default_params_t;
 
+/* Padded crop around one face, cut once per frame and shared by the parts,
+ * contour, smile, gaze-blink and recognition engines. Coordinates are in
+ * the image the engines run on */
 typedef struct {
+    uint8_t *p_buffer;       /* crop storage, carved out of the arena */
+    uint32_t capacity;
+    uint8_t *p_pixels;       /* p_buffer, or the frame itself when the face
+                                fills most of it */
+    uint32_t frame_seq;      /* frame and face the crop was cut for */
+    int32_t face_index;
+    int32_t x;
+    int32_t y;
+    uint32_t width;
+    uint32_t height;
+    POINT corners[4];        /* face corners relative to the crop */
+    INT32 pose;
+} qcff_roi_t;
+
+/* Parts, and contour once asked for, of one face on one frame, shared by
+ * every query and by recognition. The points are relative to the crop of
+ * the face, which qcff_face_roi cuts the same way each time */
+typedef struct {
+    HPTRESULT hpt_result;    /* created on first use */
+    uint32_t frame_seq;      /* frame the parts were found on, 0 for none */
+    uint8_t ct_valid;
+    POINT ct_points[QCFF_PARTS_EX_MAX];
+} qcff_parts_cache_t;
+
+/* Attributes last estimated for a tracked face, see qcff_set_attr_rates.
+ * The *_seq fields are the frames they were estimated on, 0 for never;
+ * the position and pose are those of the last forced refresh */
+typedef struct {
+    INT32 id;
+    uint32_t seen_seq;       /* frame it was last queried on, 0 when free */
+    int32_t cx;
+    int32_t cy;
+    int32_t size;
+    INT32 pose;
+    uint32_t smile_seq;
+    uint32_t gb_seq;
+    uint32_t dir_seq;
+    uint32_t smile;
+    qcff_gaze_deg_t gaze;
+    qcff_eye_open_deg_t eye_open;
+    qcff_face_dir_t direction;
+} qcff_attr_track_t;
+
+/* Album match last found for a tracked face, see qcff_set_recog_cache.
+ The raw score is kept so that a new threshold applies at once */
+typedef struct {
+    INT32 id;
+    uint8_t valid;
+    INT32 pose;
+    uint32_t verify_seq;     /* frame it was identified on */
+    INT32 user_id;
+    INT32 score;
+    INT32 num_users;
+} qcff_recog_track_t;
+
+/* Frame a tracked face was first ranked on, for its tracking age */
+typedef struct {
+    INT32 id;
+    uint8_t valid;
+    uint32_t first_seq;
+} qcff_rank_track_t;
+
+/* Engines run on the crop of a face: the handle's own, or those of a face
+ * analysis worker */
+typedef struct {
+    HPOINTER hpt;
+    HSMILE hsm;
+    HSMRESULT hsm_result;
+    HGAZEBLINK hgb;
+    HGBRESULT hgb_result;
+    HCONTOUR hct;
+    HCTRESULT hct_result;
+} qcff_face_engines_t;
+
+/* Memory of the wrapper's own buffers: one aligned block, carved up on
+ * each configuration and only reallocated when it has to grow */
+typedef struct {
+    uint8_t *p_base;
+    uint32_t size;
+    uint32_t used;           /* carved for the current configuration */
+    uint32_t peak;           /* largest used since the handle was created */
+} qcff_arena_t;
+
+/* Alignment of the arena and of each buffer in it, a cache line */
+#define QCFF_ARENA_ALIGN         64
+#define QCFF_ARENA_ROUND(size) \
+    (((size) + QCFF_ARENA_ALIGN - 1) & ~(uint32_t)(QCFF_ARENA_ALIGN - 1))
+
+/* Margin left around a face of the given size, so that the parts and
+ * contour searches do not run out of image */
+#define QCFF_ROI_PAD(size)       ((size) / 2)
+/* Above this share of the image, the face is processed in place */
+#define QCFF_ROI_MAX_PERCENT     60
+
+/* Adaptive downscale controller, see qcff_set_adaptive_downscale */
+typedef struct {
+    uint32_t min_face_size;  /* input frame pixels, 0 when off */
+    uint32_t target_us;
+    uint32_t max_scale_q8;
+    uint32_t avg_us;         /* running average of the detection time at
+                                the current factor, 0 after a switch */
+    uint32_t small_face;     /* smallest face seen recently, frame pixels */
+    uint32_t small_face_age; /* frames since small_face was updated */
+    uint32_t hold;           /* frames left before the next switch */
+} qcff_adapt_t;
+
+/* Frames a face size is remembered for */
+#define QCFF_ADAPT_FACE_WINDOW   30
+/* Frames between two factor switches */
+#define QCFF_ADAPT_HOLD          15
+/* Faces may shrink a little between two looks at them */
+#define QCFF_ADAPT_MARGIN_Q8     224
+/* Factors closer than this are not worth a switch */
+#define QCFF_ADAPT_STEP_Q8       32
+
+/* Static scene skipping, see qcff_set_static_skip */
+typedef struct {
+    uint32_t threshold;      /* 0 when off */
+    uint32_t max_skip;       /* 0 for no limit */
+    uint32_t run;            /* frames skipped since the last detection */
+    uint8_t ref_valid;
+    uint8_t ref[QCFF_IMG_SIG_SIZE]; /* frame detection last ran on */
+    uint8_t cur[QCFF_IMG_SIG_SIZE]; /* frame given to qcff_set_frame */
+    uint8_t *p_cur;          /* frame to detect on, NULL when not taken */
+    qcff_skip_stats_t stats;
+} qcff_skip_t;
+
+/* Motion guided detection masks, see qcff_set_motion_roi. Areas are
+ crop relative, at the processing scale; dx is 0 for an empty one */
+typedef struct {
+    uint32_t threshold;          /* 0 when off */
+    uint32_t full_scan_interval;
+    uint32_t since_full_scan;    /* frames since the last full scan */
+    uint8_t masked;              /* this frame searches the areas below */
+    qcff_rect_t moving;          /* changed blocks, new faces searched */
+    qcff_rect_t tracked;         /* changed blocks and last faces */
+    qcff_rect_t faces;           /* last faces with their margin */
+} qcff_motion_t;
+
+/* Frames between two full scans unless configured otherwise */
+#define QCFF_MOTION_FULL_SCAN    30
+
+/* Frame deadline, see qcff_set_deadline. Timeouts are in ms, 0 for none */
+typedef struct {
+    uint32_t non_tracking_ms;
+    uint32_t tracking_ms;
+    qcff_deadline_stats_t stats;
+} qcff_deadline_t;
+
+/* Longest timeout accepted, the engine takes a signed value */
+#define QCFF_DEADLINE_MAX_MS     60000
+
+/* Tracking values of a new detector, programmed for the negative fields
+ of the handle's policy */
+typedef struct {
+    INT32 refresh_count[QCFF_TRACKING_MAX];
+    INT32 face_retry;
+    INT32 head_retry;
+    INT32 hold_count;
+    INT32 move_rate;
+} qcff_tracking_defaults_t;
+
+/* Configuration a detector was set up for: the crop at full resolution,
+ the downscale factor of the configuration and the mode */
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t scale_q8;
+    qcff_mode_t mode;
+} qcff_dt_key_t;
+
+/* A configured detector put aside with what was programmed into it, see
+ qcff_select_dt. hdt is NULL for a free entry */
+typedef struct {
+    qcff_dt_key_t key;
+    HDETECTION hdt;
+    HDTRESULT hdt_result;
+    uint32_t dt_result_faces;
+    qcff_tracking_defaults_t tracking_defaults;
+    UINT32 dt_angles[POSE_TYPE_COUNT];
+    uint8_t dt_angles_valid;
+    uint32_t dt_backup_size;
+    uint32_t dt_work_min_size;
+    uint32_t dt_work_max_size;
+    uint32_t setup_seq;      /* settings it was programmed with */
+    uint32_t last_used;
+} qcff_dt_entry_t;
+
+/* Detectors kept configured besides the one in use */
+#define QCFF_DT_CACHE_SIZE       3
+
+/* Engine mode of each search for new faces */
+static const INT32 qcff_tracking_dt_modes[QCFF_TRACKING_MAX] = {
+    DT_MODE_MOTION1,
+    DT_MODE_MOTION2,
+    DT_MODE_MOTION3,
+};
+
+/* Frame slot of the asynchronous worker */
+typedef struct {
+    uint8_t *p_image; /* packed crop, at most crop size */
+    uint32_t scale_q8; /* factor the crop was packed at */
+    uint8_t sig[QCFF_IMG_SIG_SIZE];
+    uint8_t has_sig;
+    uint32_t seq;
+    uint64_t timestamp;
+    qcff_transform_t transform;
+} qcff_async_frame_t;
+
+/* Mailbox slots hold a buffer index; the flag marks a buffer that was
+ * put in and not taken yet */
+#define QCFF_SLOT_FRESH    (0x4)
+
+/* Asynchronous worker. Frames and results are triple buffered: the
+ * producer and the consumer each own a buffer and the third one sits in
+ * the mailbox, swapped atomically, so neither side ever waits on a lock */
+typedef struct {
+    pthread_t thread;
+    uint32_t info_mask;
+    uint32_t stop;
+
+    qcff_async_frame_t frames[3];
+    uint32_t frame_back;    /* submitting thread */
+    uint32_t frame_front;   /* worker */
+    uint32_t frame_mailbox;
+    sem_t frame_sem;
+    uint32_t num_dropped;
+
+    qcff_frame_result_t results[3];
+    uint32_t result_back;   /* worker */
+    uint32_t result_front;  /* polling thread */
+    uint32_t result_mailbox;
+    sem_t result_sem;
+} qcff_async_t;
+
+/* Image of a batch in flight; pool slots cycle through the free list,
+ * the work queue and the done queue */
+typedef struct {
+    qcff_batch_item_t item;
+    uint32_t index;
+    qcff_frame_result_t result;
+} qcff_pool_slot_t;
+
+struct qcff_pool;
+
+typedef struct {
+    pthread_t thread;
+    qcff_handle_t handle;
+    qcff_config_t cfg;      /* last configuration of the handle */
+    uint8_t configured;
+    struct qcff_pool *p_pool;
+} qcff_pool_worker_t;
+
+/* Handle pool. The batch thread takes images in and hands results back,
+ * the workers run detection; both sides meet on the queues under lock */
+typedef struct qcff_pool {
+    uint32_t num_workers;
+    qcff_pool_worker_t *p_workers;
+    uint32_t depth;
+    qcff_pool_slot_t *p_slots;
+    uint32_t *p_free;       /* stack of free slots */
+    uint32_t num_free;
+    uint32_t *p_work;       /* ring of slots waiting for a worker */
+    uint32_t work_head;
+    uint32_t num_work;
+    uint32_t *p_done;       /* ring of slots waiting to be handed back */
+    uint32_t done_head;
+    uint32_t num_done;
+    uint32_t info_mask;
+    uint32_t stop;
+    pthread_mutex_t batch_lock;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+} qcff_pool_priv_t;
+
+/* Tiled detection, see qcff_set_tiling. The overlap is the largest face
+ * the tiles look for, QCFF_TILE_FACES smallest faces wide and at least
+ * QCFF_TILE_OVERLAP_MIN; tiles are QCFF_TILE_SPAN overlaps wide. The
+ * pass for larger faces downscales them to twice the smallest size */
+#define QCFF_TILE_FACES          8
+#define QCFF_TILE_OVERLAP_MIN    160
+#define QCFF_TILE_SPAN           8
+/* Faces closer than this to a seam are cut by it */
+#define QCFF_TILE_SEAM           2
+/* Faces overlapping a more confident one by more than this percentage of
+ * their union are the same face, for the tiles and the refined faces */
+#define QCFF_FACE_NMS_IOU        40
+
+struct qcff_tiling;
+
+typedef struct {
+    pthread_t thread;       /* none for the first, the calling thread */
+    qcff_handle_t handle;   /* detector of the tiles */
+    struct qcff_tiling *p_tiling;
+} qcff_tile_worker_t;
+
+/* Faces found by one job: a tile, or the pass for large faces */
+typedef struct {
+    int status;
+    uint8_t timed_out;
+    uint32_t num_faces;
+    FACEINFO *p_faces;
+} qcff_tile_job_t;
+
+typedef struct qcff_tiling {
+    uint32_t min_pixels;
+    uint32_t num_workers;
+    qcff_tile_worker_t *p_workers;
+    qcff_handle_t large;    /* detector of the faces larger than a tile */
+
+    /* Configuration and settings the detectors were set up for */
+    qcff_config_t tile_cfg;
+    qcff_config_t large_cfg;
+    uint32_t tile_seq;
+    uint32_t large_seq;
+    uint8_t tile_set_up;
+    uint8_t large_set_up;
+
+    /* Image and tiles of the frame being searched */
+    const uint8_t *p_image;
+    uint32_t stride;
+    uint32_t x0;
+    uint32_t width;
+    uint32_t height;
+    uint32_t cols;
+    uint32_t rows;
+    uint32_t num_tiles;
+    uint8_t large_pass;
+
+    /* Jobs, the last one the large face pass */
+    qcff_tile_job_t *p_jobs;
+    FACEINFO *p_found;
+    uint32_t max_jobs;
+    uint32_t job_faces;
+    uint32_t num_jobs;
+    uint32_t next_job;
+    uint32_t jobs_done;
+    uint32_t generation;
+    uint32_t stop;
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+
+    /* Merged faces of the last detection, valid when active */
+    FACEINFO *p_faces;
+    uint32_t num_faces;
+    uint8_t active;
+} qcff_tiling_t;
+
+/* Face analysis workers, see qcff_set_face_threads. The first worker is
+ * the calling thread, on the engines and crop of the handle */
+struct qcff_face_pool;
+
+typedef struct {
+    pthread_t thread;
+    qcff_face_engines_t engines;
+    qcff_roi_t roi;          /* p_buffer malloc'ed, sized as the handle's */
+    struct qcff_face_pool *p_pool;
+} qcff_face_worker_t;
+
+typedef struct qcff_face_pool {
+    uint32_t num_workers;
+    qcff_face_worker_t *p_workers;
+
+    /* Query being answered: faces, their detection info, and the status
+     of each, written by the worker that took it */
+    struct qcff *p_qcff;
+    const uint32_t *p_face_indices;
+    qcff_complete_face_info_t *p_complete_info;
+    FACEINFO faces[QCFF_MAX_RESULT_FACES];
+    qcff_attr_track_t *p_tracks[QCFF_MAX_RESULT_FACES];
+    int status[QCFF_MAX_RESULT_FACES];
+    uint32_t num_jobs;
+    uint32_t next_job;
+    uint32_t jobs_done;
+    uint32_t generation;
+    uint32_t stop;
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+} qcff_face_pool_t;
+
+/* Coarse-to-fine detection, see qcff_set_refine. The faces are searched
+ * for again at QCFF_REFINE_SIZE_LO to QCFF_REFINE_SIZE_HI percent of their
+ * coarse size, and each square keeps at most QCFF_REFINE_FACES of them */
+#define QCFF_REFINE_MARGIN_MAX   200
+#define QCFF_REFINE_SIZE_LO      70
+#define QCFF_REFINE_SIZE_HI      140
+#define QCFF_REFINE_FACES        4
+
+/* Face ranking, see qcff_get_ranked_faces. A face scores its size times
+ * a centrality weight of 1/2 at the border to 1 at the centre, times a
+ * tracking age weight of 1 for a new face to 3/2 past QCFF_RANK_AGE_MAX
+ * frames */
+#define QCFF_RANK_AGE_MAX        30
+
+typedef struct {
+    uint32_t scale_q8;
+    uint32_t margin_pct;
+    qcff_handle_t coarse;   /* detector of the downscaled image */
+
+    /* Configuration and settings the coarse detector was set up for */
+    qcff_config_t coarse_cfg;
+    uint32_t coarse_seq;
+    uint8_t set_up;
+
+    /* Faces found again, then merged; valid when active */
+    FACEINFO *p_found;
+    FACEINFO *p_faces;
+    uint32_t max_faces;
+    uint32_t num_faces;
+    uint8_t active;
+} qcff_refine_t;
+
+typedef struct qcff {
     /* Frame dimension */
     uint32_t frame_width;
     uint32_t frame_height;
@@ -81,7 +507,6 @@ typedef struct {
     HDETECTION hdt;
     HDTRESULT hdt_result;
     HPOINTER hpt;
-    HPTRESULT hpt_result;
     HSMILE hsm;
     HSMRESULT hsm_result;
     HGAZEBLINK hgb;
@@ -97,27 +522,163 @@ typedef struct {
     uint32_t local_frame_size;
 
     /* Optional parameters */
+    qcff_params_t params;
+    uint32_t dt_result_faces; /* capacity of hdt_result */
+    qcff_tracking_t tracking;
+    qcff_tracking_defaults_t tracking_defaults;
+    /* Detector in use and the ones put aside for other configurations.
+     * setup_seq counts the changes of the settings programmed into
+     * detectors, so that a detector taken back gets the current ones */
+    qcff_dt_key_t dt_key;
+    qcff_dt_entry_t dt_cache[QCFF_DT_CACHE_SIZE];
+    uint32_t dt_cache_clock;
+    uint32_t setup_seq;
     qcff_mode_t mode;
     uint32_t frontal_rot;
     uint32_t half_profile_rot;
     uint32_t profile_rot;
-
-    /* Scratch buffers */
-    void *bmem; /* backup memory */
-    void *wmem; /* work memory */
-    /* Flags */
-    uint8_t fdBmemorySet;
-    uint8_t fdWmemorySet;
+    /* Angles taken relative to the display upright, see
+     * qcff_set_detect_rot_auto; orientation of the frame on display and
+     * angles programmed into hdt, invalid when dt_angles_valid is unset */
+    uint8_t rot_auto;
+    uint32_t orient_rotation;
+    uint32_t orient_mirrored;
+    UINT32 dt_angles[POSE_TYPE_COUNT];
+    uint8_t dt_angles_valid;
+
+    /* Scratch buffers: the local frame, the luma of RGB frames, the
+     * resampler's scratch and the face crop live in the arena. The
+     * detector's own memory is sized from its requirements for the
+     * configuration, see qcff_config_dt */
+    qcff_arena_t arena;
+    uint32_t dt_backup_size;
+    uint32_t dt_work_min_size;
+    uint32_t dt_work_max_size;
 
     uint8_t *p_local_frame;
+    /* Frame the engines run on: p_local_frame, or the caller's buffer
+     * when it was handed over through qcff_set_frame_ref */
+    uint8_t *p_frame;
     uint32_t num_faces;
 
-    /* Experimental feature: downscale processing */
-    uint32_t downscale_factor;
+    /* Downscale processing: factor in 8.8 fixed point and dimension of
+     * the image the engines run on, factor for the next frame to come in
+     * (written by the controller, read when packing) and the resampler's
+     * scratch memory, sized for any factor */
+    uint32_t scale_q8;
+    uint32_t proc_width;
+    uint32_t proc_height;
+    uint32_t next_scale_q8;
+    uint8_t *p_scale_scratch;
+    uint32_t scale_scratch_size;
+    qcff_adapt_t adapt;
+    qcff_skip_t skip;
+    qcff_motion_t motion;
+    qcff_deadline_t deadline;
+
+    /* Frame layout: row stride, offset of the luma plane and the crop
+     * region, in input frame coordinates */
+    uint32_t stride;
+    uint32_t offset;
+    qcff_rect_t crop;
+    /* Pixel format, and the luma of an RGB crop when it is downscaled */
+    qcff_format_t format;
+    uint8_t *p_luma_frame;
+    /* Image handed to the engines for the current frame and position of
+     * its top-left pixel in the input frame. It is wider than the crop
+     * when a padded frame is read in place */
+    uint32_t img_width;
+    uint32_t img_height;
+    uint32_t img_x;
+    uint32_t img_y;
+    /* Search areas programmed into hdt, non-tracking then tracking */
+    RECT dt_mask[2];
+    uint8_t dt_mask_valid;
+
+    /* Asynchronous worker, NULL when not running */
+    qcff_async_t *p_async;
+
+    /* Tiled still detection, NULL when off */
+    qcff_tiling_t *p_tiling;
+    /* Coarse-to-fine still detection, NULL when off */
+    qcff_refine_t *p_refine;
+    /* Face analysis workers, NULL for the calling thread alone */
+    qcff_face_pool_t *p_face_pool;
+
+    /* Per-face crop for the engines after detection, and the parts found
+     on it for each face; both are stale once frame_seq moves on */
+    qcff_roi_t roi;
+    qcff_parts_cache_t parts[QCFF_MAX_RESULT_FACES];
+    uint32_t frame_seq;
+
+    /* Attributes of the tracked faces, refreshed at attr_rates when
+     attr_decimate is set */
+    uint8_t attr_decimate;
+    qcff_attr_rates_t attr_rates;
+    qcff_attr_track_t attr_tracks[QCFF_MAX_RESULT_FACES];
+
+    /* Identification of the tracked faces, verified again every
+     recog_interval frames; 0 when off */
+    uint32_t recog_interval;
+    qcff_recog_track_t recog_tracks[QCFF_MAX_RESULT_FACES];
+
+    /* Ranking of the faces of frame rank_seq, most important first, and
+     the number of them fully analysed; 0 for all */
+    uint32_t face_budget;
+    uint8_t rank_valid;
+    uint32_t rank_seq;
+    uint32_t num_ranked;
+    uint32_t rank_order[QCFF_MAX_RESULT_FACES];
+    uint8_t rank_pos[QCFF_MAX_RESULT_FACES];
+    qcff_rank_track_t rank_tracks[QCFF_MAX_RESULT_FACES];
+    DTVERSION dt_version;
 } qcff_t;
 
+/* Entry points touching the detection state are refused while the
+ * asynchronous worker owns it */
+#define QCFF_ASYNC_BUSY(p_qcff)    ((p_qcff)->p_async != NULL)
+
+/* Integer part of the display transform, mirroring then rotation:
+ x' = xx * x + xy * y + x0, y' = yx * x + yy * y + y0, then scaled */
+typedef struct {
+    int32_t xx, xy, x0;
+    int32_t yx, yy, y0;
+    float scale_x;
+    float scale_y;
+} qcff_affine_t;
+
+/* Left and right facial parts, swapped on mirroring */
+static const uint8_t parts_lr_pairs[][2] = {
+    { QCFF_PARTS_LEFT_EYE_CENTER, QCFF_PARTS_RIGHT_EYE_CENTER },
+    { QCFF_PARTS_LEFT_EYE_INNER, QCFF_PARTS_RIGHT_EYE_INNER },
+    { QCFF_PARTS_LEFT_EYE_OUTER, QCFF_PARTS_RIGHT_EYE_OUTER },
+    { QCFF_PARTS_MOUTH_LEFT, QCFF_PARTS_MOUTH_RIGHT },
+    { QCFF_PARTS_NOSTRIL_LEFT, QCFF_PARTS_NOSTRIL_RIGHT },
+};
+
+static const uint8_t parts_ex_lr_pairs[][2] = {
+    { QCFF_PARTS_EX_EYE_L_PUPIL, QCFF_PARTS_EX_EYE_R_PUPIL },
+    { QCFF_PARTS_EX_EYE_L_IN, QCFF_PARTS_EX_EYE_R_IN },
+    { QCFF_PARTS_EX_EYE_L_OUT, QCFF_PARTS_EX_EYE_R_OUT },
+    { QCFF_PARTS_EX_EYE_L_UP, QCFF_PARTS_EX_EYE_R_UP },
+    { QCFF_PARTS_EX_EYE_L_DOWN, QCFF_PARTS_EX_EYE_R_DOWN },
+    { QCFF_PARTS_EX_NOSE_L, QCFF_PARTS_EX_NOSE_R },
+    { QCFF_PARTS_EX_NOSE_L_0, QCFF_PARTS_EX_NOSE_R_0 },
+    { QCFF_PARTS_EX_NOSE_L_1, QCFF_PARTS_EX_NOSE_R_1 },
+    { QCFF_PARTS_EX_MOUTH_L, QCFF_PARTS_EX_MOUTH_R },
+    { QCFF_PARTS_EX_BROW_L_UP, QCFF_PARTS_EX_BROW_R_UP },
+    { QCFF_PARTS_EX_BROW_L_DOWN, QCFF_PARTS_EX_BROW_R_DOWN },
+    { QCFF_PARTS_EX_BROW_L_IN, QCFF_PARTS_EX_BROW_R_IN },
+    { QCFF_PARTS_EX_BROW_L_OUT, QCFF_PARTS_EX_BROW_R_OUT },
+    { QCFF_PARTS_EX_CHIN_L, QCFF_PARTS_EX_CHIN_R },
+    { QCFF_PARTS_EX_EAR_L_DOWN, QCFF_PARTS_EX_EAR_R_DOWN },
+    { QCFF_PARTS_EX_EAR_L_UP, QCFF_PARTS_EX_EAR_R_UP },
+};
+
+#define NUM_PAIRS(pairs)   (sizeof(pairs) / sizeof(pairs[0]))
+
 /* Default parameters */
-static qcff_default_params_t default_params = //very important, all conf values here
+static const qcff_default_params_t default_params = //very important, all conf values here
         { 33, /* SEARCH_DENSITY       */
         300, /* FR_THRESHOLD         */
         30, /* PT_THRESHOLD         */
@@ -128,26 +689,128 @@ static qcff_default_params_t default_params = //very important, all conf values
         64, /* MAX_FACE_TO_DETECT   */
         1000, /* MAX_REGISTERED_USERS */
         10, /* MAX_DATA_PER_USER    */
-        ROT_ANGLE_ULR45, //ANGLE_U45,  /* ROT_FRONT */
-                ANGLE_NONE, /* ROT_HALF_PROFILE */
-                ANGLE_NONE, /* ROT_PROFILE */
+        ROT_ANGLE_ALL, /* ROT_FRONT */
+                ROT_ANGLE_U45, /* ROT_HALF_PROFILE */
+                ROT_ANGLE_NONE, /* ROT_PROFILE */
         };
 
-static qcff_complete_face_info_t empty_info = { NULL, NULL, NULL, NULL, NULL,
-        NULL, NULL, };
+/* Recognition threshold of the handles to create, see qcff_setThreshold */
+static int32_t fr_threshold_seed = 300;
+
+static const qcff_complete_face_info_t empty_info = { NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, };
 
 /************************************************************************
  * Helper function prototypes
  ***********************************************************************/
 static void qcff_translate_face_info_to_rect(FACEINFO*, qcff_face_rect_t*);
-static int qcff_config_dt(qcff_t *p_qcff, qcff_config_t *p_cfg);
+static int qcff_config_dt(qcff_t *p_qcff);
+static int qcff_select_dt(qcff_t *p_qcff);
+static void qcff_delete_dt(HDETECTION hdt, HDTRESULT hdt_result);
 static int qcff_config_fr(qcff_t *p_qcff);
 static int qcff_config_gb(qcff_t *p_qcff);
 static int qcff_config_ct(qcff_t *p_qcff);
 static int qcff_config_pt(qcff_t *p_qcff);
 static int qcff_config_sm(qcff_t *p_qcff);
+static int qcff_apply_dt_params(qcff_t *p_qcff);
+static int qcff_update_dt_angles(qcff_t *p_qcff);
+static int qcff_apply_dt_timeout(qcff_t *p_qcff);
+static int qcff_apply_dt_tracking(qcff_t *p_qcff);
+static int qcff_face_size_range(qcff_t *p_qcff);
 static int qcff_extract_feature(qcff_t *p_qcff, uint32_t face_index,
         HFEATURE hfr);
+static int qcff_detect(qcff_t *p_qcff);
+static int qcff_face_roi(qcff_t *p_qcff, qcff_roi_t *p_roi,
+        uint32_t face_index, const FACEINFO *p_face_info);
+static int qcff_detect_parts(qcff_t *p_qcff,
+        const qcff_face_engines_t *p_engines, qcff_roi_t *p_roi,
+        uint32_t face_index, const FACEINFO *p_face_info,
+        qcff_parts_cache_t **pp_parts);
+static int qcff_detect_contour(const qcff_face_engines_t *p_engines,
+        const qcff_roi_t *p_roi, qcff_parts_cache_t *p_parts);
+static void qcff_map_roi_point(qcff_t *p_qcff, const qcff_roi_t *p_roi,
+        POINT *p_point);
+static int qcff_ingest(qcff_t *p_qcff, uint8_t *p_frame, uint32_t scale_q8,
+        uint8_t *p_dst);
+static uint8_t *qcff_signature(qcff_t *p_qcff, const uint8_t *p_image,
+        uint32_t width, uint32_t height, uint32_t stride, uint8_t *p_sig);
+static uint8_t qcff_motion_update(qcff_t *p_qcff);
+static void qcff_motion_faces(qcff_t *p_qcff);
+static int qcff_use_scale(qcff_t *p_qcff, uint32_t scale_q8);
+static void qcff_adapt(qcff_t *p_qcff, uint32_t elapsed_us);
+static uint32_t qcff_isqrt(uint64_t value);
+static int qcff_reconfig(qcff_t *p_qcff, qcff_config_t *p_cfg);
+static int qcff_arena_setup(qcff_t *p_qcff);
+static uint8_t *qcff_arena_carve(qcff_arena_t *p_arena, uint32_t size);
+static int qcff_collect_info(qcff_t *p_qcff, uint32_t num_faces_queried,
+        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
+        qcff_complete_face_info_t *p_complete_info);
+static int qcff_analyze_face(qcff_t *p_qcff,
+        const qcff_face_engines_t *p_engines, qcff_roi_t *p_roi,
+        uint32_t face_index, const FACEINFO *p_face_info,
+        qcff_attr_track_t *p_track,
+        qcff_complete_face_info_t *p_complete_info, uint32_t i);
+static qcff_attr_track_t *qcff_attr_track(qcff_t *p_qcff,
+        const FACEINFO *p_face_info);
+static uint8_t qcff_attr_due(qcff_t *p_qcff, uint32_t seq, uint32_t interval);
+static qcff_recog_track_t *qcff_recog_track(qcff_t *p_qcff,
+        uint32_t face_index);
+static void qcff_recog_sweep(qcff_t *p_qcff);
+static void qcff_rank_update(qcff_t *p_qcff);
+static uint32_t qcff_rank_score(qcff_t *p_qcff, const FACEINFO *p_info,
+        uint32_t age);
+static uint8_t qcff_face_in_budget(qcff_t *p_qcff, uint32_t face_index);
+static void qcff_clear_face(qcff_complete_face_info_t *p_complete_info,
+        uint32_t i);
+static void qcff_own_engines(qcff_t *p_qcff, qcff_face_engines_t *p_engines);
+static uint8_t qcff_faces_parallel(qcff_t *p_qcff, uint32_t num_faces_queried,
+        const uint32_t *p_face_indices,
+        const qcff_complete_face_info_t *p_complete_info);
+static int qcff_collect_parallel(qcff_t *p_qcff, uint32_t num_faces_queried,
+        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
+        qcff_complete_face_info_t *p_complete_info);
+static void qcff_face_jobs_run(qcff_face_worker_t *p_worker,
+        uint32_t generation);
+static void *qcff_face_thread(void *arg);
+static int qcff_face_engines_create(qcff_face_engines_t *p_engines);
+static void qcff_face_engines_free(qcff_face_engines_t *p_engines);
+static void qcff_face_pool_free(qcff_face_pool_t *p_pool);
+static void *qcff_async_worker(void *arg);
+static int qcff_fill_result(qcff_t *p_qcff,
+        const qcff_transform_t *p_transform, qcff_frame_result_t *p_result);
+static void *qcff_pool_worker(void *arg);
+static void qcff_pool_process(qcff_pool_worker_t *p_worker,
+        qcff_pool_slot_t *p_slot, uint32_t info_mask);
+static void qcff_pool_free(qcff_pool_priv_t *p_pool);
+static INT32 qcff_dt_face_info(qcff_t *p_qcff, uint32_t face_index,
+        FACEINFO *p_info);
+static uint8_t qcff_tiles_apply(qcff_t *p_qcff);
+static int qcff_detect_tiles(qcff_t *p_qcff, uint8_t *p_timed_out);
+static int qcff_tiles_setup(qcff_t *p_qcff);
+static void qcff_tiles_run(qcff_tile_worker_t *p_worker, uint32_t generation);
+static void qcff_tile_job(qcff_tile_worker_t *p_worker, uint32_t job);
+static void *qcff_tile_thread(void *arg);
+static void qcff_tiles_merge(qcff_t *p_qcff);
+static void qcff_tiling_free(qcff_tiling_t *p_tiling);
+static uint32_t qcff_merge_faces(FACEINFO *p_found, uint32_t num_found,
+        uint32_t max_faces, FACEINFO *p_faces);
+static void qcff_face_box(const FACEINFO *p_info, int64_t *p_box);
+static uint32_t qcff_refine_scale(qcff_t *p_qcff);
+static int qcff_detect_refine(qcff_t *p_qcff, uint8_t *p_timed_out);
+static void qcff_refine_free(qcff_refine_t *p_refine);
+static void qcff_async_free(qcff_async_t *p_async);
+static int qcff_config_layout(qcff_t *p_qcff, qcff_config_t *p_cfg);
+static uint32_t qcff_format_bpp(qcff_format_t format);
+static void qcff_map_point(qcff_t *p_qcff, POINT *p_point);
+static void qcff_affine_init(qcff_affine_t *p_affine, uint32_t width,
+        uint32_t height, const qcff_transform_t *p_transform);
+static void qcff_affine_pixel(const qcff_affine_t *p_affine,
+        qcff_pixel_t *p_pixel);
+static void qcff_affine_rect(const qcff_affine_t *p_affine,
+        qcff_rect_t *p_rect);
+static void qcff_swap_pixels(qcff_pixel_t *p_pixels, const uint8_t *p_pairs,
+        uint32_t num_pairs);
+static int32_t qcff_wrap_degree(int32_t degree);
 
 /************************************************************************
  * Main exposed wrapper functions below
@@ -204,6 +867,7 @@ int qcff_get_version(uint32_t *p_version_major, uint32_t *p_version_minor) {
  ************************************************************************/
 int qcff_create(qcff_handle_t *p_handle) {
     qcff_t *p_qcff;
+    UINT8 dt_major, dt_minor;
 
     if (!p_handle)
         return QCFF_RET_FAILURE;
@@ -213,14 +877,35 @@ int qcff_create(qcff_handle_t *p_handle) {
         return QCFF_RET_NO_RESOURCE;
 
     memset((void*) p_qcff, 0, sizeof(qcff_t));
+    p_qcff->roi.face_index = -1;
+    p_qcff->params.search_step = default_params.SEARCH_DENSITY;
+    p_qcff->params.tracking_step = default_params.SEARCH_DENSITY;
+    p_qcff->params.min_face_size = default_params.MIN_FACE_SIZE;
+    p_qcff->params.max_face_size = 0;
+    p_qcff->params.max_faces = default_params.MAX_FACE_TO_DETECT;
+    p_qcff->params.accuracy = QCFF_ACCURACY_HIGH;
+    p_qcff->params.fr_threshold = __atomic_load_n(&fr_threshold_seed,
+            __ATOMIC_RELAXED);
+    p_qcff->tracking.search = QCFF_TRACKING_GRADUAL;
+    p_qcff->tracking.refresh_count = -1;
+    p_qcff->tracking.face_retry = -1;
+    p_qcff->tracking.head_retry = -1;
+    p_qcff->tracking.hold_count = -1;
+    p_qcff->tracking.move_rate = -1;
+    /* Parts detection is positioned from plain face corners, which needs
+     the version of the detector that found them */
+    if (FACEPROC_NORMAL == FACEPROC_GetDtVersion(&dt_major, &dt_minor))
+        p_qcff->dt_version = dt_major * 100;
+    else
+        p_qcff->dt_version = DTVERSION_SOFT_V5;
     qcff_config_fr(p_qcff);
     qcff_config_gb(p_qcff);
     qcff_config_ct(p_qcff);
     qcff_config_pt(p_qcff);
     qcff_config_sm(p_qcff);
-//p_qcff->frontal_rot = default_params.ROT_FRONT; May 13
-//p_qcff->half_profile_rot = default_params.ROT_HALF_PROFILE; //May 13
-//p_qcff->profile_rot = default_params.ROT_PROFILE; //May 13
+    p_qcff->frontal_rot = default_params.ROT_FRONT;
+    p_qcff->half_profile_rot = default_params.ROT_HALF_PROFILE;
+    p_qcff->profile_rot = default_params.ROT_PROFILE;
     QCFF_LOG("qcff_create: succeeded 0x%p", p_qcff);
     /* Output the new engine */
     *p_handle = (qcff_t *) p_qcff;
@@ -261,1477 +946,5351 @@ int qcff_set_detect_rot(qcff_handle_t handle, uint32_t frontal,
     qcff_t *p_qcff = (qcff_t *) handle;
     int rc;
 
-    if (!p_qcff)
+    if (!p_qcff || ((frontal | half_profile | profile) & ~ROT_ANGLE_ALL)
+            || !(frontal | half_profile | profile))
         return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
 
     p_qcff->frontal_rot = (uint32_t) frontal;
     p_qcff->half_profile_rot = (uint32_t) half_profile;
     p_qcff->profile_rot = (uint32_t) profile;
-    return QCFF_RET_SUCCESS;
+    if (!p_qcff->hdt)
+        return QCFF_RET_SUCCESS;
+    return qcff_update_dt_angles(p_qcff);
 }
 
 /*************************************************************************
- * qcff_config
+ * qcff_set_detect_rot_auto
  *
- * This function provides mandatory configurations to the QCFF instance.
- * It includes the input image resolution (width and height). QCFF will
- * read all subsequent inputs assuming the same resolution. It currently
- * assumes and accepts only 8-bit grayscale images.
+ * This function turns the orientation driven angles on or off. When on,
+ * the angles of qcff_set_detect_rot are relative to the upright of the
+ * display and turned into the frame by the orientation given with
+ * qcff_set_orientation, or with each submitted frame. The detector is
+ * reprogrammed when the orientation changes, not rebuilt.
  *
- * INPUT:        handle     Handle to QCFF instance created previously.
- *               p_cfg      Pointer to the configuration structure.
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               enable       Nonzero for on.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_FAILURE
  ************************************************************************/
-int qcff_config(qcff_handle_t handle, qcff_config_t *p_cfg) {
+int qcff_set_detect_rot_auto(qcff_handle_t handle, uint32_t enable) {
     qcff_t *p_qcff = (qcff_t *) handle;
-    int rc = QCFF_RET_FAILURE;
-
-    if (!p_qcff) {
-        QCFF_LOG("QCCameraSDKConfig falsed initialy");
-        return QCFF_RET_FAILURE;
-    }
-
-    /* Experimental feature: downscale processing */
-    if (p_cfg->downscale_factor != 2 && p_cfg->downscale_factor != 4)
-        p_cfg->downscale_factor = 1;
-    p_qcff->downscale_factor = p_cfg->downscale_factor;
-
-    QCFF_LOG("QCCameraSDKConfig width x height %d x %d",
-            p_cfg->width, p_cfg->height);
-    /* Delete local frame buffer */
-    if (p_qcff->p_local_frame)
-        free(p_qcff->p_local_frame);
-    p_qcff->p_local_frame = (uint8_t *) malloc(p_cfg->width * p_cfg->height);
 
-    if (p_qcff->p_local_frame == 0) {
-        QCFF_LOG("p_local_frame malloc failed");
-        return QCFF_RET_FAILURE;
-    }
+    if (!p_qcff)
+        return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
 
-    rc = qcff_config_dt(p_qcff, p_cfg);
+    p_qcff->rot_auto = enable ? TRUE : FALSE;
+    if (!p_qcff->hdt)
+        return QCFF_RET_SUCCESS;
+    return qcff_update_dt_angles(p_qcff);
+}
 
-    if (QCFF_FAILED(rc)) {
-        QCFF_LOG("QCFF_config failed");
-        return QCFF_RET_FAILURE;
-    }
-    p_qcff->local_frame_size = p_cfg->width * p_cfg->height;
+/*************************************************************************
+ * qcff_set_orientation
+ *
+ * This function gives the orientation of the following frames on
+ * display, as in qcff_transform_t. It only matters to the orientation
+ * driven angles and is applied with the next frame.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               rotation     Clockwise rotation: 0, 90, 180 or 270.
+ *               mirrored     Nonzero when the frame is mirrored first.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_set_orientation(qcff_handle_t handle, uint32_t rotation,
+        uint32_t mirrored) {
+    qcff_t *p_qcff = (qcff_t *) handle;
 
-    /* Save the input frame dimension */
-    p_qcff->frame_width = p_cfg->width;
-    p_qcff->frame_height = p_cfg->height;
+    if (!p_qcff || (rotation % 90) || rotation >= 360)
+        return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
 
+    p_qcff->orient_rotation = rotation;
+    p_qcff->orient_mirrored = mirrored;
     return QCFF_RET_SUCCESS;
-} //KEEP
+}
 
 /*************************************************************************
- * qcff_set_frame
+ * qcff_set_downscale
  *
- * This function provides the input to the QCFF instance. A local copy of
- * the frame will be made and therefore the input frame can be released
- * and altered freely after this call is finished.
+ * This function changes the factor the following frames are downscaled
+ * by, keeping the detection handles.
  *
- * INPUT:        handle     Handle to QCFF instance created previously.
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               factor_q8    Downscale factor in 8.8 fixed point.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
  ************************************************************************/
-int qcff_set_frame(qcff_handle_t handle, uint8_t *p_frame) {
-#ifdef PROFILING
-    struct timeval t1, t2;
-    int diff;
-    static FILE* fdump = NULL;
-    static int cnt = 0;
-#endif
-
+int qcff_set_downscale(qcff_handle_t handle, uint32_t factor_q8) {
     qcff_t *p_qcff = (qcff_t *) handle;
-    int rc;
 
-    if (!p_qcff || !p_frame)
+    if (!p_qcff || factor_q8 < QCFF_SCALE_ONE || factor_q8 > QCFF_SCALE_MAX)
         return QCFF_RET_INVALID_PARM;
-    if (p_frame == 0) {
-        LOG("p_frame is 0");
-    }
-
-#ifdef PROFILING
-    gettimeofday(&t1, NULL);
-#endif
-    /* Experimental feature: downscale processing */
-    if (p_qcff->downscale_factor != 1) {
-        uint8_t *p_src = p_frame;
-        uint8_t *p_dest = p_qcff->p_local_frame;
-        uint32_t j = p_qcff->frame_height / p_qcff->downscale_factor;
-        uint32_t i_cache = p_qcff->frame_width / p_qcff->downscale_factor;
-        if (p_qcff->downscale_factor == 2) {
-            while (j--) {
-                uint32_t i = i_cache;
-                while (i--) {
-                    *p_dest++ = *p_src++;
-                    p_src++;
-                }
-                p_src = p_src + p_qcff->frame_width;
-            }
-        } else if (p_qcff->downscale_factor == 4) {
-            while (j--) {
-                uint32_t i = i_cache;
-                while (i--) {
-                    *p_dest++ = *p_src++;
-                    p_src++;
-                    p_src++;
-                    p_src++;
-                }
-                p_src = p_src + p_qcff->frame_width * 3;
-            }
-        }
-    } else {
-        /* Make a copy of the frame */
-//QCFF_LOG("Before memcopy wxh %d %d", p_qcff->frame_width, p_qcff->frame_height);
-        memcpy((void *) p_qcff->p_local_frame, (void *) p_frame,
-                p_qcff->frame_width * p_qcff->frame_height);
-    }
-
-//LOG("After memcopy");
-    /* Do detection */
-    rc = FACEPROC_Detection(p_qcff->hdt, (RAWIMAGE *) p_qcff->p_local_frame,
-            p_qcff->frame_width / p_qcff->downscale_factor,
-            p_qcff->frame_height / p_qcff->downscale_factor, ACCURACY_HIGH_TR,
-            p_qcff->hdt_result);
-//LOG("Ater FQCEPROC_Detection");
-
-    if (rc != FACEPROC_NORMAL) {
-        QCFF_LOG("FACEPROC_Detection returned %d %d",
-                (uint32_t)rc, p_qcff->frame_width);
-        return QCFF_RET_FAILURE;
-    }
-#ifdef PROFILING
-    gettimeofday(&t2, NULL);
-    diff = (t2.tv_sec - t1.tv_sec) * 1000 + (t2.tv_usec - t1.tv_usec) / 1000;
-    QCFF_LOG("set frame: detection takes: %d ms", diff);
-#if 0
-    if (fdump == NULL) {
-        fdump = fopen("/data/data/com.android.qcurf/data/dump.csv", "w");
-    } else {
-        cnt++;
-        if (cnt < 350 && cnt > 50) {
-            fprintf(fdump, "%d,%d\n", cnt, diff);
-        } else if (cnt == 350) {
-            fclose(fdump);
-        }
-    }
-#endif
-#endif
-
-    /* Get the number of faces */
-    rc = FACEPROC_GetDtFaceCount(p_qcff->hdt_result,
-            (INT32*) &p_qcff->num_faces);
-//QCFF_LOG("After FACEPROC_GetDT... %d", rc);
-    if (rc != FACEPROC_NORMAL) {
-        QCFF_LOG("FACEPROC_GetDtFaceCount returned %d", (uint32_t)rc);
-        return QCFF_RET_FAILURE;
-    }
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
 
+    p_qcff->adapt.min_face_size = 0;
+    p_qcff->next_scale_q8 = factor_q8;
     return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_set_mode
+ * qcff_set_adaptive_downscale
  *
- * This function sets the optional parameter: detection mode.
- * It should be configured differently when QCFF is used in still image
- * vs video sequence scenario. If unset, default is QCFF_MODE_VIDEO.
+ * This function turns the adaptive downscale controller on or off. The
+ * controller runs after each detection, see qcff_adapt.
  *
- * INPUT:        handle     Handle to QCFF instance created previously.
+ * INPUT:        handle         Handle to QCFF instance created previously.
+ *               min_face_size  Smallest face of interest, 0 for off.
+ *               target_time_us Detection time budget, 0 for none.
+ *               max_factor_q8  Largest factor, 0 for QCFF_SCALE_MAX.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
  ************************************************************************/
-int qcff_set_mode(qcff_handle_t handle, qcff_mode_t mode) {
+int qcff_set_adaptive_downscale(qcff_handle_t handle, uint32_t min_face_size,
+        uint32_t target_time_us, uint32_t max_factor_q8) {
     qcff_t *p_qcff = (qcff_t *) handle;
-    int rc;
 
-    if (!p_qcff || mode >= QCFF_MODE_MAX)
+    if (!p_qcff || (max_factor_q8
+            && (max_factor_q8 < QCFF_SCALE_ONE || max_factor_q8 > QCFF_SCALE_MAX)))
         return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
 
-    p_qcff->mode = mode;
+    memset(&p_qcff->adapt, 0, sizeof(qcff_adapt_t));
+    p_qcff->adapt.min_face_size = min_face_size;
+    p_qcff->adapt.target_us = target_time_us;
+    p_qcff->adapt.max_scale_q8 = max_factor_q8 ? max_factor_q8 : QCFF_SCALE_MAX;
     return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_get_num_faces
+ * qcff_get_downscale
  *
- * This function retrieves the number of detected faces in the frame
- * received in the last 'qcff_set_frame' call.
+ * This function retrieves the factor the last frame was processed at.
  *
- * INPUT:        handle     Handle to QCFF instance created previously.
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ * OUTPUT:       p_factor_q8  Downscale factor in 8.8 fixed point.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
  ************************************************************************/
-int qcff_get_num_faces(qcff_handle_t handle, uint32_t *p_num_faces) {
+int qcff_get_downscale(qcff_handle_t handle, uint32_t *p_factor_q8) {
     qcff_t *p_qcff = (qcff_t *) handle;
-    int rc;
 
-    if (!p_qcff || !p_num_faces)
+    if (!p_qcff || !p_factor_q8)
         return QCFF_RET_INVALID_PARM;
 
-    *p_num_faces = p_qcff->num_faces;
+    *p_factor_q8 = p_qcff->scale_q8;
     return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_get_rects
- *
- * This function retrieves the rectangles of the detected faces. It
- * allows multiple faces to be retrieved by taking an array of face
- * indices corresponding to the face rectangles requested. The output
- * will be an array of face rectangles in the type of qcff_face_rect_t.
- * The face indices are zero-based and should be between 0 to the
- * number of detected faces - 1.
+ * qcff_set_static_skip
  *
- * INPUT:        handle               Handle to QCFF instance created
- *                                    previously.
- *               num_faces_queried    The number of faces being queried.
- *                                    (it determines how many entries in
- *                                    p_face_indices to be read)
- *               p_face_indices       The indices of the faces in which
- *                                    the rectangle information is
- *                                    requested. Whenever an invalid
- *                                    face index is encountered, the
- *                                    function call ends.
- *                                    p_num_faces_returned indicates how
- *                                    many faces are returned before
- *                                    the error happened.
- * OUTPUT:       p_num_faces_returned Returns the actual number of
- *                                    entries returned. It might be
- *                                    less than the number of faces queried
- *                                    if the number queried is actually
- *                                    more than the available faces.
- *               p_face_rects         The face rectangles outputted.
+ * This function turns the static scene skipping on or off. Frames are
+ * compared with the one detection last ran on, see qcff_detect.
  *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               threshold    Largest block mean change, 0 for off.
+ *               max_skip     Consecutive frames skipped at most, 0 for no
+ *                            limit.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
  ************************************************************************/
-int qcff_get_rects(qcff_handle_t handle, uint32_t num_faces_queried,
-        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
-        qcff_face_rect_t *p_face_rects) {
-    qcff_complete_face_info_t complete_info = empty_info;
+int qcff_set_static_skip(qcff_handle_t handle, uint32_t threshold,
+        uint32_t max_skip) {
+    qcff_t *p_qcff = (qcff_t *) handle;
 
-    if (!p_face_rects)
+    if (!p_qcff)
         return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
 
-    complete_info.p_rects = p_face_rects;
-
-    return qcff_get_complete_info(handle, num_faces_queried, p_face_indices,
-            p_num_faces_returned, &complete_info);
+    p_qcff->skip.threshold = threshold;
+    p_qcff->skip.max_skip = max_skip;
+    p_qcff->skip.run = 0;
+    p_qcff->skip.ref_valid = FALSE;
+    return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_get_parts
- *
- * This function retrieves the facial parts of the detected faces. It
- * allows multiple faces to be retrieved by taking an array of face
- * indices corresponding to the faces requested. The output
- * will be an array of facial parts in the type of qcff_face_parts_t.
- * The face indices are zero-based and should be between 0 to the
- * number of detected faces - 1.
+ * qcff_get_skip_stats
  *
- * INPUT:        handle               Handle to QCFF instance created
- *                                    previously.
- *               num_faces_queried    The number of faces being queried.
- *                                    (it determines how many entries in
- *                                    p_face_indices to be read)
- *               p_face_indices       The indices of the faces in which
- *                                    the facial parts information is
- *                                    requested. Whenever an invalid
- *                                    face index is encountered, the
- *                                    function call ends.
- *                                    p_num_faces_returned indicates how
- *                                    many faces are returned before
- *                                    the error happened.
- * OUTPUT:       p_num_faces_returned Returns the actual number of
- *                                    entries returned. It might be
- *                                    less than the number of faces queried
- *                                    if the number queried is actually
- *                                    more than the available faces.
- *               p_face_parts         The facial parts outputted.
+ * This function retrieves the static scene skipping counters. It may be
+ * called while the asynchronous worker runs.
  *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ * OUTPUT:       p_stats      The counters.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
  ************************************************************************/
-int qcff_get_parts(qcff_handle_t handle, uint32_t num_faces_queried,
-        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
-        qcff_face_parts_t *p_face_parts) {
-    qcff_complete_face_info_t complete_info = empty_info;
+int qcff_get_skip_stats(qcff_handle_t handle, qcff_skip_stats_t *p_stats) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+    qcff_skip_stats_t *p_src;
 
-    if (!p_face_parts)
+    if (!p_qcff || !p_stats)
         return QCFF_RET_INVALID_PARM;
 
-    complete_info.p_parts = p_face_parts;
-
-    return qcff_get_complete_info(handle, num_faces_queried, p_face_indices,
-            p_num_faces_returned, &complete_info);
+    p_src = &p_qcff->skip.stats;
+    p_stats->frames_detected = __atomic_load_n(&p_src->frames_detected,
+            __ATOMIC_RELAXED);
+    p_stats->frames_skipped = __atomic_load_n(&p_src->frames_skipped,
+            __ATOMIC_RELAXED);
+    p_stats->last_skipped = __atomic_load_n(&p_src->last_skipped,
+            __ATOMIC_RELAXED);
+    return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_get_parts_ex
+ * qcff_set_motion_roi
  *
- * This function retrieves the extended facial parts of the detected faces.
- * It allows multiple faces to be retrieved by taking an array of face
- * indices corresponding to the faces requested. The output
- * will be an array of facial parts in the type of qcff_face_parts_ex_t.
- * The face indices are zero-based and should be between 0 to the
- * number of detected faces - 1.
- *
- * INPUT:        handle               Handle to QCFF instance created
- *                                    previously.
- *               num_faces_queried    The number of faces being queried.
- *                                    (it determines how many entries in
- *                                    p_face_indices to be read)
- *               p_face_indices       The indices of the faces in which
- *                                    the facial parts information is
- *                                    requested. Whenever an invalid
- *                                    face index is encountered, the
- *                                    function call ends.
- *                                    p_num_faces_returned indicates how
- *                                    many faces are returned before
- *                                    the error happened.
- * OUTPUT:       p_num_faces_returned Returns the actual number of
- *                                    entries returned. It might be
- *                                    less than the number of faces queried
- *                                    if the number queried is actually
- *                                    more than the available faces.
- *               p_face_parts_ex      The extended facial parts outputted.
+ * This function turns the motion guided detection masks on or off. New
+ * faces are searched for where the frame changed since detection last
+ * ran, tracked faces around their last position, see qcff_motion_update.
  *
+ * INPUT:        handle              Handle to QCFF instance created
+ *                                   previously.
+ *               threshold           Block mean change marking a block as
+ *                                   moving, 0 for off.
+ *               full_scan_interval  Frames between two full scans, 0 for
+ *                                   QCFF_MOTION_FULL_SCAN.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
  ************************************************************************/
-int qcff_get_parts_ex(qcff_handle_t handle, uint32_t num_faces_queried,
-        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
-        qcff_face_parts_ex_t *p_face_parts_ex) {
-    qcff_complete_face_info_t complete_info = empty_info;
+int qcff_set_motion_roi(qcff_handle_t handle, uint32_t threshold,
+        uint32_t full_scan_interval) {
+    qcff_t *p_qcff = (qcff_t *) handle;
 
-    if (!p_face_parts_ex)
+    if (!p_qcff)
         return QCFF_RET_INVALID_PARM;
-
-    complete_info.p_parts_ex = p_face_parts_ex;
-
-    return qcff_get_complete_info(handle, num_faces_queried, p_face_indices,
-            p_num_faces_returned, &complete_info);
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
+
+    p_qcff->motion.threshold = threshold;
+    p_qcff->motion.full_scan_interval = full_scan_interval ?
+            full_scan_interval : QCFF_MOTION_FULL_SCAN;
+    p_qcff->motion.since_full_scan = 0;
+    p_qcff->motion.masked = FALSE;
+    p_qcff->motion.faces.dx = 0;
+    p_qcff->skip.ref_valid = FALSE;
+    return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_get_smiles
- *
- * This function retrieves the smile degree of the detected faces. It
- * allows multiple faces to be retrieved by taking an array of face
- * indices corresponding to the faces requested. The output
- * will be an array of smile degrees. The smile degree ranges from
- * 0 to 100 with 0 being the lowest smile degree.
- * The face indices are zero-based and should be between 0 to the
- * number of detected faces - 1.
+ * qcff_get_mem_stats
  *
- * INPUT:        handle               Handle to QCFF instance created
- *                                    previously.
- *               num_faces_queried    The number of faces being queried.
- *                                    (it determines how many entries in
- *                                    p_face_indices to be read)
- *               p_face_indices       The indices of the faces in which
- *                                    the facial parts information is
- *                                    requested. Whenever an invalid
- *                                    face index is encountered, the
- *                                    function call ends.
- *                                    p_num_faces_returned indicates how
- *                                    many faces are returned before
- *                                    the error happened.
- * OUTPUT:       p_num_faces_returned Returns the actual number of
- *                                    entries returned. It might be
- *                                    less than the number of faces queried
- *                                    if the number queried is actually
- *                                    more than the available faces.
- *               p_smile_degrees      The smile degrees outputted.
- *                                    They range from 0 to 100.
+ * This function retrieves the memory used by the handle for the current
+ * configuration.
  *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ * OUTPUT:       p_stats      The memory figures.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
  ************************************************************************/
-int qcff_get_smiles(qcff_handle_t handle, uint32_t num_faces_queried,
-        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
-        uint32_t *p_smile_degrees) {
-    qcff_complete_face_info_t complete_info = empty_info;
+int qcff_get_mem_stats(qcff_handle_t handle, qcff_mem_stats_t *p_stats) {
+    qcff_t *p_qcff = (qcff_t *) handle;
 
-    if (!p_smile_degrees)
+    if (!p_qcff || !p_stats)
         return QCFF_RET_INVALID_PARM;
 
-    complete_info.p_smile_degrees = p_smile_degrees;
-
-    return qcff_get_complete_info(handle, num_faces_queried, p_face_indices,
-            p_num_faces_returned, &complete_info);
+    p_stats->arena_size = p_qcff->arena.size;
+    p_stats->arena_used = p_qcff->arena.used;
+    p_stats->arena_peak = p_qcff->arena.peak;
+    p_stats->dt_backup_size = p_qcff->dt_backup_size;
+    p_stats->dt_work_min_size = p_qcff->dt_work_min_size;
+    p_stats->dt_work_max_size = p_qcff->dt_work_max_size;
+    return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_get_eye_opens
+ * qcff_get_params
  *
- * This function retrieves the eye open-close degree of the detected faces.
- * It allows multiple faces to be retrieved by taking an array of face
- * indices corresponding to the faces requested. The output
- * will be an array of eye open-close degrees. They range from 0 to 100
- * with 0 meaning complete close of the eye.
- * The face indices are zero-based and should be between 0 to the
- * number of detected faces - 1.
- *
- * INPUT:        handle               Handle to QCFF instance created
- *                                    previously.
- *               num_faces_queried    The number of faces being queried.
- *                                    (it determines how many entries in
- *                                    p_face_indices to be read)
- *               p_face_indices       The indices of the faces in which
- *                                    the facial parts information is
- *                                    requested. Whenever an invalid
- *                                    face index is encountered, the
- *                                    function call ends.
- *                                    p_num_faces_returned indicates how
- *                                    many faces are returned before
- *                                    the error happened.
- * OUTPUT:       p_num_faces_returned Returns the actual number of
- *                                    entries returned. It might be
- *                                    less than the number of faces queried
- *                                    if the number queried is actually
- *                                    more than the available faces.
- *               p_eye_open_degrees   The eye open-close degree outputted.
+ * This function retrieves the detection parameters of the handle.
  *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ * OUTPUT:       p_params     The parameters.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
  ************************************************************************/
-int qcff_get_eye_opens(qcff_handle_t handle, uint32_t num_faces_queried,
-        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
-        qcff_eye_open_deg_t *p_eye_open_degrees) {
-    qcff_complete_face_info_t complete_info = empty_info;
+int qcff_get_params(qcff_handle_t handle, qcff_params_t *p_params) {
+    qcff_t *p_qcff = (qcff_t *) handle;
 
-    if (!p_eye_open_degrees)
+    if (!p_qcff || !p_params)
         return QCFF_RET_INVALID_PARM;
 
-    complete_info.p_eye_open_degrees = p_eye_open_degrees;
-
-    return qcff_get_complete_info(handle, num_faces_queried, p_face_indices,
-            p_num_faces_returned, &complete_info);
+    *p_params = p_qcff->params;
+    return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_get_gaze_degs
- *
- * This function retrieves the gaze degree of the detected faces.
- * It allows multiple faces to be retrieved by taking an array of face
- * indices corresponding to the faces requested. The output
- * will be an array of gaze degrees. They range from -90 to 90 for
- * both the left-right and up-down plane.
- * The face indices are zero-based and should be between 0 to the
- * number of detected faces - 1.
+ * qcff_set_params
  *
- * INPUT:        handle               Handle to QCFF instance created
- *                                    previously.
- *               num_faces_queried    The number of faces being queried.
- *                                    (it determines how many entries in
- *                                    p_face_indices to be read)
- *               p_face_indices       The indices of the faces in which
- *                                    the gaze degree information is
- *                                    requested. Whenever an invalid
- *                                    face index is encountered, the
- *                                    function call ends.
- *                                    p_num_faces_returned indicates how
- *                                    many faces are returned before
- *                                    the error happened.
- * OUTPUT:       p_num_faces_returned Returns the actual number of
- *                                    entries returned. It might be
- *                                    less than the number of faces queried
- *                                    if the number queried is actually
- *                                    more than the available faces.
- *               p_gaze_degrees       The gaze degree outputted.
+ * This function sets the detection parameters of the handle and programs
+ * them into the detector when the handle is configured. On failure the
+ * previous parameters are restored.
  *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               p_params     The parameters.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_FAILURE
  ************************************************************************/
-int qcff_get_gaze_degs(qcff_handle_t handle, uint32_t num_faces_queried,
-        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
-        qcff_gaze_deg_t *p_gaze_degrees) {
-    qcff_complete_face_info_t complete_info = empty_info;
+int qcff_set_params(qcff_handle_t handle, const qcff_params_t *p_params) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+    qcff_params_t previous;
+    int rc;
 
-    if (!p_gaze_degrees)
+    if (!p_qcff || !p_params
+            || p_params->search_step < 1 || p_params->search_step > 100
+            || p_params->tracking_step < 1 || p_params->tracking_step > 100
+            || p_params->min_face_size < default_params.MIN_FACE_SIZE
+            || (p_params->max_face_size
+                    && p_params->max_face_size < p_params->min_face_size)
+            || p_params->max_faces < 1
+            || p_params->max_faces > QCFF_MAX_RESULT_FACES
+            || p_params->threshold < 0 || p_params->threshold > 1000
+            || p_params->tracking_threshold < 0
+            || p_params->tracking_threshold > 1000
+            || p_params->accuracy >= QCFF_ACCURACY_MAX
+            || p_params->fr_threshold < 0 || p_params->fr_threshold > 1000)
         return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
 
-    complete_info.p_gaze_degrees = p_gaze_degrees;
+    previous = p_qcff->params;
+    p_qcff->params = *p_params;
+    p_qcff->setup_seq++;
+    if (!p_qcff->hdt)
+        return QCFF_RET_SUCCESS;
 
-    return qcff_get_complete_info(handle, num_faces_queried, p_face_indices,
-            p_num_faces_returned, &complete_info);
+    rc = qcff_apply_dt_params(p_qcff);
+    if (QCFF_FAILED(rc)) {
+        p_qcff->params = previous;
+        qcff_apply_dt_params(p_qcff);
+    }
+    return rc;
 }
 
 /*************************************************************************
- * qcff_get_directions
+ * qcff_get_tracking
  *
- * This function retrieves the face directions of the detected faces.
- * It allows multiple faces to be retrieved by taking an array of face
- * indices corresponding to the faces requested. The output
- * will be an array of face directions.
- * The face indices are zero-based and should be between 0 to the
- * number of detected faces - 1.
-
- * INPUT:        handle               Handle to QCFF instance created
- *                                    previously.
- *               num_faces_queried    The number of faces being queried.
- *                                    (it determines how many entries in
- *                                    p_face_indices to be read)
- *               p_face_indices       The indices of the faces in which
- *                                    the facial parts information is
- *                                    requested. Whenever an invalid
- *                                    face index is encountered, the
- *                                    function call ends.
- *                                    p_num_faces_returned indicates how
- *                                    many faces are returned before
- *                                    the error happened.
- * OUTPUT:       p_num_faces_returned Returns the actual number of
- *                                    entries returned. It might be
- *                                    less than the number of faces queried
- *                                    if the number queried is actually
- *                                    more than the available faces.
- *               p_face_directions    The face directions outputted.
-
+ * This function retrieves the tracking policy of the handle.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ * OUTPUT:       p_tracking   The policy.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
  ************************************************************************/
-int qcff_get_directions(qcff_handle_t handle, uint32_t num_faces_queried,
-        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
-        qcff_face_dir_t *p_face_directions) {
-    qcff_complete_face_info_t complete_info = empty_info;
+int qcff_get_tracking(qcff_handle_t handle, qcff_tracking_t *p_tracking) {
+    qcff_t *p_qcff = (qcff_t *) handle;
 
-    if (!p_face_directions)
+    if (!p_qcff || !p_tracking)
         return QCFF_RET_INVALID_PARM;
 
-    complete_info.p_directions = p_face_directions;
-
-    return qcff_get_complete_info(handle, num_faces_queried, p_face_indices,
-            p_num_faces_returned, &complete_info);
+    *p_tracking = p_qcff->tracking;
+    return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_get_complete_info
+ * qcff_set_tracking
  *
- * This function retrieves the all possible information about each face
- * such as locations, directions, smile degrees, eye open-close degrees, etc.
- * It allows multiple faces to be retrieved by taking an array of face
- * indices corresponding to the information requested. The output
- * is an array for a structure containing pointers to various information
- * of the face. For each face, user can select a subset of information to
- * retrieve by providing valid pointers to those information in interest.
- * For other pointers, they can be set to NULL. The function will skip
- * for pointers that are NULL. The face indices are zero-based and should be
- * between 0 to the number of detected faces - 1.
-
- * INPUT:        handle               Handle to QCFF instance created
- *                                    previously.
- *               num_faces_queried    The number of faces being queried.
- *                                    (it determines how many entries in
- *                                    p_face_indices to be read)
- *               p_face_indices       The indices of the faces in which
- *                                    the complete information is
- *                                    requested. Whenever an invalid
- *                                    face index is encountered, the
- *                                    function call ends.
- *                                    p_num_faces_returned indicates how
- *                                    many faces are returned before
- *                                    the error happened.
- * OUTPUT:       p_num_faces_returned Returns the actual number of
- *                                    entries returned. It might be
- *                                    less than the number of faces queried
- *                                    if the number queried is actually
- *                                    more than the available faces.
- *               p_complete_info      The complete infos outputted.
-
+ * This function sets the tracking policy of the handle. A configured
+ * video mode detector is reprogrammed, see qcff_apply_dt_tracking; the
+ * engine checks the ranges of the counts.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               p_tracking   The policy.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_FAILURE
  ************************************************************************/
-int qcff_get_complete_info(qcff_handle_t handle, uint32_t num_faces_queried,
-        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
-        qcff_complete_face_info_t *p_complete_info) {
+int qcff_set_tracking(qcff_handle_t handle, const qcff_tracking_t *p_tracking) {
     qcff_t *p_qcff = (qcff_t *) handle;
+    qcff_tracking_t previous;
     int rc;
-    uint32_t i, j;
 
-    /*if (!p_qcff || !p_complete_info || !p_face_indices || !p_num_faces_returned)
-     return QCFF_RET_INVALID_PARM;*/
+    if (!p_qcff || !p_tracking
+            || (uint32_t) p_tracking->search >= QCFF_TRACKING_MAX)
+        return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
 
-    /* Loop through each requested face */
-    for (i = 0; i < num_faces_queried; i++) {
+    previous = p_qcff->tracking;
+    p_qcff->tracking = *p_tracking;
+    p_qcff->setup_seq++;
+    if (!p_qcff->hdt)
+        return QCFF_RET_SUCCESS;
 
-        /* Face Rectangle requested */
-        if (p_complete_info->p_rects) {
-            FACEINFO face_info;
+    rc = qcff_apply_dt_tracking(p_qcff);
+    if (QCFF_FAILED(rc)) {
+        p_qcff->tracking = previous;
+        qcff_apply_dt_tracking(p_qcff);
+    }
+    return rc;
+}
 
-            if (FACEPROC_NORMAL
-                    != FACEPROC_GetDtFaceInfo(p_qcff->hdt_result,
-                            p_face_indices[i], &face_info))
-                break;
-            /* Experimental feature: downscale processing */
-            if (p_qcff->downscale_factor != 1) {
-                face_info.ptLeftTop.x *= p_qcff->downscale_factor;
-                face_info.ptLeftTop.y *= p_qcff->downscale_factor;
-                face_info.ptRightTop.x *= p_qcff->downscale_factor;
-                face_info.ptRightTop.y *= p_qcff->downscale_factor;
-                face_info.ptLeftBottom.x *= p_qcff->downscale_factor;
-                face_info.ptLeftBottom.y *= p_qcff->downscale_factor;
-                face_info.ptRightBottom.x *= p_qcff->downscale_factor;
-                face_info.ptRightBottom.y *= p_qcff->downscale_factor;
-            }
-
-            qcff_translate_face_info_to_rect(&face_info,
-                    &(p_complete_info->p_rects[i]));
-        }
-
-        /* Perform parts detection of any other info requested */
-        if (p_complete_info->p_parts || p_complete_info->p_parts_ex
-                || p_complete_info->p_smile_degrees
-                || p_complete_info->p_gaze_degrees
-                || p_complete_info->p_eye_open_degrees
-                || p_complete_info->p_directions) {
-
-            /* Set face location to parts detection handle */
-            if (FACEPROC_NORMAL
-                    != FACEPROC_PT_SetPositionFromHandle(p_qcff->hpt,
-                            p_qcff->hdt_result, p_face_indices[i]))
-                break;
-
-            /* Do parts detection */
-            if (FACEPROC_NORMAL
-                    != FACEPROC_PT_DetectPoint(p_qcff->hpt,
-                            (RAWIMAGE *) p_qcff->p_local_frame,
-                            p_qcff->frame_width / p_qcff->downscale_factor,
-                            p_qcff->frame_height / p_qcff->downscale_factor,
-                            p_qcff->hpt_result))
-                break;
-
-            /* Extract parts information if requested */
-            if (p_complete_info->p_parts) {
-                POINT points[QCFF_PARTS_MAX];
-                INT32 confs[QCFF_PARTS_MAX];
-
-                if (FACEPROC_NORMAL
-                        != FACEPROC_PT_GetResult(p_qcff->hpt_result,
-                                QCFF_PARTS_MAX, points, confs))
-                    break;
-
-                for (j = 0; j < QCFF_PARTS_MAX; j++) {
-                    p_complete_info->p_parts[i].parts[j].x = points[j].x
-                            * p_qcff->downscale_factor;
-                    p_complete_info->p_parts[i].parts[j].y = points[j].y
-                            * p_qcff->downscale_factor;
-                }
-            }
-
-            /* Extract Face Direction */
-            if (p_complete_info->p_directions) {
-                if (FACEPROC_NORMAL
-                        != FACEPROC_PT_GetFaceDirection(p_qcff->hpt_result,
-                                (INT32*) &p_complete_info->p_directions[i].up_down_in_degree,
-                                (INT32*) &p_complete_info->p_directions[i].left_right_in_degree,
-                                (INT32*) &p_complete_info->p_directions[i].roll_in_degree))
-                    break;
-
-            }
-
-            /* Extract extended parts information if requested */
-            if (p_complete_info->p_parts_ex) {
-                POINT points[QCFF_PARTS_EX_MAX];
-
-                if (FACEPROC_NORMAL
-                        != FACEPROC_CT_SetPointFromHandle(p_qcff->hct,
-                                p_qcff->hpt_result))
-                    break;
-                if (FACEPROC_NORMAL
-                        != FACEPROC_CT_DetectContour(p_qcff->hct,
-                                p_qcff->p_local_frame,
-                                p_qcff->frame_width / p_qcff->downscale_factor,
-                                p_qcff->frame_height / p_qcff->downscale_factor,
-                                p_qcff->hct_result))
-                    break;
-                if (FACEPROC_NORMAL
-                        != FACEPROC_CT_GetResult(p_qcff->hct_result,
-                                QCFF_PARTS_EX_MAX, points))
-                    break;
-
-                for (j = 0; j < QCFF_PARTS_EX_MAX; j++) {
-                    p_complete_info->p_parts_ex[i].parts[j].x = points[j].x
-                            * p_qcff->downscale_factor;
-                    p_complete_info->p_parts_ex[i].parts[j].y = points[j].y
-                            * p_qcff->downscale_factor;
-                }
-            }
-
-            /* Perform smile degree estimation if requested */
-            if (p_complete_info->p_smile_degrees) {
-                INT32 smile_conf;
-                /* Set Smile Estimation Point from handle */
-                if (FACEPROC_NORMAL
-                        != FACEPROC_SM_SetPointFromHandle(p_qcff->hsm,
-                                p_qcff->hpt_result))
-                    break;
-
-                /* Do Smile Estimation */
-                if (FACEPROC_NORMAL
-                        != FACEPROC_SM_Estimate(p_qcff->hsm,
-                                (RAWIMAGE *) p_qcff->p_local_frame,
-                                p_qcff->frame_width / p_qcff->downscale_factor,
-                                p_qcff->frame_height / p_qcff->downscale_factor,
-                                p_qcff->hsm_result))
-                    break;
-
-                /* Extract Result */
-                if (FACEPROC_NORMAL
-                        != FACEPROC_SM_GetResult(p_qcff->hsm_result,
-                                (INT32*) &p_complete_info->p_smile_degrees[i],
-                                &smile_conf))
-                    break;
-            }
-
-            /* Perform gaze-blink estimation if requested */
-            if (p_complete_info->p_eye_open_degrees
-                    || p_complete_info->p_gaze_degrees) {
-
-                /* Set Gaze-Blink Estimation Point from handle */
-                if (FACEPROC_NORMAL
-                        != FACEPROC_GB_SetPointFromHandle(p_qcff->hgb,
-                                p_qcff->hpt_result))
-                    break;
-
-                /* Do Gaze-Blink Estimation */
-                if (FACEPROC_NORMAL
-                        != FACEPROC_GB_Estimate(p_qcff->hgb,
-                                (RAWIMAGE *) p_qcff->p_local_frame,
-                                p_qcff->frame_width / p_qcff->downscale_factor,
-                                p_qcff->frame_height / p_qcff->downscale_factor,
-                                p_qcff->hgb_result))
-                    break;
-
-                /* Extract Gaze Result */
-                if (p_complete_info->p_gaze_degrees) {
-                    if (FACEPROC_NORMAL
-                            != FACEPROC_GB_GetGazeDirection(p_qcff->hgb_result,
-                                    (INT32*) &p_complete_info->p_gaze_degrees[i].left_right,
-                                    (INT32*) &p_complete_info->p_gaze_degrees[i].up_down))
-                        break;
-                }
-                /* Extract Eye Open-Close Result */
-                if (p_complete_info->p_eye_open_degrees) {
-                    if (FACEPROC_NORMAL
-                            != FACEPROC_GB_GetEyeCloseRatio(p_qcff->hgb_result,
-                                    (INT32*) &p_complete_info->p_eye_open_degrees[i].left,
-                                    (INT32*) &p_complete_info->p_eye_open_degrees[i].right))
-                        break;
-                    p_complete_info->p_eye_open_degrees[i].left /= 10;
-                    p_complete_info->p_eye_open_degrees[i].right /= 10;
-                }
-            }
-        } /* If infos other than rectangles is needed */
-    } /* For loop on face indices */
-
-    *p_num_faces_returned = i;
-    return QCFF_RET_SUCCESS;
-}
-
-int qcff_create_feature_cache(qcff_handle_t handle, uint32_t face_index,
-        qcff_face_feature_t* p_feature) {
-    HFEATURE hfr = NULL;
+/*************************************************************************
+ * qcff_set_deadline
+ *
+ * This function sets the detection timeouts. They are programmed into a
+ * configured detector right away, see qcff_apply_dt_timeout.
+ *
+ * INPUT:        handle           Handle to QCFF instance created
+ *                                previously.
+ *               non_tracking_ms  Time to search for new faces, 0 for none.
+ *               tracking_ms      Time to track known faces, 0 for none.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_FAILURE
+ ************************************************************************/
+int qcff_set_deadline(qcff_handle_t handle, uint32_t non_tracking_ms,
+        uint32_t tracking_ms) {
     qcff_t *p_qcff = (qcff_t *) handle;
+    qcff_deadline_t previous;
     int rc;
 
-    if (!p_qcff || !p_feature)
+    if (!p_qcff || non_tracking_ms > QCFF_DEADLINE_MAX_MS
+            || tracking_ms > QCFF_DEADLINE_MAX_MS)
         return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
+
+    previous = p_qcff->deadline;
+    p_qcff->deadline.non_tracking_ms = non_tracking_ms;
+    p_qcff->deadline.tracking_ms = tracking_ms;
+    p_qcff->setup_seq++;
+    if (!p_qcff->hdt)
+        return QCFF_RET_SUCCESS;
 
-    hfr = FACEPROC_FR_CreateFeatureHandle();
-    if (!hfr)
-        return QCFF_RET_NO_RESOURCE;
-
-    rc = qcff_extract_feature(p_qcff, face_index, hfr);
-    if (QCFF_RET_SUCCESS != rc)
-        FACEPROC_FR_DeleteFeatureHandle(hfr);
-    else
-        *p_feature = (qcff_face_feature_t) hfr;
-    QCFF_LOG("Create_Feature_Cache: rc = %d hfr = %p face_index = %d",
-            rc, *p_feature, face_index);
+    rc = qcff_apply_dt_timeout(p_qcff);
+    if (QCFF_FAILED(rc))
+        p_qcff->deadline = previous;
     return rc;
 }
 
-int qcff_destroy_feature_cache(qcff_face_feature_t feature) {
-    return FACEPROC_FR_DeleteFeatureHandle((HFEATURE) feature);
-}
-
-int qcff_find_unused_user_id(qcff_t *p_qcff, uint32_t *new_user_id) {
-    int32_t user_id = 0;
-    while (1) {
-        INT32 num_data;
-        INT32 rc = FACEPROC_FR_GetRegisteredUsrDataNum(p_qcff->hal, user_id,
-                &num_data);
-        QCFF_LOG("result=%d user %d has %d data", rc, user_id, num_data);
-        if (num_data == 0) {
-            *new_user_id = (uint32_t) user_id;
-            return QCFF_RET_SUCCESS;
-        }
-        user_id++;
-    }
-    return QCFF_RET_FAILURE;
-}
-
 /*************************************************************************
- * qcff_reg_new_usr
+ * qcff_get_deadline_stats
  *
- * This function registers a new user in the internal database. It
- * requires the association of one of the detected faces. The face index
- * is zero-based and should be between 0 to the number of detected faces-1.
- * When the operation is successful, the new user ID is returned. This is
- * used to subsequently refer to this user during identification.
+ * This function retrieves the frame deadline counters. It may be called
+ * while the asynchronous worker runs.
  *
- * INPUT:        handle     Handle to QCFF instance created previously.
- *               feature    Feature obtained earlier through
- *                          qcff_create_feature_cache.
- * OUTPUT:       p_new_user_id  The user ID of the new user returned.
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ * OUTPUT:       p_stats      The counters.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
  ************************************************************************/
-int qcff_reg_new_usr(qcff_handle_t handle, qcff_face_feature_t feature,
-        uint32_t *p_new_user_id) {
+int qcff_get_deadline_stats(qcff_handle_t handle,
+        qcff_deadline_stats_t *p_stats) {
     qcff_t *p_qcff = (qcff_t *) handle;
-    HFEATURE hfr = (qcff_face_feature_t) feature;
-    int rc;
+    qcff_deadline_stats_t *p_src;
 
-    if (!p_qcff || !p_new_user_id || !hfr)
+    if (!p_qcff || !p_stats)
         return QCFF_RET_INVALID_PARM;
 
-//*p_new_user_id = p_qcff->num_registered_users;
-    qcff_find_unused_user_id(p_qcff, p_new_user_id);
-
-    /* Register the new user with the extracted feature */
-    if (FACEPROC_NORMAL
-            != FACEPROC_FR_RegisterData(p_qcff->hal, hfr, *p_new_user_id, 0))
-        return QCFF_RET_FAILURE;
-
-    p_qcff->num_registered_users++;
-    QCFF_LOG("qcff_reg_new_usr: hfr = %p successful", feature);
+    p_src = &p_qcff->deadline.stats;
+    p_stats->frames_timed_out = __atomic_load_n(&p_src->frames_timed_out,
+            __ATOMIC_RELAXED);
+    p_stats->frames_late = __atomic_load_n(&p_src->frames_late,
+            __ATOMIC_RELAXED);
+    p_stats->last_time_us = __atomic_load_n(&p_src->last_time_us,
+            __ATOMIC_RELAXED);
+    p_stats->max_time_us = __atomic_load_n(&p_src->max_time_us,
+            __ATOMIC_RELAXED);
     return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_reg_ex_usr
+ * qcff_set_tiling
  *
- * This function registers an existing user. This improves the face
- * recognition accuracy by learning faces of the same person under
- * different lighting conditions, poses and out-of-plane rotations.
+ * This function sets up the detectors and threads of tiled detection,
+ * or releases them. The detectors are configured with the first frame
+ * split into tiles.
  *
- * INPUT:        handle     Handle to QCFF instance created previously.
- *               feature    Feature obtained earlier through
- *                          qcff_create_feature_cache.
- *               user_id    The user ID of the existing user.
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               num_threads  Threads searching the tiles, up to
+ *                            QCFF_MAX_THREADS; 0 for one per CPU.
+ *               min_pixels   Smallest image split into tiles, 0 for off.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_NO_RESOURCE
  ************************************************************************/
-int qcff_reg_ex_usr(qcff_handle_t handle, qcff_face_feature_t feature,
-        uint32_t user_id) {
+int qcff_set_tiling(qcff_handle_t handle, uint32_t num_threads,
+        uint32_t min_pixels) {
     qcff_t *p_qcff = (qcff_t *) handle;
-    int rc;
-    INT32 num_data;
-    HFEATURE hfr = (qcff_face_feature_t) feature;
+    qcff_tiling_t *p_tiling;
+    long num_cpus;
+    uint32_t i;
+    int rc = QCFF_RET_SUCCESS;
 
-    if (!p_qcff || !hfr || user_id >= p_qcff->num_registered_users)
+    if (!p_qcff || num_threads > QCFF_MAX_THREADS)
         return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
+
+    /* The faces of the last detection may come from the tiles */
+    if (p_qcff->p_tiling) {
+        if (p_qcff->p_tiling->active)
+            p_qcff->num_faces = 0;
+        qcff_tiling_free(p_qcff->p_tiling);
+        p_qcff->p_tiling = NULL;
+    }
+    if (!min_pixels)
+        return QCFF_RET_SUCCESS;
 
-    /* Get current number of data as the new data ID */
-    if (FACEPROC_NORMAL
-            != FACEPROC_FR_GetRegisteredUsrDataNum(p_qcff->hal, user_id,
-                    &num_data))
-        return QCFF_RET_FAILURE;
-
-    /* Register the existing user */
-    if (FACEPROC_NORMAL
-            != FACEPROC_FR_RegisterData(p_qcff->hal, hfr, user_id, num_data))
-        return QCFF_RET_FAILURE;
+    if (!num_threads) {
+        num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (num_cpus > 0) ? (uint32_t) MIN2(num_cpus,
+                QCFF_MAX_THREADS) : 1;
+    }
+    p_tiling = (qcff_tiling_t *) malloc(sizeof(qcff_tiling_t));
+    if (!p_tiling)
+        return QCFF_RET_NO_RESOURCE;
+    memset(p_tiling, 0, sizeof(qcff_tiling_t));
+    p_tiling->min_pixels = min_pixels;
+    pthread_mutex_init(&p_tiling->lock, NULL);
+    pthread_cond_init(&p_tiling->start_cond, NULL);
+    pthread_cond_init(&p_tiling->done_cond, NULL);
+    p_tiling->p_workers = (qcff_tile_worker_t *) malloc(
+            num_threads * sizeof(qcff_tile_worker_t));
+    if (!p_tiling->p_workers) {
+        qcff_tiling_free(p_tiling);
+        return QCFF_RET_NO_RESOURCE;
+    }
+    memset(p_tiling->p_workers, 0, num_threads * sizeof(qcff_tile_worker_t));
+
+    /* The first worker is the thread detecting */
+    for (i = 0; i < num_threads; i++) {
+        qcff_tile_worker_t *p_worker = &p_tiling->p_workers[i];
+
+        p_worker->p_tiling = p_tiling;
+        rc = qcff_create(&p_worker->handle);
+        if (QCFF_SUCCEEDED(rc))
+            rc = qcff_set_mode(p_worker->handle, QCFF_MODE_STILL);
+        if (QCFF_SUCCEEDED(rc) && i && pthread_create(&p_worker->thread,
+                NULL, qcff_tile_thread, p_worker)) {
+            QCFF_LOG("qcff_set_tiling: pthread_create failed");
+            rc = QCFF_RET_NO_RESOURCE;
+        }
+        if (QCFF_FAILED(rc)) {
+            if (p_worker->handle)
+                qcff_destroy(&p_worker->handle);
+            break;
+        }
+        p_tiling->num_workers++;
+    }
+    if (QCFF_SUCCEEDED(rc))
+        rc = qcff_create(&p_tiling->large);
+    if (QCFF_SUCCEEDED(rc))
+        rc = qcff_set_mode(p_tiling->large, QCFF_MODE_STILL);
+    if (QCFF_FAILED(rc)) {
+        qcff_tiling_free(p_tiling);
+        return rc;
+    }
 
+    p_qcff->p_tiling = p_tiling;
     return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_remove_ex_usr
+ * qcff_set_refine
  *
- * This function removes an existing user from the database.
+ * This function sets up the coarse detector of coarse-to-fine detection,
+ * or releases it. The detector is configured with the first frame it
+ * applies to.
  *
- * INPUT:        handle     Handle to QCFF instance created previously.
- *               user_id    The user ID of the existing user to be removed.
+ * INPUT:        handle           Handle to QCFF instance created
+ *                                previously.
+ *               coarse_scale_q8  Downscale factor of the coarse pass, 0
+ *                                for off.
+ *               margin_pct       Margin around the coarse faces.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_NO_RESOURCE
  ************************************************************************/
-int qcff_remove_ex_usr(qcff_handle_t handle, uint32_t user_id) {
+int qcff_set_refine(qcff_handle_t handle, uint32_t coarse_scale_q8,
+        uint32_t margin_pct) {
     qcff_t *p_qcff = (qcff_t *) handle;
-    INT32 num_users;
+    qcff_refine_t *p_refine;
+    int rc;
 
-    if (!p_qcff || user_id >= p_qcff->num_registered_users)
+    if (!p_qcff || (coarse_scale_q8 && (coarse_scale_q8 <= QCFF_SCALE_ONE
+            || coarse_scale_q8 > QCFF_SCALE_MAX))
+            || margin_pct > QCFF_REFINE_MARGIN_MAX)
         return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
+
+    /* The faces of the last detection may be refined ones */
+    if (p_qcff->p_refine) {
+        if (p_qcff->p_refine->active)
+            p_qcff->num_faces = 0;
+        qcff_refine_free(p_qcff->p_refine);
+        p_qcff->p_refine = NULL;
+    }
+    if (!coarse_scale_q8)
+        return QCFF_RET_SUCCESS;
 
-    QCFF_LOG("Clearing user %d", user_id);
-    /* Clear user from database */
-    if (FACEPROC_NORMAL != FACEPROC_FR_ClearUser(p_qcff->hal, user_id))
-        return QCFF_RET_FAILURE;
+    p_refine = (qcff_refine_t *) malloc(sizeof(qcff_refine_t));
+    if (!p_refine)
+        return QCFF_RET_NO_RESOURCE;
+    memset(p_refine, 0, sizeof(qcff_refine_t));
+    p_refine->scale_q8 = coarse_scale_q8;
+    p_refine->margin_pct = margin_pct;
+    rc = qcff_create(&p_refine->coarse);
+    if (QCFF_SUCCEEDED(rc))
+        rc = qcff_set_mode(p_refine->coarse, QCFF_MODE_STILL);
+    if (QCFF_FAILED(rc)) {
+        qcff_refine_free(p_refine);
+        return rc;
+    }
 
-    QCFF_LOG("Cleared successfully");
-    p_qcff->num_registered_users--;
+    p_qcff->p_refine = p_refine;
     return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_identify_usr
+ * qcff_set_face_threads
  *
- * This function performs face recognition by matching the subject face
- * to the bank of previously registered faces. The result is the ID of
- * the user which has the closest match to the subject face. It also
- * outputs the confidence level of the claimed match. Caller can react
- * differently depending on the confidence level, such as asking the
- * user to confirm its identity if the confidence level is not high.
- * This gives the opportunity for this new face to be registered also
- * to improve accuracy later.
+ * This function sets up the workers analysing the faces of a query in
+ * parallel, or releases them. Each worker other than the calling thread
+ * gets its own parts, smile, gaze-blink and contour engines.
  *
  * INPUT:        handle       Handle to QCFF instance created previously.
- *               face_index   Zero-based index to indicate which detected
- *                            face is to be used for matching.
- * OUTPUT:       p_user_id    The ID of the user having the closest match
- *                            against the subject face. This is only
- *                            meaningful when the return value of the
- *                            function call is QCFF_RET_SUCCESSFUL.
- *                            In any other case, this output argument
- *                            is left untouched.
- *               p_confidence The confidence level of the match. Same with
- *                            p_user_id, it is valid only when return value
- *                            of this call is QCFF_RET_SUCCESSFUL.
- *
+ *               num_threads  Threads analysing faces, the calling thread
+ *                            among them; 0 for one per CPU, 1 for the
+ *                            calling thread alone.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
- *               QCFF_RET_NO_MATCH
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_NO_RESOURCE
  ************************************************************************/
-int qcff_identify_usr(qcff_handle_t handle, uint32_t face_index,
-        uint32_t *p_user_id,
-//qcff_confidence_t   *p_confidence)
-        uint32_t *p_confidence) {
+int qcff_set_face_threads(qcff_handle_t handle, uint32_t num_threads) {
     qcff_t *p_qcff = (qcff_t *) handle;
-    int rc;
-    INT32 score, num_users_returned;
+    qcff_face_pool_t *p_pool;
+    long num_cpus;
+    uint32_t i;
+    int rc = QCFF_RET_SUCCESS;
 
-    if (!p_qcff || !p_user_id || face_index >= p_qcff->num_faces
-            || !p_confidence)
+    if (!p_qcff || num_threads > QCFF_MAX_RESULT_FACES)
         return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
 
-    if (p_qcff->num_registered_users == 0)
-        return QCFF_RET_NO_MATCH;
+    if (p_qcff->p_face_pool) {
+        qcff_face_pool_free(p_qcff->p_face_pool);
+        p_qcff->p_face_pool = NULL;
+    }
+    if (!num_threads) {
+        num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (num_cpus > 0) ? (uint32_t) MIN2(num_cpus,
+                QCFF_MAX_RESULT_FACES) : 1;
+    }
+    if (num_threads == 1)
+        return QCFF_RET_SUCCESS;
 
-    /* Extract feature */
-    rc = qcff_extract_feature(p_qcff, face_index, p_qcff->hfr);
-    if (QCFF_RET_SUCCESS != rc)
+    p_pool = (qcff_face_pool_t *) malloc(sizeof(qcff_face_pool_t));
+    if (!p_pool)
+        return QCFF_RET_NO_RESOURCE;
+    memset(p_pool, 0, sizeof(qcff_face_pool_t));
+    pthread_mutex_init(&p_pool->lock, NULL);
+    pthread_cond_init(&p_pool->start_cond, NULL);
+    pthread_cond_init(&p_pool->done_cond, NULL);
+    p_pool->p_workers = (qcff_face_worker_t *) malloc(
+            num_threads * sizeof(qcff_face_worker_t));
+    if (!p_pool->p_workers) {
+        qcff_face_pool_free(p_pool);
+        return QCFF_RET_NO_RESOURCE;
+    }
+    memset(p_pool->p_workers, 0, num_threads * sizeof(qcff_face_worker_t));
+
+    /* The first worker is the thread querying */
+    for (i = 0; i < num_threads; i++) {
+        qcff_face_worker_t *p_worker = &p_pool->p_workers[i];
+
+        p_worker->p_pool = p_pool;
+        p_worker->roi.face_index = -1;
+        if (i)
+            rc = qcff_face_engines_create(&p_worker->engines);
+        if (QCFF_SUCCEEDED(rc) && i && pthread_create(&p_worker->thread,
+                NULL, qcff_face_thread, p_worker)) {
+            QCFF_LOG("qcff_set_face_threads: pthread_create failed");
+            rc = QCFF_RET_NO_RESOURCE;
+        }
+        if (QCFF_FAILED(rc)) {
+            qcff_face_engines_free(&p_worker->engines);
+            break;
+        }
+        p_pool->num_workers++;
+    }
+    if (QCFF_FAILED(rc)) {
+        qcff_face_pool_free(p_pool);
         return rc;
+    }
 
-    /* Identify the most probable user */
-    if (FACEPROC_NORMAL
-            != FACEPROC_FR_Identify(p_qcff->hfr, p_qcff->hal, 1,
-                    (INT32*) p_user_id, &score, &num_users_returned))
-        return QCFF_RET_FAILURE;
-
-    /* Check score against threshold */
-    if (!num_users_returned || (score < default_params.FR_THRESHOLD))
-        return QCFF_RET_NO_MATCH;
-
-    /* Map score to confidence
-     if (score >= default_params.HIGH_CONFIDENCE_MARK)
-     *p_confidence = QCFF_CONFIDENCE_HIGH;
-     else if (score >= default_params.LOW_CONFIDENCE_MARK)
-     *p_confidence = QCFF_CONFIDENCE_MEDIUM;
-     else
-     p_confidence = QCFF_CONFIDENCE_LOW;
-     */
-    *p_confidence = score / 10;
-
+    p_qcff->p_face_pool = p_pool;
     return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_get_num_ex_usrs
+ * qcff_set_attr_rates
  *
- * This function queries for the total number of registered users.
+ * This function sets how often the smile, gaze-blink and direction of a
+ * tracked face are estimated in video mode, or estimates them on every
+ * frame again.
  *
  * INPUT:        handle       Handle to QCFF instance created previously.
- * OUTPUT:       p_num_users  The number of previously registered users.
- *
+ *               p_rates      The refresh rates, NULL to estimate every
+ *                            frame.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
  ************************************************************************/
-int qcff_get_num_ex_usrs(qcff_handle_t handle, uint32_t *p_num_users) {
+int qcff_set_attr_rates(qcff_handle_t handle,
+        const qcff_attr_rates_t *p_rates) {
     qcff_t *p_qcff = (qcff_t *) handle;
 
-    if (!p_qcff || !p_num_users)
+    if (!p_qcff)
         return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
 
-    if (FACEPROC_NORMAL
-            != FACEPROC_FR_GetRegisteredUserNum(p_qcff->hal,
-                    (INT32*) p_num_users))
-        return QCFF_RET_FAILURE;
-
+    if (p_rates) {
+        p_qcff->attr_rates = *p_rates;
+        p_qcff->attr_decimate = 1;
+    } else {
+        memset(&p_qcff->attr_rates, 0, sizeof(qcff_attr_rates_t));
+        p_qcff->attr_decimate = 0;
+    }
+    memset(p_qcff->attr_tracks, 0, sizeof(p_qcff->attr_tracks));
     return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_reset_usr_data
- *
- * This functions resets all registration/user data.
+ * qcff_set_recog_cache
  *
- * INPUT:        handle     Handle to QCFF instance created previously.
+ * This function sets how often the identification of a tracked face is
+ * verified in video mode, or turns the cache off.
  *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               interval     Frames a match is reused for; 0 or 1 to
+ *                            identify on every call.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
  ************************************************************************/
-int qcff_reset_usr_data(qcff_handle_t handle) {
+int qcff_set_recog_cache(qcff_handle_t handle, uint32_t interval) {
     qcff_t *p_qcff = (qcff_t *) handle;
 
     if (!p_qcff)
         return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
 
-    if (FACEPROC_NORMAL != FACEPROC_FR_ClearAlbum(p_qcff->hal))
-        return QCFF_RET_FAILURE;
-
-    p_qcff->num_registered_users = 0;
+    p_qcff->recog_interval = (interval > 1) ? interval : 0;
+    memset(p_qcff->recog_tracks, 0, sizeof(p_qcff->recog_tracks));
     return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_get_usr_data_size
+ * qcff_set_face_budget
  *
- * For recognition to be useful, typically the user data needs to be
- * remembered across sessions. QCFF provides a set of functions to
- * allow easy storing and restoring of its user data bank. To save the
- * user data, QCFF provides the qcff_get_usr_data function to serialize
- * the user data and writes it to a buffer. The caller can then saves
- * what is in the buffer to persistent storage such as the file system.
- * This function (qcff_get_usr_data_size) queries the size of the user
- * data when serialized. This should be called to prepare for the memory
- * buffer for the saving of user data.
+ * This function sets how many faces of a frame are fully analysed and
+ * identified, the best ranked ones; the others get their rectangle only.
  *
- * INPUT:        handle     Handle to QCFF instance created previously.
- * OUTPUT:       p_size     The size needed to hold the serialized the
- *                          user data.
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               max_faces    Faces analysed per frame, 0 for all.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_set_face_budget(qcff_handle_t handle, uint32_t max_faces) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+
+    if (!p_qcff)
+        return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
+
+    p_qcff->face_budget = MIN2(max_faces, QCFF_MAX_RESULT_FACES);
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_get_ranked_faces
  *
+ * This function returns the indices of the detected faces, most
+ * important first.
+ *
+ * INPUT:        handle             Handle to QCFF instance created
+ *                                  previously.
+ *               max_faces          Room in p_face_indices.
+ * OUTPUT:       p_num_faces_returned  Number of indices returned.
+ *               p_face_indices     The face indices.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
  ************************************************************************/
-int qcff_get_usr_data_size(qcff_handle_t handle, uint32_t *p_size) {
+int qcff_get_ranked_faces(qcff_handle_t handle, uint32_t max_faces,
+        uint32_t *p_num_faces_returned, uint32_t *p_face_indices) {
     qcff_t *p_qcff = (qcff_t *) handle;
+    uint32_t i;
 
-    if (!p_qcff || !p_size)
+    if (!p_qcff || !p_num_faces_returned || (max_faces && !p_face_indices))
         return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
 
-    if (FACEPROC_NORMAL
-            != FACEPROC_FR_GetSerializedAlbumSize(p_qcff->hal,
-                    (UINT32*) p_size)) {
+    qcff_rank_update(p_qcff);
+    *p_num_faces_returned = MIN2(max_faces, p_qcff->num_ranked);
+    for (i = 0; i < *p_num_faces_returned; i++)
+        p_face_indices[i] = p_qcff->rank_order[i];
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_config
+ *
+ * This function provides mandatory configurations to the QCFF instance.
+ * It includes the input image resolution (width and height). QCFF will
+ * read all subsequent inputs assuming the same resolution. It currently
+ * assumes and accepts only 8-bit grayscale images.
+ *
+ * INPUT:        handle     Handle to QCFF instance created previously.
+ *               p_cfg      Pointer to the configuration structure.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_config(qcff_handle_t handle, qcff_config_t *p_cfg) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+    uint32_t async_mask = 0;
+    int rc;
+
+    if (!p_qcff) {
+        QCFF_LOG("QCCameraSDKConfig falsed initialy");
+        return QCFF_RET_FAILURE;
+    }
+
+    /* The worker's buffers depend on the configuration */
+    if (p_qcff->p_async) {
+        async_mask = p_qcff->p_async->info_mask;
+        qcff_async_stop(handle);
+    }
+    rc = qcff_reconfig(p_qcff, p_cfg);
+    if (QCFF_SUCCEEDED(rc) && async_mask)
+        rc = qcff_async_start(handle, async_mask);
+    return rc;
+}
+
+static int qcff_reconfig(qcff_t *p_qcff, qcff_config_t *p_cfg) {
+    int rc = QCFF_RET_FAILURE;
+
+    rc = qcff_config_layout(p_qcff, p_cfg);
+    if (QCFF_FAILED(rc))
+        return rc;
+
+    /* Downscale processing: the fixed point factor takes precedence */
+    if (p_cfg->downscale_factor_q8)
+        p_qcff->scale_q8 = p_cfg->downscale_factor_q8;
+    else if (p_cfg->downscale_factor)
+        p_qcff->scale_q8 = p_cfg->downscale_factor * QCFF_SCALE_ONE;
+    else
+        p_qcff->scale_q8 = QCFF_SCALE_ONE;
+    if (p_qcff->scale_q8 < QCFF_SCALE_ONE || p_qcff->scale_q8 > QCFF_SCALE_MAX)
+        p_qcff->scale_q8 = QCFF_SCALE_ONE;
+    p_qcff->next_scale_q8 = p_qcff->scale_q8;
+    p_qcff->proc_width = QCFF_SCALED_LEN(p_qcff->crop.dx, p_qcff->scale_q8);
+    p_qcff->proc_height = QCFF_SCALED_LEN(p_qcff->crop.dy, p_qcff->scale_q8);
+
+    QCFF_LOG("QCCameraSDKConfig width x height %d x %d",
+            p_cfg->width, p_cfg->height);
+    rc = qcff_arena_setup(p_qcff);
+    if (QCFF_FAILED(rc))
+        return QCFF_RET_FAILURE;
+
+    rc = qcff_select_dt(p_qcff);
+
+    if (QCFF_FAILED(rc)) {
+        QCFF_LOG("QCFF_config failed");
         return QCFF_RET_FAILURE;
     }
+    p_qcff->local_frame_size = p_qcff->crop.dx * p_qcff->crop.dy;
+    p_qcff->p_frame = NULL;
+    p_qcff->adapt.avg_us = 0;
+    p_qcff->adapt.small_face = 0;
+    p_qcff->adapt.hold = 0;
+    memset(&p_qcff->skip.stats, 0, sizeof(qcff_skip_stats_t));
+    memset(&p_qcff->deadline.stats, 0, sizeof(qcff_deadline_stats_t));
+    /* Tracking IDs start over with the new detector */
+    memset(p_qcff->attr_tracks, 0, sizeof(p_qcff->attr_tracks));
+    memset(p_qcff->recog_tracks, 0, sizeof(p_qcff->recog_tracks));
+    memset(p_qcff->rank_tracks, 0, sizeof(p_qcff->rank_tracks));
+    p_qcff->rank_valid = FALSE;
+
+    /* Save the input frame dimension */
+    p_qcff->frame_width = p_cfg->width;
+    p_qcff->frame_height = p_cfg->height;
 
     return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_get_usr_data
- *
- * For recognition to be useful, typically the user data needs to be
- * remembered across sessions. QCFF provides a set of functions to
- * allow easy storing and restoring of its user data bank. To save the
- * user data, QCFF provides the qcff_get_usr_data function to serialize
- * the user data and writes it to a buffer. The caller can then saves
- * what is in the buffer to persistent storage such as the file system.
- * Caller should use qcff_get_usr_data_size in advance to query the size
- * of the user data when serialized in order to allocate for the memory
- * buffer big enough to hold the serialized user data.
+ * qcff_set_frame
  *
- * INPUT:        handle               Handle to QCFF instance created
- *                                    previously.
- *               p_buffer             The buffer to be used for holding
- *                                    the serialized user data.
- *               num_bytes_in_buffer  The total number of bytes
- *                                    available in the buffer.
+ * This function provides the input to the QCFF instance. A local copy of
+ * the frame will be made and therefore the input frame can be released
+ * and altered freely after this call is finished. RGB frames are
+ * converted to luma while being copied.
  *
+ * INPUT:        handle     Handle to QCFF instance created previously.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
  ************************************************************************/
-int qcff_get_usr_data(qcff_handle_t handle, uint8_t *p_buffer,
-        uint32_t num_bytes_in_buffer) {
+int qcff_set_frame(qcff_handle_t handle, uint8_t *p_frame) {
+#ifdef PROFILING
+    struct timeval t1, t2;
+    int diff;
+    static FILE* fdump = NULL;
+    static int cnt = 0;
+#endif
+
     qcff_t *p_qcff = (qcff_t *) handle;
+    uint32_t scale_q8;
+    int rc;
 
-    if (!p_qcff || !p_buffer || !num_bytes_in_buffer)
+    if (!p_qcff || !p_frame)
         return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
 
-    if (FACEPROC_NORMAL
-            != FACEPROC_FR_SerializeAlbum(p_qcff->hal, p_buffer,
-                    num_bytes_in_buffer))
-        return QCFF_RET_FAILURE;
+#ifdef PROFILING
+    gettimeofday(&t1, NULL);
+#endif
+    scale_q8 = __atomic_load_n(&p_qcff->next_scale_q8, __ATOMIC_RELAXED);
+    rc = qcff_ingest(p_qcff, p_frame, scale_q8, p_qcff->p_local_frame);
+    if (QCFF_FAILED(rc))
+        return rc;
+    rc = qcff_use_scale(p_qcff, scale_q8);
+    if (QCFF_FAILED(rc))
+        return rc;
+    p_qcff->skip.p_cur = qcff_signature(p_qcff, p_qcff->p_local_frame,
+            p_qcff->proc_width, p_qcff->proc_height, p_qcff->proc_width,
+            p_qcff->skip.cur);
 
-    return QCFF_RET_SUCCESS;
+    p_qcff->p_frame = p_qcff->p_local_frame;
+    p_qcff->img_width = p_qcff->proc_width;
+    p_qcff->img_height = p_qcff->proc_height;
+    p_qcff->img_x = p_qcff->crop.x;
+    p_qcff->img_y = p_qcff->crop.y;
+
+    rc = qcff_detect(p_qcff);
+#ifdef PROFILING
+    gettimeofday(&t2, NULL);
+    diff = (t2.tv_sec - t1.tv_sec) * 1000 + (t2.tv_usec - t1.tv_usec) / 1000;
+    QCFF_LOG("set frame: detection takes: %d ms", diff);
+#if 0
+    if (fdump == NULL) {
+        fdump = fopen("/data/data/com.android.qcurf/data/dump.csv", "w");
+    } else {
+        cnt++;
+        if (cnt < 350 && cnt > 50) {
+            fprintf(fdump, "%d,%d\n", cnt, diff);
+        } else if (cnt == 350) {
+            fclose(fdump);
+        }
+    }
+#endif
+#endif
+    return rc;
 }
 
 /*************************************************************************
- * qcff_set_usr_data
+ * qcff_set_frame_ref
  *
- * This functions takes previously serialized user data (through
- * qcff_get_usr_data) and restore the user data bank from it.
+ * This function provides the input to the QCFF instance without taking
+ * a copy of it. When no downscaling is configured, detection and all
+ * subsequent facial parts, smile, gaze-blink, contour and recognition
+ * queries read directly from the caller's luma plane.
  *
- * INPUT:        handle              Handle to QCFF instance created
- *                                   previously.
- *               num_bytes_in_buffer The number of bytes in the buffer.
- *               p_buffer            The buffer holding the serialized
- *                                   user data.
+ * Lifetime contract: the buffer is borrowed, not owned. The caller must
+ * keep it allocated and must not modify it until the next call to
+ * qcff_set_frame / qcff_set_frame_ref, qcff_config or qcff_destroy on
+ * this handle, whichever comes first. Queries issued after the buffer
+ * has been released or recycled read undefined data.
+ *
+ * The crop rows are read at full stride, the last one included: the
+ * buffer must hold offset + stride * height bytes.
  *
+ * INPUT:        handle     Handle to QCFF instance created previously.
+ *               p_frame    8-bit luma plane of the configured dimension.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
  ************************************************************************/
-int qcff_set_usr_data(qcff_handle_t handle, uint32_t num_bytes_in_buffer,
-        uint8_t *p_buffer) {
+int qcff_set_frame_ref(qcff_handle_t handle, uint8_t *p_frame) {
     qcff_t *p_qcff = (qcff_t *) handle;
-    INT32 num_users, rc;
-    FR_ERROR error;
+    int rc;
 
-    if (!p_qcff || !num_bytes_in_buffer || !p_buffer) {
+    if (!p_qcff || !p_frame || !p_qcff->p_local_frame)
         return QCFF_RET_INVALID_PARM;
-    }
-
-    /* Delete previously created album first */
-    if (FACEPROC_NORMAL != FACEPROC_FR_DeleteAlbumHandle(p_qcff->hal))
-        return QCFF_RET_FAILURE;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
+
+    /* A downscaled or RGB frame has to be materialised anyway; the full
+     resolution copy is what is saved here */
+    if (p_qcff->next_scale_q8 != QCFF_SCALE_ONE
+            || qcff_format_bpp(p_qcff->format) > 1)
+        return qcff_set_frame(handle, p_frame);
+    rc = qcff_use_scale(p_qcff, QCFF_SCALE_ONE);
+    if (QCFF_FAILED(rc))
+        return rc;
 
-    /* Restore album based on the provided buffer */
-    p_qcff->hal = FACEPROC_FR_RestoreAlbum((UINT8*) p_buffer,
-            (UINT32) num_bytes_in_buffer, &error);
-    if (FR_NORMAL != error)
-        return QCFF_RET_FAILURE;
+    /* The engines read the crop rows at full stride; the columns left and
+     right of the crop are masked out of the search in qcff_detect */
+    p_qcff->p_frame = p_frame + p_qcff->offset
+            + p_qcff->crop.y * p_qcff->stride;
+    p_qcff->skip.p_cur = qcff_signature(p_qcff,
+            p_qcff->p_frame + p_qcff->crop.x, p_qcff->crop.dx,
+            p_qcff->crop.dy, p_qcff->stride, p_qcff->skip.cur);
+    p_qcff->img_width = p_qcff->stride;
+    p_qcff->img_height = p_qcff->crop.dy;
+    p_qcff->img_x = 0;
+    p_qcff->img_y = p_qcff->crop.y;
+    return qcff_detect(p_qcff);
+}
 
-    rc = FACEPROC_FR_GetRegisteredUserNum(p_qcff->hal, &num_users);
-    if (FACEPROC_NORMAL != rc)
-        return QCFF_RET_FAILURE;
+/*************************************************************************
+ * qcff_async_start
+ *
+ * This function starts the worker thread processing the frames given to
+ * qcff_submit_frame. The frame buffers are sized for the current
+ * configuration.
+ *
+ * INPUT:        handle     Handle to QCFF instance created and
+ *                          configured previously.
+ *               info_mask  QCFF_INFO_* information to gather per frame.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_NO_RESOURCE
+ ************************************************************************/
+int qcff_async_start(qcff_handle_t handle, uint32_t info_mask) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+    qcff_async_t *p_async;
+    uint32_t i;
 
-    QCFF_LOG("Album restored successfully: %d users found", num_users);
+    if (!p_qcff || !p_qcff->p_local_frame || !info_mask)
+        return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
 
-    p_qcff->num_registered_users = (uint32_t) num_users;
+    p_async = (qcff_async_t *) malloc(sizeof(qcff_async_t));
+    if (!p_async)
+        return QCFF_RET_NO_RESOURCE;
+    memset(p_async, 0, sizeof(qcff_async_t));
+    for (i = 0; i < 3; i++) {
+        p_async->frames[i].p_image = (uint8_t *) malloc(
+                p_qcff->crop.dx * p_qcff->crop.dy);
+        if (!p_async->frames[i].p_image) {
+            qcff_async_free(p_async);
+            return QCFF_RET_NO_RESOURCE;
+        }
+    }
+    p_async->info_mask = info_mask;
+    p_async->frame_back = 0;
+    p_async->frame_front = 1;
+    p_async->frame_mailbox = 2;
+    p_async->result_back = 0;
+    p_async->result_front = 1;
+    p_async->result_mailbox = 2;
+    sem_init(&p_async->frame_sem, 0, 0);
+    sem_init(&p_async->result_sem, 0, 0);
+
+    /* The handle is marked busy before the worker touches it */
+    p_qcff->p_async = p_async;
+    if (pthread_create(&p_async->thread, NULL, qcff_async_worker, p_qcff)) {
+        QCFF_LOG("qcff_async_start: pthread_create failed");
+        p_qcff->p_async = NULL;
+        sem_destroy(&p_async->frame_sem);
+        sem_destroy(&p_async->result_sem);
+        qcff_async_free(p_async);
+        return QCFF_RET_NO_RESOURCE;
+    }
     return QCFF_RET_SUCCESS;
 }
 
 /*************************************************************************
- * qcff_destroy
+ * qcff_async_stop
  *
- * This function destroys and performs clean up associated with the
- * QCFF instance previously created.
+ * This function stops the worker thread and waits for it to exit.
  *
  * INPUT:        handle     Handle to QCFF instance created previously.
- *
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
  ************************************************************************/
-int qcff_destroy(qcff_handle_t *p_handle) {
-    INT32 ret;
-    qcff_t *p_qcff = (qcff_t *) *p_handle;
+int qcff_async_stop(qcff_handle_t handle) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+    qcff_async_t *p_async;
 
     if (!p_qcff)
-        return QCFF_RET_FAILURE;
+        return QCFF_RET_INVALID_PARM;
+    p_async = p_qcff->p_async;
+    if (!p_async)
+        return QCFF_RET_SUCCESS;
 
-    /* Delete Album Handle */
-    if (p_qcff->hal) {
-        ret = FACEPROC_FR_DeleteAlbumHandle(p_qcff->hal);
-        p_qcff->hal = NULL;
-    }
-    /* Delete Facial Feature Handle */
-    if (p_qcff->hfr) {
-        ret = FACEPROC_FR_DeleteFeatureHandle(p_qcff->hfr);
-        p_qcff->hfr = NULL;
+    __atomic_store_n(&p_async->stop, 1, __ATOMIC_RELEASE);
+    sem_post(&p_async->frame_sem);
+    pthread_join(p_async->thread, NULL);
+    sem_destroy(&p_async->frame_sem);
+    sem_destroy(&p_async->result_sem);
+    qcff_async_free(p_async);
+
+    /* The last frame the worker saw is gone with its buffer */
+    p_qcff->p_async = NULL;
+    p_qcff->p_frame = NULL;
+    p_qcff->num_faces = 0;
+    p_qcff->skip.ref_valid = FALSE;
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_submit_frame
+ *
+ * This function packs the frame into the submitter's buffer and swaps it
+ * into the frame mailbox. A frame the worker has not taken yet is
+ * dropped.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               p_frame      Frame to process.
+ *               seq          Sequence number reported with the result.
+ *               timestamp    Timestamp reported with the result.
+ *               p_transform  Display transform applied to the result.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_submit_frame(qcff_handle_t handle, uint8_t *p_frame, uint32_t seq,
+        uint64_t timestamp, const qcff_transform_t *p_transform) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+    qcff_async_t *p_async;
+    qcff_async_frame_t *p_slot;
+    uint32_t old;
+    int rc;
+
+    if (!p_qcff || !p_frame || !p_qcff->p_async)
+        return QCFF_RET_INVALID_PARM;
+    p_async = p_qcff->p_async;
+
+    p_slot = &p_async->frames[p_async->frame_back];
+    p_slot->scale_q8 = __atomic_load_n(&p_qcff->next_scale_q8,
+            __ATOMIC_RELAXED);
+    rc = qcff_ingest(p_qcff, p_frame, p_slot->scale_q8, p_slot->p_image);
+    if (QCFF_FAILED(rc))
+        return rc;
+    p_slot->has_sig = qcff_signature(p_qcff, p_slot->p_image,
+            QCFF_SCALED_LEN(p_qcff->crop.dx, p_slot->scale_q8),
+            QCFF_SCALED_LEN(p_qcff->crop.dy, p_slot->scale_q8),
+            QCFF_SCALED_LEN(p_qcff->crop.dx, p_slot->scale_q8),
+            p_slot->sig) != NULL;
+    p_slot->seq = seq;
+    p_slot->timestamp = timestamp;
+    if (p_transform) {
+        p_slot->transform = *p_transform;
+    } else {
+        memset(&p_slot->transform, 0, sizeof(qcff_transform_t));
+        p_slot->transform.scale_x = 1.0f;
+        p_slot->transform.scale_y = 1.0f;
     }
-    /* Delete Contour Result Handle */
-    if (p_qcff->hct_result) {
-        ret = FACEPROC_CT_DeleteResultHandle(p_qcff->hct_result);
-        p_qcff->hct_result = NULL;
+
+    old = __atomic_exchange_n(&p_async->frame_mailbox,
+            p_async->frame_back | QCFF_SLOT_FRESH, __ATOMIC_ACQ_REL);
+    p_async->frame_back = old & ~QCFF_SLOT_FRESH;
+    if (old & QCFF_SLOT_FRESH)
+        __atomic_add_fetch(&p_async->num_dropped, 1, __ATOMIC_RELAXED);
+    else
+        sem_post(&p_async->frame_sem);
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_poll_results
+ *
+ * This function takes the result in the result mailbox, waiting up to
+ * timeout_ms milliseconds for one to arrive.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               timeout_ms   Time to wait for a result, 0 not to wait.
+ * OUTPUT:       p_result     The result.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_TIMEOUT
+ ************************************************************************/
+int qcff_poll_results(qcff_handle_t handle, uint32_t timeout_ms,
+        qcff_frame_result_t *p_result) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+    qcff_async_t *p_async;
+    struct timespec deadline;
+    uint32_t old;
+
+    if (!p_qcff || !p_result || !p_qcff->p_async)
+        return QCFF_RET_INVALID_PARM;
+    p_async = p_qcff->p_async;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
     }
-    /* Delete Contour Detection Handle */
-    if (p_qcff->hct) {
-        ret = FACEPROC_CT_DeleteHandle(p_qcff->hct);
-        p_qcff->hct = NULL;
+
+    /* A post can outlive the result it announced when that result was
+     taken early, hence the mailbox is checked again after each wake-up */
+    while (!(__atomic_load_n(&p_async->result_mailbox, __ATOMIC_ACQUIRE)
+            & QCFF_SLOT_FRESH)) {
+        if (sem_timedwait(&p_async->result_sem, &deadline)) {
+            if (errno == EINTR)
+                continue;
+            return QCFF_RET_TIMEOUT;
+        }
     }
-    /* Delete GazeBlink Result Handle */
-    if (p_qcff->hgb_result) {
+
+    old = __atomic_exchange_n(&p_async->result_mailbox,
+            p_async->result_front, __ATOMIC_ACQ_REL);
+    p_async->result_front = old & ~QCFF_SLOT_FRESH;
+    memcpy(p_result, &p_async->results[p_async->result_front],
+            sizeof(qcff_frame_result_t));
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_pool_create
+ *
+ * This function creates the handles of a pool and starts one worker
+ * thread per handle.
+ *
+ * INPUT:        p_cfg      Pool configuration.
+ * OUTPUT:       p_pool     The pool.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_NO_RESOURCE
+ ************************************************************************/
+int qcff_pool_create(qcff_pool_t *p_pool, const qcff_pool_config_t *p_cfg) {
+    qcff_pool_priv_t *p_priv;
+    uint32_t num_workers, depth, i;
+    long num_cpus;
+    int rc = QCFF_RET_SUCCESS;
+
+    if (!p_pool || !p_cfg || p_cfg->deadline_ms > QCFF_DEADLINE_MAX_MS
+            || p_cfg->num_handles > QCFF_MAX_THREADS
+            || p_cfg->queue_depth > QCFF_MAX_THREADS)
+        return QCFF_RET_INVALID_PARM;
+
+    num_workers = p_cfg->num_handles;
+    if (!num_workers) {
+        num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = (num_cpus > 0) ? (uint32_t) MIN2(num_cpus,
+                QCFF_MAX_THREADS) : 1;
+    }
+    depth = p_cfg->queue_depth ? p_cfg->queue_depth : 2 * num_workers;
+    depth = MIN2(MAX2(depth, num_workers), QCFF_MAX_THREADS);
+
+    p_priv = (qcff_pool_priv_t *) malloc(sizeof(qcff_pool_priv_t));
+    if (!p_priv)
+        return QCFF_RET_NO_RESOURCE;
+    memset(p_priv, 0, sizeof(qcff_pool_priv_t));
+    pthread_mutex_init(&p_priv->batch_lock, NULL);
+    pthread_mutex_init(&p_priv->lock, NULL);
+    pthread_cond_init(&p_priv->work_cond, NULL);
+    pthread_cond_init(&p_priv->done_cond, NULL);
+
+    p_priv->depth = depth;
+    p_priv->p_slots = (qcff_pool_slot_t *) malloc(
+            depth * sizeof(qcff_pool_slot_t));
+    p_priv->p_free = (uint32_t *) malloc(3 * depth * sizeof(uint32_t));
+    p_priv->p_workers = (qcff_pool_worker_t *) malloc(
+            num_workers * sizeof(qcff_pool_worker_t));
+    if (!p_priv->p_slots || !p_priv->p_free || !p_priv->p_workers) {
+        qcff_pool_free(p_priv);
+        return QCFF_RET_NO_RESOURCE;
+    }
+    memset(p_priv->p_workers, 0, num_workers * sizeof(qcff_pool_worker_t));
+    p_priv->p_work = p_priv->p_free + depth;
+    p_priv->p_done = p_priv->p_work + depth;
+    for (i = 0; i < depth; i++)
+        p_priv->p_free[i] = i;
+    p_priv->num_free = depth;
+
+    for (i = 0; i < num_workers && QCFF_SUCCEEDED(rc); i++) {
+        qcff_pool_worker_t *p_worker = &p_priv->p_workers[i];
+
+        p_worker->p_pool = p_priv;
+        rc = qcff_create(&p_worker->handle);
+        if (QCFF_SUCCEEDED(rc))
+            rc = qcff_set_mode(p_worker->handle, QCFF_MODE_STILL);
+        if (QCFF_SUCCEEDED(rc) && p_cfg->p_params)
+            rc = qcff_set_params(p_worker->handle, p_cfg->p_params);
+        if (QCFF_SUCCEEDED(rc))
+            rc = qcff_set_deadline(p_worker->handle, p_cfg->deadline_ms, 0);
+        if (QCFF_FAILED(rc))
+            break;
+        if (pthread_create(&p_worker->thread, NULL, qcff_pool_worker,
+                p_worker)) {
+            QCFF_LOG("qcff_pool_create: pthread_create failed");
+            rc = QCFF_RET_NO_RESOURCE;
+            break;
+        }
+        p_priv->num_workers++;
+    }
+    *p_pool = (qcff_pool_t) p_priv;
+    if (QCFF_FAILED(rc)) {
+        /* The handle of the worker that failed to start is not counted */
+        if (p_priv->p_workers[i].handle)
+            qcff_destroy(&p_priv->p_workers[i].handle);
+        qcff_pool_destroy(p_pool);
+        return rc;
+    }
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_pool_destroy
+ *
+ * This function stops the workers of a pool and releases its handles.
+ *
+ * INPUT:        p_pool     Pool created previously, NULL on return.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_pool_destroy(qcff_pool_t *p_pool) {
+    qcff_pool_priv_t *p_priv;
+    uint32_t i;
+
+    if (!p_pool || !*p_pool)
+        return QCFF_RET_INVALID_PARM;
+    p_priv = (qcff_pool_priv_t *) *p_pool;
+
+    pthread_mutex_lock(&p_priv->lock);
+    p_priv->stop = 1;
+    pthread_cond_broadcast(&p_priv->work_cond);
+    pthread_mutex_unlock(&p_priv->lock);
+    for (i = 0; i < p_priv->num_workers; i++) {
+        pthread_join(p_priv->p_workers[i].thread, NULL);
+        qcff_destroy(&p_priv->p_workers[i].handle);
+    }
+    qcff_pool_free(p_priv);
+    *p_pool = NULL;
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_process_batch
+ *
+ * This function keeps up to the queue depth of images in flight: it
+ * takes images in while slots are free and otherwise waits for results
+ * to hand back.
+ *
+ * INPUT:        pool        Pool created previously.
+ *               num_images  Number of images in the batch.
+ *               info_mask   QCFF_INFO_* information to gather per image.
+ *               p_io        Image supplier and result receiver.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_process_batch(qcff_pool_t pool, uint32_t num_images,
+        uint32_t info_mask, const qcff_batch_io_t *p_io) {
+    qcff_pool_priv_t *p_priv = (qcff_pool_priv_t *) pool;
+    uint32_t next = 0, num_pending = 0;
+
+    if (!p_priv || !info_mask || !p_io || !p_io->get_image
+            || !p_io->put_result)
+        return QCFF_RET_INVALID_PARM;
+
+    pthread_mutex_lock(&p_priv->batch_lock);
+    pthread_mutex_lock(&p_priv->lock);
+    p_priv->info_mask = info_mask;
+    while (next < num_images || num_pending) {
+        qcff_pool_slot_t *p_slot;
+        uint32_t slot;
+
+        if (next < num_images && p_priv->num_free) {
+            /* The supplier runs unlocked, the workers keep going */
+            slot = p_priv->p_free[--p_priv->num_free];
+            pthread_mutex_unlock(&p_priv->lock);
+            p_slot = &p_priv->p_slots[slot];
+            memset(&p_slot->item, 0, sizeof(qcff_batch_item_t));
+            p_slot->index = next;
+            if (QCFF_FAILED(p_io->get_image(p_io->p_user, next,
+                    &p_slot->item)) || !p_slot->item.p_frame) {
+                pthread_mutex_lock(&p_priv->lock);
+                p_priv->p_free[p_priv->num_free++] = slot;
+            } else {
+                pthread_mutex_lock(&p_priv->lock);
+                p_priv->p_work[(p_priv->work_head + p_priv->num_work)
+                        % p_priv->depth] = slot;
+                p_priv->num_work++;
+                num_pending++;
+                pthread_cond_signal(&p_priv->work_cond);
+            }
+            next++;
+            continue;
+        }
+
+        while (!p_priv->num_done)
+            pthread_cond_wait(&p_priv->done_cond, &p_priv->lock);
+        slot = p_priv->p_done[p_priv->done_head];
+        p_priv->done_head = (p_priv->done_head + 1) % p_priv->depth;
+        p_priv->num_done--;
+        pthread_mutex_unlock(&p_priv->lock);
+        p_slot = &p_priv->p_slots[slot];
+        p_io->put_result(p_io->p_user, p_slot->index, &p_slot->result);
+        pthread_mutex_lock(&p_priv->lock);
+        p_priv->p_free[p_priv->num_free++] = slot;
+        num_pending--;
+    }
+    pthread_mutex_unlock(&p_priv->lock);
+    pthread_mutex_unlock(&p_priv->batch_lock);
+    return QCFF_RET_SUCCESS;
+}
+
+
+/*************************************************************************
+ * qcff_set_mode
+ *
+ * This function sets the optional parameter: detection mode.
+ * It should be configured differently when QCFF is used in still image
+ * vs video sequence scenario. If unset, default is QCFF_MODE_VIDEO.
+ * The detector of the mode is put in use by the next configuration or
+ * detection, see qcff_select_dt, so that a mode change followed by a
+ * configuration sets up a single detector.
+ *
+ * INPUT:        handle     Handle to QCFF instance created previously.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_set_mode(qcff_handle_t handle, qcff_mode_t mode) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+
+    if (!p_qcff || mode >= QCFF_MODE_MAX)
+        return QCFF_RET_INVALID_PARM;
+    if (mode != p_qcff->mode && QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
+
+    p_qcff->mode = mode;
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_get_num_faces
+ *
+ * This function retrieves the number of detected faces in the frame
+ * received in the last 'qcff_set_frame' call.
+ *
+ * INPUT:        handle     Handle to QCFF instance created previously.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_get_num_faces(qcff_handle_t handle, uint32_t *p_num_faces) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+    int rc;
+
+    if (!p_qcff || !p_num_faces)
+        return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
+
+    *p_num_faces = p_qcff->num_faces;
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_get_rects
+ *
+ * This function retrieves the rectangles of the detected faces. It
+ * allows multiple faces to be retrieved by taking an array of face
+ * indices corresponding to the face rectangles requested. The output
+ * will be an array of face rectangles in the type of qcff_face_rect_t.
+ * The face indices are zero-based and should be between 0 to the
+ * number of detected faces - 1.
+ *
+ * INPUT:        handle               Handle to QCFF instance created
+ *                                    previously.
+ *               num_faces_queried    The number of faces being queried.
+ *                                    (it determines how many entries in
+ *                                    p_face_indices to be read)
+ *               p_face_indices       The indices of the faces in which
+ *                                    the rectangle information is
+ *                                    requested. Whenever an invalid
+ *                                    face index is encountered, the
+ *                                    function call ends.
+ *                                    p_num_faces_returned indicates how
+ *                                    many faces are returned before
+ *                                    the error happened.
+ * OUTPUT:       p_num_faces_returned Returns the actual number of
+ *                                    entries returned. It might be
+ *                                    less than the number of faces queried
+ *                                    if the number queried is actually
+ *                                    more than the available faces.
+ *               p_face_rects         The face rectangles outputted.
+ *
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_rects(qcff_handle_t handle, uint32_t num_faces_queried,
+        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
+        qcff_face_rect_t *p_face_rects) {
+    qcff_complete_face_info_t complete_info = empty_info;
+
+    if (!p_face_rects)
+        return QCFF_RET_INVALID_PARM;
+
+    complete_info.p_rects = p_face_rects;
+
+    return qcff_get_complete_info(handle, num_faces_queried, p_face_indices,
+            p_num_faces_returned, &complete_info);
+}
+
+/*************************************************************************
+ * qcff_get_parts
+ *
+ * This function retrieves the facial parts of the detected faces. It
+ * allows multiple faces to be retrieved by taking an array of face
+ * indices corresponding to the faces requested. The output
+ * will be an array of facial parts in the type of qcff_face_parts_t.
+ * The face indices are zero-based and should be between 0 to the
+ * number of detected faces - 1.
+ *
+ * INPUT:        handle               Handle to QCFF instance created
+ *                                    previously.
+ *               num_faces_queried    The number of faces being queried.
+ *                                    (it determines how many entries in
+ *                                    p_face_indices to be read)
+ *               p_face_indices       The indices of the faces in which
+ *                                    the facial parts information is
+ *                                    requested. Whenever an invalid
+ *                                    face index is encountered, the
+ *                                    function call ends.
+ *                                    p_num_faces_returned indicates how
+ *                                    many faces are returned before
+ *                                    the error happened.
+ * OUTPUT:       p_num_faces_returned Returns the actual number of
+ *                                    entries returned. It might be
+ *                                    less than the number of faces queried
+ *                                    if the number queried is actually
+ *                                    more than the available faces.
+ *               p_face_parts         The facial parts outputted.
+ *
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_parts(qcff_handle_t handle, uint32_t num_faces_queried,
+        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
+        qcff_face_parts_t *p_face_parts) {
+    qcff_complete_face_info_t complete_info = empty_info;
+
+    if (!p_face_parts)
+        return QCFF_RET_INVALID_PARM;
+
+    complete_info.p_parts = p_face_parts;
+
+    return qcff_get_complete_info(handle, num_faces_queried, p_face_indices,
+            p_num_faces_returned, &complete_info);
+}
+
+/*************************************************************************
+ * qcff_get_parts_ex
+ *
+ * This function retrieves the extended facial parts of the detected faces.
+ * It allows multiple faces to be retrieved by taking an array of face
+ * indices corresponding to the faces requested. The output
+ * will be an array of facial parts in the type of qcff_face_parts_ex_t.
+ * The face indices are zero-based and should be between 0 to the
+ * number of detected faces - 1.
+ *
+ * INPUT:        handle               Handle to QCFF instance created
+ *                                    previously.
+ *               num_faces_queried    The number of faces being queried.
+ *                                    (it determines how many entries in
+ *                                    p_face_indices to be read)
+ *               p_face_indices       The indices of the faces in which
+ *                                    the facial parts information is
+ *                                    requested. Whenever an invalid
+ *                                    face index is encountered, the
+ *                                    function call ends.
+ *                                    p_num_faces_returned indicates how
+ *                                    many faces are returned before
+ *                                    the error happened.
+ * OUTPUT:       p_num_faces_returned Returns the actual number of
+ *                                    entries returned. It might be
+ *                                    less than the number of faces queried
+ *                                    if the number queried is actually
+ *                                    more than the available faces.
+ *               p_face_parts_ex      The extended facial parts outputted.
+ *
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_parts_ex(qcff_handle_t handle, uint32_t num_faces_queried,
+        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
+        qcff_face_parts_ex_t *p_face_parts_ex) {
+    qcff_complete_face_info_t complete_info = empty_info;
+
+    if (!p_face_parts_ex)
+        return QCFF_RET_INVALID_PARM;
+
+    complete_info.p_parts_ex = p_face_parts_ex;
+
+    return qcff_get_complete_info(handle, num_faces_queried, p_face_indices,
+            p_num_faces_returned, &complete_info);
+}
+
+/*************************************************************************
+ * qcff_get_smiles
+ *
+ * This function retrieves the smile degree of the detected faces. It
+ * allows multiple faces to be retrieved by taking an array of face
+ * indices corresponding to the faces requested. The output
+ * will be an array of smile degrees. The smile degree ranges from
+ * 0 to 100 with 0 being the lowest smile degree.
+ * The face indices are zero-based and should be between 0 to the
+ * number of detected faces - 1.
+ *
+ * INPUT:        handle               Handle to QCFF instance created
+ *                                    previously.
+ *               num_faces_queried    The number of faces being queried.
+ *                                    (it determines how many entries in
+ *                                    p_face_indices to be read)
+ *               p_face_indices       The indices of the faces in which
+ *                                    the facial parts information is
+ *                                    requested. Whenever an invalid
+ *                                    face index is encountered, the
+ *                                    function call ends.
+ *                                    p_num_faces_returned indicates how
+ *                                    many faces are returned before
+ *                                    the error happened.
+ * OUTPUT:       p_num_faces_returned Returns the actual number of
+ *                                    entries returned. It might be
+ *                                    less than the number of faces queried
+ *                                    if the number queried is actually
+ *                                    more than the available faces.
+ *               p_smile_degrees      The smile degrees outputted.
+ *                                    They range from 0 to 100.
+ *
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_smiles(qcff_handle_t handle, uint32_t num_faces_queried,
+        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
+        uint32_t *p_smile_degrees) {
+    qcff_complete_face_info_t complete_info = empty_info;
+
+    if (!p_smile_degrees)
+        return QCFF_RET_INVALID_PARM;
+
+    complete_info.p_smile_degrees = p_smile_degrees;
+
+    return qcff_get_complete_info(handle, num_faces_queried, p_face_indices,
+            p_num_faces_returned, &complete_info);
+}
+
+/*************************************************************************
+ * qcff_get_eye_opens
+ *
+ * This function retrieves the eye open-close degree of the detected faces.
+ * It allows multiple faces to be retrieved by taking an array of face
+ * indices corresponding to the faces requested. The output
+ * will be an array of eye open-close degrees. They range from 0 to 100
+ * with 0 meaning complete close of the eye.
+ * The face indices are zero-based and should be between 0 to the
+ * number of detected faces - 1.
+ *
+ * INPUT:        handle               Handle to QCFF instance created
+ *                                    previously.
+ *               num_faces_queried    The number of faces being queried.
+ *                                    (it determines how many entries in
+ *                                    p_face_indices to be read)
+ *               p_face_indices       The indices of the faces in which
+ *                                    the facial parts information is
+ *                                    requested. Whenever an invalid
+ *                                    face index is encountered, the
+ *                                    function call ends.
+ *                                    p_num_faces_returned indicates how
+ *                                    many faces are returned before
+ *                                    the error happened.
+ * OUTPUT:       p_num_faces_returned Returns the actual number of
+ *                                    entries returned. It might be
+ *                                    less than the number of faces queried
+ *                                    if the number queried is actually
+ *                                    more than the available faces.
+ *               p_eye_open_degrees   The eye open-close degree outputted.
+ *
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_eye_opens(qcff_handle_t handle, uint32_t num_faces_queried,
+        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
+        qcff_eye_open_deg_t *p_eye_open_degrees) {
+    qcff_complete_face_info_t complete_info = empty_info;
+
+    if (!p_eye_open_degrees)
+        return QCFF_RET_INVALID_PARM;
+
+    complete_info.p_eye_open_degrees = p_eye_open_degrees;
+
+    return qcff_get_complete_info(handle, num_faces_queried, p_face_indices,
+            p_num_faces_returned, &complete_info);
+}
+
+/*************************************************************************
+ * qcff_get_gaze_degs
+ *
+ * This function retrieves the gaze degree of the detected faces.
+ * It allows multiple faces to be retrieved by taking an array of face
+ * indices corresponding to the faces requested. The output
+ * will be an array of gaze degrees. They range from -90 to 90 for
+ * both the left-right and up-down plane.
+ * The face indices are zero-based and should be between 0 to the
+ * number of detected faces - 1.
+ *
+ * INPUT:        handle               Handle to QCFF instance created
+ *                                    previously.
+ *               num_faces_queried    The number of faces being queried.
+ *                                    (it determines how many entries in
+ *                                    p_face_indices to be read)
+ *               p_face_indices       The indices of the faces in which
+ *                                    the gaze degree information is
+ *                                    requested. Whenever an invalid
+ *                                    face index is encountered, the
+ *                                    function call ends.
+ *                                    p_num_faces_returned indicates how
+ *                                    many faces are returned before
+ *                                    the error happened.
+ * OUTPUT:       p_num_faces_returned Returns the actual number of
+ *                                    entries returned. It might be
+ *                                    less than the number of faces queried
+ *                                    if the number queried is actually
+ *                                    more than the available faces.
+ *               p_gaze_degrees       The gaze degree outputted.
+ *
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_gaze_degs(qcff_handle_t handle, uint32_t num_faces_queried,
+        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
+        qcff_gaze_deg_t *p_gaze_degrees) {
+    qcff_complete_face_info_t complete_info = empty_info;
+
+    if (!p_gaze_degrees)
+        return QCFF_RET_INVALID_PARM;
+
+    complete_info.p_gaze_degrees = p_gaze_degrees;
+
+    return qcff_get_complete_info(handle, num_faces_queried, p_face_indices,
+            p_num_faces_returned, &complete_info);
+}
+
+/*************************************************************************
+ * qcff_get_directions
+ *
+ * This function retrieves the face directions of the detected faces.
+ * It allows multiple faces to be retrieved by taking an array of face
+ * indices corresponding to the faces requested. The output
+ * will be an array of face directions.
+ * The face indices are zero-based and should be between 0 to the
+ * number of detected faces - 1.
+
+ * INPUT:        handle               Handle to QCFF instance created
+ *                                    previously.
+ *               num_faces_queried    The number of faces being queried.
+ *                                    (it determines how many entries in
+ *                                    p_face_indices to be read)
+ *               p_face_indices       The indices of the faces in which
+ *                                    the facial parts information is
+ *                                    requested. Whenever an invalid
+ *                                    face index is encountered, the
+ *                                    function call ends.
+ *                                    p_num_faces_returned indicates how
+ *                                    many faces are returned before
+ *                                    the error happened.
+ * OUTPUT:       p_num_faces_returned Returns the actual number of
+ *                                    entries returned. It might be
+ *                                    less than the number of faces queried
+ *                                    if the number queried is actually
+ *                                    more than the available faces.
+ *               p_face_directions    The face directions outputted.
+
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_directions(qcff_handle_t handle, uint32_t num_faces_queried,
+        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
+        qcff_face_dir_t *p_face_directions) {
+    qcff_complete_face_info_t complete_info = empty_info;
+
+    if (!p_face_directions)
+        return QCFF_RET_INVALID_PARM;
+
+    complete_info.p_directions = p_face_directions;
+
+    return qcff_get_complete_info(handle, num_faces_queried, p_face_indices,
+            p_num_faces_returned, &complete_info);
+}
+
+/*************************************************************************
+ * qcff_get_complete_info
+ *
+ * This function retrieves the all possible information about each face
+ * such as locations, directions, smile degrees, eye open-close degrees, etc.
+ * It allows multiple faces to be retrieved by taking an array of face
+ * indices corresponding to the information requested. The output
+ * is an array for a structure containing pointers to various information
+ * of the face. For each face, user can select a subset of information to
+ * retrieve by providing valid pointers to those information in interest.
+ * For other pointers, they can be set to NULL. The function will skip
+ * for pointers that are NULL. The face indices are zero-based and should be
+ * between 0 to the number of detected faces - 1.
+
+ * INPUT:        handle               Handle to QCFF instance created
+ *                                    previously.
+ *               num_faces_queried    The number of faces being queried.
+ *                                    (it determines how many entries in
+ *                                    p_face_indices to be read)
+ *               p_face_indices       The indices of the faces in which
+ *                                    the complete information is
+ *                                    requested. Whenever an invalid
+ *                                    face index is encountered, the
+ *                                    function call ends.
+ *                                    p_num_faces_returned indicates how
+ *                                    many faces are returned before
+ *                                    the error happened.
+ * OUTPUT:       p_num_faces_returned Returns the actual number of
+ *                                    entries returned. It might be
+ *                                    less than the number of faces queried
+ *                                    if the number queried is actually
+ *                                    more than the available faces.
+ *               p_complete_info      The complete infos outputted.
+
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_get_complete_info(qcff_handle_t handle, uint32_t num_faces_queried,
+        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
+        qcff_complete_face_info_t *p_complete_info) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+
+    if (p_qcff && QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
+    return qcff_collect_info(p_qcff, num_faces_queried, p_face_indices,
+            p_num_faces_returned, p_complete_info);
+}
+
+static int qcff_collect_info(qcff_t *p_qcff, uint32_t num_faces_queried,
+        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
+        qcff_complete_face_info_t *p_complete_info) {
+    qcff_face_engines_t engines;
+    FACEINFO face_info;
+    uint32_t i;
+
+    /*if (!p_qcff || !p_complete_info || !p_face_indices || !p_num_faces_returned)
+     return QCFF_RET_INVALID_PARM;*/
+
+    /* The faces past the budget are told apart before any worker runs */
+    if (p_qcff->face_budget)
+        qcff_rank_update(p_qcff);
+
+    /* Faces spread over the analysis workers when there are several */
+    if (qcff_faces_parallel(p_qcff, num_faces_queried, p_face_indices,
+            p_complete_info))
+        return qcff_collect_parallel(p_qcff, num_faces_queried,
+                p_face_indices, p_num_faces_returned, p_complete_info);
+
+    /* Loop through each requested face */
+    qcff_own_engines(p_qcff, &engines);
+    for (i = 0; i < num_faces_queried; i++) {
+        if (FACEPROC_NORMAL
+                != qcff_dt_face_info(p_qcff, p_face_indices[i], &face_info))
+            break;
+        if (QCFF_RET_SUCCESS
+                != qcff_analyze_face(p_qcff, &engines, &p_qcff->roi,
+                        p_face_indices[i], &face_info,
+                        qcff_attr_track(p_qcff, &face_info),
+                        p_complete_info, i))
+            break;
+    }
+
+    *p_num_faces_returned = i;
+    return QCFF_RET_SUCCESS;
+}
+
+/* Fills entry i of p_complete_info for one face, with the given engines
+ and crop; the engines of a face analysis worker or the handle's own.
+ With a track, the attributes not due are taken from it, and parts are
+ only found when something needs them */
+static int qcff_analyze_face(qcff_t *p_qcff,
+        const qcff_face_engines_t *p_engines, qcff_roi_t *p_roi,
+        uint32_t face_index, const FACEINFO *p_face_info,
+        qcff_attr_track_t *p_track,
+        qcff_complete_face_info_t *p_complete_info, uint32_t i) {
+    qcff_attr_rates_t *p_rates = &p_qcff->attr_rates;
+    qcff_parts_cache_t *p_parts = NULL;
+    uint8_t smile_due, gb_due, dir_due;
+    uint32_t j;
+
+    /* Face Rectangle requested */
+    if (p_complete_info->p_rects) {
+        FACEINFO face_info = *p_face_info;
+
+        /* Downscale processing: back to input frame coordinates */
+        qcff_map_point(p_qcff, &face_info.ptLeftTop);
+        qcff_map_point(p_qcff, &face_info.ptRightTop);
+        qcff_map_point(p_qcff, &face_info.ptLeftBottom);
+        qcff_map_point(p_qcff, &face_info.ptRightBottom);
+
+        qcff_translate_face_info_to_rect(&face_info,
+                &(p_complete_info->p_rects[i]));
+    }
+
+    /* Past the budget of the frame only the rectangle is returned */
+    if (!qcff_face_in_budget(p_qcff, face_index)) {
+        qcff_clear_face(p_complete_info, i);
+        return QCFF_RET_SUCCESS;
+    }
+
+    smile_due = p_complete_info->p_smile_degrees && (!p_track
+            || qcff_attr_due(p_qcff, p_track->smile_seq,
+                    p_rates->smile_interval));
+    gb_due = (p_complete_info->p_eye_open_degrees
+            || p_complete_info->p_gaze_degrees) && (!p_track
+            || qcff_attr_due(p_qcff, p_track->gb_seq,
+                    p_rates->gaze_blink_interval));
+    dir_due = p_complete_info->p_directions && (!p_track
+            || qcff_attr_due(p_qcff, p_track->dir_seq,
+                    p_rates->direction_interval));
+
+    /* Perform parts detection of any other info requested */
+    if (p_complete_info->p_parts || p_complete_info->p_parts_ex
+            || smile_due || gb_due || dir_due) {
+
+        /* Do parts detection on the crop around the face */
+        if (QCFF_RET_SUCCESS
+                != qcff_detect_parts(p_qcff, p_engines, p_roi, face_index,
+                        p_face_info, &p_parts))
+            return QCFF_RET_FAILURE;
+
+        /* Extract parts information if requested */
+        if (p_complete_info->p_parts) {
+            POINT points[QCFF_PARTS_MAX];
+            INT32 confs[QCFF_PARTS_MAX];
+
+            if (FACEPROC_NORMAL
+                    != FACEPROC_PT_GetResult(p_parts->hpt_result,
+                            QCFF_PARTS_MAX, points, confs))
+                return QCFF_RET_FAILURE;
+
+            for (j = 0; j < QCFF_PARTS_MAX; j++) {
+                qcff_map_roi_point(p_qcff, p_roi, &points[j]);
+                p_complete_info->p_parts[i].parts[j].x = points[j].x;
+                p_complete_info->p_parts[i].parts[j].y = points[j].y;
+            }
+        }
+
+        /* Extract extended parts information if requested */
+        if (p_complete_info->p_parts_ex) {
+            POINT point;
+
+            if (QCFF_RET_SUCCESS
+                    != qcff_detect_contour(p_engines, p_roi, p_parts))
+                return QCFF_RET_FAILURE;
+
+            for (j = 0; j < QCFF_PARTS_EX_MAX; j++) {
+                point = p_parts->ct_points[j];
+                qcff_map_roi_point(p_qcff, p_roi, &point);
+                p_complete_info->p_parts_ex[i].parts[j].x = point.x;
+                p_complete_info->p_parts_ex[i].parts[j].y = point.y;
+            }
+        }
+    } /* If infos other than rectangles is needed */
+
+    /* Extract Face Direction, for free once the parts are found */
+    if (p_complete_info->p_directions) {
+        if (p_parts) {
+            if (FACEPROC_NORMAL
+                    != FACEPROC_PT_GetFaceDirection(p_parts->hpt_result,
+                            (INT32*) &p_complete_info->p_directions[i].up_down_in_degree,
+                            (INT32*) &p_complete_info->p_directions[i].left_right_in_degree,
+                            (INT32*) &p_complete_info->p_directions[i].roll_in_degree))
+                return QCFF_RET_FAILURE;
+            if (p_track) {
+                p_track->direction = p_complete_info->p_directions[i];
+                p_track->dir_seq = p_qcff->frame_seq;
+            }
+        } else {
+            p_complete_info->p_directions[i] = p_track->direction;
+        }
+    }
+
+    /* Perform smile degree estimation if requested */
+    if (smile_due) {
+        INT32 smile_conf;
+        /* Set Smile Estimation Point from handle */
+        if (FACEPROC_NORMAL
+                != FACEPROC_SM_SetPointFromHandle(p_engines->hsm,
+                        p_parts->hpt_result))
+            return QCFF_RET_FAILURE;
+
+        /* Do Smile Estimation */
+        if (FACEPROC_NORMAL
+                != FACEPROC_SM_Estimate(p_engines->hsm,
+                        (RAWIMAGE *) p_roi->p_pixels,
+                        p_roi->width,
+                        p_roi->height,
+                        p_engines->hsm_result))
+            return QCFF_RET_FAILURE;
+
+        /* Extract Result */
+        if (FACEPROC_NORMAL
+                != FACEPROC_SM_GetResult(p_engines->hsm_result,
+                        (INT32*) &p_complete_info->p_smile_degrees[i],
+                        &smile_conf))
+            return QCFF_RET_FAILURE;
+        if (p_track) {
+            p_track->smile = p_complete_info->p_smile_degrees[i];
+            p_track->smile_seq = p_qcff->frame_seq;
+        }
+    } else if (p_complete_info->p_smile_degrees) {
+        p_complete_info->p_smile_degrees[i] = p_track->smile;
+    }
+
+    /* Perform gaze-blink estimation if requested */
+    if (gb_due) {
+        qcff_gaze_deg_t gaze;
+        qcff_eye_open_deg_t eye_open;
+
+        /* Set Gaze-Blink Estimation Point from handle */
+        if (FACEPROC_NORMAL
+                != FACEPROC_GB_SetPointFromHandle(p_engines->hgb,
+                        p_parts->hpt_result))
+            return QCFF_RET_FAILURE;
+
+        /* Do Gaze-Blink Estimation */
+        if (FACEPROC_NORMAL
+                != FACEPROC_GB_Estimate(p_engines->hgb,
+                        (RAWIMAGE *) p_roi->p_pixels,
+                        p_roi->width,
+                        p_roi->height,
+                        p_engines->hgb_result))
+            return QCFF_RET_FAILURE;
+
+        /* Extract Gaze and Eye Open-Close Results, both kept for the
+         track whichever was asked for */
+        if (FACEPROC_NORMAL
+                != FACEPROC_GB_GetGazeDirection(p_engines->hgb_result,
+                        (INT32*) &gaze.left_right,
+                        (INT32*) &gaze.up_down))
+            return QCFF_RET_FAILURE;
+        if (FACEPROC_NORMAL
+                != FACEPROC_GB_GetEyeCloseRatio(p_engines->hgb_result,
+                        (INT32*) &eye_open.left,
+                        (INT32*) &eye_open.right))
+            return QCFF_RET_FAILURE;
+        eye_open.left /= 10;
+        eye_open.right /= 10;
+        if (p_track) {
+            p_track->gaze = gaze;
+            p_track->eye_open = eye_open;
+            p_track->gb_seq = p_qcff->frame_seq;
+        }
+        if (p_complete_info->p_gaze_degrees)
+            p_complete_info->p_gaze_degrees[i] = gaze;
+        if (p_complete_info->p_eye_open_degrees)
+            p_complete_info->p_eye_open_degrees[i] = eye_open;
+    } else {
+        if (p_complete_info->p_gaze_degrees)
+            p_complete_info->p_gaze_degrees[i] = p_track->gaze;
+        if (p_complete_info->p_eye_open_degrees)
+            p_complete_info->p_eye_open_degrees[i] = p_track->eye_open;
+    }
+
+    /* Age of what was returned */
+    if (p_complete_info->p_attr_ages) {
+        qcff_attr_age_t *p_age = &p_complete_info->p_attr_ages[i];
+
+        memset(p_age, 0, sizeof(qcff_attr_age_t));
+        if (p_track) {
+            if (p_track->smile_seq)
+                p_age->smile = p_qcff->frame_seq - p_track->smile_seq;
+            if (p_track->gb_seq)
+                p_age->gaze_blink = p_qcff->frame_seq - p_track->gb_seq;
+            if (p_track->dir_seq)
+                p_age->direction = p_qcff->frame_seq - p_track->dir_seq;
+        }
+    }
+
+    return QCFF_RET_SUCCESS;
+}
+
+/* Track of a face for its attributes, NULL when they are not decimated.
+ A face that moved, resized or turned too much since it was last forced
+ has all of its attributes due */
+static qcff_attr_track_t *qcff_attr_track(qcff_t *p_qcff,
+        const FACEINFO *p_face_info) {
+    qcff_attr_track_t *p_track = NULL, *p_oldest = NULL;
+    int32_t left, top, right, bottom, cx, cy, size, move;
+    uint32_t i;
+
+    if (!p_qcff->attr_decimate || p_qcff->mode == QCFF_MODE_STILL)
+        return NULL;
+
+    for (i = 0; i < QCFF_MAX_RESULT_FACES && !p_track; i++) {
+        qcff_attr_track_t *p_entry = &p_qcff->attr_tracks[i];
+
+        if (p_entry->seen_seq && p_entry->id == p_face_info->nID)
+            p_track = p_entry;
+        else if (!p_oldest || p_entry->seen_seq < p_oldest->seen_seq)
+            p_oldest = p_entry;
+    }
+
+    left = MIN4(p_face_info->ptLeftTop.x, p_face_info->ptRightTop.x,
+            p_face_info->ptLeftBottom.x, p_face_info->ptRightBottom.x);
+    right = MAX4(p_face_info->ptLeftTop.x, p_face_info->ptRightTop.x,
+            p_face_info->ptLeftBottom.x, p_face_info->ptRightBottom.x);
+    top = MIN4(p_face_info->ptLeftTop.y, p_face_info->ptRightTop.y,
+            p_face_info->ptLeftBottom.y, p_face_info->ptRightBottom.y);
+    bottom = MAX4(p_face_info->ptLeftTop.y, p_face_info->ptRightTop.y,
+            p_face_info->ptLeftBottom.y, p_face_info->ptRightBottom.y);
+    cx = (left + right) / 2;
+    cy = (top + bottom) / 2;
+    size = MAX2(right - left, bottom - top);
+
+    if (!p_track) {
+        p_track = p_oldest;
+        memset(p_track, 0, sizeof(qcff_attr_track_t));
+        p_track->id = p_face_info->nID;
+    } else if (p_track->seen_seq != p_qcff->frame_seq) {
+        move = (int32_t) (p_qcff->attr_rates.move_percent * p_track->size
+                / 100);
+        if (p_track->pose != p_face_info->nPose
+                || (p_qcff->attr_rates.move_percent
+                        && (abs(cx - p_track->cx) > move
+                                || abs(cy - p_track->cy) > move
+                                || abs(size - p_track->size) > move))) {
+            p_track->smile_seq = 0;
+            p_track->gb_seq = 0;
+            p_track->dir_seq = 0;
+        }
+    }
+    if (!p_track->smile_seq && !p_track->gb_seq && !p_track->dir_seq) {
+        p_track->cx = cx;
+        p_track->cy = cy;
+        p_track->size = size;
+        p_track->pose = p_face_info->nPose;
+    }
+    p_track->seen_seq = p_qcff->frame_seq;
+    return p_track;
+}
+
+/* An attribute estimated on frame seq is due again after interval frames */
+static uint8_t qcff_attr_due(qcff_t *p_qcff, uint32_t seq, uint32_t interval) {
+    return !seq || p_qcff->frame_seq - seq >= MAX2(interval, 1);
+}
+
+/* Recognition entry of a detected face, NULL when the cache is off. A
+ face turned to another pose since it was identified is due again */
+static qcff_recog_track_t *qcff_recog_track(qcff_t *p_qcff,
+        uint32_t face_index) {
+    qcff_recog_track_t *p_track = NULL, *p_oldest = NULL;
+    FACEINFO face_info;
+    uint32_t i;
+
+    if (!p_qcff->recog_interval || p_qcff->mode == QCFF_MODE_STILL)
+        return NULL;
+    if (FACEPROC_NORMAL != qcff_dt_face_info(p_qcff, face_index, &face_info))
+        return NULL;
+
+    for (i = 0; i < QCFF_MAX_RESULT_FACES && !p_track; i++) {
+        qcff_recog_track_t *p_entry = &p_qcff->recog_tracks[i];
+
+        if (p_entry->valid && p_entry->id == face_info.nID)
+            p_track = p_entry;
+        else if (!p_oldest || !p_entry->valid || (p_oldest->valid
+                && p_entry->verify_seq < p_oldest->verify_seq))
+            p_oldest = p_entry;
+    }
+
+    if (!p_track) {
+        p_track = p_oldest;
+        memset(p_track, 0, sizeof(qcff_recog_track_t));
+        p_track->id = face_info.nID;
+        p_track->valid = TRUE;
+    } else if (p_track->pose != face_info.nPose) {
+        p_track->verify_seq = 0;
+    }
+    p_track->pose = face_info.nPose;
+    return p_track;
+}
+
+/* Drops the recognition entries of the faces the tracker lost, so that a
+ face coming back is identified again */
+static void qcff_recog_sweep(qcff_t *p_qcff) {
+    INT32 ids[QCFF_MAX_RESULT_FACES];
+    FACEINFO face_info;
+    uint32_t num_ids = 0, i, j;
+
+    for (i = 0; i < p_qcff->num_faces && num_ids < QCFF_MAX_RESULT_FACES;
+            i++)
+        if (FACEPROC_NORMAL == qcff_dt_face_info(p_qcff, i, &face_info))
+            ids[num_ids++] = face_info.nID;
+
+    for (i = 0; i < QCFF_MAX_RESULT_FACES; i++) {
+        qcff_recog_track_t *p_entry = &p_qcff->recog_tracks[i];
+
+        if (!p_entry->valid)
+            continue;
+        for (j = 0; j < num_ids && ids[j] != p_entry->id; j++)
+            ;
+        if (j == num_ids)
+            p_entry->valid = FALSE;
+    }
+}
+
+/* Ranks the faces of the current frame, once per frame. In video mode
+ the tracks of the faces gone are dropped before the new ones get one */
+static void qcff_rank_update(qcff_t *p_qcff) {
+    FACEINFO faces[QCFF_MAX_RESULT_FACES];
+    uint32_t scores[QCFF_MAX_RESULT_FACES];
+    qcff_rank_track_t *p_entry;
+    uint32_t num_faces, age, i, j;
+    uint8_t video = (p_qcff->mode != QCFF_MODE_STILL);
+
+    if (p_qcff->rank_valid && p_qcff->rank_seq == p_qcff->frame_seq)
+        return;
+
+    for (num_faces = 0; num_faces < MIN2(p_qcff->num_faces,
+            QCFF_MAX_RESULT_FACES); num_faces++)
+        if (FACEPROC_NORMAL
+                != qcff_dt_face_info(p_qcff, num_faces, &faces[num_faces]))
+            break;
+
+    if (video) {
+        for (i = 0; i < QCFF_MAX_RESULT_FACES; i++) {
+            p_entry = &p_qcff->rank_tracks[i];
+            for (j = 0; j < num_faces && faces[j].nID != p_entry->id; j++)
+                ;
+            if (j == num_faces)
+                p_entry->valid = FALSE;
+        }
+    }
+
+    /* Insertion by score, the lower index first among equals */
+    for (i = 0; i < num_faces; i++) {
+        age = 0;
+        if (video) {
+            qcff_rank_track_t *p_free = NULL;
+
+            for (j = 0; j < QCFF_MAX_RESULT_FACES; j++) {
+                p_entry = &p_qcff->rank_tracks[j];
+                if (p_entry->valid && p_entry->id == faces[i].nID)
+                    break;
+                if (!p_entry->valid && !p_free)
+                    p_free = p_entry;
+            }
+            if (j < QCFF_MAX_RESULT_FACES) {
+                age = p_qcff->frame_seq - p_entry->first_seq;
+            } else if (p_free) {
+                p_free->id = faces[i].nID;
+                p_free->valid = TRUE;
+                p_free->first_seq = p_qcff->frame_seq;
+            }
+        }
+        scores[i] = qcff_rank_score(p_qcff, &faces[i], age);
+
+        for (j = i; j > 0 && scores[p_qcff->rank_order[j - 1]] < scores[i];
+                j--)
+            p_qcff->rank_order[j] = p_qcff->rank_order[j - 1];
+        p_qcff->rank_order[j] = i;
+    }
+
+    memset(p_qcff->rank_pos, 0xFF, sizeof(p_qcff->rank_pos));
+    for (i = 0; i < num_faces; i++)
+        p_qcff->rank_pos[p_qcff->rank_order[i]] = (uint8_t) i;
+    p_qcff->num_ranked = num_faces;
+    p_qcff->rank_seq = p_qcff->frame_seq;
+    p_qcff->rank_valid = TRUE;
+}
+
+/* Importance of a face, in input frame coordinates so that the crop and
+ the downscaling do not matter */
+static uint32_t qcff_rank_score(qcff_t *p_qcff, const FACEINFO *p_info,
+        uint32_t age) {
+    const qcff_rect_t *p_crop = &p_qcff->crop;
+    int64_t box[4];
+    POINT lt, rb;
+    uint32_t size_q8, off_q8, dx, dy;
+
+    qcff_face_box(p_info, box);
+    lt.x = (INT32) box[0];
+    lt.y = (INT32) box[1];
+    rb.x = (INT32) box[2];
+    rb.y = (INT32) box[3];
+    qcff_map_point(p_qcff, &lt);
+    qcff_map_point(p_qcff, &rb);
+
+    size_q8 = (uint32_t) MAX2(rb.x - lt.x, rb.y - lt.y) * QCFF_SCALE_ONE
+            / MAX2(MIN2(p_crop->dx, p_crop->dy), 1);
+    size_q8 = MIN2(size_q8, 2 * QCFF_SCALE_ONE);
+
+    /* Offset of the centre, from 0 at the centre to 256 at the border */
+    dx = (uint32_t) abs((lt.x + rb.x) - (int32_t) (2 * p_crop->x + p_crop->dx));
+    dy = (uint32_t) abs((lt.y + rb.y) - (int32_t) (2 * p_crop->y + p_crop->dy));
+    off_q8 = MAX2(dx * QCFF_SCALE_ONE / MAX2(p_crop->dx, 1),
+            dy * QCFF_SCALE_ONE / MAX2(p_crop->dy, 1));
+    off_q8 = MIN2(off_q8, QCFF_SCALE_ONE);
+
+    age = MIN2(age, QCFF_RANK_AGE_MAX);
+    return size_q8 * (QCFF_SCALE_ONE - off_q8 / 2)
+            / QCFF_SCALE_ONE * (QCFF_SCALE_ONE * 2 * QCFF_RANK_AGE_MAX + age
+                    * QCFF_SCALE_ONE) / (2 * QCFF_RANK_AGE_MAX);
+}
+
+/* The ranking must be up to date when a budget is set */
+static uint8_t qcff_face_in_budget(qcff_t *p_qcff, uint32_t face_index) {
+    return !p_qcff->face_budget || (face_index < QCFF_MAX_RESULT_FACES
+            && p_qcff->rank_pos[face_index] < p_qcff->face_budget);
+}
+
+/* Zeroes entry i of everything but the rectangles */
+static void qcff_clear_face(qcff_complete_face_info_t *p_complete_info,
+        uint32_t i) {
+    if (p_complete_info->p_parts)
+        memset(&p_complete_info->p_parts[i], 0, sizeof(qcff_face_parts_t));
+    if (p_complete_info->p_parts_ex)
+        memset(&p_complete_info->p_parts_ex[i], 0,
+                sizeof(qcff_face_parts_ex_t));
+    if (p_complete_info->p_directions)
+        memset(&p_complete_info->p_directions[i], 0, sizeof(qcff_face_dir_t));
+    if (p_complete_info->p_smile_degrees)
+        p_complete_info->p_smile_degrees[i] = 0;
+    if (p_complete_info->p_eye_open_degrees)
+        memset(&p_complete_info->p_eye_open_degrees[i], 0,
+                sizeof(qcff_eye_open_deg_t));
+    if (p_complete_info->p_gaze_degrees)
+        memset(&p_complete_info->p_gaze_degrees[i], 0,
+                sizeof(qcff_gaze_deg_t));
+    if (p_complete_info->p_attr_ages)
+        memset(&p_complete_info->p_attr_ages[i], 0, sizeof(qcff_attr_age_t));
+}
+
+static void qcff_own_engines(qcff_t *p_qcff, qcff_face_engines_t *p_engines) {
+    p_engines->hpt = p_qcff->hpt;
+    p_engines->hsm = p_qcff->hsm;
+    p_engines->hsm_result = p_qcff->hsm_result;
+    p_engines->hgb = p_qcff->hgb;
+    p_engines->hgb_result = p_qcff->hgb_result;
+    p_engines->hct = p_qcff->hct;
+    p_engines->hct_result = p_qcff->hct_result;
+}
+
+/* Worth spreading: workers are set up, more than one face wants more
+ than its rectangle, and no face is asked for twice, since the parts of a
+ face are found by whichever worker takes it */
+static uint8_t qcff_faces_parallel(qcff_t *p_qcff, uint32_t num_faces_queried,
+        const uint32_t *p_face_indices,
+        const qcff_complete_face_info_t *p_complete_info) {
+    uint32_t i, j;
+
+    if (!p_qcff->p_face_pool || num_faces_queried < 2
+            || num_faces_queried > QCFF_MAX_RESULT_FACES)
+        return FALSE;
+    if (!p_complete_info->p_parts && !p_complete_info->p_parts_ex
+            && !p_complete_info->p_smile_degrees
+            && !p_complete_info->p_gaze_degrees
+            && !p_complete_info->p_eye_open_degrees
+            && !p_complete_info->p_directions)
+        return FALSE;
+    for (i = 1; i < num_faces_queried; i++)
+        for (j = 0; j < i; j++)
+            if (p_face_indices[i] == p_face_indices[j])
+                return FALSE;
+    return TRUE;
+}
+
+/* qcff_collect_info over the workers. Each face is written to its own
+ entries by the worker that takes it, so the result does not depend on
+ the order they run in; the faces up to the first failure are returned */
+static int qcff_collect_parallel(qcff_t *p_qcff, uint32_t num_faces_queried,
+        uint32_t *p_face_indices, uint32_t *p_num_faces_returned,
+        qcff_complete_face_info_t *p_complete_info) {
+    qcff_face_pool_t *p_pool = p_qcff->p_face_pool;
+    uint32_t num_jobs, i;
+
+    /* Worker crops as large as the handle's; without one, faces are
+     processed in place */
+    for (i = 1; i < p_pool->num_workers; i++) {
+        qcff_roi_t *p_roi = &p_pool->p_workers[i].roi;
+
+        if (p_roi->capacity < p_qcff->roi.capacity) {
+            free(p_roi->p_buffer);
+            p_roi->p_buffer = (uint8_t *) malloc(p_qcff->roi.capacity);
+            p_roi->capacity = p_roi->p_buffer ? p_qcff->roi.capacity : 0;
+            p_roi->face_index = -1;
+        }
+    }
+
+    /* Detection info and tracks are looked up here, the engines only
+     touch their own handles and the parts and track of their faces */
+    for (num_jobs = 0; num_jobs < num_faces_queried; num_jobs++) {
+        if (FACEPROC_NORMAL != qcff_dt_face_info(p_qcff,
+                p_face_indices[num_jobs], &p_pool->faces[num_jobs]))
+            break;
+        p_pool->p_tracks[num_jobs] = qcff_attr_track(p_qcff,
+                &p_pool->faces[num_jobs]);
+    }
+
+    pthread_mutex_lock(&p_pool->lock);
+    p_pool->p_qcff = p_qcff;
+    p_pool->p_face_indices = p_face_indices;
+    p_pool->p_complete_info = p_complete_info;
+    p_pool->num_jobs = num_jobs;
+    p_pool->next_job = 0;
+    p_pool->jobs_done = 0;
+    p_pool->generation++;
+    pthread_cond_broadcast(&p_pool->start_cond);
+    qcff_face_jobs_run(&p_pool->p_workers[0], p_pool->generation);
+    while (p_pool->jobs_done < num_jobs)
+        pthread_cond_wait(&p_pool->done_cond, &p_pool->lock);
+    pthread_mutex_unlock(&p_pool->lock);
+
+    for (i = 0; i < num_jobs; i++)
+        if (QCFF_FAILED(p_pool->status[i]))
+            break;
+    *p_num_faces_returned = i;
+    return QCFF_RET_SUCCESS;
+}
+
+/* Runs the faces of a query until none is left; called and returns with
+ the lock held */
+static void qcff_face_jobs_run(qcff_face_worker_t *p_worker,
+        uint32_t generation) {
+    qcff_face_pool_t *p_pool = p_worker->p_pool;
+    qcff_face_engines_t engines;
+    qcff_roi_t *p_roi = &p_worker->roi;
+    uint32_t job;
+
+    /* The first worker runs on the handle's own engines and crop */
+    engines = p_worker->engines;
+    if (p_worker == &p_pool->p_workers[0]) {
+        qcff_own_engines(p_pool->p_qcff, &engines);
+        p_roi = &p_pool->p_qcff->roi;
+    }
+    while (p_pool->generation == generation
+            && p_pool->next_job < p_pool->num_jobs) {
+        job = p_pool->next_job++;
+        pthread_mutex_unlock(&p_pool->lock);
+        p_pool->status[job] = qcff_analyze_face(p_pool->p_qcff, &engines,
+                p_roi, p_pool->p_face_indices[job], &p_pool->faces[job],
+                p_pool->p_tracks[job], p_pool->p_complete_info, job);
+        pthread_mutex_lock(&p_pool->lock);
+        if (++p_pool->jobs_done == p_pool->num_jobs)
+            pthread_cond_broadcast(&p_pool->done_cond);
+    }
+}
+
+static void *qcff_face_thread(void *arg) {
+    qcff_face_worker_t *p_worker = (qcff_face_worker_t *) arg;
+    qcff_face_pool_t *p_pool = p_worker->p_pool;
+    uint32_t generation;
+
+    pthread_mutex_lock(&p_pool->lock);
+    generation = p_pool->generation;
+    while (!p_pool->stop) {
+        if (p_pool->generation == generation) {
+            pthread_cond_wait(&p_pool->start_cond, &p_pool->lock);
+            continue;
+        }
+        generation = p_pool->generation;
+        qcff_face_jobs_run(p_worker, generation);
+    }
+    pthread_mutex_unlock(&p_pool->lock);
+    return NULL;
+}
+
+static int qcff_face_engines_create(qcff_face_engines_t *p_engines) {
+    p_engines->hpt = FACEPROC_PT_CreateHandle();
+    p_engines->hsm = FACEPROC_SM_CreateHandle();
+    p_engines->hsm_result = FACEPROC_SM_CreateResultHandle();
+    p_engines->hgb = FACEPROC_GB_CreateHandle();
+    p_engines->hgb_result = FACEPROC_GB_CreateResultHandle();
+    p_engines->hct = FACEPROC_CT_CreateHandle();
+    p_engines->hct_result = FACEPROC_CT_CreateResultHandle();
+    if (!p_engines->hpt || !p_engines->hsm || !p_engines->hsm_result
+            || !p_engines->hgb || !p_engines->hgb_result
+            || !p_engines->hct || !p_engines->hct_result) {
+        QCFF_LOG("face analysis engines could not be created");
+        return QCFF_RET_NO_RESOURCE;
+    }
+    return QCFF_RET_SUCCESS;
+}
+
+static void qcff_face_engines_free(qcff_face_engines_t *p_engines) {
+    if (p_engines->hct_result)
+        FACEPROC_CT_DeleteResultHandle(p_engines->hct_result);
+    if (p_engines->hct)
+        FACEPROC_CT_DeleteHandle(p_engines->hct);
+    if (p_engines->hgb_result)
+        FACEPROC_GB_DeleteResultHandle(p_engines->hgb_result);
+    if (p_engines->hgb)
+        FACEPROC_GB_DeleteHandle(p_engines->hgb);
+    if (p_engines->hsm_result)
+        FACEPROC_SM_DeleteResultHandle(p_engines->hsm_result);
+    if (p_engines->hsm)
+        FACEPROC_SM_DeleteHandle(p_engines->hsm);
+    if (p_engines->hpt)
+        FACEPROC_PT_DeleteHandle(p_engines->hpt);
+    memset(p_engines, 0, sizeof(qcff_face_engines_t));
+}
+
+/* Stops the threads and releases the engines of the face analysis
+ workers */
+static void qcff_face_pool_free(qcff_face_pool_t *p_pool) {
+    uint32_t i;
+
+    pthread_mutex_lock(&p_pool->lock);
+    p_pool->stop = TRUE;
+    pthread_cond_broadcast(&p_pool->start_cond);
+    pthread_mutex_unlock(&p_pool->lock);
+    for (i = 1; i < p_pool->num_workers; i++) {
+        pthread_join(p_pool->p_workers[i].thread, NULL);
+        qcff_face_engines_free(&p_pool->p_workers[i].engines);
+        free(p_pool->p_workers[i].roi.p_buffer);
+    }
+    pthread_cond_destroy(&p_pool->done_cond);
+    pthread_cond_destroy(&p_pool->start_cond);
+    pthread_mutex_destroy(&p_pool->lock);
+    free(p_pool->p_workers);
+    free(p_pool);
+}
+
+/*************************************************************************
+ * qcff_transform_complete_info
+ *
+ * This function applies a display transform (mirroring, rotation and
+ * scaling) to the information returned by qcff_get_complete_info. All
+ * points of all faces go through the same integer affine map, so no
+ * per-point trigonometry is involved.
+ *
+ * INPUT:        handle               Handle to QCFF instance created
+ *                                    previously.
+ *               p_transform          Transform to apply.
+ *               num_faces            The number of entries per array.
+ *               p_complete_info      The complete info to transform.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_transform_complete_info(qcff_handle_t handle,
+        const qcff_transform_t *p_transform, uint32_t num_faces,
+        qcff_complete_face_info_t *p_complete_info) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+    qcff_affine_t affine;
+    int32_t rotation;
+    uint32_t i, j;
+
+    if (!p_qcff || !p_transform || !p_complete_info)
+        return QCFF_RET_INVALID_PARM;
+    rotation = (int32_t) p_transform->rotation;
+    if (rotation != 0 && rotation != 90 && rotation != 180 && rotation != 270)
+        return QCFF_RET_INVALID_PARM;
+
+    qcff_affine_init(&affine, p_qcff->frame_width, p_qcff->frame_height,
+            p_transform);
+
+    for (i = 0; i < num_faces; i++) {
+        if (p_complete_info->p_rects) {
+            qcff_face_rect_t *p_rect = &p_complete_info->p_rects[i];
+            qcff_affine_pixel(&affine, &p_rect->top_left);
+            qcff_affine_pixel(&affine, &p_rect->top_right);
+            qcff_affine_pixel(&affine, &p_rect->bottom_left);
+            qcff_affine_pixel(&affine, &p_rect->bottom_right);
+            if (p_transform->mirrored) {
+                qcff_pixel_t tmp = p_rect->top_left;
+                p_rect->top_left = p_rect->top_right;
+                p_rect->top_right = tmp;
+                tmp = p_rect->bottom_left;
+                p_rect->bottom_left = p_rect->bottom_right;
+                p_rect->bottom_right = tmp;
+            }
+            qcff_affine_rect(&affine, &p_rect->bounding_box);
+        }
+
+        if (p_complete_info->p_parts) {
+            qcff_pixel_t *p_parts = p_complete_info->p_parts[i].parts;
+            for (j = 0; j < QCFF_PARTS_MAX; j++)
+                qcff_affine_pixel(&affine, &p_parts[j]);
+            if (p_transform->mirrored)
+                qcff_swap_pixels(p_parts, &parts_lr_pairs[0][0],
+                        NUM_PAIRS(parts_lr_pairs));
+        }
+
+        if (p_complete_info->p_parts_ex) {
+            qcff_pixel_t *p_parts = p_complete_info->p_parts_ex[i].parts;
+            for (j = 0; j < QCFF_PARTS_EX_MAX; j++)
+                qcff_affine_pixel(&affine, &p_parts[j]);
+            if (p_transform->mirrored)
+                qcff_swap_pixels(p_parts, &parts_ex_lr_pairs[0][0],
+                        NUM_PAIRS(parts_ex_lr_pairs));
+        }
+
+        if (p_complete_info->p_directions) {
+            qcff_face_dir_t *p_dir = &p_complete_info->p_directions[i];
+            if (p_transform->mirrored) {
+                p_dir->left_right_in_degree = -p_dir->left_right_in_degree;
+                p_dir->roll_in_degree = -p_dir->roll_in_degree;
+            }
+            if (rotation)
+                p_dir->roll_in_degree = qcff_wrap_degree(
+                        p_dir->roll_in_degree + rotation);
+        }
+
+        if (p_complete_info->p_gaze_degrees) {
+            qcff_gaze_deg_t *p_gaze = &p_complete_info->p_gaze_degrees[i];
+            int32_t h = p_gaze->left_right;
+            int32_t v = p_gaze->up_down;
+            if (p_transform->mirrored)
+                h = -h;
+            switch (rotation) {
+            case 90:
+                p_gaze->left_right = v;
+                p_gaze->up_down = -h;
+                break;
+            case 180:
+                p_gaze->left_right = -h;
+                p_gaze->up_down = -v;
+                break;
+            case 270:
+                p_gaze->left_right = -v;
+                p_gaze->up_down = h;
+                break;
+            default:
+                p_gaze->left_right = h;
+                p_gaze->up_down = v;
+                break;
+            }
+        }
+
+        if (p_complete_info->p_eye_open_degrees && p_transform->mirrored) {
+            qcff_eye_open_deg_t *p_eye = &p_complete_info->p_eye_open_degrees[i];
+            int32_t tmp = p_eye->left;
+            p_eye->left = p_eye->right;
+            p_eye->right = tmp;
+        }
+    }
+
+    return QCFF_RET_SUCCESS;
+}
+
+int qcff_create_feature_cache(qcff_handle_t handle, uint32_t face_index,
+        qcff_face_feature_t* p_feature) {
+    HFEATURE hfr = NULL;
+    qcff_t *p_qcff = (qcff_t *) handle;
+    int rc;
+
+    if (!p_qcff || !p_feature)
+        return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
+
+    hfr = FACEPROC_FR_CreateFeatureHandle();
+    if (!hfr)
+        return QCFF_RET_NO_RESOURCE;
+
+    rc = qcff_extract_feature(p_qcff, face_index, hfr);
+    if (QCFF_RET_SUCCESS != rc)
+        FACEPROC_FR_DeleteFeatureHandle(hfr);
+    else
+        *p_feature = (qcff_face_feature_t) hfr;
+    QCFF_LOG("Create_Feature_Cache: rc = %d hfr = %p face_index = %d",
+            rc, *p_feature, face_index);
+    return rc;
+}
+
+int qcff_destroy_feature_cache(qcff_face_feature_t feature) {
+    return FACEPROC_FR_DeleteFeatureHandle((HFEATURE) feature);
+}
+
+int qcff_find_unused_user_id(qcff_t *p_qcff, uint32_t *new_user_id) {
+    int32_t user_id = 0;
+    while (1) {
+        INT32 num_data;
+        INT32 rc = FACEPROC_FR_GetRegisteredUsrDataNum(p_qcff->hal, user_id,
+                &num_data);
+        QCFF_LOG("result=%d user %d has %d data", rc, user_id, num_data);
+        if (num_data == 0) {
+            *new_user_id = (uint32_t) user_id;
+            return QCFF_RET_SUCCESS;
+        }
+        user_id++;
+    }
+    return QCFF_RET_FAILURE;
+}
+
+/*************************************************************************
+ * qcff_reg_new_usr
+ *
+ * This function registers a new user in the internal database. It
+ * requires the association of one of the detected faces. The face index
+ * is zero-based and should be between 0 to the number of detected faces-1.
+ * When the operation is successful, the new user ID is returned. This is
+ * used to subsequently refer to this user during identification.
+ *
+ * INPUT:        handle     Handle to QCFF instance created previously.
+ *               feature    Feature obtained earlier through
+ *                          qcff_create_feature_cache.
+ * OUTPUT:       p_new_user_id  The user ID of the new user returned.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_reg_new_usr(qcff_handle_t handle, qcff_face_feature_t feature,
+        uint32_t *p_new_user_id) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+    HFEATURE hfr = (qcff_face_feature_t) feature;
+    int rc;
+
+    if (!p_qcff || !p_new_user_id || !hfr)
+        return QCFF_RET_INVALID_PARM;
+
+//*p_new_user_id = p_qcff->num_registered_users;
+    qcff_find_unused_user_id(p_qcff, p_new_user_id);
+
+    /* Register the new user with the extracted feature */
+    if (FACEPROC_NORMAL
+            != FACEPROC_FR_RegisterData(p_qcff->hal, hfr, *p_new_user_id, 0))
+        return QCFF_RET_FAILURE;
+
+    p_qcff->num_registered_users++;
+    memset(p_qcff->recog_tracks, 0, sizeof(p_qcff->recog_tracks));
+    QCFF_LOG("qcff_reg_new_usr: hfr = %p successful", feature);
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_reg_ex_usr
+ *
+ * This function registers an existing user. This improves the face
+ * recognition accuracy by learning faces of the same person under
+ * different lighting conditions, poses and out-of-plane rotations.
+ *
+ * INPUT:        handle     Handle to QCFF instance created previously.
+ *               feature    Feature obtained earlier through
+ *                          qcff_create_feature_cache.
+ *               user_id    The user ID of the existing user.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_reg_ex_usr(qcff_handle_t handle, qcff_face_feature_t feature,
+        uint32_t user_id) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+    int rc;
+    INT32 num_data;
+    HFEATURE hfr = (qcff_face_feature_t) feature;
+
+    if (!p_qcff || !hfr || user_id >= p_qcff->num_registered_users)
+        return QCFF_RET_INVALID_PARM;
+
+    /* Get current number of data as the new data ID */
+    if (FACEPROC_NORMAL
+            != FACEPROC_FR_GetRegisteredUsrDataNum(p_qcff->hal, user_id,
+                    &num_data))
+        return QCFF_RET_FAILURE;
+
+    /* Register the existing user */
+    if (FACEPROC_NORMAL
+            != FACEPROC_FR_RegisterData(p_qcff->hal, hfr, user_id, num_data))
+        return QCFF_RET_FAILURE;
+
+    memset(p_qcff->recog_tracks, 0, sizeof(p_qcff->recog_tracks));
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_remove_ex_usr
+ *
+ * This function removes an existing user from the database.
+ *
+ * INPUT:        handle     Handle to QCFF instance created previously.
+ *               user_id    The user ID of the existing user to be removed.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_remove_ex_usr(qcff_handle_t handle, uint32_t user_id) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+    INT32 num_users;
+
+    if (!p_qcff || user_id >= p_qcff->num_registered_users)
+        return QCFF_RET_INVALID_PARM;
+
+    QCFF_LOG("Clearing user %d", user_id);
+    /* Clear user from database */
+    if (FACEPROC_NORMAL != FACEPROC_FR_ClearUser(p_qcff->hal, user_id))
+        return QCFF_RET_FAILURE;
+
+    QCFF_LOG("Cleared successfully");
+    p_qcff->num_registered_users--;
+    memset(p_qcff->recog_tracks, 0, sizeof(p_qcff->recog_tracks));
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_identify_usr
+ *
+ * This function performs face recognition by matching the subject face
+ * to the bank of previously registered faces. The result is the ID of
+ * the user which has the closest match to the subject face. It also
+ * outputs the confidence level of the claimed match. Caller can react
+ * differently depending on the confidence level, such as asking the
+ * user to confirm its identity if the confidence level is not high.
+ * This gives the opportunity for this new face to be registered also
+ * to improve accuracy later.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               face_index   Zero-based index to indicate which detected
+ *                            face is to be used for matching.
+ * OUTPUT:       p_user_id    The ID of the user having the closest match
+ *                            against the subject face. This is only
+ *                            meaningful when the return value of the
+ *                            function call is QCFF_RET_SUCCESSFUL.
+ *                            In any other case, this output argument
+ *                            is left untouched.
+ *               p_confidence The confidence level of the match. Same with
+ *                            p_user_id, it is valid only when return value
+ *                            of this call is QCFF_RET_SUCCESSFUL.
+ *
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_NO_MATCH
+ *               QCFF_RET_SKIPPED
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_identify_usr(qcff_handle_t handle, uint32_t face_index,
+        uint32_t *p_user_id,
+//qcff_confidence_t   *p_confidence)
+        uint32_t *p_confidence) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+    qcff_recog_track_t *p_track;
+    int rc;
+    INT32 user_id, score, num_users_returned;
+
+    if (!p_qcff || !p_user_id || face_index >= p_qcff->num_faces
+            || !p_confidence)
+        return QCFF_RET_INVALID_PARM;
+    if (QCFF_ASYNC_BUSY(p_qcff))
+        return QCFF_RET_BUSY;
+
+    if (p_qcff->num_registered_users == 0)
+        return QCFF_RET_NO_MATCH;
+
+    /* Faces past the budget of the frame are not matched, which is not
+     the same as matching no one */
+    if (p_qcff->face_budget) {
+        qcff_rank_update(p_qcff);
+        if (!qcff_face_in_budget(p_qcff, face_index))
+            return QCFF_RET_SKIPPED;
+    }
+
+    /* A tracked face keeps its match until it is due again */
+    p_track = qcff_recog_track(p_qcff, face_index);
+    if (p_track && p_track->verify_seq
+            && p_qcff->frame_seq - p_track->verify_seq
+                    < p_qcff->recog_interval) {
+        user_id = p_track->user_id;
+        score = p_track->score;
+        num_users_returned = p_track->num_users;
+    } else {
+        /* Extract feature */
+        rc = qcff_extract_feature(p_qcff, face_index, p_qcff->hfr);
+        if (QCFF_RET_SUCCESS != rc)
+            return rc;
+
+        /* Identify the most probable user */
+        if (FACEPROC_NORMAL
+                != FACEPROC_FR_Identify(p_qcff->hfr, p_qcff->hal, 1,
+                        &user_id, &score, &num_users_returned))
+            return QCFF_RET_FAILURE;
+
+        if (p_track) {
+            p_track->verify_seq = p_qcff->frame_seq;
+            p_track->user_id = user_id;
+            p_track->score = score;
+            p_track->num_users = num_users_returned;
+        }
+    }
+
+    /* Check score against threshold */
+    if (!num_users_returned || (score < p_qcff->params.fr_threshold))
+        return QCFF_RET_NO_MATCH;
+    *p_user_id = (uint32_t) user_id;
+
+    /* Map score to confidence
+     if (score >= default_params.HIGH_CONFIDENCE_MARK)
+     *p_confidence = QCFF_CONFIDENCE_HIGH;
+     else if (score >= default_params.LOW_CONFIDENCE_MARK)
+     *p_confidence = QCFF_CONFIDENCE_MEDIUM;
+     else
+     p_confidence = QCFF_CONFIDENCE_LOW;
+     */
+    *p_confidence = score / 10;
+
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_get_num_ex_usrs
+ *
+ * This function queries for the total number of registered users.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ * OUTPUT:       p_num_users  The number of previously registered users.
+ *
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_num_ex_usrs(qcff_handle_t handle, uint32_t *p_num_users) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+
+    if (!p_qcff || !p_num_users)
+        return QCFF_RET_INVALID_PARM;
+
+    if (FACEPROC_NORMAL
+            != FACEPROC_FR_GetRegisteredUserNum(p_qcff->hal,
+                    (INT32*) p_num_users))
+        return QCFF_RET_FAILURE;
+
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_reset_usr_data
+ *
+ * This functions resets all registration/user data.
+ *
+ * INPUT:        handle     Handle to QCFF instance created previously.
+ *
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_reset_usr_data(qcff_handle_t handle) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+
+    if (!p_qcff)
+        return QCFF_RET_INVALID_PARM;
+
+    if (FACEPROC_NORMAL != FACEPROC_FR_ClearAlbum(p_qcff->hal))
+        return QCFF_RET_FAILURE;
+
+    p_qcff->num_registered_users = 0;
+    memset(p_qcff->recog_tracks, 0, sizeof(p_qcff->recog_tracks));
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_get_usr_data_size
+ *
+ * For recognition to be useful, typically the user data needs to be
+ * remembered across sessions. QCFF provides a set of functions to
+ * allow easy storing and restoring of its user data bank. To save the
+ * user data, QCFF provides the qcff_get_usr_data function to serialize
+ * the user data and writes it to a buffer. The caller can then saves
+ * what is in the buffer to persistent storage such as the file system.
+ * This function (qcff_get_usr_data_size) queries the size of the user
+ * data when serialized. This should be called to prepare for the memory
+ * buffer for the saving of user data.
+ *
+ * INPUT:        handle     Handle to QCFF instance created previously.
+ * OUTPUT:       p_size     The size needed to hold the serialized the
+ *                          user data.
+ *
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_usr_data_size(qcff_handle_t handle, uint32_t *p_size) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+
+    if (!p_qcff || !p_size)
+        return QCFF_RET_INVALID_PARM;
+
+    if (FACEPROC_NORMAL
+            != FACEPROC_FR_GetSerializedAlbumSize(p_qcff->hal,
+                    (UINT32*) p_size)) {
+        return QCFF_RET_FAILURE;
+    }
+
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_get_usr_data
+ *
+ * For recognition to be useful, typically the user data needs to be
+ * remembered across sessions. QCFF provides a set of functions to
+ * allow easy storing and restoring of its user data bank. To save the
+ * user data, QCFF provides the qcff_get_usr_data function to serialize
+ * the user data and writes it to a buffer. The caller can then saves
+ * what is in the buffer to persistent storage such as the file system.
+ * Caller should use qcff_get_usr_data_size in advance to query the size
+ * of the user data when serialized in order to allocate for the memory
+ * buffer big enough to hold the serialized user data.
+ *
+ * INPUT:        handle               Handle to QCFF instance created
+ *                                    previously.
+ *               p_buffer             The buffer to be used for holding
+ *                                    the serialized user data.
+ *               num_bytes_in_buffer  The total number of bytes
+ *                                    available in the buffer.
+ *
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_usr_data(qcff_handle_t handle, uint8_t *p_buffer,
+        uint32_t num_bytes_in_buffer) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+
+    if (!p_qcff || !p_buffer || !num_bytes_in_buffer)
+        return QCFF_RET_INVALID_PARM;
+
+    if (FACEPROC_NORMAL
+            != FACEPROC_FR_SerializeAlbum(p_qcff->hal, p_buffer,
+                    num_bytes_in_buffer))
+        return QCFF_RET_FAILURE;
+
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_set_usr_data
+ *
+ * This functions takes previously serialized user data (through
+ * qcff_get_usr_data) and restore the user data bank from it.
+ *
+ * INPUT:        handle              Handle to QCFF instance created
+ *                                   previously.
+ *               num_bytes_in_buffer The number of bytes in the buffer.
+ *               p_buffer            The buffer holding the serialized
+ *                                   user data.
+ *
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_set_usr_data(qcff_handle_t handle, uint32_t num_bytes_in_buffer,
+        uint8_t *p_buffer) {
+    qcff_t *p_qcff = (qcff_t *) handle;
+    INT32 num_users, rc;
+    FR_ERROR error;
+
+    if (!p_qcff || !num_bytes_in_buffer || !p_buffer) {
+        return QCFF_RET_INVALID_PARM;
+    }
+
+    /* Delete previously created album first */
+    if (FACEPROC_NORMAL != FACEPROC_FR_DeleteAlbumHandle(p_qcff->hal))
+        return QCFF_RET_FAILURE;
+
+    /* Restore album based on the provided buffer */
+    p_qcff->hal = FACEPROC_FR_RestoreAlbum((UINT8*) p_buffer,
+            (UINT32) num_bytes_in_buffer, &error);
+    if (FR_NORMAL != error)
+        return QCFF_RET_FAILURE;
+
+    rc = FACEPROC_FR_GetRegisteredUserNum(p_qcff->hal, &num_users);
+    if (FACEPROC_NORMAL != rc)
+        return QCFF_RET_FAILURE;
+
+    QCFF_LOG("Album restored successfully: %d users found", num_users);
+
+    p_qcff->num_registered_users = (uint32_t) num_users;
+    memset(p_qcff->recog_tracks, 0, sizeof(p_qcff->recog_tracks));
+    return QCFF_RET_SUCCESS;
+}
+
+/*************************************************************************
+ * qcff_destroy
+ *
+ * This function destroys and performs clean up associated with the
+ * QCFF instance previously created.
+ *
+ * INPUT:        handle     Handle to QCFF instance created previously.
+ *
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_destroy(qcff_handle_t *p_handle) {
+    INT32 ret;
+    uint32_t i;
+    qcff_t *p_qcff = (qcff_t *) *p_handle;
+
+    if (!p_qcff)
+        return QCFF_RET_FAILURE;
+
+    /* Stop the worker before the handles it uses go away */
+    if (p_qcff->p_async)
+        qcff_async_stop(*p_handle);
+    if (p_qcff->p_tiling) {
+        qcff_tiling_free(p_qcff->p_tiling);
+        p_qcff->p_tiling = NULL;
+    }
+    if (p_qcff->p_refine) {
+        qcff_refine_free(p_qcff->p_refine);
+        p_qcff->p_refine = NULL;
+    }
+    if (p_qcff->p_face_pool) {
+        qcff_face_pool_free(p_qcff->p_face_pool);
+        p_qcff->p_face_pool = NULL;
+    }
+
+    /* Delete Album Handle */
+    if (p_qcff->hal) {
+        ret = FACEPROC_FR_DeleteAlbumHandle(p_qcff->hal);
+        p_qcff->hal = NULL;
+    }
+    /* Delete Facial Feature Handle */
+    if (p_qcff->hfr) {
+        ret = FACEPROC_FR_DeleteFeatureHandle(p_qcff->hfr);
+        p_qcff->hfr = NULL;
+    }
+    /* Delete Contour Result Handle */
+    if (p_qcff->hct_result) {
+        ret = FACEPROC_CT_DeleteResultHandle(p_qcff->hct_result);
+        p_qcff->hct_result = NULL;
+    }
+    /* Delete Contour Detection Handle */
+    if (p_qcff->hct) {
+        ret = FACEPROC_CT_DeleteHandle(p_qcff->hct);
+        p_qcff->hct = NULL;
+    }
+    /* Delete GazeBlink Result Handle */
+    if (p_qcff->hgb_result) {
         ret = FACEPROC_GB_DeleteResultHandle(p_qcff->hgb_result);
         p_qcff->hgb_result = NULL;
     }
-    /* Delete GazeBlink Detection Handle */
-    if (p_qcff->hgb) {
-        ret = FACEPROC_GB_DeleteHandle(p_qcff->hgb);
-        p_qcff->hgb = NULL;
+    /* Delete GazeBlink Detection Handle */
+    if (p_qcff->hgb) {
+        ret = FACEPROC_GB_DeleteHandle(p_qcff->hgb);
+        p_qcff->hgb = NULL;
+    }
+    /* Delete Smile Estimation Result Handle */
+    if (p_qcff->hsm_result) {
+        ret = FACEPROC_SM_DeleteResultHandle(p_qcff->hsm_result);
+        p_qcff->hsm_result = NULL;
+    }
+    /* Delete Smile Estimation Handle */
+    if (p_qcff->hsm) {
+        ret = FACEPROC_SM_DeleteHandle(p_qcff->hsm);
+        p_qcff->hsm = NULL;
+    }
+    /* Delete Parts Detection Result Handles */
+    for (i = 0; i < QCFF_MAX_RESULT_FACES; i++) {
+        if (p_qcff->parts[i].hpt_result) {
+            ret = FACEPROC_PT_DeleteResultHandle(p_qcff->parts[i].hpt_result);
+            p_qcff->parts[i].hpt_result = NULL;
+        }
+    }
+    /* Delete Parts Detection Handle */
+    if (p_qcff->hpt) {
+        ret = FACEPROC_PT_DeleteHandle(p_qcff->hpt);
+        p_qcff->hpt = NULL;
+    }
+    /* Delete Detection Handles, in use and put aside */
+    qcff_delete_dt(p_qcff->hdt, p_qcff->hdt_result);
+    p_qcff->hdt = NULL;
+    p_qcff->hdt_result = NULL;
+    for (i = 0; i < QCFF_DT_CACHE_SIZE; i++) {
+        qcff_delete_dt(p_qcff->dt_cache[i].hdt, p_qcff->dt_cache[i].hdt_result);
+        p_qcff->dt_cache[i].hdt = NULL;
+    }
+    /* Delete the local frame and the other buffers carved with it */
+    if (p_qcff->arena.p_base) {
+        free(p_qcff->arena.p_base);
+        p_qcff->arena.p_base = NULL;
+    }
+    p_qcff->p_local_frame = NULL;
+
+    free((void*) p_qcff);
+    *p_handle = NULL;
+    QCFF_LOG("qcff_destroy");
+    return QCFF_RET_SUCCESS;
+}
+
+/************************************************************************
+ * Main exposed wrapper functions below
+ ***********************************************************************/
+/* Helper functions */
+static void qcff_delete_dt(HDETECTION hdt, HDTRESULT hdt_result) {
+    if (hdt_result)
+        FACEPROC_DeleteDtResult(hdt_result);
+    if (hdt)
+        FACEPROC_DeleteDetection(hdt);
+}
+
+/* Puts the detector in use aside, in a free entry or in place of the one
+ used longest ago */
+static void qcff_park_dt(qcff_t *p_qcff) {
+    qcff_dt_entry_t *p_entry = &p_qcff->dt_cache[0];
+    uint32_t i;
+
+    for (i = 0; i < QCFF_DT_CACHE_SIZE && p_entry->hdt; i++) {
+        if (!p_qcff->dt_cache[i].hdt
+                || p_qcff->dt_cache[i].last_used < p_entry->last_used)
+            p_entry = &p_qcff->dt_cache[i];
+    }
+    qcff_delete_dt(p_entry->hdt, p_entry->hdt_result);
+
+    p_entry->key = p_qcff->dt_key;
+    p_entry->hdt = p_qcff->hdt;
+    p_entry->hdt_result = p_qcff->hdt_result;
+    p_entry->dt_result_faces = p_qcff->dt_result_faces;
+    p_entry->tracking_defaults = p_qcff->tracking_defaults;
+    memcpy(p_entry->dt_angles, p_qcff->dt_angles, sizeof(p_entry->dt_angles));
+    p_entry->dt_angles_valid = p_qcff->dt_angles_valid;
+    p_entry->dt_backup_size = p_qcff->dt_backup_size;
+    p_entry->dt_work_min_size = p_qcff->dt_work_min_size;
+    p_entry->dt_work_max_size = p_qcff->dt_work_max_size;
+    p_entry->setup_seq = p_qcff->setup_seq;
+    p_entry->last_used = ++p_qcff->dt_cache_clock;
+    p_qcff->hdt = NULL;
+    p_qcff->hdt_result = NULL;
+}
+
+/* Takes a detector put aside back in use */
+static void qcff_unpark_dt(qcff_t *p_qcff, qcff_dt_entry_t *p_entry) {
+    p_qcff->dt_key = p_entry->key;
+    p_qcff->hdt = p_entry->hdt;
+    p_qcff->hdt_result = p_entry->hdt_result;
+    p_qcff->dt_result_faces = p_entry->dt_result_faces;
+    p_qcff->tracking_defaults = p_entry->tracking_defaults;
+    memcpy(p_qcff->dt_angles, p_entry->dt_angles, sizeof(p_qcff->dt_angles));
+    p_qcff->dt_angles_valid = p_entry->dt_angles_valid;
+    p_qcff->dt_backup_size = p_entry->dt_backup_size;
+    p_qcff->dt_work_min_size = p_entry->dt_work_min_size;
+    p_qcff->dt_work_max_size = p_entry->dt_work_max_size;
+    p_entry->hdt = NULL;
+    p_entry->hdt_result = NULL;
+}
+
+/* Puts the detector of the current crop, factor and mode in use. Setting
+ one up takes a while and allocates the engine's memory, so up to
+ QCFF_DT_CACHE_SIZE detectors of other configurations are kept and a
+ switch between them, e.g. from preview to still images and back, only
+ swaps handles. A detector taken back is reprogrammed with the settings
+ changed since it was put aside, and only with those. Faces found so
+ far are dropped */
+static int qcff_select_dt(qcff_t *p_qcff) {
+    qcff_dt_key_t key;
+    qcff_dt_entry_t *p_entry = NULL;
+    uint32_t i;
+    int rc;
+
+    key.width = p_qcff->crop.dx;
+    key.height = p_qcff->crop.dy;
+    key.scale_q8 = p_qcff->scale_q8;
+    key.mode = p_qcff->mode;
+
+    if (p_qcff->hdt && (p_qcff->dt_key.width != key.width
+            || p_qcff->dt_key.height != key.height
+            || p_qcff->dt_key.scale_q8 != key.scale_q8
+            || p_qcff->dt_key.mode != key.mode))
+        qcff_park_dt(p_qcff);
+
+    if (!p_qcff->hdt) {
+        for (i = 0; i < QCFF_DT_CACHE_SIZE; i++) {
+            qcff_dt_entry_t *p_cached = &p_qcff->dt_cache[i];
+            if (p_cached->hdt && p_cached->key.width == key.width
+                    && p_cached->key.height == key.height
+                    && p_cached->key.scale_q8 == key.scale_q8
+                    && p_cached->key.mode == key.mode) {
+                p_entry = p_cached;
+                break;
+            }
+        }
+        if (!p_entry) {
+            rc = qcff_config_dt(p_qcff);
+            if (QCFF_FAILED(rc)) {
+                qcff_delete_dt(p_qcff->hdt, p_qcff->hdt_result);
+                p_qcff->hdt = NULL;
+                p_qcff->hdt_result = NULL;
+                return rc;
+            }
+            p_qcff->dt_key = key;
+        } else {
+            qcff_unpark_dt(p_qcff, p_entry);
+        }
+    }
+
+    if (p_entry && p_entry->setup_seq != p_qcff->setup_seq) {
+        rc = qcff_apply_dt_tracking(p_qcff);
+        if (QCFF_SUCCEEDED(rc))
+            rc = qcff_apply_dt_timeout(p_qcff);
+        if (QCFF_SUCCEEDED(rc))
+            rc = qcff_apply_dt_params(p_qcff);
+    } else {
+        /* The factor may have moved while the detector was in use */
+        rc = qcff_face_size_range(p_qcff);
+    }
+    if (QCFF_SUCCEEDED(rc))
+        rc = qcff_update_dt_angles(p_qcff);
+    if (QCFF_FAILED(rc))
+        return rc;
+
+    FACEPROC_ClearDtResult(p_qcff->hdt_result);
+    p_qcff->num_faces = 0;
+    p_qcff->dt_mask_valid = FALSE;
+    p_qcff->motion.since_full_scan = 0;
+    p_qcff->motion.faces.dx = 0;
+    p_qcff->roi.face_index = -1;
+    p_qcff->skip.run = 0;
+    p_qcff->skip.ref_valid = FALSE;
+    return QCFF_RET_SUCCESS;
+}
+
+/* Creates and sets up a detector for the current configuration */
+static int qcff_config_dt(qcff_t *p_qcff) {
+    qcff_tracking_defaults_t *p_defaults = &p_qcff->tracking_defaults;
+    UINT8 major, minor;
+    uint32_t i;
+    int rc = QCFF_RET_SUCCESS;
+
+    /* Create Face-Engine FD handle */
+    p_qcff->hdt = FACEPROC_CreateDetection();
+    if (!p_qcff->hdt) {
+        QCFF_LOG("FACEPROC_CreateDetection failed");
+        return QCFF_RET_FAILURE;
+    }
+
+    /* Keep the engine's tracking values before the policy changes them */
+    for (i = 0; i < QCFF_TRACKING_MAX; i++) {
+        rc = (int) FACEPROC_GetDtRefreshCount(p_qcff->hdt,
+                qcff_tracking_dt_modes[i], &p_defaults->refresh_count[i]);
+        if (rc != FACEPROC_NORMAL)
+            break;
+    }
+    if (rc == FACEPROC_NORMAL)
+        rc = (int) FACEPROC_GetDtLostParam(p_qcff->hdt,
+                &p_defaults->face_retry, &p_defaults->head_retry,
+                &p_defaults->hold_count);
+    if (rc == FACEPROC_NORMAL)
+        rc = (int) FACEPROC_GetDtModifyMoveRate(p_qcff->hdt,
+                &p_defaults->move_rate);
+    if (rc != FACEPROC_NORMAL) {
+        QCFF_LOG("FACEPROC_GetDt tracking defaults failed %d", rc);
+        return QCFF_RET_FAILURE;
+    }
+
+    /* Set best Face-Engine detection mode for the use */
+    rc = qcff_apply_dt_tracking(p_qcff);
+    if (QCFF_FAILED(rc))
+        return rc;
+
+    /* Set Omrom Detection Angles */
+    p_qcff->dt_angles_valid = FALSE;
+    rc = qcff_update_dt_angles(p_qcff);
+    if (QCFF_FAILED(rc))
+        return rc;
+
+    rc = (int) FACEPROC_SetDtDirectionMask(p_qcff->hdt, FALSE);
+    if (rc != FACEPROC_NORMAL) {
+        QCFF_LOG("FACEPROC_SetDtDirectionMask failed %d", rc);
+        return QCFF_RET_FAILURE;
+    }
+
+    rc = qcff_apply_dt_timeout(p_qcff);
+    if (QCFF_FAILED(rc))
+        return rc;
+
+    return qcff_apply_dt_params(p_qcff);
+}
+
+/* Programs the detection mode and the handle's tracking policy into the
+ detector. Still mode searches every frame in full. The mode is only set
+ when it changes, which drops the faces being tracked */
+static int qcff_apply_dt_tracking(qcff_t *p_qcff) {
+    qcff_tracking_t *p_tracking = &p_qcff->tracking;
+    qcff_tracking_defaults_t *p_defaults = &p_qcff->tracking_defaults;
+    INT32 dt_mode, cur_mode;
+    int rc;
+
+    if (p_qcff->mode == QCFF_MODE_STILL)
+        dt_mode = DT_MODE_DEFAULT;
+    else
+        dt_mode = qcff_tracking_dt_modes[p_tracking->search];
+
+    rc = (int) FACEPROC_GetDtMode(p_qcff->hdt, &cur_mode);
+    if (rc == FACEPROC_NORMAL && cur_mode != dt_mode)
+        rc = (int) FACEPROC_SetDtMode(p_qcff->hdt, dt_mode);
+    if (rc != FACEPROC_NORMAL) {
+        QCFF_LOG("FACEPROC_SetDtMode failed %d", rc);
+        return QCFF_RET_FAILURE;
+    }
+    if (dt_mode == DT_MODE_DEFAULT)
+        return QCFF_RET_SUCCESS;
+
+    rc = (int) FACEPROC_SetDtRefreshCount(p_qcff->hdt, dt_mode,
+            (p_tracking->refresh_count < 0)
+                    ? p_defaults->refresh_count[p_tracking->search]
+                    : p_tracking->refresh_count);
+    if (rc != FACEPROC_NORMAL) {
+        QCFF_LOG("FACEPROC_SetDtRefreshCount failed %d", rc);
+        return QCFF_RET_FAILURE;
+    }
+
+    rc = (int) FACEPROC_SetDtLostParam(p_qcff->hdt,
+            (p_tracking->face_retry < 0)
+                    ? p_defaults->face_retry : p_tracking->face_retry,
+            (p_tracking->head_retry < 0)
+                    ? p_defaults->head_retry : p_tracking->head_retry,
+            (p_tracking->hold_count < 0)
+                    ? p_defaults->hold_count : p_tracking->hold_count);
+    if (rc != FACEPROC_NORMAL) {
+        QCFF_LOG("FACEPROC_SetDtLostParam failed %d", rc);
+        return QCFF_RET_FAILURE;
+    }
+
+    rc = (int) FACEPROC_SetDtModifyMoveRate(p_qcff->hdt,
+            (p_tracking->move_rate < 0)
+                    ? p_defaults->move_rate : p_tracking->move_rate);
+    if (rc != FACEPROC_NORMAL) {
+        QCFF_LOG("FACEPROC_SetDtModifyMoveRate failed %d", rc);
+        return QCFF_RET_FAILURE;
+    }
+    return QCFF_RET_SUCCESS;
+}
+
+/* Programs the handle's timeouts into the detector. The engine times
+ itself with FaceProcExtraInitTime/FaceProcExtraGetTime, which the
+ library binds internally, so they are not hooked here; qcff_detect
+ checks the wall time on top */
+static int qcff_apply_dt_timeout(qcff_t *p_qcff) {
+    int rc;
+
+    rc = (int) FACEPROC_SetDtTimeout(p_qcff->hdt,
+            (INT32) p_qcff->deadline.non_tracking_ms,
+            (INT32) p_qcff->deadline.tracking_ms);
+    if (rc != FACEPROC_NORMAL) {
+        QCFF_LOG("FACEPROC_SetDtTimeout failed %d", rc);
+        return QCFF_RET_FAILURE;
+    }
+    return QCFF_RET_SUCCESS;
+}
+
+/* Programs the handle's parameters into the detector */
+static int qcff_apply_dt_params(qcff_t *p_qcff) {
+    qcff_params_t *p_params = &p_qcff->params;
+    RECT nil_edge = { -1, -1, -1, -1 };
+    int rc;
+
+    /* Minimum face size to be detected should be at most half the
+     height of the input frame */
+    if (p_params->min_face_size > p_qcff->crop.dy / 2) {
+        QCFF_LOG("min_face_size > crop height / 2");
+        return QCFF_RET_INVALID_PARM;
+    }
+
+    /* Set search density */
+    rc = (int) FACEPROC_SetDtStep(p_qcff->hdt, p_params->search_step,
+            p_params->tracking_step);
+    if (rc != FACEPROC_NORMAL) {
+        QCFF_LOG("FACEPROC_SetDtStep failed %d", rc);
+        return QCFF_RET_FAILURE;
+    }
+
+    rc = qcff_face_size_range(p_qcff);
+    if (QCFF_FAILED(rc))
+        return rc;
+
+    if (p_params->threshold || p_params->tracking_threshold) {
+        INT32 threshold, tracking_threshold;
+
+        /* A threshold left at 0 keeps its current value */
+        rc = (int) FACEPROC_GetDtThreshold(p_qcff->hdt, &threshold,
+                &tracking_threshold);
+        if (rc == FACEPROC_NORMAL) {
+            if (p_params->threshold)
+                threshold = p_params->threshold;
+            if (p_params->tracking_threshold)
+                tracking_threshold = p_params->tracking_threshold;
+            rc = (int) FACEPROC_SetDtThreshold(p_qcff->hdt, threshold,
+                    tracking_threshold);
+        }
+        if (rc != FACEPROC_NORMAL) {
+            QCFF_LOG("FACEPROC_SetDtThreshold failed %d", rc);
+            return QCFF_RET_FAILURE;
+        }
     }
-    /* Delete Smile Estimation Result Handle */
-    if (p_qcff->hsm_result) {
-        ret = FACEPROC_SM_DeleteResultHandle(p_qcff->hsm_result);
-        p_qcff->hsm_result = NULL;
+
+    /* Bound the detector's work memory by what the largest image of the
+     configuration needs, the crop at full resolution */
+    if (p_qcff->mode == QCFF_MODE_STILL)
+        rc = (int) FACEPROC_GetDtRequiredStillMemSize(p_qcff->crop.dx,
+                p_qcff->crop.dy, p_params->min_face_size,
+                p_params->max_faces, nil_edge, p_params->search_step,
+                &p_qcff->dt_backup_size, &p_qcff->dt_work_min_size,
+                &p_qcff->dt_work_max_size);
+    else
+        rc = (int) FACEPROC_GetDtRequiredMovieMemSize(p_qcff->crop.dx,
+                p_qcff->crop.dy, p_params->min_face_size,
+                p_params->max_faces, nil_edge, p_params->search_step,
+                nil_edge, p_params->tracking_step, &p_qcff->dt_backup_size,
+                &p_qcff->dt_work_min_size, &p_qcff->dt_work_max_size);
+    if (rc == FACEPROC_NORMAL) {
+        rc = (int) FACEPROC_SetDtMemorySize(p_qcff->hdt,
+                p_qcff->dt_work_max_size);
+        if (rc != FACEPROC_NORMAL)
+            QCFF_LOG("FACEPROC_SetDtMemorySize failed %d", rc);
+    } else {
+        QCFF_LOG("FACEPROC_GetDtRequiredMemSize failed %d", rc);
+        p_qcff->dt_backup_size = 0;
+        p_qcff->dt_work_min_size = 0;
+        p_qcff->dt_work_max_size = 0;
     }
-    /* Delete Smile Estimation Handle */
-    if (p_qcff->hsm) {
-        ret = FACEPROC_SM_DeleteHandle(p_qcff->hsm);
-        p_qcff->hsm = NULL;
+
+    /* Create Face-Engine result handle, sized for max_faces */
+    if (p_qcff->hdt_result && p_qcff->dt_result_faces != p_params->max_faces) {
+        FACEPROC_DeleteDtResult(p_qcff->hdt_result);
+        p_qcff->hdt_result = NULL;
+        p_qcff->num_faces = 0;
+        p_qcff->skip.ref_valid = FALSE;
     }
-    /* Delete Parts Detection Result Handle */
-    if (p_qcff->hpt_result) {
-        ret = FACEPROC_PT_DeleteResultHandle(p_qcff->hpt_result);
-        p_qcff->hpt_result = NULL;
+    if (!p_qcff->hdt_result) {
+        p_qcff->hdt_result = FACEPROC_CreateDtResult(p_params->max_faces,
+                MAX2(p_params->max_faces / 2, 1));
+        if (!(p_qcff->hdt_result)) {
+            QCFF_LOG("FACEPROC_CreateDtResult failed");
+            p_qcff->dt_result_faces = 0;
+            return QCFF_RET_FAILURE;
+        }
+        p_qcff->dt_result_faces = p_params->max_faces;
     }
-    /* Delete Parts Detection Handle */
-    if (p_qcff->hpt) {
-        ret = FACEPROC_PT_DeleteHandle(p_qcff->hpt);
-        p_qcff->hpt = NULL;
+    return QCFF_RET_SUCCESS;
+}
+
+static int qcff_config_pt(qcff_t *p_qcff) {
+    p_qcff->hpt = FACEPROC_PT_CreateHandle();
+    if (!p_qcff->hpt) {
+        QCFF_LOG("FACEPROC_PT_CreateHandle failed");
+        return QCFF_RET_FAILURE;
     }
-    /* Delete Detection Result handle */
-    if (p_qcff->hdt_result) {
-        ret = FACEPROC_DeleteDtResult(p_qcff->hdt_result);
-        p_qcff->hdt_result = NULL;
+
+    /* Result handles are created per face, see qcff_detect_parts */
+    return QCFF_RET_SUCCESS;
+}
+
+static int qcff_config_sm(qcff_t *p_qcff) {
+    p_qcff->hsm = FACEPROC_SM_CreateHandle();
+    if (!p_qcff->hsm) {
+        QCFF_LOG("FACEPROC_SM_CreateHandle failed");
+        return QCFF_RET_FAILURE;
+    }
+
+    p_qcff->hsm_result = FACEPROC_SM_CreateResultHandle();
+    if (!p_qcff->hsm_result) {
+        QCFF_LOG("FACEPROC_SM_CreateResultHandle failed");
+        return QCFF_RET_FAILURE;
+    }
+
+    return QCFF_RET_SUCCESS;
+}
+
+static int qcff_config_gb(qcff_t *p_qcff) {
+    p_qcff->hgb = FACEPROC_GB_CreateHandle();
+    if (!p_qcff->hgb) {
+        QCFF_LOG("FACEPROC_GB_CreateHandle failed");
+        return QCFF_RET_FAILURE;
+    }
+
+    p_qcff->hgb_result = FACEPROC_GB_CreateResultHandle();
+    if (!p_qcff->hgb_result) {
+        QCFF_LOG("FACEPROC_SM_CreateResultHandle failed");
+        return QCFF_RET_FAILURE;
+    }
+
+    return QCFF_RET_SUCCESS;
+}
+
+static int qcff_config_fr(qcff_t *p_qcff) {
+    p_qcff->hfr = FACEPROC_FR_CreateFeatureHandle();
+    if (!p_qcff->hfr) {
+        QCFF_LOG("FACEPROC_FR_CreateFeatureHandle failed");
+        return QCFF_RET_FAILURE;
+    }
+    p_qcff->hal = FACEPROC_FR_CreateAlbumHandle(
+            default_params.MAX_REGISTERED_USERS,
+            default_params.MAX_DATA_PER_USER);
+    if (!p_qcff->hal) {
+        QCFF_LOG("FACEPROC_FR_CreateAlbumHandle failed");
+        return QCFF_RET_FAILURE;
+    }
+    p_qcff->num_registered_users = 0;
+    return QCFF_RET_SUCCESS;
+}
+
+static int qcff_config_ct(qcff_t *p_qcff) {
+    p_qcff->hct = FACEPROC_CT_CreateHandle();
+    if (!p_qcff->hct) {
+        QCFF_LOG("FACEPROC_CT_CreateHandle failed");
+        return QCFF_RET_FAILURE;
+    }
+
+    p_qcff->hct_result = FACEPROC_CT_CreateResultHandle();
+    if (!p_qcff->hct_result) {
+        QCFF_LOG("FACEPROC_CT_CreateResultHandle failed");
+        return QCFF_RET_FAILURE;
+    }
+
+    return QCFF_RET_SUCCESS;
+}
+
+static void qcff_translate_face_info_to_rect(FACEINFO *p_info,
+        qcff_face_rect_t *p_rect) {
+    int32_t left, right, top, bottom;
+
+    p_rect->top_left.x = p_info->ptLeftTop.x;
+    p_rect->top_left.y = p_info->ptLeftTop.y;
+    p_rect->top_right.x = p_info->ptRightTop.x;
+    p_rect->top_right.y = p_info->ptRightTop.y;
+    p_rect->bottom_left.x = p_info->ptLeftBottom.x;
+    p_rect->bottom_left.y = p_info->ptLeftBottom.y;
+    p_rect->bottom_right.x = p_info->ptRightBottom.x;
+    p_rect->bottom_right.y = p_info->ptRightBottom.y;
+
+    left = MIN4(p_rect->top_left.x, p_rect->top_right.x,
+            p_rect->bottom_left.x, p_rect->bottom_right.x);
+    top = MIN4(p_rect->top_left.y, p_rect->top_right.y,
+            p_rect->bottom_left.y, p_rect->bottom_right.y);
+    right = MAX4(p_rect->top_left.x, p_rect->top_right.x,
+            p_rect->bottom_left.x, p_rect->bottom_right.x);
+    bottom = MAX4(p_rect->top_left.y, p_rect->top_right.y,
+            p_rect->bottom_left.y, p_rect->bottom_right.y);
+
+    p_rect->bounding_box.x = left;
+    p_rect->bounding_box.y = top;
+    p_rect->bounding_box.dx = right - left;
+    p_rect->bounding_box.dy = bottom - top;
+}
+
+static int qcff_extract_feature(qcff_t *p_qcff, uint32_t face_index,
+        HFEATURE hfr) {
+    qcff_face_engines_t engines;
+    qcff_parts_cache_t *p_parts;
+    FACEINFO face_info;
+
+    if (FACEPROC_NORMAL != qcff_dt_face_info(p_qcff, face_index, &face_info))
+        return QCFF_RET_FAILURE;
+
+    /* Do parts detection on the crop around the face */
+    qcff_own_engines(p_qcff, &engines);
+    if (QCFF_RET_SUCCESS
+            != qcff_detect_parts(p_qcff, &engines, &p_qcff->roi, face_index,
+                    &face_info, &p_parts))
+        return QCFF_RET_FAILURE;
+
+    /* Extract feature */
+    if (FACEPROC_NORMAL
+            != FACEPROC_FR_ExtractFeatureFromPtHdl(hfr,
+                    (RAWIMAGE*) p_qcff->roi.p_pixels,
+                    p_qcff->roi.width,
+                    p_qcff->roi.height,
+                    p_parts->hpt_result))
+        return QCFF_RET_FAILURE;
+
+    return QCFF_RET_SUCCESS;
+}
+
+/* Copies the crop of p_frame into p_dst, converting RGB to luma and
+ downscaling by scale_q8 on the way */
+static int qcff_ingest(qcff_t *p_qcff, uint8_t *p_frame, uint32_t scale_q8,
+        uint8_t *p_dst) {
+    uint32_t bpp = qcff_format_bpp(p_qcff->format);
+    uint32_t scratch_size = qcff_img_downscale_scratch_size(p_qcff->crop.dx,
+            p_qcff->crop.dy, scale_q8);
+    uint8_t *p_src = p_frame + p_qcff->offset
+            + p_qcff->crop.y * p_qcff->stride + p_qcff->crop.x * bpp;
+
+    /* The scratch is carved for the worst factor, see qcff_arena_setup */
+    if (scratch_size > p_qcff->scale_scratch_size) {
+        QCFF_LOG("scale scratch of %d bytes short of %d",
+                p_qcff->scale_scratch_size, scratch_size);
+        return QCFF_RET_NO_RESOURCE;
+    }
+
+    if (bpp > 1) {
+        qcff_img_rgb_t order = (p_qcff->format == QCFF_FORMAT_BGR888) ?
+                QCFF_IMG_BGR888 : QCFF_IMG_RGBA8888;
+        uint8_t *p_luma = p_dst;
+
+        /* RGB frames are converted to luma ahead of the downscaler */
+        if (scale_q8 != QCFF_SCALE_ONE)
+            p_luma = p_qcff->p_luma_frame;
+        qcff_img_rgb_to_luma(p_src, p_qcff->crop.dx, p_qcff->crop.dy,
+                p_qcff->stride, order, p_luma);
+        if (p_luma != p_dst)
+            qcff_img_downscale(p_luma, p_qcff->crop.dx, p_qcff->crop.dy,
+                    p_qcff->crop.dx, scale_q8, p_dst,
+                    p_qcff->p_scale_scratch);
+    } else {
+        /* Downscale processing: area averaging for 2x/4x, resampling for
+         other factors; a plain copy otherwise. Only the crop is packed */
+        qcff_img_downscale(p_src, p_qcff->crop.dx, p_qcff->crop.dy,
+                p_qcff->stride, scale_q8, p_dst, p_qcff->p_scale_scratch);
+    }
+    return QCFF_RET_SUCCESS;
+}
+
+/* Carves the wrapper's buffers for the configured layout. The scratch is
+ sized for the worst factor of each integer pre-reduction band, just
+ above 1 and just above 2, so that the factor can change between frames
+ without allocating. The face crop covers the largest crop that is cut
+ rather than read in place, over the widest image the engines may run
+ on: a frame read in place spans the whole stride */
+static int qcff_arena_setup(qcff_t *p_qcff) {
+    qcff_arena_t *p_arena = &p_qcff->arena;
+    uint32_t area = p_qcff->crop.dx * p_qcff->crop.dy;
+    uint32_t bpp = qcff_format_bpp(p_qcff->format);
+    uint32_t scratch_size, luma_size, roi_size, size;
+
+    scratch_size = (uint32_t) MAX2(
+            qcff_img_downscale_scratch_size(p_qcff->crop.dx, p_qcff->crop.dy,
+                    QCFF_SCALE_ONE + 1),
+            qcff_img_downscale_scratch_size(p_qcff->crop.dx, p_qcff->crop.dy,
+                    2 * QCFF_SCALE_ONE + 1));
+    luma_size = (bpp > 1) ? area : 0;
+    roi_size = (uint32_t) ((uint64_t) ((bpp > 1) ? p_qcff->crop.dx
+            : MAX2(p_qcff->crop.dx, p_qcff->stride)) * p_qcff->crop.dy
+            * QCFF_ROI_MAX_PERCENT / 100);
+    size = QCFF_ARENA_ROUND(area) + QCFF_ARENA_ROUND(luma_size)
+            + QCFF_ARENA_ROUND(scratch_size) + QCFF_ARENA_ROUND(roi_size);
+
+    if (size > p_arena->size) {
+        void *p_base = NULL;
+
+        if (p_arena->p_base)
+            free(p_arena->p_base);
+        p_arena->p_base = NULL;
+        p_arena->size = 0;
+        p_qcff->p_local_frame = NULL;
+        if (posix_memalign(&p_base, QCFF_ARENA_ALIGN, size)) {
+            QCFF_LOG("arena of %d bytes malloc failed", size);
+            return QCFF_RET_NO_RESOURCE;
+        }
+        p_arena->p_base = (uint8_t *) p_base;
+        p_arena->size = size;
+    }
+
+    p_arena->used = 0;
+    p_qcff->p_local_frame = qcff_arena_carve(p_arena, area);
+    p_qcff->p_luma_frame = luma_size ?
+            qcff_arena_carve(p_arena, luma_size) : NULL;
+    p_qcff->p_scale_scratch = qcff_arena_carve(p_arena, scratch_size);
+    p_qcff->scale_scratch_size = scratch_size;
+    p_qcff->roi.p_buffer = qcff_arena_carve(p_arena, roi_size);
+    p_qcff->roi.capacity = roi_size;
+    p_arena->peak = MAX2(p_arena->peak, p_arena->used);
+    return QCFF_RET_SUCCESS;
+}
+
+static uint8_t *qcff_arena_carve(qcff_arena_t *p_arena, uint32_t size) {
+    uint8_t *p = p_arena->p_base + p_arena->used;
+
+    p_arena->used += QCFF_ARENA_ROUND(size);
+    return p;
+}
+
+/* The largest face is bounded by the image the detector runs on */
+static int qcff_face_size_range(qcff_t *p_qcff) {
+    uint32_t max_size = MIN2(p_qcff->proc_width, p_qcff->proc_height);
+    int rc;
+
+    if (p_qcff->params.max_face_size)
+        max_size = MIN2(max_size, p_qcff->params.max_face_size);
+    max_size = MAX2(max_size, p_qcff->params.min_face_size);
+    rc = FACEPROC_SetDtFaceSizeRange(p_qcff->hdt,
+            p_qcff->params.min_face_size, max_size);
+    if (rc != FACEPROC_NORMAL) {
+        QCFF_LOG("FACEPROC_SetDtFaceSizeRange failed %d", rc);
+        return QCFF_RET_FAILURE;
+    }
+    return QCFF_RET_SUCCESS;
+}
+
+static int qcff_use_scale(qcff_t *p_qcff, uint32_t scale_q8) {
+    int rc;
+
+    if (scale_q8 == p_qcff->scale_q8)
+        return QCFF_RET_SUCCESS;
+
+    p_qcff->scale_q8 = scale_q8;
+    p_qcff->proc_width = QCFF_SCALED_LEN(p_qcff->crop.dx, scale_q8);
+    p_qcff->proc_height = QCFF_SCALED_LEN(p_qcff->crop.dy, scale_q8);
+
+    /* Same handles, new image size: faces being tracked were found at the
+     previous scale and have to be searched for again */
+    rc = qcff_face_size_range(p_qcff);
+    if (QCFF_FAILED(rc))
+        return rc;
+    FACEPROC_ClearDtResult(p_qcff->hdt_result);
+    p_qcff->num_faces = 0;
+    p_qcff->skip.ref_valid = FALSE;
+    return QCFF_RET_SUCCESS;
+}
+
+/* Takes the signature of a packed frame when static scene skipping or
+ motion masks are on and the frame covers the signature grid; returns
+ p_sig, or NULL when no signature was taken */
+static uint8_t *qcff_signature(qcff_t *p_qcff, const uint8_t *p_image,
+        uint32_t width, uint32_t height, uint32_t stride, uint8_t *p_sig) {
+    if ((!p_qcff->skip.threshold && !p_qcff->motion.threshold)
+            || width < QCFF_IMG_SIG_COLS
+            || height < QCFF_IMG_SIG_ROWS)
+        return NULL;
+
+    qcff_img_signature(p_image, width, height, stride, p_sig);
+    return p_sig;
+}
+
+static void *qcff_async_worker(void *arg) {
+    qcff_t *p_qcff = (qcff_t *) arg;
+    qcff_async_t *p_async = p_qcff->p_async;
+    uint32_t old;
+
+    for (;;) {
+        qcff_async_frame_t *p_slot;
+        qcff_frame_result_t *p_result;
+        struct timespec t1, t2;
+
+        while (sem_wait(&p_async->frame_sem) && errno == EINTR)
+            ;
+        if (__atomic_load_n(&p_async->stop, __ATOMIC_ACQUIRE))
+            break;
+        if (!(__atomic_load_n(&p_async->frame_mailbox, __ATOMIC_ACQUIRE)
+                & QCFF_SLOT_FRESH))
+            continue;
+        old = __atomic_exchange_n(&p_async->frame_mailbox,
+                p_async->frame_front, __ATOMIC_ACQ_REL);
+        p_async->frame_front = old & ~QCFF_SLOT_FRESH;
+        p_slot = &p_async->frames[p_async->frame_front];
+
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        p_result = &p_async->results[p_async->result_back];
+        p_result->seq = p_slot->seq;
+        p_result->timestamp = p_slot->timestamp;
+        p_result->info_mask = p_async->info_mask;
+        p_result->num_faces = 0;
+        p_result->skipped = 0;
+        p_result->num_dropped = __atomic_exchange_n(&p_async->num_dropped, 0,
+                __ATOMIC_RELAXED);
+        p_result->status = qcff_use_scale(p_qcff, p_slot->scale_q8);
+
+        p_qcff->p_frame = p_slot->p_image;
+        p_qcff->img_width = p_qcff->proc_width;
+        p_qcff->img_height = p_qcff->proc_height;
+        p_qcff->img_x = p_qcff->crop.x;
+        p_qcff->img_y = p_qcff->crop.y;
+        p_qcff->skip.p_cur = p_slot->has_sig ? p_slot->sig : NULL;
+        p_qcff->orient_rotation = p_slot->transform.rotation % 360;
+        p_qcff->orient_mirrored = p_slot->transform.mirrored;
+
+        if (QCFF_SUCCEEDED(p_result->status)) {
+            p_result->status = qcff_detect(p_qcff);
+            p_result->skipped = p_qcff->skip.stats.last_skipped;
+        }
+        if (QCFF_SUCCEEDED(p_result->status))
+            p_result->status = qcff_fill_result(p_qcff, &p_slot->transform,
+                    p_result);
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        p_result->time_us = (t2.tv_sec - t1.tv_sec) * 1000000
+                + (t2.tv_nsec - t1.tv_nsec) / 1000;
+
+        old = __atomic_exchange_n(&p_async->result_mailbox,
+                p_async->result_back | QCFF_SLOT_FRESH, __ATOMIC_ACQ_REL);
+        p_async->result_back = old & ~QCFF_SLOT_FRESH;
+        sem_post(&p_async->result_sem);
+    }
+    return NULL;
+}
+
+/* Gathers the information selected by the info_mask of p_result for the
+ faces detected last, transformed by p_transform when given */
+static int qcff_fill_result(qcff_t *p_qcff,
+        const qcff_transform_t *p_transform, qcff_frame_result_t *p_result) {
+    uint32_t face_indices[QCFF_MAX_RESULT_FACES];
+    qcff_complete_face_info_t info = empty_info;
+    uint32_t mask = p_result->info_mask;
+    uint32_t num_faces, i;
+    int rc;
+
+    p_result->num_faces = 0;
+    num_faces = MIN2(p_qcff->num_faces, QCFF_MAX_RESULT_FACES);
+    if (!num_faces)
+        return QCFF_RET_SUCCESS;
+
+    for (i = 0; i < num_faces; i++)
+        face_indices[i] = i;
+    if (mask & QCFF_INFO_RECTS)
+        info.p_rects = p_result->rects;
+    if (mask & QCFF_INFO_PARTS)
+        info.p_parts = p_result->parts;
+    if (mask & QCFF_INFO_PARTS_EX)
+        info.p_parts_ex = p_result->parts_ex;
+    if (mask & QCFF_INFO_DIRECTIONS)
+        info.p_directions = p_result->directions;
+    if (mask & QCFF_INFO_SMILES)
+        info.p_smile_degrees = p_result->smile_degrees;
+    if (mask & QCFF_INFO_EYE_OPENS)
+        info.p_eye_open_degrees = p_result->eye_open_degrees;
+    if (mask & QCFF_INFO_GAZES)
+        info.p_gaze_degrees = p_result->gaze_degrees;
+    rc = qcff_collect_info(p_qcff, num_faces, face_indices,
+            &p_result->num_faces, &info);
+    if (QCFF_SUCCEEDED(rc) && p_transform)
+        rc = qcff_transform_complete_info((qcff_handle_t) p_qcff,
+                p_transform, p_result->num_faces, &info);
+    return rc;
+}
+
+static void qcff_async_free(qcff_async_t *p_async) {
+    uint32_t i;
+
+    for (i = 0; i < 3; i++)
+        if (p_async->frames[i].p_image)
+            free(p_async->frames[i].p_image);
+    free(p_async);
+}
+
+static void *qcff_pool_worker(void *arg) {
+    qcff_pool_worker_t *p_worker = (qcff_pool_worker_t *) arg;
+    qcff_pool_priv_t *p_priv = p_worker->p_pool;
+    uint32_t slot, info_mask;
+
+    pthread_mutex_lock(&p_priv->lock);
+    for (;;) {
+        while (!p_priv->num_work && !p_priv->stop)
+            pthread_cond_wait(&p_priv->work_cond, &p_priv->lock);
+        if (p_priv->stop)
+            break;
+        slot = p_priv->p_work[p_priv->work_head];
+        p_priv->work_head = (p_priv->work_head + 1) % p_priv->depth;
+        p_priv->num_work--;
+        info_mask = p_priv->info_mask;
+        pthread_mutex_unlock(&p_priv->lock);
+
+        qcff_pool_process(p_worker, &p_priv->p_slots[slot], info_mask);
+
+        pthread_mutex_lock(&p_priv->lock);
+        p_priv->p_done[(p_priv->done_head + p_priv->num_done)
+                % p_priv->depth] = slot;
+        p_priv->num_done++;
+        pthread_cond_signal(&p_priv->done_cond);
+    }
+    pthread_mutex_unlock(&p_priv->lock);
+    return NULL;
+}
+
+/* Runs detection on the image of a slot with the handle of a worker,
+ configuring it first when the image is laid out differently from the
+ previous one */
+static void qcff_pool_process(qcff_pool_worker_t *p_worker,
+        qcff_pool_slot_t *p_slot, uint32_t info_mask) {
+    qcff_frame_result_t *p_result = &p_slot->result;
+    qcff_t *p_qcff = (qcff_t *) p_worker->handle;
+    struct timespec t1, t2;
+    int rc = QCFF_RET_SUCCESS;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    p_result->seq = p_slot->index;
+    p_result->timestamp = 0;
+    p_result->info_mask = info_mask;
+    p_result->num_faces = 0;
+    p_result->num_dropped = 0;
+    p_result->skipped = 0;
+
+    if (!p_worker->configured
+            || memcmp(&p_worker->cfg, &p_slot->item.cfg, sizeof(qcff_config_t))) {
+        p_worker->cfg = p_slot->item.cfg;
+        rc = qcff_config(p_worker->handle, &p_worker->cfg);
+        p_worker->configured = QCFF_SUCCEEDED(rc);
+    }
+    if (QCFF_SUCCEEDED(rc))
+        rc = qcff_set_frame(p_worker->handle, p_slot->item.p_frame);
+    if (QCFF_SUCCEEDED(rc))
+        rc = qcff_fill_result(p_qcff, p_slot->item.p_transform, p_result);
+    p_result->status = rc;
+
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    p_result->time_us = (t2.tv_sec - t1.tv_sec) * 1000000
+            + (t2.tv_nsec - t1.tv_nsec) / 1000;
+}
+
+static void qcff_pool_free(qcff_pool_priv_t *p_priv) {
+    pthread_mutex_destroy(&p_priv->batch_lock);
+    pthread_mutex_destroy(&p_priv->lock);
+    pthread_cond_destroy(&p_priv->work_cond);
+    pthread_cond_destroy(&p_priv->done_cond);
+    if (p_priv->p_workers)
+        free(p_priv->p_workers);
+    if (p_priv->p_free)
+        free(p_priv->p_free);
+    if (p_priv->p_slots)
+        free(p_priv->p_slots);
+    free(p_priv);
+}
+
+/* Cuts the crop around a face into p_roi, the handle's or a worker's,
+ unless it already holds it */
+static int qcff_face_roi(qcff_t *p_qcff, qcff_roi_t *p_roi,
+        uint32_t face_index, const FACEINFO *p_face_info) {
+    FACEINFO face_info = *p_face_info;
+    int32_t left, top, right, bottom, pad;
+    uint32_t width, height, i;
+
+    if (p_roi->face_index == (int32_t) face_index
+            && p_roi->frame_seq == p_qcff->frame_seq)
+        return QCFF_RET_SUCCESS;
+
+    /* Bounding box of the (possibly rolled) face, padded and clipped */
+    left = MIN4(face_info.ptLeftTop.x, face_info.ptRightTop.x,
+            face_info.ptLeftBottom.x, face_info.ptRightBottom.x);
+    right = MAX4(face_info.ptLeftTop.x, face_info.ptRightTop.x,
+            face_info.ptLeftBottom.x, face_info.ptRightBottom.x);
+    top = MIN4(face_info.ptLeftTop.y, face_info.ptRightTop.y,
+            face_info.ptLeftBottom.y, face_info.ptRightBottom.y);
+    bottom = MAX4(face_info.ptLeftTop.y, face_info.ptRightTop.y,
+            face_info.ptLeftBottom.y, face_info.ptRightBottom.y);
+    pad = QCFF_ROI_PAD(MAX2(right - left, bottom - top));
+    left = MAX2(left - pad, 0);
+    top = MAX2(top - pad, 0);
+    right = MIN2(right + pad + 1, (int32_t) p_qcff->img_width);
+    bottom = MIN2(bottom + pad + 1, (int32_t) p_qcff->img_height);
+    if (right <= left || bottom <= top)
+        return QCFF_RET_FAILURE;
+    width = right - left;
+    height = bottom - top;
+
+    if (width * height * 100
+            > p_qcff->img_width * p_qcff->img_height * QCFF_ROI_MAX_PERCENT
+            || width * height > p_roi->capacity) {
+        /* Little to gain over the frame, which is already in memory */
+        left = 0;
+        top = 0;
+        width = p_qcff->img_width;
+        height = p_qcff->img_height;
+        p_roi->p_pixels = p_qcff->p_frame;
+    } else {
+        for (i = 0; i < height; i++)
+            memcpy(p_roi->p_buffer + i * width,
+                    p_qcff->p_frame + (top + i) * p_qcff->img_width + left,
+                    width);
+        p_roi->p_pixels = p_roi->p_buffer;
+    }
+
+    p_roi->x = left;
+    p_roi->y = top;
+    p_roi->width = width;
+    p_roi->height = height;
+    p_roi->corners[0] = face_info.ptLeftTop;
+    p_roi->corners[1] = face_info.ptRightTop;
+    p_roi->corners[2] = face_info.ptLeftBottom;
+    p_roi->corners[3] = face_info.ptRightBottom;
+    for (i = 0; i < 4; i++) {
+        p_roi->corners[i].x -= left;
+        p_roi->corners[i].y -= top;
+    }
+    p_roi->pose = face_info.nPose;
+    p_roi->face_index = face_index;
+    p_roi->frame_seq = p_qcff->frame_seq;
+    return QCFF_RET_SUCCESS;
+}
+
+/* Cuts the crop of the face and finds its parts on it, once per frame;
+ *pp_parts holds them for the other engines */
+static int qcff_detect_parts(qcff_t *p_qcff,
+        const qcff_face_engines_t *p_engines, qcff_roi_t *p_roi,
+        uint32_t face_index, const FACEINFO *p_face_info,
+        qcff_parts_cache_t **pp_parts) {
+    qcff_parts_cache_t *p_parts;
+    int rc;
+
+    if (face_index >= QCFF_MAX_RESULT_FACES)
+        return QCFF_RET_INVALID_PARM;
+    rc = qcff_face_roi(p_qcff, p_roi, face_index, p_face_info);
+    if (QCFF_FAILED(rc))
+        return rc;
+    p_parts = &p_qcff->parts[face_index];
+    *pp_parts = p_parts;
+    if (p_parts->frame_seq == p_qcff->frame_seq)
+        return QCFF_RET_SUCCESS;
+    if (!p_parts->hpt_result) {
+        p_parts->hpt_result = FACEPROC_PT_CreateResultHandle();
+        if (!p_parts->hpt_result) {
+            QCFF_LOG("FACEPROC_PT_CreateResultHandle failed");
+            return QCFF_RET_NO_RESOURCE;
+        }
+    }
+
+    /* Set face location, relative to the crop, to parts detection handle */
+    if (FACEPROC_NORMAL
+            != FACEPROC_PT_SetPosition(p_engines->hpt, &p_roi->corners[0],
+                    &p_roi->corners[1], &p_roi->corners[2],
+                    &p_roi->corners[3], p_roi->pose, p_qcff->dt_version))
+        return QCFF_RET_FAILURE;
+
+    /* Do parts detection */
+    if (FACEPROC_NORMAL
+            != FACEPROC_PT_DetectPoint(p_engines->hpt,
+                    (RAWIMAGE *) p_roi->p_pixels,
+                    p_roi->width,
+                    p_roi->height,
+                    p_parts->hpt_result))
+        return QCFF_RET_FAILURE;
+
+    p_parts->frame_seq = p_qcff->frame_seq;
+    p_parts->ct_valid = FALSE;
+    return QCFF_RET_SUCCESS;
+}
+
+/* Finds the contour from the parts of the face whose crop is cut, once
+ per frame */
+static int qcff_detect_contour(const qcff_face_engines_t *p_engines,
+        const qcff_roi_t *p_roi, qcff_parts_cache_t *p_parts) {
+    if (p_parts->ct_valid)
+        return QCFF_RET_SUCCESS;
+    if (FACEPROC_NORMAL
+            != FACEPROC_CT_SetPointFromHandle(p_engines->hct,
+                    p_parts->hpt_result))
+        return QCFF_RET_FAILURE;
+    if (FACEPROC_NORMAL
+            != FACEPROC_CT_DetectContour(p_engines->hct,
+                    p_roi->p_pixels,
+                    p_roi->width,
+                    p_roi->height,
+                    p_engines->hct_result))
+        return QCFF_RET_FAILURE;
+    if (FACEPROC_NORMAL
+            != FACEPROC_CT_GetResult(p_engines->hct_result,
+                    QCFF_PARTS_EX_MAX, p_parts->ct_points))
+        return QCFF_RET_FAILURE;
+
+    p_parts->ct_valid = TRUE;
+    return QCFF_RET_SUCCESS;
+}
+
+static void qcff_map_roi_point(qcff_t *p_qcff, const qcff_roi_t *p_roi,
+        POINT *p_point) {
+    p_point->x += p_roi->x;
+    p_point->y += p_roi->y;
+    qcff_map_point(p_qcff, p_point);
+}
+
+/* Maps a point found on the processed image back to the input frame,
+ keeping pixel centres aligned */
+static void qcff_map_point(qcff_t *p_qcff, POINT *p_point) {
+    int32_t scale = (int32_t) p_qcff->scale_q8;
+
+    if (scale != QCFF_SCALE_ONE) {
+        p_point->x = (p_point->x * scale + (scale - QCFF_SCALE_ONE) / 2) >> 8;
+        p_point->y = (p_point->y * scale + (scale - QCFF_SCALE_ONE) / 2) >> 8;
     }
-    /* Delete Detection Handle */
-    if (p_qcff->hdt) {
-        ret = FACEPROC_DeleteDetection(p_qcff->hdt);
-        p_qcff->hdt = NULL;
+    p_point->x += (int32_t) p_qcff->img_x;
+    p_point->y += (int32_t) p_qcff->img_y;
+}
+
+/* Composes the mirroring (x' = w - 1 - x) and the clockwise rotation
+ about the frame, which for 90 degrees is x' = h - y, y' = x, for 180
+ x' = 2 (w / 2) - x, y' = 2 (h / 2) - y and for 270 x' = y, y' = w - 1 - x */
+static void qcff_affine_init(qcff_affine_t *p_affine, uint32_t width,
+        uint32_t height, const qcff_transform_t *p_transform) {
+    int32_t w = (int32_t) width, h = (int32_t) height;
+    int32_t mxx = 1, mx0 = 0;
+    int32_t rxx = 1, rxy = 0, rx0 = 0, ryx = 0, ryy = 1, ry0 = 0;
+
+    if (p_transform->mirrored) {
+        mxx = -1;
+        mx0 = w - 1;
     }
-    /* Delete local frame buffer */
-    if (p_qcff->p_local_frame) {
-        free(p_qcff->p_local_frame);
-        p_qcff->p_local_frame = NULL;
+    switch (p_transform->rotation) {
+    case 90:
+        rxx = 0; rxy = -1; rx0 = h;
+        ryx = 1; ryy = 0; ry0 = 0;
+        break;
+    case 180:
+        rxx = -1; rxy = 0; rx0 = 2 * (w / 2);
+        ryx = 0; ryy = -1; ry0 = 2 * (h / 2);
+        break;
+    case 270:
+        rxx = 0; rxy = 1; rx0 = 0;
+        ryx = -1; ryy = 0; ry0 = w - 1;
+        break;
     }
 
-    free((void*) p_qcff);
-    *p_handle = NULL;
-    QCFF_LOG("qcff_destroy");
-    return QCFF_RET_SUCCESS;
+    p_affine->xx = rxx * mxx;
+    p_affine->xy = rxy;
+    p_affine->x0 = rxx * mx0 + rx0;
+    p_affine->yx = ryx * mxx;
+    p_affine->yy = ryy;
+    p_affine->y0 = ryx * mx0 + ry0;
+    p_affine->scale_x = p_transform->scale_x;
+    p_affine->scale_y = p_transform->scale_y;
 }
 
-/************************************************************************
- * Main exposed wrapper functions below
- ***********************************************************************/
-/* Helper functions */
-static int qcff_config_dt(qcff_t *p_qcff, qcff_config_t *p_cfg) {
-    UINT32 an_still_angle[POSE_TYPE_COUNT];
-    UINT8 major, minor;
-    RECT nil_edge = { -1, -1, -1, -1 };
-    int rc = QCFF_RET_SUCCESS;
+static void qcff_affine_pixel(const qcff_affine_t *p_affine,
+        qcff_pixel_t *p_pixel) {
+    int32_t x = p_pixel->x, y = p_pixel->y;
 
-//an_still_angle[POSE_FRONT] = p_qcff->frontal_rot;
-//an_still_angle[POSE_HALF_PROFILE] = p_qcff->half_profile_rot;
-//an_still_angle[POSE_PROFILE] = p_qcff->profile_rot;
+    p_pixel->x = (int32_t) ((float) (p_affine->xx * x + p_affine->xy * y
+            + p_affine->x0) * p_affine->scale_x);
+    p_pixel->y = (int32_t) ((float) (p_affine->yx * x + p_affine->yy * y
+            + p_affine->y0) * p_affine->scale_y);
+}
 
-    an_still_angle[POSE_FRONT] = ANGLE_0 | ANGLE_1 | ANGLE_2 | ANGLE_3 | ANGLE_4
-            | ANGLE_8 | ANGLE_9 | ANGLE_10 | ANGLE_11 | ANGLE_5 | ANGLE_6
-            | ANGLE_7;
-    an_still_angle[POSE_HALF_PROFILE] = ANGLE_11 | ANGLE_0 | ANGLE_1;
-    an_still_angle[POSE_PROFILE] = ANGLE_NONE;
+/* Transforms the top left and bottom right corners, then sorts them */
+static void qcff_affine_rect(const qcff_affine_t *p_affine,
+        qcff_rect_t *p_rect) {
+    qcff_pixel_t a, b;
+    int32_t left, top, right, bottom;
+
+    a.x = (int32_t) p_rect->x;
+    a.y = (int32_t) p_rect->y;
+    b.x = a.x + (int32_t) p_rect->dx;
+    b.y = a.y + (int32_t) p_rect->dy;
+    qcff_affine_pixel(p_affine, &a);
+    qcff_affine_pixel(p_affine, &b);
+
+    left = MIN2(a.x, b.x);
+    right = MAX2(a.x, b.x);
+    top = MIN2(a.y, b.y);
+    bottom = MAX2(a.y, b.y);
+    p_rect->x = (uint32_t) left;
+    p_rect->y = (uint32_t) top;
+    p_rect->dx = (uint32_t) (right - left);
+    p_rect->dy = (uint32_t) (bottom - top);
+}
 
-    /* Create Face-Engine FD handle */
-    p_qcff->hdt = FACEPROC_CreateDetection();
-    if (!p_qcff->hdt) {
-        QCFF_LOG("FACEPROC_CreateDetection failed");
-        return QCFF_RET_FAILURE;
+static void qcff_swap_pixels(qcff_pixel_t *p_pixels, const uint8_t *p_pairs,
+        uint32_t num_pairs) {
+    uint32_t i;
+
+    for (i = 0; i < num_pairs; i++, p_pairs += 2) {
+        qcff_pixel_t tmp = p_pixels[p_pairs[0]];
+        p_pixels[p_pairs[0]] = p_pixels[p_pairs[1]];
+        p_pixels[p_pairs[1]] = tmp;
     }
+}
 
-    /* Set best Face-Engine detection mode for video */
-    if (p_qcff->mode == QCFF_MODE_STILL)
-        rc = (int) FACEPROC_SetDtMode(p_qcff->hdt, DT_MODE_DEFAULT);
-    else
-        rc = (int) FACEPROC_SetDtMode(p_qcff->hdt, DT_MODE_MOTION3);
+/* Brings an angle back into (-180, 180] */
+static int32_t qcff_wrap_degree(int32_t degree) {
+    while (degree > 180)
+        degree -= 360;
+    while (degree <= -180)
+        degree += 360;
+    return degree;
+}
 
-    if (rc != FACEPROC_NORMAL) {
-        QCFF_LOG("FACEPROC_SetDtMode failed %d", rc);
-        return QCFF_RET_FAILURE;
+/* Validates the frame layout and stores it; the crop defaults to the
+ whole frame and is clipped to it */
+static int qcff_config_layout(qcff_t *p_qcff, qcff_config_t *p_cfg) {
+    qcff_rect_t crop = p_cfg->crop;
+    uint32_t row_size;
+
+    if (!p_cfg->width || !p_cfg->height || p_cfg->format >= QCFF_FORMAT_MAX)
+        return QCFF_RET_INVALID_PARM;
+    p_qcff->format = p_cfg->format;
+
+    row_size = p_cfg->width * qcff_format_bpp(p_cfg->format);
+    p_qcff->stride = p_cfg->stride ? p_cfg->stride : row_size;
+    if (p_qcff->stride < row_size) {
+        QCFF_LOG("stride %d smaller than a row of %d bytes", p_qcff->stride,
+                row_size);
+        return QCFF_RET_INVALID_PARM;
     }
+    p_qcff->offset = p_cfg->offset;
 
-    /* Set search density */
-    rc = (int) FACEPROC_SetDtStep(p_qcff->hdt, default_params.SEARCH_DENSITY,
-            default_params.SEARCH_DENSITY);
-    if (rc != FACEPROC_NORMAL) {
-        QCFF_LOG("FACEPROC_SetDtStep failed %d", rc);
-        return QCFF_RET_FAILURE;
+    if (!crop.dx || !crop.dy) {
+        crop.x = 0;
+        crop.y = 0;
+        crop.dx = p_cfg->width;
+        crop.dy = p_cfg->height;
+    }
+    if (crop.x >= p_cfg->width || crop.y >= p_cfg->height) {
+        QCFF_LOG("crop origin %d,%d outside of the frame", crop.x, crop.y);
+        return QCFF_RET_INVALID_PARM;
     }
+    crop.dx = MIN2(crop.dx, p_cfg->width - crop.x);
+    crop.dy = MIN2(crop.dy, p_cfg->height - crop.y);
+    p_qcff->crop = crop;
 
-    /* Set Omrom Detection Angles */
-    rc = (int) FACEPROC_SetDtAngle(p_qcff->hdt, an_still_angle,
+    return QCFF_RET_SUCCESS;
+}
+
+/* Bytes per pixel of the first plane */
+static uint32_t qcff_format_bpp(qcff_format_t format) {
+    switch (format) {
+    case QCFF_FORMAT_RGBA8888:
+        return 4;
+    case QCFF_FORMAT_BGR888:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+/* Turns an angle mask by steps of 30 degrees clockwise. Each angle has a
+ bit in both 12 bit halves of the mask */
+static uint32_t qcff_turn_angles(uint32_t angles, uint32_t steps) {
+    uint32_t low = angles & 0xfff;
+
+    steps %= 12;
+    if (steps)
+        low = ((low << steps) | (low >> (12 - steps))) & 0xfff;
+    return low | (low << 12);
+}
+
+/* Programs the detection angles, turned to the display orientation in
+ automatic mode. hdt is only reprogrammed when the angles change */
+static int qcff_update_dt_angles(qcff_t *p_qcff) {
+    UINT32 angles[POSE_TYPE_COUNT];
+    uint32_t steps = 0;
+    int rc;
+
+    /* A face upright on display is rolled by the rotation undone in the
+     frame, and by the rotation itself when the frame is also mirrored */
+    if (p_qcff->rot_auto)
+        steps = (p_qcff->orient_mirrored ? p_qcff->orient_rotation
+                : 360 - p_qcff->orient_rotation) / 30;
+    angles[POSE_FRONT] = qcff_turn_angles(p_qcff->frontal_rot, steps);
+    angles[POSE_HALF_PROFILE] = qcff_turn_angles(p_qcff->half_profile_rot,
+            steps);
+    angles[POSE_PROFILE] = qcff_turn_angles(p_qcff->profile_rot, steps);
+
+    if (p_qcff->dt_angles_valid
+            && !memcmp(angles, p_qcff->dt_angles, sizeof(angles)))
+        return QCFF_RET_SUCCESS;
+
+    rc = (int) FACEPROC_SetDtAngle(p_qcff->hdt, angles,
             ANGLE_ROTATION_EXT0 | ANGLE_POSE_EXT0);
     if (rc != FACEPROC_NORMAL) {
         QCFF_LOG("FACEPROC_SetDtAngle failed %d", rc);
+        p_qcff->dt_angles_valid = FALSE;
         return QCFF_RET_FAILURE;
     }
+    memcpy(p_qcff->dt_angles, angles, sizeof(angles));
+    p_qcff->dt_angles_valid = TRUE;
+    /* Faces at the angles just added have not been looked for yet */
+    p_qcff->skip.ref_valid = FALSE;
 
-    rc = (int) FACEPROC_SetDtDirectionMask(p_qcff->hdt, FALSE);
+    return QCFF_RET_SUCCESS;
+}
+
+/* Converts a crop relative area into a mask rectangle of the image */
+static void qcff_mask_area(qcff_t *p_qcff, const qcff_rect_t *p_area,
+        RECT *p_rect) {
+    int32_t x0 = (int32_t) (p_qcff->crop.x - p_qcff->img_x);
+
+    p_rect->left = x0 + (INT32) p_area->x;
+    p_rect->top = (INT32) p_area->y;
+    p_rect->right = p_rect->left + (INT32) p_area->dx - 1;
+    p_rect->bottom = p_rect->top + (INT32) p_area->dy - 1;
+}
+
+/* Restricts the search to the crop columns while a padded frame is read
+ in place, and further to the motion areas when they apply. hdt is only
+ reprogrammed when the areas change */
+static int qcff_update_dt_mask(qcff_t *p_qcff) {
+    qcff_rect_t crop_area = { 0, 0, p_qcff->proc_width, p_qcff->proc_height };
+    RECT mask[2] = { { -1, -1, -1, -1 }, { -1, -1, -1, -1 } };
+    int rc;
+
+    if (p_qcff->motion.masked) {
+        qcff_mask_area(p_qcff, &p_qcff->motion.moving, &mask[0]);
+        qcff_mask_area(p_qcff, &p_qcff->motion.tracked, &mask[1]);
+    } else if (p_qcff->img_width > p_qcff->proc_width) {
+        qcff_mask_area(p_qcff, &crop_area, &mask[0]);
+        mask[1] = mask[0];
+    }
+
+    if (p_qcff->dt_mask_valid && !memcmp(mask, p_qcff->dt_mask, sizeof(mask)))
+        return QCFF_RET_SUCCESS;
+
+    rc = FACEPROC_SetDtRectangleMask(p_qcff->hdt, mask[0], mask[1]);
     if (rc != FACEPROC_NORMAL) {
-        QCFF_LOG("FACEPROC_SetDtDirectionMask failed %d", rc);
+        QCFF_LOG("FACEPROC_SetDtRectangleMask failed %d", rc);
+        p_qcff->dt_mask_valid = FALSE;
         return QCFF_RET_FAILURE;
     }
+    memcpy(p_qcff->dt_mask, mask, sizeof(mask));
+    p_qcff->dt_mask_valid = TRUE;
 
-    /* Minimum face size to be detected should be at most half the
-     height of the input frame */
-    if (default_params.MIN_FACE_SIZE > p_cfg->height / 2) {
-        QCFF_LOG("default_params.MIN_FACE_SIZE > p_cfg->height / 2");
-        return QCFF_RET_INVALID_PARM;
+    return QCFF_RET_SUCCESS;
+}
+
+static int qcff_detect(qcff_t *p_qcff) {
+    qcff_skip_t *p_skip = &p_qcff->skip;
+    qcff_deadline_t *p_deadline = &p_qcff->deadline;
+    struct timespec t1, t2;
+    uint32_t elapsed_us, budget_ms;
+    uint8_t search, timed_out;
+    int rc;
+
+    /* The mode changed since the configuration */
+    if (p_qcff->hdt && p_qcff->dt_key.mode != p_qcff->mode) {
+        rc = qcff_select_dt(p_qcff);
+        if (QCFF_FAILED(rc))
+            return rc;
+        /* The new detector numbers its faces afresh */
+        memset(p_qcff->attr_tracks, 0, sizeof(p_qcff->attr_tracks));
+        memset(p_qcff->recog_tracks, 0, sizeof(p_qcff->recog_tracks));
+        memset(p_qcff->rank_tracks, 0, sizeof(p_qcff->rank_tracks));
     }
 
-    /* Set the max and min face size for detection */
-    /* Maximum face size is set to the minimum of frame width and height */
-    rc = (int) FACEPROC_SetDtFaceSizeRange(p_qcff->hdt,
-            default_params.MIN_FACE_SIZE,
-            p_cfg->width > p_cfg->height ?
-                    p_cfg->height / p_cfg->downscale_factor :
-                    p_cfg->width / p_cfg->downscale_factor);
-    if (rc != FACEPROC_NORMAL) {
-        QCFF_LOG("FACEPROC_SetDtFaceSizeRange failed %d", rc);
-        return QCFF_RET_FAILURE;
+    /* Crops cut for the previous frame are stale */
+    p_qcff->frame_seq++;
+    p_qcff->roi.face_index = -1;
+
+    /* Static scene: the faces found on the reference frame still hold.
+     The same holds when nothing moved and no face is tracked */
+    search = qcff_motion_update(p_qcff);
+    if (!search || (p_skip->threshold && p_skip->p_cur && p_skip->ref_valid
+            && (!p_skip->max_skip || p_skip->run < p_skip->max_skip)
+            && qcff_img_signature_diff(p_skip->p_cur, p_skip->ref)
+                    <= p_skip->threshold)) {
+        p_skip->run++;
+        __atomic_add_fetch(&p_skip->stats.frames_skipped, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&p_skip->stats.last_skipped, 1, __ATOMIC_RELAXED);
+        return QCFF_RET_SUCCESS;
     }
+    p_skip->run = 0;
+    p_skip->ref_valid = FALSE;
 
-    /* Create Face-Engine result handle */
-    p_qcff->hdt_result = FACEPROC_CreateDtResult(
-            default_params.MAX_FACE_TO_DETECT,
-            (default_params.MAX_FACE_TO_DETECT / 2));
-    if (!(p_qcff->hdt_result)) {
-        QCFF_LOG("FACEPROC_CreateDtResult failed");
-        return QCFF_RET_FAILURE;
+    rc = qcff_update_dt_mask(p_qcff);
+    if (QCFF_FAILED(rc))
+        return rc;
+    if (p_qcff->rot_auto) {
+        rc = qcff_update_dt_angles(p_qcff);
+        if (QCFF_FAILED(rc))
+            return rc;
+    }
+
+    /* Do detection */
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (p_qcff->p_tiling)
+        p_qcff->p_tiling->active = FALSE;
+    if (p_qcff->p_refine)
+        p_qcff->p_refine->active = FALSE;
+    if (qcff_tiles_apply(p_qcff)) {
+        rc = qcff_detect_tiles(p_qcff, &timed_out);
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        if (QCFF_FAILED(rc))
+            return rc;
+    } else if (qcff_refine_scale(p_qcff) > QCFF_SCALE_ONE) {
+        rc = qcff_detect_refine(p_qcff, &timed_out);
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        if (QCFF_FAILED(rc))
+            return rc;
+    } else {
+        rc = FACEPROC_Detection(p_qcff->hdt, (RAWIMAGE *) p_qcff->p_frame,
+                p_qcff->img_width,
+                p_qcff->img_height,
+                (p_qcff->params.accuracy == QCFF_ACCURACY_HIGH)
+                        ? ACCURACY_HIGH_TR : ACCURACY_NORMAL,
+                p_qcff->hdt_result);
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+
+        /* At a timeout the faces found so far are returned */
+        timed_out = (rc == FACEPROC_TIMEOUT);
+        if (rc != FACEPROC_NORMAL && !timed_out) {
+            QCFF_LOG("FACEPROC_Detection returned %d %d",
+                    (uint32_t)rc, p_qcff->frame_width);
+            return QCFF_RET_FAILURE;
+        }
+
+        /* Get the number of faces */
+        rc = FACEPROC_GetDtFaceCount(p_qcff->hdt_result,
+                (INT32*) &p_qcff->num_faces);
+        if (rc != FACEPROC_NORMAL) {
+            QCFF_LOG("FACEPROC_GetDtFaceCount returned %d", (uint32_t)rc);
+            return QCFF_RET_FAILURE;
+        }
+    }
+
+    elapsed_us = (t2.tv_sec - t1.tv_sec) * 1000000
+            + (t2.tv_nsec - t1.tv_nsec) / 1000;
+    budget_ms = p_deadline->non_tracking_ms;
+    if (p_qcff->mode != QCFF_MODE_STILL)
+        budget_ms += p_deadline->tracking_ms;
+    if (timed_out)
+        __atomic_add_fetch(&p_deadline->stats.frames_timed_out, 1,
+                __ATOMIC_RELAXED);
+    if (budget_ms && elapsed_us > budget_ms * 1000)
+        __atomic_add_fetch(&p_deadline->stats.frames_late, 1,
+                __ATOMIC_RELAXED);
+    __atomic_store_n(&p_deadline->stats.last_time_us, elapsed_us,
+            __ATOMIC_RELAXED);
+    if (elapsed_us > p_deadline->stats.max_time_us)
+        __atomic_store_n(&p_deadline->stats.max_time_us, elapsed_us,
+                __ATOMIC_RELAXED);
+
+    __atomic_add_fetch(&p_skip->stats.frames_detected, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&p_skip->stats.last_skipped, 0, __ATOMIC_RELAXED);
+    /* A cut short search is no reference: the next frame is searched
+     again, in full when the motion masks are on */
+    if (p_skip->p_cur && !timed_out) {
+        memcpy(p_skip->ref, p_skip->p_cur, QCFF_IMG_SIG_SIZE);
+        p_skip->ref_valid = TRUE;
     }
+    if (p_qcff->motion.threshold)
+        qcff_motion_faces(p_qcff);
+
+    if (p_qcff->adapt.min_face_size)
+        qcff_adapt(p_qcff, elapsed_us);
+    if (p_qcff->recog_interval && p_qcff->mode != QCFF_MODE_STILL)
+        qcff_recog_sweep(p_qcff);
     return QCFF_RET_SUCCESS;
 }
 
-static int qcff_config_pt(qcff_t *p_qcff) {
-    p_qcff->hpt = FACEPROC_PT_CreateHandle();
-    if (!p_qcff->hpt) {
-        QCFF_LOG("FACEPROC_PT_CreateHandle failed");
-        return QCFF_RET_FAILURE;
-    }
+/* Face of the last detection, from the tiles or the refined faces when
+ it took one of those */
+static INT32 qcff_dt_face_info(qcff_t *p_qcff, uint32_t face_index,
+        FACEINFO *p_info) {
+    qcff_tiling_t *p_tiling = p_qcff->p_tiling;
+    qcff_refine_t *p_refine = p_qcff->p_refine;
+    const FACEINFO *p_faces;
+    uint32_t num_faces;
 
-    p_qcff->hpt_result = FACEPROC_PT_CreateResultHandle();
-    if (!p_qcff->hpt_result) {
-        QCFF_LOG("FACEPROC_PT_CreateResultHandle failed");
-        return QCFF_RET_FAILURE;
+    if (p_tiling && p_tiling->active) {
+        p_faces = p_tiling->p_faces;
+        num_faces = p_tiling->num_faces;
+    } else if (p_refine && p_refine->active) {
+        p_faces = p_refine->p_faces;
+        num_faces = p_refine->num_faces;
+    } else {
+        return FACEPROC_GetDtFaceInfo(p_qcff->hdt_result, face_index, p_info);
     }
+    if (face_index >= p_qcff->num_faces || face_index >= num_faces)
+        return FACEPROC_ERR_INVALIDPARAM;
+    *p_info = p_faces[face_index];
+    return FACEPROC_NORMAL;
+}
+
+/* Overlap of the tiles: the largest face they look for, in pixels of the
+ image the engines run on */
+static uint32_t qcff_tile_overlap(qcff_t *p_qcff) {
+    return MAX2(QCFF_TILE_FACES * p_qcff->params.min_face_size,
+            QCFF_TILE_OVERLAP_MIN);
+}
+
+/* Still images of at least the size set, larger than a tile */
+static uint8_t qcff_tiles_apply(qcff_t *p_qcff) {
+    qcff_tiling_t *p_tiling = p_qcff->p_tiling;
+    uint32_t span;
+
+    if (!p_tiling || p_qcff->mode != QCFF_MODE_STILL
+            || p_qcff->proc_width * p_qcff->proc_height < p_tiling->min_pixels)
+        return FALSE;
+    span = QCFF_TILE_SPAN * qcff_tile_overlap(p_qcff);
+    return p_qcff->proc_width > span || p_qcff->proc_height > span;
+}
 
+/* Searches the tiles of the frame, the calling thread along with the
+ workers, and merges their faces */
+static int qcff_detect_tiles(qcff_t *p_qcff, uint8_t *p_timed_out) {
+    qcff_tiling_t *p_tiling = p_qcff->p_tiling;
+    uint32_t num_jobs, i;
+    int rc;
+
+    p_qcff->num_faces = 0;
+    rc = qcff_tiles_setup(p_qcff);
+    if (QCFF_FAILED(rc))
+        return rc;
+    num_jobs = p_tiling->num_tiles + p_tiling->large_pass;
+
+    /* Workers only look at the jobs under the lock, see qcff_tiles_run */
+    pthread_mutex_lock(&p_tiling->lock);
+    p_tiling->num_jobs = num_jobs;
+    p_tiling->next_job = 0;
+    p_tiling->jobs_done = 0;
+    p_tiling->generation++;
+    pthread_cond_broadcast(&p_tiling->start_cond);
+    qcff_tiles_run(&p_tiling->p_workers[0], p_tiling->generation);
+    while (p_tiling->jobs_done < num_jobs)
+        pthread_cond_wait(&p_tiling->done_cond, &p_tiling->lock);
+    pthread_mutex_unlock(&p_tiling->lock);
+
+    *p_timed_out = FALSE;
+    for (i = 0; i < num_jobs; i++) {
+        if (QCFF_FAILED(p_tiling->p_jobs[i].status))
+            return p_tiling->p_jobs[i].status;
+        if (p_tiling->p_jobs[i].timed_out)
+            *p_timed_out = TRUE;
+    }
+    qcff_tiles_merge(p_qcff);
+    p_qcff->num_faces = p_tiling->num_faces;
+    p_tiling->active = TRUE;
     return QCFF_RET_SUCCESS;
 }
 
-static int qcff_config_sm(qcff_t *p_qcff) {
-    p_qcff->hsm = FACEPROC_SM_CreateHandle();
-    if (!p_qcff->hsm) {
-        QCFF_LOG("FACEPROC_SM_CreateHandle failed");
-        return QCFF_RET_FAILURE;
+/* Brings a detector of the tiles or the coarse pass in line with the
+ handle, p_params when the settings changed; p_cur is the configuration
+ it was last given */
+static int qcff_sync_detector(qcff_t *p_qcff, qcff_handle_t handle,
+        const qcff_params_t *p_params, qcff_config_t *p_cfg,
+        const qcff_config_t *p_cur) {
+    int rc = QCFF_RET_SUCCESS;
+
+    if (p_params) {
+        rc = qcff_set_params(handle, p_params);
+        if (QCFF_SUCCEEDED(rc))
+            rc = qcff_set_deadline(handle,
+                    p_qcff->deadline.non_tracking_ms, 0);
     }
+    if (QCFF_SUCCEEDED(rc) && (p_params
+            || memcmp(p_cfg, p_cur, sizeof(qcff_config_t))))
+        rc = qcff_config(handle, p_cfg);
+    if (QCFF_SUCCEEDED(rc))
+        rc = qcff_set_detect_rot(handle, p_qcff->frontal_rot,
+                p_qcff->half_profile_rot, p_qcff->profile_rot);
+    if (QCFF_SUCCEEDED(rc))
+        rc = qcff_set_detect_rot_auto(handle, p_qcff->rot_auto);
+    if (QCFF_SUCCEEDED(rc))
+        rc = qcff_set_orientation(handle, p_qcff->orient_rotation,
+                p_qcff->orient_mirrored);
+    return rc;
+}
 
-    p_qcff->hsm_result = FACEPROC_SM_CreateResultHandle();
-    if (!p_qcff->hsm_result) {
-        QCFF_LOG("FACEPROC_SM_CreateResultHandle failed");
-        return QCFF_RET_FAILURE;
+/* Lays the tiles out over the frame, evenly spaced and all of the same
+ size, and brings the detectors in line with the handle: tiles look for
+ faces up to the overlap, the large face pass for the larger ones on
+ the image downscaled so that they are at least twice the smallest size */
+static int qcff_tiles_setup(qcff_t *p_qcff) {
+    qcff_tiling_t *p_tiling = p_qcff->p_tiling;
+    qcff_params_t tile_params = p_qcff->params;
+    qcff_params_t large_params = p_qcff->params;
+    qcff_config_t tile_cfg, large_cfg;
+    uint32_t overlap, span, scale_q8, num_jobs, job_faces, i;
+    uint8_t settings;
+    int rc = QCFF_RET_SUCCESS;
+
+    overlap = qcff_tile_overlap(p_qcff);
+    span = QCFF_TILE_SPAN * overlap;
+    p_tiling->p_image = p_qcff->p_frame;
+    p_tiling->stride = p_qcff->img_width;
+    p_tiling->x0 = p_qcff->crop.x - p_qcff->img_x;
+    p_tiling->width = p_qcff->proc_width;
+    p_tiling->height = p_qcff->proc_height;
+    p_tiling->cols = (p_tiling->width > span) ? 1
+            + (p_tiling->width - overlap - 1) / (span - overlap) : 1;
+    p_tiling->rows = (p_tiling->height > span) ? 1
+            + (p_tiling->height - overlap - 1) / (span - overlap) : 1;
+    p_tiling->num_tiles = p_tiling->cols * p_tiling->rows;
+
+    memset(&tile_cfg, 0, sizeof(qcff_config_t));
+    tile_cfg.width = MIN2(span, p_tiling->width);
+    tile_cfg.height = MIN2(span, p_tiling->height);
+    tile_cfg.stride = p_tiling->stride;
+    tile_cfg.format = QCFF_FORMAT_Y;
+    if (!tile_params.max_face_size || tile_params.max_face_size > overlap)
+        tile_params.max_face_size = overlap;
+
+    scale_q8 = MIN2(overlap * QCFF_SCALE_ONE
+            / MAX2(2 * p_qcff->params.min_face_size, 1), QCFF_SCALE_MAX);
+    memset(&large_cfg, 0, sizeof(qcff_config_t));
+    large_cfg.width = p_tiling->width;
+    large_cfg.height = p_tiling->height;
+    large_cfg.stride = p_tiling->stride;
+    large_cfg.format = QCFF_FORMAT_Y;
+    large_cfg.downscale_factor_q8 = scale_q8;
+    large_params.min_face_size = overlap * QCFF_SCALE_ONE / scale_q8;
+    if (large_params.max_face_size)
+        large_params.max_face_size = large_params.max_face_size
+                * QCFF_SCALE_ONE / scale_q8;
+    p_tiling->large_pass = (!p_qcff->params.max_face_size
+            || p_qcff->params.max_face_size > overlap)
+            && large_params.min_face_size <= QCFF_SCALED_LEN(
+                    p_tiling->height, scale_q8) / 2;
+
+    /* Room for the faces of every job */
+    num_jobs = p_tiling->num_tiles + p_tiling->large_pass;
+    job_faces = p_qcff->params.max_faces;
+    if (num_jobs > p_tiling->max_jobs || job_faces > p_tiling->job_faces) {
+        num_jobs = MAX2(num_jobs, p_tiling->max_jobs);
+        job_faces = MAX2(job_faces, p_tiling->job_faces);
+        free(p_tiling->p_jobs);
+        free(p_tiling->p_found);
+        free(p_tiling->p_faces);
+        p_tiling->p_jobs = (qcff_tile_job_t *) malloc(
+                num_jobs * sizeof(qcff_tile_job_t));
+        p_tiling->p_found = (FACEINFO *) malloc(
+                num_jobs * job_faces * sizeof(FACEINFO));
+        p_tiling->p_faces = (FACEINFO *) malloc(job_faces * sizeof(FACEINFO));
+        if (!p_tiling->p_jobs || !p_tiling->p_found || !p_tiling->p_faces) {
+            p_tiling->max_jobs = 0;
+            p_tiling->job_faces = 0;
+            return QCFF_RET_NO_RESOURCE;
+        }
+        p_tiling->max_jobs = num_jobs;
+        p_tiling->job_faces = job_faces;
     }
+    for (i = 0; i < p_tiling->max_jobs; i++)
+        p_tiling->p_jobs[i].p_faces = p_tiling->p_found
+                + i * p_tiling->job_faces;
+
+    /* Parameters and deadline when they changed, the layout when the
+     frame size did, the angles with every frame */
+    settings = !p_tiling->tile_set_up
+            || p_tiling->tile_seq != p_qcff->setup_seq;
+    for (i = 0; i < p_tiling->num_workers && QCFF_SUCCEEDED(rc); i++)
+        rc = qcff_sync_detector(p_qcff, p_tiling->p_workers[i].handle,
+                settings ? &tile_params : NULL, &tile_cfg,
+                &p_tiling->tile_cfg);
+    if (QCFF_FAILED(rc)) {
+        p_tiling->tile_set_up = FALSE;
+        return rc;
+    }
+    p_tiling->tile_cfg = tile_cfg;
+    p_tiling->tile_seq = p_qcff->setup_seq;
+    p_tiling->tile_set_up = TRUE;
 
+    /* The large face detector is only set up once it is needed */
+    if (!p_tiling->large_pass)
+        return QCFF_RET_SUCCESS;
+    settings = !p_tiling->large_set_up
+            || p_tiling->large_seq != p_qcff->setup_seq;
+    rc = qcff_sync_detector(p_qcff, p_tiling->large,
+            settings ? &large_params : NULL, &large_cfg,
+            &p_tiling->large_cfg);
+    if (QCFF_FAILED(rc)) {
+        p_tiling->large_set_up = FALSE;
+        return rc;
+    }
+    p_tiling->large_cfg = large_cfg;
+    p_tiling->large_seq = p_qcff->setup_seq;
+    p_tiling->large_set_up = TRUE;
     return QCFF_RET_SUCCESS;
 }
 
-static int qcff_config_gb(qcff_t *p_qcff) {
-    p_qcff->hgb = FACEPROC_GB_CreateHandle();
-    if (!p_qcff->hgb) {
-        QCFF_LOG("FACEPROC_GB_CreateHandle failed");
-        return QCFF_RET_FAILURE;
+/* Runs the jobs of a generation until none is left; called and returns
+ with the lock held */
+static void qcff_tiles_run(qcff_tile_worker_t *p_worker, uint32_t generation) {
+    qcff_tiling_t *p_tiling = p_worker->p_tiling;
+    uint32_t job;
+
+    while (p_tiling->generation == generation
+            && p_tiling->next_job < p_tiling->num_jobs) {
+        job = p_tiling->next_job++;
+        pthread_mutex_unlock(&p_tiling->lock);
+        qcff_tile_job(p_worker, job);
+        pthread_mutex_lock(&p_tiling->lock);
+        if (++p_tiling->jobs_done == p_tiling->num_jobs)
+            pthread_cond_broadcast(&p_tiling->done_cond);
     }
+}
 
-    p_qcff->hgb_result = FACEPROC_GB_CreateResultHandle();
-    if (!p_qcff->hgb_result) {
-        QCFF_LOG("FACEPROC_SM_CreateResultHandle failed");
-        return QCFF_RET_FAILURE;
+static void *qcff_tile_thread(void *arg) {
+    qcff_tile_worker_t *p_worker = (qcff_tile_worker_t *) arg;
+    qcff_tiling_t *p_tiling = p_worker->p_tiling;
+    uint32_t generation;
+
+    pthread_mutex_lock(&p_tiling->lock);
+    generation = p_tiling->generation;
+    while (!p_tiling->stop) {
+        if (p_tiling->generation == generation) {
+            pthread_cond_wait(&p_tiling->start_cond, &p_tiling->lock);
+            continue;
+        }
+        generation = p_tiling->generation;
+        qcff_tiles_run(p_worker, generation);
     }
+    pthread_mutex_unlock(&p_tiling->lock);
+    return NULL;
+}
 
-    return QCFF_RET_SUCCESS;
+/* Searches a tile, or the whole image for the large faces, on the
+ detector of the worker and keeps its faces in frame coordinates. Faces
+ touching an inner edge of a tile are left to the tile across it, which
+ sees them whole */
+static void qcff_tile_job(qcff_tile_worker_t *p_worker, uint32_t job) {
+    qcff_tiling_t *p_tiling = p_worker->p_tiling;
+    qcff_tile_job_t *p_job = &p_tiling->p_jobs[job];
+    qcff_handle_t handle = p_worker->handle;
+    qcff_t *p_det;
+    uint32_t x = 0, y = 0, tile_w, tile_h, timed_out, count, i;
+    int32_t left, top, right, bottom, dx, dy;
+    INT32 num_faces = 0;
+    FACEINFO info;
+
+    p_job->num_faces = 0;
+    p_job->timed_out = FALSE;
+    if (job == p_tiling->num_tiles) {
+        handle = p_tiling->large;
+        tile_w = p_tiling->width;
+        tile_h = p_tiling->height;
+    } else {
+        tile_w = p_tiling->tile_cfg.width;
+        tile_h = p_tiling->tile_cfg.height;
+        if (p_tiling->cols > 1)
+            x = (job % p_tiling->cols) * (p_tiling->width - tile_w)
+                    / (p_tiling->cols - 1);
+        if (p_tiling->rows > 1)
+            y = (job / p_tiling->cols) * (p_tiling->height - tile_h)
+                    / (p_tiling->rows - 1);
+    }
+    p_det = (qcff_t *) handle;
+
+    timed_out = p_det->deadline.stats.frames_timed_out;
+    p_job->status = qcff_set_frame(handle, (uint8_t *) p_tiling->p_image
+            + y * p_tiling->stride + p_tiling->x0 + x);
+    if (QCFF_FAILED(p_job->status))
+        return;
+    p_job->timed_out = (p_det->deadline.stats.frames_timed_out != timed_out);
+    if (FACEPROC_GetDtFaceCount(p_det->hdt_result, &num_faces)
+            != FACEPROC_NORMAL)
+        num_faces = 0;
+
+    count = MIN2((uint32_t) num_faces, p_tiling->job_faces);
+    for (i = 0; i < count; i++) {
+        if (FACEPROC_GetDtFaceInfo(p_det->hdt_result, (INT32) i, &info)
+                != FACEPROC_NORMAL)
+            continue;
+        qcff_map_point(p_det, &info.ptLeftTop);
+        qcff_map_point(p_det, &info.ptRightTop);
+        qcff_map_point(p_det, &info.ptLeftBottom);
+        qcff_map_point(p_det, &info.ptRightBottom);
+
+        if (job < p_tiling->num_tiles) {
+            left = MIN2(info.ptLeftTop.x, info.ptLeftBottom.x);
+            right = MAX2(info.ptRightTop.x, info.ptRightBottom.x);
+            top = MIN2(info.ptLeftTop.y, info.ptRightTop.y);
+            bottom = MAX2(info.ptLeftBottom.y, info.ptRightBottom.y);
+            if ((x && left < QCFF_TILE_SEAM)
+                    || (x + tile_w < p_tiling->width
+                            && right >= (int32_t) (tile_w - QCFF_TILE_SEAM))
+                    || (y && top < QCFF_TILE_SEAM)
+                    || (y + tile_h < p_tiling->height
+                            && bottom >= (int32_t) (tile_h - QCFF_TILE_SEAM)))
+                continue;
+        }
+        dx = (int32_t) (p_tiling->x0 + x);
+        dy = (int32_t) y;
+        info.ptLeftTop.x += dx;
+        info.ptLeftTop.y += dy;
+        info.ptRightTop.x += dx;
+        info.ptRightTop.y += dy;
+        info.ptLeftBottom.x += dx;
+        info.ptLeftBottom.y += dy;
+        info.ptRightBottom.x += dx;
+        info.ptRightBottom.y += dy;
+        p_job->p_faces[p_job->num_faces++] = info;
+    }
 }
 
-static int qcff_config_fr(qcff_t *p_qcff) {
-    p_qcff->hfr = FACEPROC_FR_CreateFeatureHandle();
-    if (!p_qcff->hfr) {
-        QCFF_LOG("FACEPROC_FR_CreateFeatureHandle failed");
-        return QCFF_RET_FAILURE;
+static void qcff_face_box(const FACEINFO *p_info, int64_t *p_box) {
+    p_box[0] = MIN2(MIN2(p_info->ptLeftTop.x, p_info->ptLeftBottom.x),
+            MIN2(p_info->ptRightTop.x, p_info->ptRightBottom.x));
+    p_box[1] = MIN2(MIN2(p_info->ptLeftTop.y, p_info->ptRightTop.y),
+            MIN2(p_info->ptLeftBottom.y, p_info->ptRightBottom.y));
+    p_box[2] = MAX2(MAX2(p_info->ptLeftTop.x, p_info->ptLeftBottom.x),
+            MAX2(p_info->ptRightTop.x, p_info->ptRightBottom.x));
+    p_box[3] = MAX2(MAX2(p_info->ptLeftTop.y, p_info->ptRightTop.y),
+            MAX2(p_info->ptLeftBottom.y, p_info->ptRightBottom.y));
+}
+
+static int qcff_face_confidence_cmp(const void *p_a, const void *p_b) {
+    const FACEINFO *p_fa = (const FACEINFO *) p_a;
+    const FACEINFO *p_fb = (const FACEINFO *) p_b;
+
+    if (p_fa->nConfidence != p_fb->nConfidence)
+        return (p_fa->nConfidence > p_fb->nConfidence) ? -1 : 1;
+    return 0;
+}
+
+/* Keeps the most confident of the faces overlapping by more than
+ QCFF_FACE_NMS_IOU, at most max_faces of them; reorders p_found */
+static uint32_t qcff_merge_faces(FACEINFO *p_found, uint32_t num_found,
+        uint32_t max_faces, FACEINFO *p_faces) {
+    uint32_t num_kept = 0, i, j;
+    int64_t a[4], b[4], inter, uni, w, h;
+
+    qsort(p_found, num_found, sizeof(FACEINFO), qcff_face_confidence_cmp);
+    for (i = 0; i < num_found && num_kept < max_faces; i++) {
+        qcff_face_box(&p_found[i], a);
+        for (j = 0; j < num_kept; j++) {
+            qcff_face_box(&p_faces[j], b);
+            w = MIN2(a[2], b[2]) - MAX2(a[0], b[0]);
+            h = MIN2(a[3], b[3]) - MAX2(a[1], b[1]);
+            if (w <= 0 || h <= 0)
+                continue;
+            inter = w * h;
+            uni = (a[2] - a[0]) * (a[3] - a[1])
+                    + (b[2] - b[0]) * (b[3] - b[1]) - inter;
+            if (inter * 100 > QCFF_FACE_NMS_IOU * uni)
+                break;
+        }
+        if (j < num_kept)
+            continue;
+        p_faces[num_kept] = p_found[i];
+        p_faces[num_kept].nID = (INT32) num_kept;
+        num_kept++;
     }
-    p_qcff->hal = FACEPROC_FR_CreateAlbumHandle(
-            default_params.MAX_REGISTERED_USERS,
-            default_params.MAX_DATA_PER_USER);
-    if (!p_qcff->hal) {
-        QCFF_LOG("FACEPROC_FR_CreateAlbumHandle failed");
-        return QCFF_RET_FAILURE;
+    return num_kept;
+}
+
+/* Merges the faces of the jobs: the same face found by two tiles, or by
+ a tile and the large face pass, is kept once, the most confident */
+static void qcff_tiles_merge(qcff_t *p_qcff) {
+    qcff_tiling_t *p_tiling = p_qcff->p_tiling;
+    uint32_t num_jobs = p_tiling->num_tiles + p_tiling->large_pass;
+    uint32_t num_found = 0, i;
+
+    for (i = 0; i < num_jobs; i++) {
+        qcff_tile_job_t *p_job = &p_tiling->p_jobs[i];
+
+        memmove(p_tiling->p_found + num_found, p_job->p_faces,
+                p_job->num_faces * sizeof(FACEINFO));
+        num_found += p_job->num_faces;
     }
-    p_qcff->num_registered_users = 0;
-    return QCFF_RET_SUCCESS;
+    p_tiling->num_faces = qcff_merge_faces(p_tiling->p_found, num_found,
+            p_qcff->params.max_faces, p_tiling->p_faces);
 }
 
-static int qcff_config_ct(qcff_t *p_qcff) {
-    p_qcff->hct = FACEPROC_CT_CreateHandle();
-    if (!p_qcff->hct) {
-        QCFF_LOG("FACEPROC_CT_CreateHandle failed");
-        return QCFF_RET_FAILURE;
+/* Stops the threads and releases the detectors of tiled detection */
+static void qcff_tiling_free(qcff_tiling_t *p_tiling) {
+    uint32_t i;
+
+    pthread_mutex_lock(&p_tiling->lock);
+    p_tiling->stop = TRUE;
+    pthread_cond_broadcast(&p_tiling->start_cond);
+    pthread_mutex_unlock(&p_tiling->lock);
+    for (i = 1; i < p_tiling->num_workers; i++)
+        pthread_join(p_tiling->p_workers[i].thread, NULL);
+    for (i = 0; i < p_tiling->num_workers; i++)
+        qcff_destroy(&p_tiling->p_workers[i].handle);
+    if (p_tiling->large)
+        qcff_destroy(&p_tiling->large);
+    pthread_cond_destroy(&p_tiling->done_cond);
+    pthread_cond_destroy(&p_tiling->start_cond);
+    pthread_mutex_destroy(&p_tiling->lock);
+    free(p_tiling->p_faces);
+    free(p_tiling->p_found);
+    free(p_tiling->p_jobs);
+    free(p_tiling->p_workers);
+    free(p_tiling);
+}
+
+/* Factor of the coarse pass for the current frame: the one set, lowered
+ so that the smallest faces stay detectable; QCFF_SCALE_ONE when
+ refinement does not apply */
+static uint32_t qcff_refine_scale(qcff_t *p_qcff) {
+    qcff_refine_t *p_refine = p_qcff->p_refine;
+    uint32_t scale_q8;
+
+    if (!p_refine || p_qcff->mode != QCFF_MODE_STILL)
+        return QCFF_SCALE_ONE;
+    scale_q8 = MIN2(p_refine->scale_q8, p_qcff->params.min_face_size
+            * QCFF_SCALE_ONE / default_params.MIN_FACE_SIZE);
+    /* The coarse image has to hold the smallest face twice */
+    if (scale_q8 <= QCFF_SCALE_ONE || default_params.MIN_FACE_SIZE
+            > QCFF_SCALED_LEN(p_qcff->proc_height, scale_q8) / 2)
+        return QCFF_SCALE_ONE;
+    return scale_q8;
+}
+
+/* Finds the faces on the downscaled image with the coarse detector, then
+ again on hdt in a square around each, in the sizes around the coarse
+ one. A face not found again keeps its coarse box */
+static int qcff_detect_refine(qcff_t *p_qcff, uint8_t *p_timed_out) {
+    qcff_refine_t *p_refine = p_qcff->p_refine;
+    qcff_t *p_coarse = (qcff_t *) p_refine->coarse;
+    qcff_params_t params = p_qcff->params;
+    qcff_config_t cfg;
+    uint32_t scale_q8, x0, timed_out, count, size, side, lo, hi;
+    uint32_t num_found = 0, num_roi, i, j;
+    int32_t roi_x, roi_y, roi_w, roi_h;
+    int64_t box[4];
+    INT32 num_faces = 0, num_fine;
+    FACEINFO info, fine;
+    RECT mask;
+    int rc;
+
+    p_qcff->num_faces = 0;
+    *p_timed_out = FALSE;
+    if (params.max_faces > p_refine->max_faces) {
+        free(p_refine->p_found);
+        free(p_refine->p_faces);
+        p_refine->p_found = (FACEINFO *) malloc(params.max_faces
+                * QCFF_REFINE_FACES * sizeof(FACEINFO));
+        p_refine->p_faces = (FACEINFO *) malloc(
+                params.max_faces * sizeof(FACEINFO));
+        if (!p_refine->p_found || !p_refine->p_faces) {
+            p_refine->max_faces = 0;
+            return QCFF_RET_NO_RESOURCE;
+        }
+        p_refine->max_faces = params.max_faces;
     }
 
-    p_qcff->hct_result = FACEPROC_CT_CreateResultHandle();
-    if (!p_qcff->hct_result) {
-        QCFF_LOG("FACEPROC_CT_CreateResultHandle failed");
-        return QCFF_RET_FAILURE;
+    /* Coarse pass, over the crop columns of the image hdt runs on */
+    scale_q8 = qcff_refine_scale(p_qcff);
+    x0 = p_qcff->crop.x - p_qcff->img_x;
+    memset(&cfg, 0, sizeof(qcff_config_t));
+    cfg.width = p_qcff->proc_width;
+    cfg.height = p_qcff->proc_height;
+    cfg.stride = p_qcff->img_width;
+    cfg.format = QCFF_FORMAT_Y;
+    cfg.downscale_factor_q8 = scale_q8;
+    params.min_face_size = p_qcff->params.min_face_size * QCFF_SCALE_ONE
+            / scale_q8;
+    if (params.max_face_size)
+        params.max_face_size = MAX2(params.max_face_size * QCFF_SCALE_ONE
+                / scale_q8, params.min_face_size);
+    rc = qcff_sync_detector(p_qcff, p_refine->coarse,
+            (!p_refine->set_up || p_refine->coarse_seq != p_qcff->setup_seq
+                    || memcmp(&cfg, &p_refine->coarse_cfg,
+                            sizeof(qcff_config_t))) ? &params : NULL,
+            &cfg, &p_refine->coarse_cfg);
+    if (QCFF_FAILED(rc)) {
+        p_refine->set_up = FALSE;
+        return rc;
+    }
+    p_refine->coarse_cfg = cfg;
+    p_refine->coarse_seq = p_qcff->setup_seq;
+    p_refine->set_up = TRUE;
+
+    timed_out = p_coarse->deadline.stats.frames_timed_out;
+    rc = qcff_set_frame(p_refine->coarse, p_qcff->p_frame + x0);
+    if (QCFF_FAILED(rc))
+        return rc;
+    *p_timed_out = (p_coarse->deadline.stats.frames_timed_out != timed_out);
+    if (FACEPROC_GetDtFaceCount(p_coarse->hdt_result, &num_faces)
+            != FACEPROC_NORMAL)
+        num_faces = 0;
+    count = MIN2((uint32_t) num_faces, params.max_faces);
+
+    /* Fine passes: hdt searches a band of rows of the image, masked to
+     the square, for the sizes around the coarse one */
+    for (i = 0; i < count && QCFF_SUCCEEDED(rc); i++) {
+        if (FACEPROC_GetDtFaceInfo(p_coarse->hdt_result, (INT32) i, &info)
+                != FACEPROC_NORMAL)
+            continue;
+        qcff_map_point(p_coarse, &info.ptLeftTop);
+        qcff_map_point(p_coarse, &info.ptRightTop);
+        qcff_map_point(p_coarse, &info.ptLeftBottom);
+        qcff_map_point(p_coarse, &info.ptRightBottom);
+        info.ptLeftTop.x += (int32_t) x0;
+        info.ptRightTop.x += (int32_t) x0;
+        info.ptLeftBottom.x += (int32_t) x0;
+        info.ptRightBottom.x += (int32_t) x0;
+
+        qcff_face_box(&info, box);
+        size = (uint32_t) MAX2(box[2] - box[0], box[3] - box[1]);
+        side = size + 2 * size * p_refine->margin_pct / 100;
+        roi_w = (int32_t) MIN2(side, p_qcff->proc_width);
+        roi_h = (int32_t) MIN2(side, p_qcff->proc_height);
+        roi_x = (int32_t) ((box[0] + box[2]) / 2) - roi_w / 2;
+        roi_x = MAX2(roi_x, (int32_t) x0);
+        roi_x = MIN2(roi_x, (int32_t) (x0 + p_qcff->proc_width) - roi_w);
+        roi_y = (int32_t) ((box[1] + box[3]) / 2) - roi_h / 2;
+        roi_y = MAX2(roi_y, 0);
+        roi_y = MIN2(roi_y, (int32_t) p_qcff->proc_height - roi_h);
+        lo = MAX2(size * QCFF_REFINE_SIZE_LO / 100,
+                p_qcff->params.min_face_size);
+        hi = MAX2(size * QCFF_REFINE_SIZE_HI / 100, lo);
+        if (p_qcff->params.max_face_size)
+            hi = MIN2(hi, p_qcff->params.max_face_size);
+
+        num_roi = 0;
+        if (lo <= hi && lo <= (uint32_t) roi_h / 2) {
+            mask.left = roi_x;
+            mask.top = 0;
+            mask.right = roi_x + roi_w - 1;
+            mask.bottom = roi_h - 1;
+            if (FACEPROC_SetDtFaceSizeRange(p_qcff->hdt, lo, hi)
+                    != FACEPROC_NORMAL
+                    || FACEPROC_SetDtRectangleMask(p_qcff->hdt, mask, mask)
+                            != FACEPROC_NORMAL) {
+                rc = QCFF_RET_FAILURE;
+                break;
+            }
+            p_qcff->dt_mask_valid = FALSE;
+            num_fine = FACEPROC_Detection(p_qcff->hdt,
+                    (RAWIMAGE *) (p_qcff->p_frame + roi_y * p_qcff->img_width),
+                    p_qcff->img_width, roi_h,
+                    (p_qcff->params.accuracy == QCFF_ACCURACY_HIGH)
+                            ? ACCURACY_HIGH_TR : ACCURACY_NORMAL,
+                    p_qcff->hdt_result);
+            if (num_fine == FACEPROC_TIMEOUT)
+                *p_timed_out = TRUE;
+            else if (num_fine != FACEPROC_NORMAL) {
+                QCFF_LOG("FACEPROC_Detection returned %d", (int) num_fine);
+                rc = QCFF_RET_FAILURE;
+                break;
+            }
+            if (FACEPROC_GetDtFaceCount(p_qcff->hdt_result, &num_fine)
+                    != FACEPROC_NORMAL)
+                num_fine = 0;
+            for (j = 0; j < (uint32_t) num_fine && num_roi < QCFF_REFINE_FACES;
+                    j++) {
+                if (FACEPROC_GetDtFaceInfo(p_qcff->hdt_result, (INT32) j,
+                        &fine) != FACEPROC_NORMAL)
+                    continue;
+                fine.ptLeftTop.y += roi_y;
+                fine.ptRightTop.y += roi_y;
+                fine.ptLeftBottom.y += roi_y;
+                fine.ptRightBottom.y += roi_y;
+                p_refine->p_found[num_found + num_roi++] = fine;
+            }
+        }
+        if (!num_roi)
+            p_refine->p_found[num_found + num_roi++] = info;
+        num_found += num_roi;
     }
 
+    /* hdt gets its size range back now, its search areas with the next
+     frame */
+    if (QCFF_SUCCEEDED(rc))
+        rc = qcff_face_size_range(p_qcff);
+    else
+        qcff_face_size_range(p_qcff);
+    if (QCFF_FAILED(rc))
+        return rc;
+    FACEPROC_ClearDtResult(p_qcff->hdt_result);
+
+    p_refine->num_faces = qcff_merge_faces(p_refine->p_found, num_found,
+            params.max_faces, p_refine->p_faces);
+    p_qcff->num_faces = p_refine->num_faces;
+    p_refine->active = TRUE;
     return QCFF_RET_SUCCESS;
 }
 
-static void qcff_translate_face_info_to_rect(FACEINFO *p_info,
-        qcff_face_rect_t *p_rect) {
-    int32_t left, right, top, bottom;
+/* Releases the coarse detector of coarse-to-fine detection */
+static void qcff_refine_free(qcff_refine_t *p_refine) {
+    if (p_refine->coarse)
+        qcff_destroy(&p_refine->coarse);
+    free(p_refine->p_faces);
+    free(p_refine->p_found);
+    free(p_refine);
+}
+/* Works out the search areas of the frame: new faces are searched for in
+ the blocks of the signature that changed since the reference frame,
+ grown by a block for faces entering them, and where the last faces
+ were; tracked faces there and in the changed blocks. The whole image is
+ searched every full_scan_interval frames, or when there is no
+ reference to compare with. Returns FALSE when there is nothing to
+ search: no block changed and no face is tracked */
+static uint8_t qcff_motion_update(qcff_t *p_qcff) {
+    qcff_motion_t *p_motion = &p_qcff->motion;
+    const uint8_t *p_cur = p_qcff->skip.p_cur;
+    const uint8_t *p_ref = p_qcff->skip.ref;
+    uint32_t w = p_qcff->proc_width, h = p_qcff->proc_height;
+    uint32_t c0 = QCFF_IMG_SIG_COLS, c1 = 0, r0 = QCFF_IMG_SIG_ROWS, r1 = 0;
+    uint32_t r, c, x1, y1;
+
+    p_motion->masked = FALSE;
+    if (!p_motion->threshold)
+        return TRUE;
+    if (!p_cur || !p_qcff->skip.ref_valid
+            || ++p_motion->since_full_scan >= p_motion->full_scan_interval) {
+        p_motion->since_full_scan = 0;
+        return TRUE;
+    }
 
-    p_rect->top_left.x = p_info->ptLeftTop.x;
-    p_rect->top_left.y = p_info->ptLeftTop.y;
-    p_rect->top_right.x = p_info->ptRightTop.x;
-    p_rect->top_right.y = p_info->ptRightTop.y;
-    p_rect->bottom_left.x = p_info->ptLeftBottom.x;
-    p_rect->bottom_left.y = p_info->ptLeftBottom.y;
-    p_rect->bottom_right.x = p_info->ptRightBottom.x;
-    p_rect->bottom_right.y = p_info->ptRightBottom.y;
+    for (r = 0; r < QCFF_IMG_SIG_ROWS; r++) {
+        for (c = 0; c < QCFF_IMG_SIG_COLS; c++) {
+            uint32_t i = r * QCFF_IMG_SIG_COLS + c;
+            uint32_t d = (p_cur[i] > p_ref[i]) ?
+                    p_cur[i] - p_ref[i] : p_ref[i] - p_cur[i];
+            if (d > p_motion->threshold) {
+                c0 = MIN2(c0, c);
+                c1 = MAX2(c1, c + 1);
+                r0 = MIN2(r0, r);
+                r1 = MAX2(r1, r + 1);
+            }
+        }
+    }
 
-    left = MIN4(p_rect->top_left.x, p_rect->top_right.x,
-            p_rect->bottom_left.x, p_rect->bottom_right.x);
-    top = MIN4(p_rect->top_left.y, p_rect->top_right.y,
-            p_rect->bottom_left.y, p_rect->bottom_right.y);
-    right = MAX4(p_rect->top_left.x, p_rect->top_right.x,
-            p_rect->bottom_left.x, p_rect->bottom_right.x);
-    bottom = MAX4(p_rect->top_left.y, p_rect->top_right.y,
-            p_rect->bottom_left.y, p_rect->bottom_right.y);
+    p_motion->moving.dx = 0;
+    if (c0 < c1) {
+        c0 = c0 ? c0 - 1 : 0;
+        r0 = r0 ? r0 - 1 : 0;
+        c1 = MIN2(c1 + 1, QCFF_IMG_SIG_COLS);
+        r1 = MIN2(r1 + 1, QCFF_IMG_SIG_ROWS);
+        p_motion->moving.x = c0 * w / QCFF_IMG_SIG_COLS;
+        p_motion->moving.y = r0 * h / QCFF_IMG_SIG_ROWS;
+        p_motion->moving.dx = c1 * w / QCFF_IMG_SIG_COLS - p_motion->moving.x;
+        p_motion->moving.dy = r1 * h / QCFF_IMG_SIG_ROWS - p_motion->moving.y;
+    }
 
-    p_rect->bounding_box.x = left;
-    p_rect->bounding_box.y = top;
-    p_rect->bounding_box.dx = right - left;
-    p_rect->bounding_box.dy = bottom - top;
+    p_motion->tracked = p_motion->moving;
+    if (!p_motion->moving.dx) {
+        p_motion->moving = p_motion->faces;
+        p_motion->tracked = p_motion->faces;
+    } else if (p_motion->faces.dx) {
+        qcff_rect_t *p_t = &p_motion->tracked;
+        const qcff_rect_t *p_f = &p_motion->faces;
+
+        x1 = MAX2(p_t->x + p_t->dx, p_f->x + p_f->dx);
+        y1 = MAX2(p_t->y + p_t->dy, p_f->y + p_f->dy);
+        p_t->x = MIN2(p_t->x, p_f->x);
+        p_t->y = MIN2(p_t->y, p_f->y);
+        p_t->dx = x1 - p_t->x;
+        p_t->dy = y1 - p_t->y;
+    }
+    if (!p_motion->tracked.dx)
+        return FALSE;
+
+    p_motion->masked = TRUE;
+    return TRUE;
 }
 
-static int qcff_extract_feature(qcff_t *p_qcff, uint32_t face_index,
-        HFEATURE hfr) {
-    /* Set face location to parts detection handle */
-    if (FACEPROC_NORMAL
-            != FACEPROC_PT_SetPositionFromHandle(p_qcff->hpt,
-                    p_qcff->hdt_result, face_index))
-        return QCFF_RET_FAILURE;
+/* Remembers where the faces just found are, with the margin of a face
+ crop, for the areas of the next frames */
+static void qcff_motion_faces(qcff_t *p_qcff) {
+    qcff_motion_t *p_motion = &p_qcff->motion;
+    int32_t x0 = (int32_t) (p_qcff->crop.x - p_qcff->img_x);
+    int32_t w = (int32_t) p_qcff->proc_width;
+    int32_t h = (int32_t) p_qcff->proc_height;
+    int32_t left = w, top = h, right = 0, bottom = 0;
+    uint32_t i;
+
+    for (i = 0; i < p_qcff->num_faces; i++) {
+        FACEINFO info;
+        int32_t l, t, r, b, pad;
+
+        if (FACEPROC_NORMAL
+                != qcff_dt_face_info(p_qcff, i, &info))
+            break;
+        l = MIN4(info.ptLeftTop.x, info.ptRightTop.x, info.ptLeftBottom.x,
+                info.ptRightBottom.x) - x0;
+        r = MAX4(info.ptLeftTop.x, info.ptRightTop.x, info.ptLeftBottom.x,
+                info.ptRightBottom.x) - x0;
+        t = MIN4(info.ptLeftTop.y, info.ptRightTop.y, info.ptLeftBottom.y,
+                info.ptRightBottom.y);
+        b = MAX4(info.ptLeftTop.y, info.ptRightTop.y, info.ptLeftBottom.y,
+                info.ptRightBottom.y);
+        pad = QCFF_ROI_PAD(MAX2(r - l, b - t));
+        left = MIN2(left, MAX2(l - pad, 0));
+        top = MIN2(top, MAX2(t - pad, 0));
+        right = MAX2(right, MIN2(r + pad + 1, w));
+        bottom = MAX2(bottom, MIN2(b + pad + 1, h));
+    }
 
-    /* Do parts detection */
-    if (FACEPROC_NORMAL
-            != FACEPROC_PT_DetectPoint(p_qcff->hpt,
-                    (RAWIMAGE *) p_qcff->p_local_frame,
-                    p_qcff->frame_width / p_qcff->downscale_factor,
-                    p_qcff->frame_height / p_qcff->downscale_factor,
-                    p_qcff->hpt_result))
-        return QCFF_RET_FAILURE;
+    p_motion->faces.dx = 0;
+    if (left < right && top < bottom) {
+        p_motion->faces.x = (uint32_t) left;
+        p_motion->faces.y = (uint32_t) top;
+        p_motion->faces.dx = (uint32_t) (right - left);
+        p_motion->faces.dy = (uint32_t) (bottom - top);
+    }
+}
 
-    /* Extract feature */
-    if (FACEPROC_NORMAL
-            != FACEPROC_FR_ExtractFeatureFromPtHdl(hfr,
-                    (RAWIMAGE*) p_qcff->p_local_frame,
-                    p_qcff->frame_width / p_qcff->downscale_factor,
-                    p_qcff->frame_height / p_qcff->downscale_factor,
-                    p_qcff->hpt_result))
-        return QCFF_RET_FAILURE;
+static void qcff_adapt(qcff_t *p_qcff, uint32_t elapsed_us) {
+    qcff_adapt_t *p_adapt = &p_qcff->adapt;
+    uint32_t scale = p_qcff->scale_q8;
+    uint32_t smallest = 0, interest, target, i;
+
+    p_adapt->avg_us = p_adapt->avg_us ?
+            (p_adapt->avg_us * 7 + elapsed_us) / 8 : elapsed_us;
+
+    /* Smallest face of this frame, in input frame pixels */
+    for (i = 0; i < p_qcff->num_faces; i++) {
+        FACEINFO info;
+        uint32_t size;
+
+        if (FACEPROC_NORMAL
+                != qcff_dt_face_info(p_qcff, i, &info))
+            break;
+        size = MAX2(MAX4(info.ptLeftTop.x, info.ptRightTop.x,
+                info.ptLeftBottom.x, info.ptRightBottom.x)
+                - MIN4(info.ptLeftTop.x, info.ptRightTop.x,
+                info.ptLeftBottom.x, info.ptRightBottom.x),
+                MAX4(info.ptLeftTop.y, info.ptRightTop.y,
+                info.ptLeftBottom.y, info.ptRightBottom.y)
+                - MIN4(info.ptLeftTop.y, info.ptRightTop.y,
+                info.ptLeftBottom.y, info.ptRightBottom.y));
+        size = (size * scale) >> 8;
+        if (!smallest || size < smallest)
+            smallest = size;
+    }
+    if (smallest && (!p_adapt->small_face || smallest <= p_adapt->small_face
+            || p_adapt->small_face_age >= QCFF_ADAPT_FACE_WINDOW)) {
+        p_adapt->small_face = smallest;
+        p_adapt->small_face_age = 0;
+    } else if (++p_adapt->small_face_age >= QCFF_ADAPT_FACE_WINDOW) {
+        p_adapt->small_face = 0;
+    }
 
-    return QCFF_RET_SUCCESS;
+    /* Largest factor keeping the faces of interest detectable */
+    interest = p_adapt->min_face_size;
+    if (p_adapt->small_face)
+        interest = MIN2(interest,
+                (p_adapt->small_face * QCFF_ADAPT_MARGIN_Q8) >> 8);
+    target = (interest * QCFF_SCALE_ONE) / p_qcff->params.min_face_size;
+
+    /* Detection time goes with the pixel count, i.e. the square of the
+     factor: raise the factor further when over budget */
+    if (p_adapt->target_us && p_adapt->avg_us > p_adapt->target_us) {
+        uint32_t needed = (uint32_t) (((uint64_t) scale
+                * qcff_isqrt(((uint64_t) p_adapt->avg_us << 16)
+                        / p_adapt->target_us)) >> 8);
+        target = MAX2(target, needed);
+    }
+    target = MAX2(target, QCFF_SCALE_ONE);
+    target = MIN2(target, p_adapt->max_scale_q8);
+    /* 2x and 4x have the fast area averaging paths */
+    if (target >= 2 * QCFF_SCALE_ONE
+            && target < 2 * QCFF_SCALE_ONE + QCFF_ADAPT_STEP_Q8)
+        target = 2 * QCFF_SCALE_ONE;
+    else if (target >= 4 * QCFF_SCALE_ONE
+            && target < 4 * QCFF_SCALE_ONE + QCFF_ADAPT_STEP_Q8)
+        target = 4 * QCFF_SCALE_ONE;
+
+    if (p_adapt->hold) {
+        p_adapt->hold--;
+        return;
+    }
+    if (target + QCFF_ADAPT_STEP_Q8 > scale
+            && target < scale + QCFF_ADAPT_STEP_Q8)
+        return;
+
+    QCFF_LOG("adaptive downscale %d -> %d, smallest face %d, %d us",
+            scale, target, p_adapt->small_face, p_adapt->avg_us);
+    __atomic_store_n(&p_qcff->next_scale_q8, target, __ATOMIC_RELAXED);
+    p_adapt->avg_us = 0;
+    p_adapt->hold = QCFF_ADAPT_HOLD;
+}
+
+static uint32_t qcff_isqrt(uint64_t value) {
+    uint64_t root = 0, bit = (uint64_t) 1 << 62;
+
+    while (bit > value)
+        bit >>= 2;
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t) root;
 }
 
 /*
@@ -1742,7 +6301,8 @@ int qcff_setThreshold(int32_t threshold) {
     if (threshold < 0 || threshold > 100) {
         return QCFF_RET_FAILURE;
     } else {
-        default_params.FR_THRESHOLD = threshold * 10;
+        __atomic_store_n(&fr_threshold_seed, threshold * 10,
+                __ATOMIC_RELAXED);
         return QCFF_RET_SUCCESS;
     }
 }
@@ -0,0 +1,219 @@
+/* =========================================================================
+ * Copyright (c) 2013-2014 Qualcomm Technologies, Inc.  All Rights Reserved.
+ * Qualcomm Technologies Proprietary and Confidential.
+ * =========================================================================
+ * @file    qcff_bench.c
+ *
+ * Multi-instance stress benchmark. For N = 1, 2, 4 ... up to the number
+ * of CPUs, N threads each process the same frames on a handle of their
+ * own, and the aggregate frame rate is compared with N times that of a
+ * single handle. Handles sharing no state, the scaling should stay close
+ * to 100% up to the number of cores.
+ *
+ * Usage: qcff_bench [-w width] [-h height] [-f luma_file] [-n frames]
+ *                   [-t max_threads] [-v]
+ *
+ *   -f   8-bit luma frame of width * height bytes, e.g. a camera preview
+ *        Y plane with faces in it; a synthetic frame is used by default
+ *   -n   frames processed by each thread per run (default 100)
+ *   -t   largest number of threads (default: number of CPUs)
+ *   -v   video mode (tracking) instead of still mode (full search)
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "qcff_native.h"
+
+#define BENCH_DEF_WIDTH     640
+#define BENCH_DEF_HEIGHT    480
+#define BENCH_DEF_FRAMES    100
+#define BENCH_MAX_THREADS   64
+
+typedef struct {
+    pthread_t thread;
+    qcff_handle_t handle;
+    const uint8_t *p_frame;
+    uint32_t num_frames;
+    uint32_t num_faces;
+    int rc;
+} bench_worker_t;
+
+/* All workers start together once their handles are configured */
+static pthread_barrier_t start_barrier;
+
+static double bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *bench_thread(void *arg) {
+    bench_worker_t *p_worker = (bench_worker_t *) arg;
+    uint32_t i;
+
+    pthread_barrier_wait(&start_barrier);
+    for (i = 0; i < p_worker->num_frames; i++) {
+        p_worker->rc = qcff_set_frame(p_worker->handle,
+                (uint8_t *) p_worker->p_frame);
+        if (QCFF_FAILED(p_worker->rc))
+            break;
+        p_worker->rc = qcff_get_num_faces(p_worker->handle,
+                &p_worker->num_faces);
+        if (QCFF_FAILED(p_worker->rc))
+            break;
+    }
+    pthread_barrier_wait(&start_barrier);
+    return NULL;
+}
+
+/* Runs num_threads handles at once; returns the aggregate frames/s, or a
+ negative value on failure */
+static double bench_run(uint32_t num_threads, qcff_config_t *p_cfg,
+        qcff_mode_t mode, const uint8_t *p_frame, uint32_t num_frames,
+        uint32_t *p_num_faces) {
+    bench_worker_t workers[BENCH_MAX_THREADS];
+    double t1, t2, fps = -1;
+    uint32_t i, started = 0;
+    int rc = QCFF_RET_SUCCESS;
+
+    memset(workers, 0, sizeof(workers));
+    for (i = 0; i < num_threads && QCFF_SUCCEEDED(rc); i++) {
+        rc = qcff_create(&workers[i].handle);
+        if (QCFF_SUCCEEDED(rc))
+            rc = qcff_config(workers[i].handle, p_cfg);
+        if (QCFF_SUCCEEDED(rc))
+            rc = qcff_set_mode(workers[i].handle, mode);
+        workers[i].p_frame = p_frame;
+        workers[i].num_frames = num_frames;
+    }
+    if (QCFF_FAILED(rc)) {
+        fprintf(stderr, "handle %u: setup failed %d\n", i - 1, rc);
+        goto done;
+    }
+
+    pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+    for (started = 0; started < num_threads; started++)
+        if (pthread_create(&workers[started].thread, NULL, bench_thread,
+                &workers[started]))
+            break;
+    if (started < num_threads) {
+        /* The barrier cannot be released without all of them */
+        fprintf(stderr, "pthread_create failed at %u threads\n", started);
+        exit(1);
+    }
+
+    pthread_barrier_wait(&start_barrier);
+    t1 = bench_now();
+    pthread_barrier_wait(&start_barrier);
+    t2 = bench_now();
+    for (i = 0; i < num_threads; i++)
+        pthread_join(workers[i].thread, NULL);
+    pthread_barrier_destroy(&start_barrier);
+
+    fps = num_threads * num_frames / (t2 - t1);
+    *p_num_faces = workers[0].num_faces;
+    for (i = 0; i < num_threads; i++)
+        if (QCFF_FAILED(workers[i].rc)) {
+            fprintf(stderr, "thread %u: processing failed %d\n", i,
+                    workers[i].rc);
+            fps = -1;
+        }
+
+done:
+    for (i = 0; i < num_threads; i++)
+        if (workers[i].handle)
+            qcff_destroy(&workers[i].handle);
+    return fps;
+}
+
+/* Smooth gradients and blobs with some noise, so that the detector does
+ the work of a real scene rather than skip a flat one */
+static void bench_synth_frame(uint8_t *p_frame, uint32_t width,
+        uint32_t height) {
+    uint32_t x, y, seed = 12345;
+
+    for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++) {
+            seed = seed * 1103515245 + 12345;
+            p_frame[y * width + x] = (uint8_t) ((x * 255 / width + y * 3
+                    + ((x / 16 + y / 16) & 1) * 40 + (seed >> 27)) & 0xFF);
+        }
+}
+
+int main(int argc, char **argv) {
+    qcff_config_t cfg;
+    qcff_mode_t mode = QCFF_MODE_STILL;
+    uint32_t width = BENCH_DEF_WIDTH, height = BENCH_DEF_HEIGHT;
+    uint32_t num_frames = BENCH_DEF_FRAMES, max_threads, n, num_faces = 0;
+    const char *p_file = NULL;
+    uint8_t *p_frame;
+    double fps, fps_one = 0;
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    max_threads = (num_cpus > 0) ? (uint32_t) num_cpus : 1;
+    while ((opt = getopt(argc, argv, "w:h:f:n:t:v")) != -1) {
+        switch (opt) {
+        case 'w': width = (uint32_t) atoi(optarg); break;
+        case 'h': height = (uint32_t) atoi(optarg); break;
+        case 'f': p_file = optarg; break;
+        case 'n': num_frames = (uint32_t) atoi(optarg); break;
+        case 't': max_threads = (uint32_t) atoi(optarg); break;
+        case 'v': mode = QCFF_MODE_VIDEO; break;
+        default:
+            fprintf(stderr, "usage: %s [-w width] [-h height] [-f luma_file]"
+                    " [-n frames] [-t max_threads] [-v]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!width || !height || !num_frames || !max_threads
+            || max_threads > BENCH_MAX_THREADS) {
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+
+    p_frame = (uint8_t *) malloc(width * height);
+    if (!p_frame)
+        return 1;
+    if (p_file) {
+        FILE *fp = fopen(p_file, "rb");
+
+        if (!fp || fread(p_frame, 1, width * height, fp) != width * height) {
+            fprintf(stderr, "cannot read %u bytes from %s\n", width * height,
+                    p_file);
+            return 1;
+        }
+        fclose(fp);
+    } else {
+        bench_synth_frame(p_frame, width, height);
+    }
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.width = width;
+    cfg.height = height;
+    cfg.format = QCFF_FORMAT_Y;
+
+    printf("%ux%u %s, %u frames per thread, %ld CPUs\n", width, height,
+            (mode == QCFF_MODE_STILL) ? "still" : "video", num_frames,
+            num_cpus);
+    printf("threads   frames/s   per thread   scaling\n");
+    for (n = 1; n <= max_threads; n = (n * 2 > max_threads && n < max_threads)
+            ? max_threads : n * 2) {
+        fps = bench_run(n, &cfg, mode, p_frame, num_frames, &num_faces);
+        if (fps < 0)
+            return 1;
+        if (n == 1)
+            fps_one = fps;
+        printf("%7u %10.1f %12.1f %8.0f%%\n", n, fps, fps / n,
+                100.0 * fps / (n * fps_one));
+    }
+    printf("faces per frame: %u\n", num_faces);
+
+    free(p_frame);
+    return 0;
+}
@@ -0,0 +1,763 @@
+/* =========================================================================
+ * Copyright (c) 2013-2014 Qualcomm Technologies, Inc.  All Rights Reserved.
+ * Qualcomm Technologies Proprietary and Confidential.
+ * =========================================================================
+ * @file    qcff_img.c
+ *
+ */
+
+#include "qcff_img.h"
+
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define QCFF_IMG_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__SSE2__)
+#define QCFF_IMG_SSE2
+#include <emmintrin.h>
+#endif
+
+/* AVX2 kernels are compiled with a function-level target attribute and
+ only used when cpuid says the CPU and the OS support them */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) \
+        || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define QCFF_IMG_AVX2
+#include <immintrin.h>
+#include <cpuid.h>
+#define QCFF_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#define ALIGN16(x)   (((x) + 15) & ~(size_t)15)
+#define MAX2(a,b)    (((a) > (b)) ? (a) : (b))
+
+/* BT.601 studio swing luma, as the Java converter used to compute it */
+#define RGB_TO_Y(r, g, b) \
+    ((uint8_t) (((66 * (r) + 129 * (g) + 25 * (b) + 128) >> 8) + 16))
+
+/* Row kernels. n is the number of output pixels. */
+typedef struct {
+    void (*box2_row)(const uint8_t *p_src, uint32_t stride, uint8_t *p_dst,
+            uint32_t n);
+    void (*box4_row)(const uint8_t *p_src, uint32_t stride, uint8_t *p_dst,
+            uint32_t n);
+    /* p_dst = (p_row0 * (256 - w1) + p_row1 * w1) / 256, w1 in 1..255 */
+    void (*lerp_row)(const uint8_t *p_row0, const uint8_t *p_row1, uint32_t w1,
+            uint8_t *p_dst, uint32_t n);
+    /* Luma of n packed RGB pixels */
+    void (*rgba_to_y_row)(const uint8_t *p_src, uint8_t *p_dst, uint32_t n);
+    void (*bgr_to_y_row)(const uint8_t *p_src, uint8_t *p_dst, uint32_t n);
+    /* Sum of n pixels */
+    uint32_t (*sum_row)(const uint8_t *p_src, uint32_t n);
+    /* Largest absolute difference between n pixel pairs */
+    uint32_t (*max_absdiff_row)(const uint8_t *p_a, const uint8_t *p_b,
+            uint32_t n);
+} qcff_img_kernels_t;
+
+static qcff_img_kernels_t kernels;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+/************************************************************************
+ * Portable kernels, also used for the row tails of the vector ones
+ ***********************************************************************/
+static void box2_row_c(const uint8_t *p_src, uint32_t stride, uint8_t *p_dst,
+        uint32_t n) {
+    const uint8_t *p_src1 = p_src + stride;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        p_dst[i] = (uint8_t) ((p_src[2 * i] + p_src[2 * i + 1]
+                + p_src1[2 * i] + p_src1[2 * i + 1] + 2) >> 2);
+    }
+}
+
+static void box4_row_c(const uint8_t *p_src, uint32_t stride, uint8_t *p_dst,
+        uint32_t n) {
+    uint32_t i, j;
+
+    for (i = 0; i < n; i++) {
+        const uint8_t *p = p_src + 4 * i;
+        uint32_t sum = 8;
+        for (j = 0; j < 4; j++, p += stride)
+            sum += p[0] + p[1] + p[2] + p[3];
+        p_dst[i] = (uint8_t) (sum >> 4);
+    }
+}
+
+static void lerp_row_c(const uint8_t *p_row0, const uint8_t *p_row1,
+        uint32_t w1, uint8_t *p_dst, uint32_t n) {
+    uint32_t w0 = 256 - w1;
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+        p_dst[i] = (uint8_t) ((p_row0[i] * w0 + p_row1[i] * w1 + 128) >> 8);
+}
+
+static void rgba_to_y_row_c(const uint8_t *p_src, uint8_t *p_dst, uint32_t n) {
+    uint32_t i;
+
+    for (i = 0; i < n; i++, p_src += 4)
+        p_dst[i] = RGB_TO_Y(p_src[0], p_src[1], p_src[2]);
+}
+
+static void bgr_to_y_row_c(const uint8_t *p_src, uint8_t *p_dst, uint32_t n) {
+    uint32_t i;
+
+    for (i = 0; i < n; i++, p_src += 3)
+        p_dst[i] = RGB_TO_Y(p_src[2], p_src[1], p_src[0]);
+}
+
+static uint32_t sum_row_c(const uint8_t *p_src, uint32_t n) {
+    uint32_t sum = 0, i;
+
+    for (i = 0; i < n; i++)
+        sum += p_src[i];
+    return sum;
+}
+
+static uint32_t max_absdiff_row_c(const uint8_t *p_a, const uint8_t *p_b,
+        uint32_t n) {
+    uint32_t max = 0, i;
+
+    for (i = 0; i < n; i++) {
+        uint32_t d = (p_a[i] > p_b[i]) ? p_a[i] - p_b[i] : p_b[i] - p_a[i];
+        if (d > max)
+            max = d;
+    }
+    return max;
+}
+
+#ifdef QCFF_IMG_NEON
+/************************************************************************
+ * NEON kernels
+ ***********************************************************************/
+static void box2_row_neon(const uint8_t *p_src, uint32_t stride,
+        uint8_t *p_dst, uint32_t n) {
+    uint32_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t s = vpaddlq_u8(vld1q_u8(p_src + 2 * i));
+        s = vpadalq_u8(s, vld1q_u8(p_src + stride + 2 * i));
+        vst1_u8(p_dst + i, vrshrn_n_u16(s, 2));
+    }
+    box2_row_c(p_src + 2 * i, stride, p_dst + i, n - i);
+}
+
+static void box4_row_neon(const uint8_t *p_src, uint32_t stride,
+        uint8_t *p_dst, uint32_t n) {
+    uint32_t i = 0, j;
+
+    for (; i + 8 <= n; i += 8) {
+        const uint8_t *p = p_src + 4 * i;
+        uint16x8_t s0 = vpaddlq_u8(vld1q_u8(p));
+        uint16x8_t s1 = vpaddlq_u8(vld1q_u8(p + 16));
+        for (j = 1; j < 4; j++) {
+            p += stride;
+            s0 = vpadalq_u8(s0, vld1q_u8(p));
+            s1 = vpadalq_u8(s1, vld1q_u8(p + 16));
+        }
+        vst1_u8(p_dst + i, vmovn_u16(vcombine_u16(
+                vrshrn_n_u32(vpaddlq_u16(s0), 4),
+                vrshrn_n_u32(vpaddlq_u16(s1), 4))));
+    }
+    box4_row_c(p_src + 4 * i, stride, p_dst + i, n - i);
+}
+
+static void lerp_row_neon(const uint8_t *p_row0, const uint8_t *p_row1,
+        uint32_t w1, uint8_t *p_dst, uint32_t n) {
+    const uint8x8_t v_w0 = vdup_n_u8((uint8_t) (256 - w1));
+    const uint8x8_t v_w1 = vdup_n_u8((uint8_t) w1);
+    uint32_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t a = vld1q_u8(p_row0 + i);
+        uint8x16_t b = vld1q_u8(p_row1 + i);
+        uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(a), v_w0),
+                vget_low_u8(b), v_w1);
+        uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(a), v_w0),
+                vget_high_u8(b), v_w1);
+        vst1q_u8(p_dst + i,
+                vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+    }
+    lerp_row_c(p_row0 + i, p_row1 + i, w1, p_dst + i, n - i);
+}
+
+/* 16 luma values from deinterleaved R, G and B */
+static inline uint8x16_t rgb_to_y_neon(uint8x16_t r, uint8x16_t g,
+        uint8x16_t b) {
+    const uint8x8_t c_r = vdup_n_u8(66);
+    const uint8x8_t c_g = vdup_n_u8(129);
+    const uint8x8_t c_b = vdup_n_u8(25);
+    uint16x8_t lo = vmull_u8(vget_low_u8(r), c_r);
+    uint16x8_t hi = vmull_u8(vget_high_u8(r), c_r);
+
+    lo = vmlal_u8(lo, vget_low_u8(g), c_g);
+    hi = vmlal_u8(hi, vget_high_u8(g), c_g);
+    lo = vmlal_u8(lo, vget_low_u8(b), c_b);
+    hi = vmlal_u8(hi, vget_high_u8(b), c_b);
+    return vaddq_u8(vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)),
+            vdupq_n_u8(16));
+}
+
+static void rgba_to_y_row_neon(const uint8_t *p_src, uint8_t *p_dst,
+        uint32_t n) {
+    uint32_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x4_t px = vld4q_u8(p_src + 4 * i);
+        vst1q_u8(p_dst + i, rgb_to_y_neon(px.val[0], px.val[1], px.val[2]));
+    }
+    rgba_to_y_row_c(p_src + 4 * i, p_dst + i, n - i);
+}
+
+static void bgr_to_y_row_neon(const uint8_t *p_src, uint8_t *p_dst,
+        uint32_t n) {
+    uint32_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x3_t px = vld3q_u8(p_src + 3 * i);
+        vst1q_u8(p_dst + i, rgb_to_y_neon(px.val[2], px.val[1], px.val[0]));
+    }
+    bgr_to_y_row_c(p_src + 3 * i, p_dst + i, n - i);
+}
+
+static uint32_t sum_row_neon(const uint8_t *p_src, uint32_t n) {
+    uint32x4_t acc = vdupq_n_u32(0);
+    uint32x2_t half;
+    uint32_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+        acc = vpadalq_u16(acc, vpaddlq_u8(vld1q_u8(p_src + i)));
+    half = vadd_u32(vget_low_u32(acc), vget_high_u32(acc));
+    return vget_lane_u32(vpadd_u32(half, half), 0)
+            + sum_row_c(p_src + i, n - i);
+}
+
+static uint32_t max_absdiff_row_neon(const uint8_t *p_a, const uint8_t *p_b,
+        uint32_t n) {
+    uint8x16_t max = vdupq_n_u8(0);
+    uint8x8_t half;
+    uint32_t i = 0, tail;
+
+    for (; i + 16 <= n; i += 16)
+        max = vmaxq_u8(max, vabdq_u8(vld1q_u8(p_a + i), vld1q_u8(p_b + i)));
+    half = vmax_u8(vget_low_u8(max), vget_high_u8(max));
+    half = vpmax_u8(half, half);
+    half = vpmax_u8(half, half);
+    half = vpmax_u8(half, half);
+    tail = max_absdiff_row_c(p_a + i, p_b + i, n - i);
+    return MAX2(vget_lane_u8(half, 0), tail);
+}
+#endif /* QCFF_IMG_NEON */
+
+#ifdef QCFF_IMG_SSE2
+/************************************************************************
+ * SSE2 kernels
+ ***********************************************************************/
+/* Sums of horizontally adjacent byte pairs, as 8 16-bit lanes */
+static inline __m128i pair_sum_sse2(__m128i v) {
+    return _mm_add_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00ff)),
+            _mm_srli_epi16(v, 8));
+}
+
+static void box2_row_sse2(const uint8_t *p_src, uint32_t stride,
+        uint8_t *p_dst, uint32_t n) {
+    const __m128i two = _mm_set1_epi16(2);
+    uint32_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        const uint8_t *p0 = p_src + 2 * i;
+        const uint8_t *p1 = p0 + stride;
+        __m128i lo = _mm_add_epi16(
+                pair_sum_sse2(_mm_loadu_si128((const __m128i *) p0)),
+                pair_sum_sse2(_mm_loadu_si128((const __m128i *) p1)));
+        __m128i hi = _mm_add_epi16(
+                pair_sum_sse2(_mm_loadu_si128((const __m128i *) (p0 + 16))),
+                pair_sum_sse2(_mm_loadu_si128((const __m128i *) (p1 + 16))));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+        _mm_storeu_si128((__m128i *) (p_dst + i), _mm_packus_epi16(lo, hi));
+    }
+    box2_row_c(p_src + 2 * i, stride, p_dst + i, n - i);
+}
+
+/* Four 4x4 block averages from a 16 pixel wide, 4 row high strip */
+static inline __m128i box4_quad_sse2(const uint8_t *p, uint32_t stride) {
+    __m128i s = pair_sum_sse2(_mm_loadu_si128((const __m128i *) p));
+    s = _mm_add_epi16(s,
+            pair_sum_sse2(_mm_loadu_si128((const __m128i *) (p + stride))));
+    s = _mm_add_epi16(s,
+            pair_sum_sse2(
+                    _mm_loadu_si128((const __m128i *) (p + 2 * stride))));
+    s = _mm_add_epi16(s,
+            pair_sum_sse2(
+                    _mm_loadu_si128((const __m128i *) (p + 3 * stride))));
+    s = _mm_madd_epi16(s, _mm_set1_epi16(1));
+    return _mm_srli_epi32(_mm_add_epi32(s, _mm_set1_epi32(8)), 4);
+}
+
+static void box4_row_sse2(const uint8_t *p_src, uint32_t stride,
+        uint8_t *p_dst, uint32_t n) {
+    uint32_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        const uint8_t *p = p_src + 4 * i;
+        __m128i a = _mm_packs_epi32(box4_quad_sse2(p, stride),
+                box4_quad_sse2(p + 16, stride));
+        __m128i b = _mm_packs_epi32(box4_quad_sse2(p + 32, stride),
+                box4_quad_sse2(p + 48, stride));
+        _mm_storeu_si128((__m128i *) (p_dst + i), _mm_packus_epi16(a, b));
+    }
+    box4_row_c(p_src + 4 * i, stride, p_dst + i, n - i);
+}
+
+static void lerp_row_sse2(const uint8_t *p_row0, const uint8_t *p_row1,
+        uint32_t w1, uint8_t *p_dst, uint32_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i v_w0 = _mm_set1_epi16((short) (256 - w1));
+    const __m128i v_w1 = _mm_set1_epi16((short) w1);
+    const __m128i half = _mm_set1_epi16(128);
+    uint32_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (p_row0 + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (p_row1 + i));
+        __m128i lo = _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), v_w0),
+                _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), v_w1));
+        __m128i hi = _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), v_w0),
+                _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), v_w1));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, half), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, half), 8);
+        _mm_storeu_si128((__m128i *) (p_dst + i), _mm_packus_epi16(lo, hi));
+    }
+    lerp_row_c(p_row0 + i, p_row1 + i, w1, p_dst + i, n - i);
+}
+
+/* Rounded weighted sums of 4 RGBA pixels, as 32-bit lanes */
+static inline __m128i rgba_quad_sse2(const uint8_t *p) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i coef = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+    __m128i px = _mm_loadu_si128((const __m128i *) p);
+    /* R*66 + G*129 and B*25 of each pixel, in adjacent lanes */
+    __m128 lo = _mm_castsi128_ps(
+            _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), coef));
+    __m128 hi = _mm_castsi128_ps(
+            _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), coef));
+    __m128i sum = _mm_add_epi32(
+            _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))),
+            _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1))));
+    return _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8);
+}
+
+static void rgba_to_y_row_sse2(const uint8_t *p_src, uint8_t *p_dst,
+        uint32_t n) {
+    const __m128i sixteen = _mm_set1_epi16(16);
+    uint32_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        const uint8_t *p = p_src + 4 * i;
+        __m128i a = _mm_add_epi16(sixteen,
+                _mm_packs_epi32(rgba_quad_sse2(p), rgba_quad_sse2(p + 16)));
+        __m128i b = _mm_add_epi16(sixteen,
+                _mm_packs_epi32(rgba_quad_sse2(p + 32),
+                        rgba_quad_sse2(p + 48)));
+        _mm_storeu_si128((__m128i *) (p_dst + i), _mm_packus_epi16(a, b));
+    }
+    rgba_to_y_row_c(p_src + 4 * i, p_dst + i, n - i);
+}
+
+static uint32_t sum_row_sse2(const uint8_t *p_src, uint32_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    uint32_t i = 0;
+
+    /* The sum of absolute differences against zero adds up 8 bytes */
+    for (; i + 16 <= n; i += 16)
+        acc = _mm_add_epi64(acc,
+                _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (p_src + i)),
+                        zero));
+    return (uint32_t) (_mm_cvtsi128_si32(acc)
+            + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)))
+            + sum_row_c(p_src + i, n - i);
+}
+
+static uint32_t max_absdiff_row_sse2(const uint8_t *p_a, const uint8_t *p_b,
+        uint32_t n) {
+    __m128i max = _mm_setzero_si128();
+    uint32_t i = 0, tail;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (p_a + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (p_b + i));
+        max = _mm_max_epu8(max,
+                _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)));
+    }
+    max = _mm_max_epu8(max, _mm_srli_si128(max, 8));
+    max = _mm_max_epu8(max, _mm_srli_si128(max, 4));
+    max = _mm_max_epu8(max, _mm_srli_si128(max, 2));
+    max = _mm_max_epu8(max, _mm_srli_si128(max, 1));
+    tail = max_absdiff_row_c(p_a + i, p_b + i, n - i);
+    return MAX2((uint32_t) (_mm_cvtsi128_si32(max) & 0xff), tail);
+}
+#endif /* QCFF_IMG_SSE2 */
+
+#ifdef QCFF_IMG_AVX2
+/************************************************************************
+ * AVX2 kernels
+ ***********************************************************************/
+QCFF_TARGET_AVX2
+static inline __m256i pair_sum_avx2(__m256i v) {
+    return _mm256_add_epi16(_mm256_and_si256(v, _mm256_set1_epi16(0x00ff)),
+            _mm256_srli_epi16(v, 8));
+}
+
+QCFF_TARGET_AVX2
+static void box2_row_avx2(const uint8_t *p_src, uint32_t stride,
+        uint8_t *p_dst, uint32_t n) {
+    const __m256i two = _mm256_set1_epi16(2);
+    uint32_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        const uint8_t *p0 = p_src + 2 * i;
+        const uint8_t *p1 = p0 + stride;
+        __m256i lo = _mm256_add_epi16(
+                pair_sum_avx2(_mm256_loadu_si256((const __m256i *) p0)),
+                pair_sum_avx2(_mm256_loadu_si256((const __m256i *) p1)));
+        __m256i hi = _mm256_add_epi16(
+                pair_sum_avx2(_mm256_loadu_si256((const __m256i *) (p0 + 32))),
+                pair_sum_avx2(_mm256_loadu_si256((const __m256i *) (p1 + 32))));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, two), 2);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, two), 2);
+        /* packus works per 128-bit lane; put the quadwords back in order */
+        _mm256_storeu_si256((__m256i *) (p_dst + i),
+                _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8));
+    }
+    box2_row_c(p_src + 2 * i, stride, p_dst + i, n - i);
+}
+
+QCFF_TARGET_AVX2
+static inline __m256i box4_oct_avx2(const uint8_t *p, uint32_t stride) {
+    __m256i s = pair_sum_avx2(_mm256_loadu_si256((const __m256i *) p));
+    s = _mm256_add_epi16(s,
+            pair_sum_avx2(_mm256_loadu_si256((const __m256i *) (p + stride))));
+    s = _mm256_add_epi16(s,
+            pair_sum_avx2(
+                    _mm256_loadu_si256((const __m256i *) (p + 2 * stride))));
+    s = _mm256_add_epi16(s,
+            pair_sum_avx2(
+                    _mm256_loadu_si256((const __m256i *) (p + 3 * stride))));
+    s = _mm256_madd_epi16(s, _mm256_set1_epi16(1));
+    return _mm256_srli_epi32(_mm256_add_epi32(s, _mm256_set1_epi32(8)), 4);
+}
+
+QCFF_TARGET_AVX2
+static void box4_row_avx2(const uint8_t *p_src, uint32_t stride,
+        uint8_t *p_dst, uint32_t n) {
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    uint32_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        const uint8_t *p = p_src + 4 * i;
+        __m256i a = _mm256_packs_epi32(box4_oct_avx2(p, stride),
+                box4_oct_avx2(p + 32, stride));
+        __m256i b = _mm256_packs_epi32(box4_oct_avx2(p + 64, stride),
+                box4_oct_avx2(p + 96, stride));
+        /* Each dword now holds 4 outputs, interleaved by lane */
+        _mm256_storeu_si256((__m256i *) (p_dst + i),
+                _mm256_permutevar8x32_epi32(_mm256_packus_epi16(a, b), order));
+    }
+    box4_row_c(p_src + 4 * i, stride, p_dst + i, n - i);
+}
+
+QCFF_TARGET_AVX2
+static void lerp_row_avx2(const uint8_t *p_row0, const uint8_t *p_row1,
+        uint32_t w1, uint8_t *p_dst, uint32_t n) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i v_w0 = _mm256_set1_epi16((short) (256 - w1));
+    const __m256i v_w1 = _mm256_set1_epi16((short) w1);
+    const __m256i half = _mm256_set1_epi16(128);
+    uint32_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (p_row0 + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (p_row1 + i));
+        __m256i lo = _mm256_add_epi16(
+                _mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), v_w0),
+                _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), v_w1));
+        __m256i hi = _mm256_add_epi16(
+                _mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), v_w0),
+                _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), v_w1));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, half), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, half), 8);
+        _mm256_storeu_si256((__m256i *) (p_dst + i),
+                _mm256_packus_epi16(lo, hi));
+    }
+    lerp_row_c(p_row0 + i, p_row1 + i, w1, p_dst + i, n - i);
+}
+
+static int cpu_has_avx2(void) {
+    unsigned int eax, ebx, ecx, edx, xcr0_lo, xcr0_hi;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return 0;
+    /* OSXSAVE and AVX */
+    if ((ecx & (1u << 27)) == 0 || (ecx & (1u << 28)) == 0)
+        return 0;
+    /* The OS must save the YMM state */
+    __asm__ volatile ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+    if ((xcr0_lo & 0x6) != 0x6)
+        return 0;
+    if (__get_cpuid_max(0, NULL) < 7)
+        return 0;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1u << 5)) != 0;
+}
+#endif /* QCFF_IMG_AVX2 */
+
+static void qcff_img_select_kernels(void) {
+    kernels.box2_row = box2_row_c;
+    kernels.box4_row = box4_row_c;
+    kernels.lerp_row = lerp_row_c;
+    kernels.rgba_to_y_row = rgba_to_y_row_c;
+    kernels.bgr_to_y_row = bgr_to_y_row_c;
+    kernels.sum_row = sum_row_c;
+    kernels.max_absdiff_row = max_absdiff_row_c;
+#ifdef QCFF_IMG_NEON
+    kernels.box2_row = box2_row_neon;
+    kernels.box4_row = box4_row_neon;
+    kernels.lerp_row = lerp_row_neon;
+    kernels.rgba_to_y_row = rgba_to_y_row_neon;
+    kernels.bgr_to_y_row = bgr_to_y_row_neon;
+    kernels.sum_row = sum_row_neon;
+    kernels.max_absdiff_row = max_absdiff_row_neon;
+#endif
+#ifdef QCFF_IMG_SSE2
+    /* Without byte shuffles 3-byte pixels do not vectorize well, BGR stays
+     portable on x86 */
+    kernels.box2_row = box2_row_sse2;
+    kernels.box4_row = box4_row_sse2;
+    kernels.lerp_row = lerp_row_sse2;
+    kernels.rgba_to_y_row = rgba_to_y_row_sse2;
+    kernels.sum_row = sum_row_sse2;
+    kernels.max_absdiff_row = max_absdiff_row_sse2;
+#endif
+#ifdef QCFF_IMG_AVX2
+    if (cpu_has_avx2()) {
+        kernels.box2_row = box2_row_avx2;
+        kernels.box4_row = box4_row_avx2;
+        kernels.lerp_row = lerp_row_avx2;
+    }
+#endif
+}
+
+/************************************************************************
+ * Downscaler
+ ***********************************************************************/
+static void qcff_img_box(const uint8_t *p_src, uint32_t src_width,
+        uint32_t src_height, uint32_t src_stride, uint32_t factor,
+        uint8_t *p_dst) {
+    uint32_t dst_width = src_width / factor;
+    uint32_t dst_height = src_height / factor;
+    uint32_t j;
+
+    for (j = 0; j < dst_height; j++) {
+        if (factor == 2)
+            kernels.box2_row(p_src, src_stride, p_dst, dst_width);
+        else
+            kernels.box4_row(p_src, src_stride, p_dst, dst_width);
+        p_src += src_stride * factor;
+        p_dst += dst_width;
+    }
+}
+
+/* Maps output pixel i to the left source tap and its 8-bit weight,
+ pixel centres aligned */
+static void qcff_img_tap(uint32_t i, uint32_t step_q16, uint32_t src_len,
+        uint32_t *p_index, uint32_t *p_weight) {
+    int64_t pos = (int64_t) i * step_q16 + (step_q16 >> 1) - 32768;
+    uint32_t index;
+
+    if (pos < 0)
+        pos = 0;
+    index = (uint32_t) (pos >> 16);
+    if (index >= src_len - 1) {
+        *p_index = src_len - 1;
+        *p_weight = 0;
+    } else {
+        *p_index = index;
+        *p_weight = (uint32_t) ((pos >> 8) & 0xff);
+    }
+}
+
+static void qcff_img_bilinear(const uint8_t *p_src, uint32_t src_width,
+        uint32_t src_height, uint32_t src_stride, uint8_t *p_dst,
+        uint32_t dst_width, uint32_t dst_height, uint8_t *p_scratch) {
+    uint8_t *p_row = p_scratch;
+    uint32_t *p_xindex = (uint32_t *) (p_scratch + ALIGN16(src_width + 1));
+    uint8_t *p_xweight = (uint8_t *) (p_xindex + dst_width);
+    uint32_t step_x = (uint32_t) (((uint64_t) src_width << 16) / dst_width);
+    uint32_t step_y = (uint32_t) (((uint64_t) src_height << 16) / dst_height);
+    uint32_t i, j, index, weight;
+
+    for (i = 0; i < dst_width; i++) {
+        qcff_img_tap(i, step_x, src_width, &index, &weight);
+        p_xindex[i] = index;
+        p_xweight[i] = (uint8_t) weight;
+    }
+
+    for (j = 0; j < dst_height; j++) {
+        const uint8_t *p_row0;
+
+        /* Vertical pass over the whole source row, vectorized */
+        qcff_img_tap(j, step_y, src_height, &index, &weight);
+        p_row0 = p_src + (size_t) index * src_stride;
+        if (weight)
+            kernels.lerp_row(p_row0, p_row0 + src_stride, weight, p_row,
+                    src_width);
+        else
+            memcpy(p_row, p_row0, src_width);
+        /* The right edge tap reads one pixel past the row */
+        p_row[src_width] = p_row[src_width - 1];
+
+        /* Horizontal pass through the precomputed taps */
+        for (i = 0; i < dst_width; i++) {
+            const uint8_t *p = p_row + p_xindex[i];
+            uint32_t w1 = p_xweight[i];
+            *p_dst++ = (uint8_t) ((p[0] * (256 - w1) + p[1] * w1 + 128) >> 8);
+        }
+    }
+}
+
+/* Integer pre-reduction applied before resampling by scale_q8 */
+static uint32_t qcff_img_pre_factor(uint32_t scale_q8) {
+    if (scale_q8 >= 4 * QCFF_SCALE_ONE)
+        return 4;
+    if (scale_q8 >= 2 * QCFF_SCALE_ONE)
+        return 2;
+    return 1;
+}
+
+size_t qcff_img_downscale_scratch_size(uint32_t src_width, uint32_t src_height,
+        uint32_t scale_q8) {
+    uint32_t pre, dst_width;
+    size_t size = 0;
+
+    if (scale_q8 == QCFF_SCALE_ONE || scale_q8 == 2 * QCFF_SCALE_ONE
+            || scale_q8 == 4 * QCFF_SCALE_ONE)
+        return 0;
+
+    pre = qcff_img_pre_factor(scale_q8);
+    dst_width = QCFF_SCALED_LEN(src_width, scale_q8);
+    if (pre > 1)
+        size += ALIGN16((size_t) (src_width / pre) * (src_height / pre));
+    size += ALIGN16(src_width + 1);
+    size += (size_t) dst_width * (sizeof(uint32_t) + sizeof(uint8_t));
+    return size;
+}
+
+void qcff_img_downscale(const uint8_t *p_src, uint32_t src_width,
+        uint32_t src_height, uint32_t src_stride, uint32_t scale_q8,
+        uint8_t *p_dst, uint8_t *p_scratch) {
+    uint32_t dst_width = QCFF_SCALED_LEN(src_width, scale_q8);
+    uint32_t dst_height = QCFF_SCALED_LEN(src_height, scale_q8);
+    uint32_t pre;
+    uint32_t j;
+
+    pthread_once(&kernels_once, qcff_img_select_kernels);
+
+    if (!dst_width || !dst_height)
+        return;
+
+    if (scale_q8 == QCFF_SCALE_ONE) {
+        for (j = 0; j < src_height; j++)
+            memcpy(p_dst + (size_t) j * src_width,
+                    p_src + (size_t) j * src_stride, src_width);
+        return;
+    }
+    if (scale_q8 == 2 * QCFF_SCALE_ONE || scale_q8 == 4 * QCFF_SCALE_ONE) {
+        qcff_img_box(p_src, src_width, src_height, src_stride, scale_q8 >> 8,
+                p_dst);
+        return;
+    }
+
+    /* Area-average down by the integer part first so the two-tap
+     resampler never skips source pixels */
+    pre = qcff_img_pre_factor(scale_q8);
+    if (pre > 1) {
+        uint8_t *p_reduced = p_scratch;
+        qcff_img_box(p_src, src_width, src_height, src_stride, pre, p_reduced);
+        src_width /= pre;
+        src_height /= pre;
+        p_src = p_reduced;
+        src_stride = src_width;
+        p_scratch += ALIGN16((size_t) src_width * src_height);
+    }
+    qcff_img_bilinear(p_src, src_width, src_height, src_stride, p_dst,
+            dst_width, dst_height, p_scratch);
+}
+
+/************************************************************************
+ * Colour conversion
+ ***********************************************************************/
+void qcff_img_rgb_to_luma(const uint8_t *p_src, uint32_t width,
+        uint32_t height, uint32_t src_stride, qcff_img_rgb_t order,
+        uint8_t *p_dst) {
+    void (*to_y_row)(const uint8_t *, uint8_t *, uint32_t);
+    uint32_t j;
+
+    pthread_once(&kernels_once, qcff_img_select_kernels);
+
+    to_y_row = (order == QCFF_IMG_BGR888) ?
+            kernels.bgr_to_y_row : kernels.rgba_to_y_row;
+    for (j = 0; j < height; j++) {
+        to_y_row(p_src, p_dst, width);
+        p_src += src_stride;
+        p_dst += width;
+    }
+}
+
+/************************************************************************
+ * Frame signature
+ ***********************************************************************/
+void qcff_img_signature(const uint8_t *p_src, uint32_t width,
+        uint32_t height, uint32_t src_stride, uint8_t *p_sig) {
+    uint32_t r, c, j;
+
+    pthread_once(&kernels_once, qcff_img_select_kernels);
+
+    for (r = 0; r < QCFF_IMG_SIG_ROWS; r++) {
+        uint32_t y0 = r * height / QCFF_IMG_SIG_ROWS;
+        uint32_t y1 = (r + 1) * height / QCFF_IMG_SIG_ROWS;
+        /* QCFF_IMG_SIG_SAMPLES rows of each block are read */
+        uint32_t step = MAX2((y1 - y0) / QCFF_IMG_SIG_SAMPLES, 1);
+        uint32_t sums[QCFF_IMG_SIG_COLS] = { 0 };
+        uint32_t count = 0;
+
+        for (j = y0; j < y1; j += step, count++) {
+            const uint8_t *p_row = p_src + (size_t) j * src_stride;
+            for (c = 0; c < QCFF_IMG_SIG_COLS; c++) {
+                uint32_t x0 = c * width / QCFF_IMG_SIG_COLS;
+                uint32_t x1 = (c + 1) * width / QCFF_IMG_SIG_COLS;
+                sums[c] += kernels.sum_row(p_row + x0, x1 - x0);
+            }
+        }
+        for (c = 0; c < QCFF_IMG_SIG_COLS; c++) {
+            uint32_t x0 = c * width / QCFF_IMG_SIG_COLS;
+            uint32_t x1 = (c + 1) * width / QCFF_IMG_SIG_COLS;
+            p_sig[r * QCFF_IMG_SIG_COLS + c] =
+                    (uint8_t) (sums[c] / (count * (x1 - x0)));
+        }
+    }
+}
+
+uint32_t qcff_img_signature_diff(const uint8_t *p_sig_a,
+        const uint8_t *p_sig_b) {
+    pthread_once(&kernels_once, qcff_img_select_kernels);
+
+    return kernels.max_absdiff_row(p_sig_a, p_sig_b, QCFF_IMG_SIG_SIZE);
+}
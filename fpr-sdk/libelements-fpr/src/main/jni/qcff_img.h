@@ -0,0 +1,134 @@
+/* =========================================================================
+ * Copyright (c) 2013-2014 Qualcomm Technologies, Inc.  All Rights Reserved.
+ * Qualcomm Technologies Proprietary and Confidential.
+ * =========================================================================
+ * @file    qcff_img.h
+ *
+ * Pixel kernels used by QCFF ahead of the face engine.
+ */
+
+#ifndef QCFF_IMG_H
+#define QCFF_IMG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Downscale factors are 8.8 fixed point: 256 is 1.0, 384 is 1.5 */
+#define QCFF_SCALE_ONE          (256)
+#define QCFF_SCALE_MAX          (8 * QCFF_SCALE_ONE)
+
+/* Dimension of a frame side once downscaled by scale_q8 */
+#define QCFF_SCALED_LEN(len, scale_q8) \
+    ((uint32_t)(((uint64_t)(len) << 8) / (scale_q8)))
+
+/*************************************************************************
+ * qcff_img_downscale_scratch_size
+ *
+ * This function returns the number of bytes of scratch memory
+ * qcff_img_downscale needs for the given source width, height and
+ * factor. Integer factors 1, 2 and 4 need none.
+ *
+ * INPUT:        src_width  Width of the source image.
+ *               src_height Height of the source image.
+ *               scale_q8   Downscale factor, 8.8 fixed point.
+ * RETURN VALUE: Scratch size in bytes.
+ ************************************************************************/
+size_t qcff_img_downscale_scratch_size (uint32_t   src_width,
+                                        uint32_t   src_height,
+                                        uint32_t   scale_q8);
+
+/*************************************************************************
+ * qcff_img_downscale
+ *
+ * This function downscales an 8-bit luma plane. Factors 2 and 4 are
+ * area averaged; any other factor is bilinearly resampled, after an
+ * area-averaging 2x or 4x pre-reduction for factors above 2 so that
+ * large factors do not alias. The vector kernel (NEON, SSE2 or AVX2)
+ * is picked once at runtime from what the CPU supports.
+ *
+ * INPUT:        p_src      Top-left pixel of the source image.
+ *               src_width  Width of the source image.
+ *               src_height Height of the source image.
+ *               src_stride Distance in bytes between source rows.
+ *               scale_q8   Downscale factor, 8.8 fixed point.
+ *               p_scratch  Scratch memory of at least
+ *                          qcff_img_downscale_scratch_size bytes.
+ * OUTPUT:       p_dst      Packed image of QCFF_SCALED_LEN(src_width)
+ *                          x QCFF_SCALED_LEN(src_height) pixels.
+ ************************************************************************/
+void qcff_img_downscale (const uint8_t  *p_src,
+                         uint32_t        src_width,
+                         uint32_t        src_height,
+                         uint32_t        src_stride,
+                         uint32_t        scale_q8,
+                         uint8_t        *p_dst,
+                         uint8_t        *p_scratch);
+
+/* Byte orders of the RGB images qcff_img_rgb_to_luma reads */
+typedef enum {
+    QCFF_IMG_RGBA8888 = 0,
+    QCFF_IMG_BGR888,
+} qcff_img_rgb_t;
+
+/*************************************************************************
+ * qcff_img_rgb_to_luma
+ *
+ * This function computes the 8-bit luma of an RGB image in one pass,
+ * using the BT.601 studio swing weights
+ * Y = ((66 R + 129 G + 25 B + 128) >> 8) + 16. The vector kernel is
+ * picked the same way as for qcff_img_downscale.
+ *
+ * INPUT:        p_src      Top-left pixel of the source image.
+ *               width      Width of the source image.
+ *               height     Height of the source image.
+ *               src_stride Distance in bytes between source rows.
+ *               order      Byte order of the source pixels.
+ * OUTPUT:       p_dst      Packed luma image of width x height pixels.
+ ************************************************************************/
+void qcff_img_rgb_to_luma (const uint8_t  *p_src,
+                           uint32_t        width,
+                           uint32_t        height,
+                           uint32_t        src_stride,
+                           qcff_img_rgb_t  order,
+                           uint8_t        *p_dst);
+
+/* Grid of block means making up a frame signature */
+#define QCFF_IMG_SIG_COLS       16
+#define QCFF_IMG_SIG_ROWS       16
+#define QCFF_IMG_SIG_SIZE       (QCFF_IMG_SIG_COLS * QCFF_IMG_SIG_ROWS)
+/* Rows read per block */
+#define QCFF_IMG_SIG_SAMPLES    4
+
+/*************************************************************************
+ * qcff_img_signature
+ *
+ * This function computes a coarse signature of an 8-bit luma image: the
+ * mean of each block of a QCFF_IMG_SIG_COLS x QCFF_IMG_SIG_ROWS grid,
+ * estimated from QCFF_IMG_SIG_SAMPLES rows per block. The image must be
+ * at least as large as the grid.
+ *
+ * INPUT:        p_src      Top-left pixel of the image.
+ *               width      Width of the image.
+ *               height     Height of the image.
+ *               src_stride Distance in bytes between rows.
+ * OUTPUT:       p_sig      QCFF_IMG_SIG_SIZE block means, row by row.
+ ************************************************************************/
+void qcff_img_signature (const uint8_t  *p_src,
+                         uint32_t        width,
+                         uint32_t        height,
+                         uint32_t        src_stride,
+                         uint8_t        *p_sig);
+
+/*************************************************************************
+ * qcff_img_signature_diff
+ *
+ * This function compares two signatures of the same grid.
+ *
+ * INPUT:        p_sig_a    First signature.
+ *               p_sig_b    Second signature.
+ * RETURN VALUE: Largest absolute difference between two block means.
+ ************************************************************************/
+uint32_t qcff_img_signature_diff (const uint8_t  *p_sig_a,
+                                  const uint8_t  *p_sig_b);
+
+#endif /* #define QCFF_IMG_H */
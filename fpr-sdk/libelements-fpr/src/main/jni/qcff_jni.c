@@ -16,7 +16,10 @@
 #include <time.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 #include <android/log.h>
+#include <android/bitmap.h>
 
 #include "qcff_jni.h"
 
@@ -24,14 +27,15 @@
 #define LOG(msg)   __android_log_print(ANDROID_LOG_DEBUG, "QCFF", msg);
 #define QCFF_LOG(fmt, args...)     __android_log_print(ANDROID_LOG_DEBUG, "QCFF", fmt, ##args)
 
-uint32_t face_indices[NUM_FACES_SUPPORTED];
+/* Filled once for the process, read-only afterwards: every object gets
+   its own handle and shares nothing else */
+static uint32_t face_indices[NUM_FACES_SUPPORTED];
 
-funcs_t gLib = {0};
+static funcs_t gLib = {0};
+static pthread_once_t gLib_once = PTHREAD_ONCE_INIT;
 
-
-jint
-Java_com_qti_elements_sdk_fpr_FacialProcessing_initialize( JNIEnv* env,
-                                                    jobject this )
+static void
+bind_lib( void )
 {
         int i;
         for (i = 0; i < NUM_FACES_SUPPORTED; i++)
@@ -43,7 +47,37 @@ Java_com_qti_elements_sdk_fpr_FacialProcessing_initialize( JNIEnv* env,
         *(void**)&gLib.qcff_create            = &qcff_create;
         *(void**)&gLib.qcff_config            = &qcff_config;
         *(void**)&gLib.qcff_set_detect_rot    = &qcff_set_detect_rot;
+        *(void**)&gLib.qcff_set_detect_rot_auto = &qcff_set_detect_rot_auto;
+        *(void**)&gLib.qcff_set_orientation   = &qcff_set_orientation;
+        *(void**)&gLib.qcff_set_downscale     = &qcff_set_downscale;
+        *(void**)&gLib.qcff_set_adaptive_downscale = &qcff_set_adaptive_downscale;
+        *(void**)&gLib.qcff_get_downscale     = &qcff_get_downscale;
+        *(void**)&gLib.qcff_set_static_skip   = &qcff_set_static_skip;
+        *(void**)&gLib.qcff_get_skip_stats    = &qcff_get_skip_stats;
+        *(void**)&gLib.qcff_set_motion_roi    = &qcff_set_motion_roi;
+        *(void**)&gLib.qcff_get_mem_stats     = &qcff_get_mem_stats;
+        *(void**)&gLib.qcff_get_params        = &qcff_get_params;
+        *(void**)&gLib.qcff_set_params        = &qcff_set_params;
+        *(void**)&gLib.qcff_get_tracking      = &qcff_get_tracking;
+        *(void**)&gLib.qcff_set_tracking      = &qcff_set_tracking;
+        *(void**)&gLib.qcff_set_deadline      = &qcff_set_deadline;
+        *(void**)&gLib.qcff_get_deadline_stats = &qcff_get_deadline_stats;
+        *(void**)&gLib.qcff_set_tiling        = &qcff_set_tiling;
+        *(void**)&gLib.qcff_set_refine        = &qcff_set_refine;
+        *(void**)&gLib.qcff_set_face_threads  = &qcff_set_face_threads;
+        *(void**)&gLib.qcff_set_attr_rates    = &qcff_set_attr_rates;
+        *(void**)&gLib.qcff_set_recog_cache   = &qcff_set_recog_cache;
+        *(void**)&gLib.qcff_set_face_budget   = &qcff_set_face_budget;
+        *(void**)&gLib.qcff_get_ranked_faces  = &qcff_get_ranked_faces;
         *(void**)&gLib.qcff_set_frame         = &qcff_set_frame;
+        *(void**)&gLib.qcff_set_frame_ref     = &qcff_set_frame_ref;
+        *(void**)&gLib.qcff_async_start       = &qcff_async_start;
+        *(void**)&gLib.qcff_async_stop        = &qcff_async_stop;
+        *(void**)&gLib.qcff_submit_frame      = &qcff_submit_frame;
+        *(void**)&gLib.qcff_poll_results      = &qcff_poll_results;
+        *(void**)&gLib.qcff_pool_create       = &qcff_pool_create;
+        *(void**)&gLib.qcff_pool_destroy      = &qcff_pool_destroy;
+        *(void**)&gLib.qcff_process_batch     = &qcff_process_batch;
         *(void**)&gLib.qcff_set_mode          = &qcff_set_mode;
         *(void**)&gLib.qcff_get_num_faces     = &qcff_get_num_faces;
         *(void**)&gLib.qcff_get_rects         = &qcff_get_rects;
@@ -55,6 +89,7 @@ Java_com_qti_elements_sdk_fpr_FacialProcessing_initialize( JNIEnv* env,
         //*(void**)&gLib.qcff_get_eye_detection = &qcff_get_eye_detection;  //eye detection
         *(void**)&gLib.qcff_get_directions    = &qcff_get_directions;
         *(void**)&gLib.qcff_get_complete_info = &qcff_get_complete_info;
+        *(void**)&gLib.qcff_transform_complete_info = &qcff_transform_complete_info;
         *(void**)&gLib.qcff_create_feature_cache  = &qcff_create_feature_cache;
         *(void**)&gLib.qcff_destroy_feature_cache = &qcff_destroy_feature_cache;
         *(void**)&gLib.qcff_reg_new_usr       = &qcff_reg_new_usr;
@@ -69,6 +104,13 @@ Java_com_qti_elements_sdk_fpr_FacialProcessing_initialize( JNIEnv* env,
         *(void**)&gLib.qcff_destroy           = &qcff_destroy;
         *(void**)&gLib.qcff_setThreshold      = &qcff_setThreshold;
     }
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_initialize( JNIEnv* env,
+                                                    jobject this )
+{
+    pthread_once(&gLib_once, bind_lib);
     return 0;
 }
 
@@ -101,33 +143,510 @@ jint
 Java_com_qti_elements_sdk_fpr_FacialProcessing_create( JNIEnv* env,
                                                 jobject this )
 {
-        qcff_handle_t handle;
-        int rc = gLib.qcff_create(&handle);
-        if (QCFF_FAILED(rc))
+        qcff_handle_t handle;
+        int rc = gLib.qcff_create(&handle);
+        if (QCFF_FAILED(rc))
+        {
+                return 0;
+        }
+        return (jint)handle;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_config( JNIEnv* env,
+                                                jobject this,
+                                                jint handle,
+                                                jint width,
+                                                jint height,
+                                                jint downscale_factor_q8,
+                                                jint stride,
+                                                jint offset,
+                                                jint crop_x,
+                                                jint crop_y,
+                                                jint crop_dx,
+                                                jint crop_dy,
+                                                jint format )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h)
+        {
+            qcff_config_t config;
+            memset(&config, 0, sizeof(config));
+            config.width  = width;
+            config.height = height;
+            config.downscale_factor_q8 = downscale_factor_q8;
+            config.stride  = stride;
+            config.offset  = offset;
+            config.crop.x  = crop_x;
+            config.crop.y  = crop_y;
+            config.crop.dx = crop_dx;
+            config.crop.dy = crop_dy;
+            config.format  = (qcff_format_t)format;
+            rc = gLib.qcff_config(h, &config);
+            QCFF_LOG("QCCameraConfig returned %d",  (uint32_t)rc);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setDetectableRotation( JNIEnv* env,
+                                                                  jobject this,
+                                                                  jint handle,
+                                                                  jint frontal,
+                                                                  jint half_profile,
+                                                                  jint profile )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h)
+        {
+            rc = gLib.qcff_set_detect_rot(h, frontal, half_profile, profile);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setDetectableRotationAuto( JNIEnv* env,
+                                                                      jobject this,
+                                                                      jint handle,
+                                                                      jboolean enable )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h)
+        {
+            rc = gLib.qcff_set_detect_rot_auto(h, enable ? 1 : 0);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setOrientation( JNIEnv* env,
+                                                           jobject this,
+                                                           jint handle,
+                                                           jint rotation,
+                                                           jboolean mirrored )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h)
+        {
+            rc = gLib.qcff_set_orientation(h, rotation, mirrored ? 1 : 0);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setDownscale( JNIEnv* env,
+                                                         jobject this,
+                                                         jint handle,
+                                                         jint factor_q8 )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h)
+        {
+            rc = gLib.qcff_set_downscale(h, factor_q8);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setAdaptiveDownscale( JNIEnv* env,
+                                                                 jobject this,
+                                                                 jint handle,
+                                                                 jint min_face_size,
+                                                                 jint target_time_us,
+                                                                 jint max_factor_q8 )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h)
+        {
+            rc = gLib.qcff_set_adaptive_downscale(h, min_face_size, target_time_us, max_factor_q8);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_getDownscale( JNIEnv* env,
+                                                         jobject this,
+                                                         jint handle )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        uint32_t factor_q8 = 0;
+        if (h)
+        {
+            gLib.qcff_get_downscale(h, &factor_q8);
+        }
+        return (jint)factor_q8;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setStaticSkip( JNIEnv* env,
+                                                          jobject this,
+                                                          jint handle,
+                                                          jint threshold,
+                                                          jint max_skip )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h)
+        {
+            rc = gLib.qcff_set_static_skip(h, threshold, max_skip);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setMotionRoi( JNIEnv* env,
+                                                         jobject this,
+                                                         jint handle,
+                                                         jint threshold,
+                                                         jint full_scan_interval )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h)
+        {
+            rc = gLib.qcff_set_motion_roi(h, threshold, full_scan_interval);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
+jintArray
+Java_com_qti_elements_sdk_fpr_FacialProcessing_getSkipStats( JNIEnv* env,
+                                                         jobject this,
+                                                         jint handle )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        qcff_skip_stats_t stats;
+        jint values[3];
+        jintArray result;
+        memset(&stats, 0, sizeof(stats));
+        if (h)
+        {
+            gLib.qcff_get_skip_stats(h, &stats);
+        }
+        values[0] = (jint)stats.frames_detected;
+        values[1] = (jint)stats.frames_skipped;
+        values[2] = (jint)stats.last_skipped;
+        result = (*env)->NewIntArray(env, 3);
+        if (result)
+        {
+            (*env)->SetIntArrayRegion(env, result, 0, 3, values);
+        }
+        return result;
+}
+
+/* Parameters travel as an int array in the field order of qcff_params_t */
+#define PARAMS_SIZE 9
+
+jintArray
+Java_com_qti_elements_sdk_fpr_FacialProcessing_getParams( JNIEnv* env,
+                                                      jobject this,
+                                                      jint handle )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        qcff_params_t params;
+        jint values[PARAMS_SIZE];
+        jintArray result;
+        if (!h || QCFF_RET_SUCCESS != gLib.qcff_get_params(h, &params))
+        {
+                return NULL;
+        }
+        values[0] = (jint)params.search_step;
+        values[1] = (jint)params.tracking_step;
+        values[2] = (jint)params.min_face_size;
+        values[3] = (jint)params.max_face_size;
+        values[4] = (jint)params.max_faces;
+        values[5] = (jint)params.threshold;
+        values[6] = (jint)params.tracking_threshold;
+        values[7] = (jint)params.accuracy;
+        values[8] = (jint)params.fr_threshold;
+        result = (*env)->NewIntArray(env, PARAMS_SIZE);
+        if (result)
+        {
+            (*env)->SetIntArrayRegion(env, result, 0, PARAMS_SIZE, values);
+        }
+        return result;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setParams( JNIEnv* env,
+                                                      jobject this,
+                                                      jint handle,
+                                                      jintArray values_array )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        qcff_params_t params;
+        jint values[PARAMS_SIZE];
+        int rc = QCFF_RET_FAILURE;
+        if (h && values_array
+                && (*env)->GetArrayLength(env, values_array) >= PARAMS_SIZE)
+        {
+            (*env)->GetIntArrayRegion(env, values_array, 0, PARAMS_SIZE, values);
+            params.search_step = (uint32_t)values[0];
+            params.tracking_step = (uint32_t)values[1];
+            params.min_face_size = (uint32_t)values[2];
+            params.max_face_size = (uint32_t)values[3];
+            params.max_faces = (uint32_t)values[4];
+            params.threshold = values[5];
+            params.tracking_threshold = values[6];
+            params.accuracy = (qcff_accuracy_t)values[7];
+            params.fr_threshold = values[8];
+            rc = gLib.qcff_set_params(h, &params);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
+/* Tracking policy travels as an int array in the field order of
+   qcff_tracking_t */
+#define TRACKING_SIZE 6
+
+jintArray
+Java_com_qti_elements_sdk_fpr_FacialProcessing_getTracking( JNIEnv* env,
+                                                        jobject this,
+                                                        jint handle )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        qcff_tracking_t tracking;
+        jint values[TRACKING_SIZE];
+        jintArray result;
+        if (!h || QCFF_RET_SUCCESS != gLib.qcff_get_tracking(h, &tracking))
+        {
+                return NULL;
+        }
+        values[0] = (jint)tracking.search;
+        values[1] = (jint)tracking.refresh_count;
+        values[2] = (jint)tracking.face_retry;
+        values[3] = (jint)tracking.head_retry;
+        values[4] = (jint)tracking.hold_count;
+        values[5] = (jint)tracking.move_rate;
+        result = (*env)->NewIntArray(env, TRACKING_SIZE);
+        if (result)
+        {
+            (*env)->SetIntArrayRegion(env, result, 0, TRACKING_SIZE, values);
+        }
+        return result;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setTracking( JNIEnv* env,
+                                                        jobject this,
+                                                        jint handle,
+                                                        jintArray values_array )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        qcff_tracking_t tracking;
+        jint values[TRACKING_SIZE];
+        int rc = QCFF_RET_FAILURE;
+        if (h && values_array
+                && (*env)->GetArrayLength(env, values_array) >= TRACKING_SIZE)
+        {
+            (*env)->GetIntArrayRegion(env, values_array, 0, TRACKING_SIZE, values);
+            tracking.search = (qcff_tracking_search_t)values[0];
+            tracking.refresh_count = values[1];
+            tracking.face_retry = values[2];
+            tracking.head_retry = values[3];
+            tracking.hold_count = values[4];
+            tracking.move_rate = values[5];
+            rc = gLib.qcff_set_tracking(h, &tracking);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setDeadline( JNIEnv* env,
+                                                        jobject this,
+                                                        jint handle,
+                                                        jint non_tracking_ms,
+                                                        jint tracking_ms )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h)
+        {
+            rc = gLib.qcff_set_deadline(h, non_tracking_ms, tracking_ms);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
+jintArray
+Java_com_qti_elements_sdk_fpr_FacialProcessing_getDeadlineStats( JNIEnv* env,
+                                                             jobject this,
+                                                             jint handle )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        qcff_deadline_stats_t stats;
+        jint values[4];
+        jintArray result;
+        memset(&stats, 0, sizeof(stats));
+        if (h)
+        {
+            gLib.qcff_get_deadline_stats(h, &stats);
+        }
+        values[0] = (jint)stats.frames_timed_out;
+        values[1] = (jint)stats.frames_late;
+        values[2] = (jint)stats.last_time_us;
+        values[3] = (jint)stats.max_time_us;
+        result = (*env)->NewIntArray(env, 4);
+        if (result)
+        {
+            (*env)->SetIntArrayRegion(env, result, 0, 4, values);
+        }
+        return result;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setTiling( JNIEnv* env,
+                                                      jobject this,
+                                                      jint handle,
+                                                      jint num_threads,
+                                                      jint min_pixels )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h && num_threads >= 0 && num_threads <= QCFF_MAX_THREADS
+                && min_pixels >= 0)
+        {
+            rc = gLib.qcff_set_tiling(h, num_threads, min_pixels);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setRefine( JNIEnv* env,
+                                                      jobject this,
+                                                      jint handle,
+                                                      jint coarse_scale_q8,
+                                                      jint margin_pct )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h && coarse_scale_q8 >= 0 && margin_pct >= 0)
+        {
+            rc = gLib.qcff_set_refine(h, coarse_scale_q8, margin_pct);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setFaceThreads( JNIEnv* env,
+                                                           jobject this,
+                                                           jint handle,
+                                                           jint num_threads )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h && num_threads >= 0)
+        {
+            rc = gLib.qcff_set_face_threads(h, num_threads);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setAttrRates( JNIEnv* env,
+                                                         jobject this,
+                                                         jint handle,
+                                                         jint smile_interval,
+                                                         jint gaze_blink_interval,
+                                                         jint direction_interval,
+                                                         jint move_percent )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h && smile_interval >= 0 && gaze_blink_interval >= 0
+                && direction_interval >= 0 && move_percent >= 0)
         {
-                return 0;
+            qcff_attr_rates_t rates;
+            rates.smile_interval = smile_interval;
+            rates.gaze_blink_interval = gaze_blink_interval;
+            rates.direction_interval = direction_interval;
+            rates.move_percent = move_percent;
+            /* All 1s is every frame: no history kept */
+            if (smile_interval <= 1 && gaze_blink_interval <= 1
+                    && direction_interval <= 1)
+                rc = gLib.qcff_set_attr_rates(h, NULL);
+            else
+                rc = gLib.qcff_set_attr_rates(h, &rates);
         }
-        return (jint)handle;
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
 }
 
 jint
-Java_com_qti_elements_sdk_fpr_FacialProcessing_config( JNIEnv* env,
-                                                jobject this,
-                                                jint handle,
-                                                jint width,
-                                                jint height,
-                                                jint downscale_factor )
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setRecogCache( JNIEnv* env,
+                                                          jobject this,
+                                                          jint handle,
+                                                          jint interval )
 {
         qcff_handle_t h = (qcff_handle_t)handle;
         int rc = QCFF_RET_FAILURE;
-        if (h)
+        if (h && interval >= 0)
         {
-            qcff_config_t config;
-            config.width  = width;
-            config.height = height;
-            config.downscale_factor = downscale_factor;
-            rc = gLib.qcff_config(h, &config);
-            QCFF_LOG("QCCameraConfig returned %d",  (uint32_t)rc);
+            rc = gLib.qcff_set_recog_cache(h, interval);
         }
         if (QCFF_RET_SUCCESS != rc)
         {
@@ -137,18 +656,16 @@ Java_com_qti_elements_sdk_fpr_FacialProcessing_config( JNIEnv* env,
 }
 
 jint
-Java_com_qti_elements_sdk_fpr_FacialProcessing_setDetectableRotation( JNIEnv* env,
-                                                                  jobject this,
-                                                                  jint handle,
-                                                                  jint frontal,
-                                                                  jint half_profile,
-                                                                  jint profile )
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setFaceBudget( JNIEnv* env,
+                                                          jobject this,
+                                                          jint handle,
+                                                          jint max_faces )
 {
         qcff_handle_t h = (qcff_handle_t)handle;
         int rc = QCFF_RET_FAILURE;
-        if (h)
+        if (h && max_faces >= 0)
         {
-            rc = gLib.qcff_set_detect_rot(h, frontal, half_profile, profile);
+            rc = gLib.qcff_set_face_budget(h, max_faces);
         }
         if (QCFF_RET_SUCCESS != rc)
         {
@@ -157,6 +674,34 @@ Java_com_qti_elements_sdk_fpr_FacialProcessing_setDetectableRotation( JNIEnv* en
         return 0;
 }
 
+jintArray
+Java_com_qti_elements_sdk_fpr_FacialProcessing_getMemStats( JNIEnv* env,
+                                                        jobject this,
+                                                        jint handle )
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        qcff_mem_stats_t stats;
+        jint values[6];
+        jintArray result;
+        memset(&stats, 0, sizeof(stats));
+        if (h)
+        {
+            gLib.qcff_get_mem_stats(h, &stats);
+        }
+        values[0] = (jint)stats.arena_size;
+        values[1] = (jint)stats.arena_used;
+        values[2] = (jint)stats.arena_peak;
+        values[3] = (jint)stats.dt_backup_size;
+        values[4] = (jint)stats.dt_work_min_size;
+        values[5] = (jint)stats.dt_work_max_size;
+        result = (*env)->NewIntArray(env, 6);
+        if (result)
+        {
+            (*env)->SetIntArrayRegion(env, result, 0, 6, values);
+        }
+        return result;
+}
+
 void
 Java_com_qti_elements_sdk_fpr_FacialProcessing_setFrame( JNIEnv* env,
                                                   jobject this,
@@ -183,6 +728,41 @@ Java_com_qti_elements_sdk_fpr_FacialProcessing_setFrame( JNIEnv* env,
 
 }
 
+/*
+ * Zero-copy variant of setFrame. The frame must be a direct ByteBuffer;
+ * when borrow is set its luma plane is handed to the engine as is and
+ * stays borrowed until the next setFrame/setFrameDirect/config/destroy on
+ * this handle. Without it, e.g. for a last row shorter than the stride,
+ * the crop is copied out of the buffer.
+ */
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_setFrameDirect( JNIEnv* env,
+                                                        jobject this,
+                                                        jint handle,
+                                                        jobject frame_buffer,
+                                                        jboolean borrow)
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h && frame_buffer)
+        {
+            uint8_t* frame = (uint8_t*)(*env)->GetDirectBufferAddress(env, frame_buffer);
+            if (frame)
+            {
+                if (borrow)
+                    rc = gLib.qcff_set_frame_ref(h, frame);
+                else
+                    rc = gLib.qcff_set_frame(h, frame);
+            }
+            QCFF_LOG("SetFrameDirect returned %d",  (uint32_t)rc);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
+
 void
 Java_com_qti_elements_sdk_fpr_FacialProcessing_setMode( JNIEnv* env,
                                                     jobject this,
@@ -502,6 +1082,65 @@ Java_com_qti_elements_sdk_fpr_FacialProcessing_getFaceDirections( JNIEnv* env,
     return NULL;
 }
 
+/*
+ * Packs the requested information of each face into pDst, in the layout
+ * parsed by FacialProcessing.parseFaceData(). Returns the next free slot.
+ */
+static jint *
+pack_complete_info(jint *pDst, uint32_t num_faces, const qcff_complete_face_info_t *cinfo)
+{
+        uint32_t i;
+        int j;
+
+        for (i = 0; i < num_faces; i++)
+        {
+                if (cinfo->p_rects)
+                {
+                        *pDst++ = cinfo->p_rects[i].bounding_box.x;
+                        *pDst++ = cinfo->p_rects[i].bounding_box.y;
+                        *pDst++ = cinfo->p_rects[i].bounding_box.dx;
+                        *pDst++ = cinfo->p_rects[i].bounding_box.dy;
+                }
+                if (cinfo->p_parts)
+                {
+                        for (j = 0; j < QCFF_PARTS_MAX; j++)
+                        {
+                                *pDst++ = cinfo->p_parts[i].parts[j].x;
+                                *pDst++ = cinfo->p_parts[i].parts[j].y;
+                        }
+                }
+                if (cinfo->p_parts_ex)
+                {
+                        for (j = 0; j < QCFF_PARTS_EX_MAX; j++)
+                        {
+                                *pDst++ = cinfo->p_parts_ex[i].parts[j].x;
+                                *pDst++ = cinfo->p_parts_ex[i].parts[j].y;
+                        }
+                }
+                if (cinfo->p_directions)
+                {
+                        *pDst++ = cinfo->p_directions[i].up_down_in_degree;
+                        *pDst++ = cinfo->p_directions[i].left_right_in_degree;
+                        *pDst++ = cinfo->p_directions[i].roll_in_degree;
+                }
+                if (cinfo->p_smile_degrees)
+                {
+                        *pDst++ = cinfo->p_smile_degrees[i];
+                }
+                if (cinfo->p_gaze_degrees)
+                {
+                        *pDst++ = cinfo->p_gaze_degrees[i].left_right;
+                        *pDst++ = cinfo->p_gaze_degrees[i].up_down;
+                }
+                if (cinfo->p_eye_open_degrees)
+                {
+                        *pDst++ = cinfo->p_eye_open_degrees[i].left;
+                        *pDst++ = cinfo->p_eye_open_degrees[i].right;
+                }
+        }
+        return pDst;
+}
+
 jintArray
 Java_com_qti_elements_sdk_fpr_FacialProcessing_getCompleteInfos( JNIEnv* env,
                                                              jobject this,
@@ -512,11 +1151,14 @@ Java_com_qti_elements_sdk_fpr_FacialProcessing_getCompleteInfos( JNIEnv* env,
                                                              jboolean get_dirs,
                                                              jboolean get_smiles,
                                                              jboolean get_gazes,
-                                                             jboolean get_eye_opens)
+                                                             jboolean get_eye_opens,
+                                                             jboolean mirrored,
+                                                             jint rotation,
+                                                             jfloat scale_x,
+                                                             jfloat scale_y)
 {
     qcff_handle_t h = (qcff_handle_t)handle;
-    int rc = QCFF_RET_SUCCESS, j;
-    uint32_t i;
+    int rc = QCFF_RET_SUCCESS;
     qcff_complete_face_info_t cinfo;
     qcff_face_rect_t rects[NUM_FACES_SUPPORTED];
     qcff_face_parts_t parts[NUM_FACES_SUPPORTED];
@@ -538,6 +1180,7 @@ Java_com_qti_elements_sdk_fpr_FacialProcessing_getCompleteInfos( JNIEnv* env,
         cinfo.p_smile_degrees = (get_smiles) ? smiles : NULL;
         cinfo.p_eye_open_degrees = (get_eye_opens) ? eye_opens : NULL;
         cinfo.p_gaze_degrees = (get_gazes) ? gazes : NULL;
+        cinfo.p_attr_ages = NULL;
 
         num_elements += (get_rects) ? sizeof(qcff_face_rect_t) / sizeof(int) : 0;
         num_elements += (get_parts) ? sizeof(qcff_face_parts_t) / sizeof(int) : 0;
@@ -548,72 +1191,352 @@ Java_com_qti_elements_sdk_fpr_FacialProcessing_getCompleteInfos( JNIEnv* env,
         num_elements += (get_gazes) ? sizeof(qcff_gaze_deg_t) / sizeof(int) : 0;
 
         rc = gLib.qcff_get_complete_info(h, NUM_FACES_SUPPORTED, face_indices, &num_returned, &cinfo);
+
+        /* Bring the results to display coordinates in one batch */
+        if (QCFF_RET_SUCCESS == rc && num_returned > 0 &&
+            (mirrored || rotation || scale_x != 1.0f || scale_y != 1.0f))
+        {
+            qcff_transform_t transform;
+            transform.mirrored = mirrored;
+            transform.rotation = rotation;
+            transform.scale_x  = scale_x;
+            transform.scale_y  = scale_y;
+            rc = gLib.qcff_transform_complete_info(h, &transform, num_returned, &cinfo);
+        }
     }
     if (QCFF_RET_SUCCESS == rc && num_returned > 0)
     {
         jintArray newArray = (*env)->NewIntArray(env, num_elements * num_returned);
         jint pArray[NUM_FACES_SUPPORTED*num_elements];
-        jint *pDst = pArray;
 
-        for (i = 0; i < num_returned; i++)
+        memset(pArray, 0, sizeof(jint) * num_elements * num_returned);
+        pack_complete_info(pArray, num_returned, &cinfo);
+        (*env)->SetIntArrayRegion(env, newArray, 0, num_elements * num_returned, pArray);
+        return newArray;
+    }
+    else{
+        QCFF_LOG("Complete info returns %d n  face count %d", rc, num_returned);
+    }
+
+    return NULL;
+}
+
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_asyncStart( JNIEnv* env,
+                                                       jobject this,
+                                                       jint handle,
+                                                       jint info_mask)
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h)
         {
-                if (get_rects)
-                {
-                                *pDst++ = rects[i].bounding_box.x;
-                                *pDst++ = rects[i].bounding_box.y;
-                                *pDst++ = rects[i].bounding_box.dx;
-                                *pDst++ = rects[i].bounding_box.dy;
-                }
-                if (get_parts)
-                {
-                        for (j = 0; j < QCFF_PARTS_MAX; j++)
-                        {
-                            *pDst++ = parts[i].parts[j].x;
-                            *pDst++ = parts[i].parts[j].y;
-                        }
-                }
-                if (get_parts_ex)
-                {
-                        for (j = 0; j < QCFF_PARTS_EX_MAX; j++)
-                                {
-                                *pDst++ = parts_ex[i].parts[j].x;
-                                *pDst++ = parts_ex[i].parts[j].y;
-                                }
-                }
+            rc = gLib.qcff_async_start(h, (uint32_t)info_mask);
+            QCFF_LOG("AsyncStart returned %d",  (uint32_t)rc);
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
 
-                if (get_dirs)
-                {
-                        *pDst++ = dirs[i].up_down_in_degree;
-                                *pDst++ = dirs[i].left_right_in_degree;
-                                *pDst++ = dirs[i].roll_in_degree;
-                }
+void
+Java_com_qti_elements_sdk_fpr_FacialProcessing_asyncStop( JNIEnv* env,
+                                                      jobject this,
+                                                      jint handle)
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        if (h)
+        {
+            gLib.qcff_async_stop(h);
+        }
+}
 
-                if (get_smiles)
-                {
-                        *pDst++ = smiles[i];
-                }
+/*
+ * Hands a frame to the native worker. The crop is packed before this
+ * returns, so the array is only pinned for the copy.
+ */
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_submitFrame( JNIEnv* env,
+                                                        jobject this,
+                                                        jint handle,
+                                                        jbyteArray frame_array,
+                                                        jint seq,
+                                                        jlong timestamp,
+                                                        jboolean mirrored,
+                                                        jint rotation,
+                                                        jfloat scale_x,
+                                                        jfloat scale_y)
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        int rc = QCFF_RET_FAILURE;
+        if (h && frame_array)
+        {
+            qcff_transform_t transform;
+            uint8_t* frame;
+
+            transform.mirrored = mirrored;
+            transform.rotation = rotation;
+            transform.scale_x  = scale_x;
+            transform.scale_y  = scale_y;
+            frame = (uint8_t*)(*env)->GetPrimitiveArrayCritical(env, frame_array, NULL);
+            if (frame)
+            {
+                rc = gLib.qcff_submit_frame(h, frame, (uint32_t)seq, (uint64_t)timestamp, &transform);
+                (*env)->ReleasePrimitiveArrayCritical(env, frame_array, frame, JNI_ABORT);
+            }
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return -1;
+        }
+        return 0;
+}
 
-                if (get_gazes)
-                {
-                        *pDst++ = gazes[i].left_right;
-                *pDst++ = gazes[i].up_down;
-                }
+/*
+ * Waits up to timeout_ms for the next result of the native worker.
+ * Returns NULL on timeout, else a header of ASYNC_HEADER_SIZE ints
+ * (sequence, timestamp high and low words, dropped frames, faces)
+ * followed by the faces packed as in getCompleteInfos().
+ */
+#define ASYNC_HEADER_SIZE 5
 
-                if (get_eye_opens)
-                {
-                        *pDst++ = eye_opens[i].left;
-                *pDst++ = eye_opens[i].right;
-                }
+jintArray
+Java_com_qti_elements_sdk_fpr_FacialProcessing_pollResults( JNIEnv* env,
+                                                        jobject this,
+                                                        jint handle,
+                                                        jint timeout_ms)
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        qcff_frame_result_t result;
+        qcff_complete_face_info_t cinfo;
+        jint pArray[ASYNC_HEADER_SIZE + sizeof(qcff_frame_result_t) / sizeof(jint)];
+        jint *pDst = pArray;
+        jintArray newArray;
+        uint32_t num_faces;
+        int rc;
+
+        if (!h)
+        {
+            return NULL;
+        }
+        rc = gLib.qcff_poll_results(h, (uint32_t)timeout_ms, &result);
+        if (QCFF_RET_SUCCESS != rc)
+        {
+            return NULL;
         }
 
-        (*env)->SetIntArrayRegion(env, newArray, 0, num_elements * num_returned, pArray);
+        num_faces = QCFF_SUCCEEDED(result.status) ? result.num_faces : 0;
+        *pDst++ = (jint)result.seq;
+        *pDst++ = (jint)(result.timestamp >> 32);
+        *pDst++ = (jint)(result.timestamp & 0xFFFFFFFF);
+        *pDst++ = (jint)result.num_dropped;
+        *pDst++ = (jint)num_faces;
+
+        cinfo.p_rects = (result.info_mask & QCFF_INFO_RECTS) ? result.rects : NULL;
+        cinfo.p_parts = (result.info_mask & QCFF_INFO_PARTS) ? result.parts : NULL;
+        cinfo.p_parts_ex = (result.info_mask & QCFF_INFO_PARTS_EX) ? result.parts_ex : NULL;
+        cinfo.p_directions = (result.info_mask & QCFF_INFO_DIRECTIONS) ? result.directions : NULL;
+        cinfo.p_smile_degrees = (result.info_mask & QCFF_INFO_SMILES) ? result.smile_degrees : NULL;
+        cinfo.p_eye_open_degrees = (result.info_mask & QCFF_INFO_EYE_OPENS) ? result.eye_open_degrees : NULL;
+        cinfo.p_gaze_degrees = (result.info_mask & QCFF_INFO_GAZES) ? result.gaze_degrees : NULL;
+        cinfo.p_attr_ages = NULL;
+        pDst = pack_complete_info(pDst, num_faces, &cinfo);
+
+        newArray = (*env)->NewIntArray(env, pDst - pArray);
+        if (newArray)
+        {
+            (*env)->SetIntArrayRegion(env, newArray, 0, pDst - pArray, pArray);
+        }
         return newArray;
-    }
-    else{
-        QCFF_LOG("Complete info returns %d n  face count %d", rc, num_returned);
-    }
+}
 
-    return NULL;
+jint
+Java_com_qti_elements_sdk_fpr_FacialProcessing_poolCreate( JNIEnv* env,
+                                                       jobject this,
+                                                       jint handle,
+                                                       jint num_handles,
+                                                       jint queue_depth,
+                                                       jint deadline_ms)
+{
+        qcff_handle_t h = (qcff_handle_t)handle;
+        qcff_pool_config_t cfg;
+        qcff_params_t params;
+        qcff_pool_t pool = NULL;
+        int rc = QCFF_RET_FAILURE;
+
+        if (h && num_handles >= 0 && num_handles <= QCFF_MAX_THREADS
+                && queue_depth >= 0 && queue_depth <= QCFF_MAX_THREADS
+                && deadline_ms >= 0)
+        {
+            /* The pool detects with the parameters of the handle */
+            rc = gLib.qcff_get_params(h, &params);
+            if (QCFF_RET_SUCCESS == rc)
+            {
+                cfg.num_handles = (uint32_t)num_handles;
+                cfg.queue_depth = (uint32_t)queue_depth;
+                cfg.deadline_ms = (uint32_t)deadline_ms;
+                cfg.p_params = &params;
+                rc = gLib.qcff_pool_create(&pool, &cfg);
+            }
+        }
+        if (QCFF_RET_SUCCESS != rc)
+        {
+                return 0;
+        }
+        return (jint)pool;
+}
+
+void
+Java_com_qti_elements_sdk_fpr_FacialProcessing_poolDestroy( JNIEnv* env,
+                                                        jobject this,
+                                                        jint pool )
+{
+        qcff_pool_t p = (qcff_pool_t)pool;
+        if (p)
+        {
+            gLib.qcff_pool_destroy(&p);
+        }
+}
+
+/* Bitmaps of a batch and their packed results */
+typedef struct
+{
+        JNIEnv *env;
+        jobjectArray bitmaps;
+        jobjectArray results;
+} batch_io_t;
+
+/*
+ * Locks the pixels of an ARGB_8888 bitmap for the pool, which reads them
+ * in place.
+ */
+static int
+batch_get_image(void *p_user, uint32_t index, qcff_batch_item_t *p_item)
+{
+        batch_io_t *io = (batch_io_t *)p_user;
+        JNIEnv *env = io->env;
+        AndroidBitmapInfo info;
+        void *pixels = NULL;
+        jobject bitmap;
+        int rc = QCFF_RET_FAILURE;
+
+        bitmap = (*env)->GetObjectArrayElement(env, io->bitmaps, index);
+        if (bitmap)
+        {
+            if (ANDROID_BITMAP_RESULT_SUCCESS == AndroidBitmap_getInfo(env, bitmap, &info)
+                    && ANDROID_BITMAP_FORMAT_RGBA_8888 == info.format
+                    && ANDROID_BITMAP_RESULT_SUCCESS == AndroidBitmap_lockPixels(env, bitmap, &pixels))
+            {
+                p_item->p_frame = (uint8_t *)pixels;
+                p_item->cfg.width = info.width;
+                p_item->cfg.height = info.height;
+                p_item->cfg.stride = info.stride;
+                p_item->cfg.format = QCFF_FORMAT_RGBA8888;
+                rc = QCFF_RET_SUCCESS;
+            }
+            (*env)->DeleteLocalRef(env, bitmap);
+        }
+        return rc;
+}
+
+/*
+ * Unlocks the bitmap and stores its result at its index: a header of
+ * BATCH_HEADER_SIZE ints (status, processing time in microseconds,
+ * faces) followed by the faces packed as in getCompleteInfos().
+ */
+#define BATCH_HEADER_SIZE 3
+
+static void
+batch_put_result(void *p_user, uint32_t index, const qcff_frame_result_t *p_result)
+{
+        batch_io_t *io = (batch_io_t *)p_user;
+        JNIEnv *env = io->env;
+        qcff_frame_result_t *result = (qcff_frame_result_t *)p_result;
+        qcff_complete_face_info_t cinfo;
+        jint pArray[BATCH_HEADER_SIZE + sizeof(qcff_frame_result_t) / sizeof(jint)];
+        jint *pDst = pArray;
+        jintArray newArray;
+        jobject bitmap;
+        uint32_t num_faces;
+
+        bitmap = (*env)->GetObjectArrayElement(env, io->bitmaps, index);
+        if (bitmap)
+        {
+            AndroidBitmap_unlockPixels(env, bitmap);
+            (*env)->DeleteLocalRef(env, bitmap);
+        }
+
+        num_faces = QCFF_SUCCEEDED(result->status) ? result->num_faces : 0;
+        *pDst++ = (jint)result->status;
+        *pDst++ = (jint)result->time_us;
+        *pDst++ = (jint)num_faces;
+
+        cinfo.p_rects = (result->info_mask & QCFF_INFO_RECTS) ? result->rects : NULL;
+        cinfo.p_parts = (result->info_mask & QCFF_INFO_PARTS) ? result->parts : NULL;
+        cinfo.p_parts_ex = (result->info_mask & QCFF_INFO_PARTS_EX) ? result->parts_ex : NULL;
+        cinfo.p_directions = (result->info_mask & QCFF_INFO_DIRECTIONS) ? result->directions : NULL;
+        cinfo.p_smile_degrees = (result->info_mask & QCFF_INFO_SMILES) ? result->smile_degrees : NULL;
+        cinfo.p_eye_open_degrees = (result->info_mask & QCFF_INFO_EYE_OPENS) ? result->eye_open_degrees : NULL;
+        cinfo.p_gaze_degrees = (result->info_mask & QCFF_INFO_GAZES) ? result->gaze_degrees : NULL;
+        cinfo.p_attr_ages = NULL;
+        pDst = pack_complete_info(pDst, num_faces, &cinfo);
+
+        newArray = (*env)->NewIntArray(env, pDst - pArray);
+        if (newArray)
+        {
+            (*env)->SetIntArrayRegion(env, newArray, 0, pDst - pArray, pArray);
+            (*env)->SetObjectArrayElement(env, io->results, index, newArray);
+            (*env)->DeleteLocalRef(env, newArray);
+        }
+}
+
+/*
+ * Runs detection on ARGB_8888 bitmaps over the handles of a pool.
+ * Returns one int array per bitmap in input order, as packed by
+ * batch_put_result(), or null for a bitmap that could not be read.
+ */
+jobjectArray
+Java_com_qti_elements_sdk_fpr_FacialProcessing_processBatch( JNIEnv* env,
+                                                         jobject this,
+                                                         jint pool,
+                                                         jobjectArray bitmaps,
+                                                         jint info_mask)
+{
+        qcff_pool_t p = (qcff_pool_t)pool;
+        qcff_batch_io_t batch;
+        batch_io_t io;
+        jclass intArrayClass;
+        jsize num_bitmaps;
+        int rc;
+
+        if (!p || !bitmaps)
+        {
+            return NULL;
+        }
+        num_bitmaps = (*env)->GetArrayLength(env, bitmaps);
+        intArrayClass = (*env)->FindClass(env, "[I");
+        if (!intArrayClass)
+        {
+            return NULL;
+        }
+        io.env = env;
+        io.bitmaps = bitmaps;
+        io.results = (*env)->NewObjectArray(env, num_bitmaps, intArrayClass, NULL);
+        if (!io.results)
+        {
+            return NULL;
+        }
+        batch.p_user = &io;
+        batch.get_image = batch_get_image;
+        batch.put_result = batch_put_result;
+        rc = gLib.qcff_process_batch(p, (uint32_t)num_bitmaps, (uint32_t)info_mask, &batch);
+        if (QCFF_RET_SUCCESS != rc)
+        {
+            return NULL;
+        }
+        return io.results;
 }
 
 void
@@ -637,47 +1560,15 @@ Java_com_qti_elements_sdk_fpr_FacialProcessing_getPrimaryFaceId( JNIEnv* env,
         qcff_handle_t h = (qcff_handle_t)handle;
         int rc = QCFF_RET_FAILURE;
         jint face_id = -1;
-        uint32_t num_faces = 0;
+        uint32_t num_faces_returned = 0;
+        uint32_t top_index;
 
         if (h)
         {
-                rc = gLib.qcff_get_num_faces(h, &num_faces);
-                if (QCFF_SUCCEEDED(rc))
-                {
-                    if (num_faces > 1)
-                        face_id = 0;
-                    else
-                    {
-                            qcff_face_rect_t* rects = (qcff_face_rect_t*)malloc(num_faces * sizeof(qcff_face_rect_t));
-                            if (rects)
-                            {
-                                uint32_t* indices = (uint32_t *)malloc(num_faces * sizeof(uint32_t));
-                                if (indices)
-                                {
-                                    uint32_t i;
-                                    uint32_t num_faces_returned;
-                                    for (i = 0; i < num_faces; i++)
-                                        indices[i] = i;
-                                        rc = gLib.qcff_get_rects(h, num_faces, indices, &num_faces_returned, rects);
-                                        if (QCFF_SUCCEEDED(rc))
-                                        {
-                                            uint32_t largest = 0;
-                                            for (i = 0; i < num_faces_returned; i++)
-                                            {
-                                                uint32_t face_size = rects[i].bounding_box.dx * rects[i].bounding_box.dy;
-                                                if (face_size > largest)
-                                                {
-                                                    largest = face_size;
-                                                    face_id = i;
-                                                }
-                                            }
-                                        }
-                                        free(indices);
-                                        }
-                                        free(rects);
-                                }
-                        }
-                }
+                /* The best ranked face: large, central and long tracked */
+                rc = gLib.qcff_get_ranked_faces(h, 1, &num_faces_returned, &top_index);
+                if (QCFF_SUCCEEDED(rc) && num_faces_returned)
+                        face_id = top_index;
         }
 
         return face_id;
@@ -725,10 +1616,15 @@ Java_com_qti_elements_sdk_fpr_FacialProcessing_identifyPerson( JNIEnv* env,
 
         if (h)
         {
-                jintArray newArray = (*env)->NewIntArray(env, 4);
+                jintArray newArray;
                 int pArray[4];
 
                 rc = gLib.qcff_identify_usr(h, face_idx, pArray, pArray+2);
+                /* Past the face budget: not matched against the album,
+                   returned as an empty array rather than -1 */
+                if (QCFF_RET_SKIPPED == rc)
+                        return (*env)->NewIntArray(env, 0);
+                newArray = (*env)->NewIntArray(env, 4);
                 if (QCFF_RET_NO_MATCH == rc)
                 {
                                 pArray[0] = -1;
@@ -917,7 +1813,7 @@ Java_com_qti_elements_sdk_fpr_FacialProcessing_getVersion( JNIEnv*  env,
 
 jint
 Java_com_qti_elements_sdk_fpr_FacialProcessing_setConfidenceValue( JNIEnv*  env,
-                                                    jobject  this, jint threshold )
+                                                    jobject  this, jint handle, jint threshold )
 {
         if(threshold < 0 || threshold > 100)
         {
@@ -925,8 +1821,18 @@ Java_com_qti_elements_sdk_fpr_FacialProcessing_setConfidenceValue( JNIEnv*  env,
         }
         else
         {
+                qcff_handle_t h = (qcff_handle_t)handle;
+                qcff_params_t params;
                 jint rc = QCFF_RET_FAILURE;
-                rc = gLib.qcff_setThreshold(threshold);
+                if (h)
+                {
+                    rc = gLib.qcff_get_params(h, &params);
+                    if (rc == QCFF_RET_SUCCESS)
+                    {
+                        params.fr_threshold = threshold * 10;
+                        rc = gLib.qcff_set_params(h, &params);
+                    }
+                }
 
                 if(rc != QCFF_RET_SUCCESS)
                         return -1;
@@ -14,7 +14,37 @@ typedef struct
     int (*qcff_create)            (qcff_handle_t *);
     int (*qcff_config)            (qcff_handle_t, qcff_config_t *);
     int (*qcff_set_detect_rot)    (qcff_handle_t, uint32_t, uint32_t, uint32_t);
+    int (*qcff_set_detect_rot_auto) (qcff_handle_t, uint32_t);
+    int (*qcff_set_orientation)   (qcff_handle_t, uint32_t, uint32_t);
+    int (*qcff_set_downscale)     (qcff_handle_t, uint32_t);
+    int (*qcff_set_adaptive_downscale) (qcff_handle_t, uint32_t, uint32_t, uint32_t);
+    int (*qcff_get_downscale)     (qcff_handle_t, uint32_t *);
+    int (*qcff_set_static_skip)   (qcff_handle_t, uint32_t, uint32_t);
+    int (*qcff_get_skip_stats)    (qcff_handle_t, qcff_skip_stats_t *);
+    int (*qcff_set_motion_roi)    (qcff_handle_t, uint32_t, uint32_t);
+    int (*qcff_get_mem_stats)     (qcff_handle_t, qcff_mem_stats_t *);
+    int (*qcff_get_params)        (qcff_handle_t, qcff_params_t *);
+    int (*qcff_set_params)        (qcff_handle_t, const qcff_params_t *);
+    int (*qcff_get_tracking)      (qcff_handle_t, qcff_tracking_t *);
+    int (*qcff_set_tracking)      (qcff_handle_t, const qcff_tracking_t *);
+    int (*qcff_set_deadline)      (qcff_handle_t, uint32_t, uint32_t);
+    int (*qcff_get_deadline_stats) (qcff_handle_t, qcff_deadline_stats_t *);
+    int (*qcff_set_tiling)        (qcff_handle_t, uint32_t, uint32_t);
+    int (*qcff_set_refine)        (qcff_handle_t, uint32_t, uint32_t);
+    int (*qcff_set_face_threads)  (qcff_handle_t, uint32_t);
+    int (*qcff_set_attr_rates)    (qcff_handle_t, const qcff_attr_rates_t *);
+    int (*qcff_set_recog_cache)   (qcff_handle_t, uint32_t);
+    int (*qcff_set_face_budget)   (qcff_handle_t, uint32_t);
+    int (*qcff_get_ranked_faces)  (qcff_handle_t, uint32_t, uint32_t *, uint32_t *);
     int (*qcff_set_frame)         (qcff_handle_t, uint8_t *);
+    int (*qcff_set_frame_ref)     (qcff_handle_t, uint8_t *);
+    int (*qcff_async_start)       (qcff_handle_t, uint32_t);
+    int (*qcff_async_stop)        (qcff_handle_t);
+    int (*qcff_submit_frame)      (qcff_handle_t, uint8_t *, uint32_t, uint64_t, const qcff_transform_t *);
+    int (*qcff_poll_results)      (qcff_handle_t, uint32_t, qcff_frame_result_t *);
+    int (*qcff_pool_create)       (qcff_pool_t *, const qcff_pool_config_t *);
+    int (*qcff_pool_destroy)      (qcff_pool_t *);
+    int (*qcff_process_batch)     (qcff_pool_t, uint32_t, uint32_t, const qcff_batch_io_t *);
     int (*qcff_set_mode)          (qcff_handle_t, qcff_mode_t);
     int (*qcff_set_engine)        (qcff_handle_t, qcff_engine_t);
     int (*qcff_get_num_faces)     (qcff_handle_t, uint32_t *);
@@ -27,6 +57,7 @@ typedef struct
     int (*qcff_get_directions)    (qcff_handle_t, uint32_t, uint32_t *, uint32_t *, qcff_face_dir_t *);
 //    int (*qcff_get_eye_detection) (qcff_handle_t, uint32_t, uint32_t *, qcff_eye_t *);    //eye detection
     int (*qcff_get_complete_info) (qcff_handle_t, uint32_t, uint32_t *, uint32_t *, qcff_complete_face_info_t *);
+    int (*qcff_transform_complete_info) (qcff_handle_t, const qcff_transform_t *, uint32_t, qcff_complete_face_info_t *);
     int (*qcff_create_feature_cache)  (qcff_handle_t, uint32_t, qcff_face_feature_t *);
     int (*qcff_destroy_feature_cache) (qcff_face_feature_t);
     int (*qcff_reg_new_usr)           (qcff_handle_t, qcff_face_feature_t, uint32_t *);
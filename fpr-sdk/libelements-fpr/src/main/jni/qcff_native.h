@@ -11,6 +11,17 @@
 
 #include <stdint.h>
 
+/* Threading: a handle owns all of its state, engine handles included,
+   and handles share nothing but read-only tables. Different handles may
+   therefore be used from different threads at the same time, and scale
+   with the cores. One handle is used from one thread at a time; the
+   functions documented as such may also be called while its
+   asynchronous worker runs. qcff_get_version may be called from any
+   thread. qcff_setThreshold is the one process wide setting.
+   qcff_bench (qcff_bench.c) checks the scaling on a device: it runs
+   N handles on N threads and prints their aggregate frame rate as a
+   percentage of N times that of one handle. */
+
 /* MACROS */
 #define QCFF_SUCCEEDED(x)   (QCFF_RET_SUCCESS == x)
 #define QCFF_FAILED(x)      (QCFF_RET_SUCCESS != x)
@@ -26,6 +37,9 @@
 #define   QCFF_RET_INVALID_PARM    3
 #define   QCFF_RET_NO_MATCH        4
 #define   QCFF_RET_UNIMPLEMENTED   5
+#define   QCFF_RET_BUSY            6
+#define   QCFF_RET_TIMEOUT         7
+#define   QCFF_RET_SKIPPED         8  /* face past the analysis budget */
 
 #define ROT_ANGLE_0     (0x00001001)  /* Up            0 degree */
 #define ROT_ANGLE_1     (0x00002002)  /* Upper Right  30 degree */
@@ -80,6 +94,83 @@ typedef enum
     QCFF_MODE_MAX,
 } qcff_mode_t;
 
+/* Detection accuracy */
+typedef enum {
+    QCFF_ACCURACY_NORMAL = 0,    // faster
+    QCFF_ACCURACY_HIGH = 1,      // default, high accuracy while tracking
+    QCFF_ACCURACY_MAX,
+} qcff_accuracy_t;
+
+/* Tunable detection parameters of a handle, see qcff_set_params. Face
+   sizes are in pixels of the image the detector runs on, i.e. after
+   downscaling */
+typedef struct {
+    uint32_t             search_step;       /* Search density for new
+                                               faces, 1-100; lower finds
+                                               more faces, slower       */
+    uint32_t             tracking_step;     /* Same for tracked faces    */
+    uint32_t             min_face_size;     /* At least 20               */
+    uint32_t             max_face_size;     /* 0 for the image size      */
+    uint32_t             max_faces;         /* 1-QCFF_MAX_RESULT_FACES   */
+    int32_t              threshold;         /* Detection threshold for
+                                               new faces, 1-1000; 0
+                                               keeps the engine default */
+    int32_t              tracking_threshold;/* Same for tracked faces    */
+    qcff_accuracy_t      accuracy;
+    int32_t              fr_threshold;      /* Smallest recognition
+                                               score, 0-1000            */
+} qcff_params_t;
+
+/* Search for new faces between tracked frames in video mode */
+typedef enum {
+    QCFF_TRACKING_WHOLE = 0,     // whole frame at once, every few frames
+    QCFF_TRACKING_PARTITION = 1, // a third of the frame per frame
+    QCFF_TRACKING_GRADUAL = 2,   // default, a little of the frame per frame
+    QCFF_TRACKING_MAX,
+} qcff_tracking_search_t;
+
+/* Tracking policy of a handle in video mode, see qcff_set_tracking.
+   Negative counts keep the engine default */
+typedef struct {
+    qcff_tracking_search_t search;
+    int32_t              refresh_count;     /* Frames taken by a search
+                                               for new faces            */
+    int32_t              face_retry;        /* Frames a lost face is
+                                               looked for again         */
+    int32_t              head_retry;        /* Same, as a head           */
+    int32_t              hold_count;        /* Frames a lost face is
+                                               still reported           */
+    int32_t              move_rate;         /* Correction of the tracked
+                                               position for motion      */
+} qcff_tracking_t;
+
+/* Refresh of the attributes of tracked faces in video mode, see
+   qcff_set_attr_rates. An interval of 0 or 1 estimates on every frame */
+typedef struct {
+    uint32_t             smile_interval;    /* Frames between smile
+                                               estimates                */
+    uint32_t             gaze_blink_interval;/* Same for gaze and eyes   */
+    uint32_t             direction_interval;/* Same for face direction  */
+    uint32_t             move_percent;      /* Movement or resizing, in
+                                               percent of the face size,
+                                               that forces all of them;
+                                               0 for none               */
+} qcff_attr_rates_t;
+
+/* Pixel format of the input frames. Only luma is processed: it is read
+   straight from the Y plane of the YUV formats and computed from the
+   RGB formats while the frame is ingested */
+typedef enum
+{
+    QCFF_FORMAT_Y = 0,          /* 8-bit luma only, default    */
+    QCFF_FORMAT_NV21,           /* Y plane, then interleaved VU */
+    QCFF_FORMAT_NV12,           /* Y plane, then interleaved UV */
+    QCFF_FORMAT_YV12,           /* Y plane, then V and U planes */
+    QCFF_FORMAT_RGBA8888,       /* R, G, B, A bytes per pixel   */
+    QCFF_FORMAT_BGR888,         /* B, G, R bytes per pixel      */
+    QCFF_FORMAT_MAX,
+} qcff_format_t;
+
 typedef enum {
     QCFF_ENGINE_OMRON = 0,
     QCFF_ENGINE_M21,
@@ -150,13 +241,40 @@ typedef enum
     QCFF_PARTS_EX_MAX
 } qcff_parts_ex_idx_t;
 
+/* Rectangle (faces, crop region)
+   Coordinates with respect to the input frame */
+typedef struct {
+    uint32_t             x;
+    uint32_t             y;
+    uint32_t             dx;
+    uint32_t             dy;
+} qcff_rect_t;
+
 /* QCFF Configuration */
 typedef struct {
     uint32_t             width;     /* Frame Width */
     uint32_t             height;    /* Frame Height */
 
-    /* experimental feature */
-    uint32_t             downscale_factor; /* downscale the image before processing */
+    /* Downscale the image before processing. Integer factors go in
+       downscale_factor; downscale_factor_q8 takes any factor from 1.0 to
+       8.0 in 8.8 fixed point (384 is 1.5) and wins when non-zero.
+       Factors 2 and 4 are area averaged, others bilinearly resampled.
+       All results are reported in input frame coordinates. */
+    uint32_t             downscale_factor;
+    uint32_t             downscale_factor_q8;
+
+    /* Frame layout. stride is the distance in bytes between luma rows
+       (0 means width) and offset the position of the first luma pixel in
+       the buffer handed to qcff_set_frame. Only the crop rectangle is
+       searched for faces; a zero dx or dy selects the whole frame.
+       Results stay in full frame coordinates. */
+    uint32_t             stride;
+    uint32_t             offset;
+    qcff_rect_t          crop;
+
+    /* Pixel format of the frames; stride and offset count bytes of the
+       first plane, so an RGBA row is at least 4 * width bytes */
+    qcff_format_t        format;
 } qcff_config_t;
 
 /* Location struction */
@@ -181,15 +299,6 @@ typedef struct {
     qcff_pixel_t         parts[QCFF_PARTS_EX_MAX];
 } qcff_face_parts_ex_t;
 
-/* Face rectangle
-   Coordinates with respect to the input frame */
-typedef struct {
-    uint32_t             x;
-    uint32_t             y;
-    uint32_t             dx;
-    uint32_t             dy;
-} qcff_rect_t;
-
 typedef struct {
     /* Four corners of the face relative to the facial features: top left, top right,
     * bottom left and bottom right. */
@@ -222,6 +331,14 @@ typedef struct {
     int32_t              roll_in_degree;
 } qcff_face_dir_t;
 
+/* Frames since each attribute of a face was estimated, 0 when it was
+   on the current frame */
+typedef struct {
+    uint32_t             smile;
+    uint32_t             gaze_blink;
+    uint32_t             direction;
+} qcff_attr_age_t;
+
 typedef struct {
     int32_t              confidence;
     qcff_rect_t          rect;
@@ -271,8 +388,93 @@ typedef struct {
     uint32_t              *p_smile_degrees;
     qcff_eye_open_deg_t   *p_eye_open_degrees;
     qcff_gaze_deg_t       *p_gaze_degrees;
+    qcff_attr_age_t       *p_attr_ages;     /* filled along with the
+                                               attributes asked for     */
 } qcff_complete_face_info_t;
 
+/* Transform taking results from input frame to display coordinates.
+   The frame is mirrored horizontally first (when mirrored is set),
+   then rotated clockwise by rotation degrees (0, 90, 180 or 270), then
+   each axis is scaled. Directions, gaze and eye open degrees follow the
+   geometry: left and right swap on mirroring, roll turns with the frame. */
+typedef struct {
+    uint32_t             mirrored;
+    uint32_t             rotation;
+    float                scale_x;
+    float                scale_y;
+} qcff_transform_t;
+
+/* Counters of the static scene skipping, see qcff_set_static_skip */
+typedef struct {
+    uint32_t             frames_detected;
+    uint32_t             frames_skipped;
+    uint32_t             last_skipped;  /* The last frame reused the faces
+                                           of an earlier one */
+} qcff_skip_stats_t;
+
+/* Counters of the frame deadline, see qcff_set_deadline */
+typedef struct {
+    uint32_t             frames_timed_out;  /* Detections the engine cut
+                                               short at a timeout        */
+    uint32_t             frames_late;       /* Detections that took longer
+                                               than the deadline         */
+    uint32_t             last_time_us;      /* Wall time of the last
+                                               detection                 */
+    uint32_t             max_time_us;       /* Longest detection          */
+} qcff_deadline_stats_t;
+
+/* Memory of a handle, see qcff_get_mem_stats. Sizes are in bytes */
+typedef struct {
+    uint32_t             arena_size;        /* Block holding the local frame,
+                                               scratch and face crop     */
+    uint32_t             arena_used;        /* Carved for the current
+                                               configuration             */
+    uint32_t             arena_peak;        /* Largest arena_used since the
+                                               handle was created        */
+    uint32_t             dt_backup_size;    /* Detector requirements for
+                                               the configuration, as
+                                               reported by the engine    */
+    uint32_t             dt_work_min_size;
+    uint32_t             dt_work_max_size;
+} qcff_mem_stats_t;
+
+/* Information gathered for each frame processed asynchronously */
+#define QCFF_INFO_RECTS        (1 << 0)
+#define QCFF_INFO_PARTS        (1 << 1)
+#define QCFF_INFO_PARTS_EX     (1 << 2)
+#define QCFF_INFO_DIRECTIONS   (1 << 3)
+#define QCFF_INFO_SMILES       (1 << 4)
+#define QCFF_INFO_EYE_OPENS    (1 << 5)
+#define QCFF_INFO_GAZES        (1 << 6)
+
+/* Maximum number of faces in a qcff_frame_result_t */
+#define QCFF_MAX_RESULT_FACES  64
+
+/* Results of a frame processed asynchronously or in a batch. Only the
+   arrays selected by info_mask hold data, for num_faces faces. */
+typedef struct {
+    uint32_t              seq;          /* As passed to qcff_submit_frame,
+                                           index of the image in a batch */
+    uint64_t              timestamp;    /* As passed to qcff_submit_frame */
+    int                   status;       /* QCFF_RET_* of the processing   */
+    uint32_t              time_us;      /* Time taken by the processing   */
+    uint32_t              num_dropped;  /* Frames replaced by newer ones
+                                           since the previous result     */
+    uint32_t              skipped;      /* Detection was skipped and the
+                                           faces of an earlier frame
+                                           reused, see
+                                           qcff_set_static_skip          */
+    uint32_t              info_mask;
+    uint32_t              num_faces;
+    qcff_face_rect_t      rects[QCFF_MAX_RESULT_FACES];
+    qcff_face_parts_t     parts[QCFF_MAX_RESULT_FACES];
+    qcff_face_parts_ex_t  parts_ex[QCFF_MAX_RESULT_FACES];
+    qcff_face_dir_t       directions[QCFF_MAX_RESULT_FACES];
+    uint32_t              smile_degrees[QCFF_MAX_RESULT_FACES];
+    qcff_eye_open_deg_t   eye_open_degrees[QCFF_MAX_RESULT_FACES];
+    qcff_gaze_deg_t       gaze_degrees[QCFF_MAX_RESULT_FACES];
+} qcff_frame_result_t;
+
 /* Opaque handle to an QCFF instance */
 typedef void* qcff_handle_t;
 
@@ -326,21 +528,484 @@ int qcff_config (qcff_handle_t      handle,
  * This function provides the optional parameter of the angles to detect
  * in different planes. There are three planes to configure: frontal,
  * half-profile (+/-30 degree from frontal) and profile (+/-90 side view).
- * For each plane, valid configuration * includes: 15 (i.e. -15 to 15 degrees),
- * 45 (-45 to 45 degrees), 75 (-75 to 75 degrees) and 135 (-135 to 135 degrees).
+ * For each plane, the in-plane rotations to detect are an OR of ROT_ANGLE_*
+ * masks, e.g. ROT_ANGLE_U45 for -45 to 45 degrees. The default is
+ * ROT_ANGLE_ALL frontal, ROT_ANGLE_U45 half profile and no profile. Each
+ * angle costs about as much detection time as the others, so the fewer
+ * the faster. A configured detector is reprogrammed, not rebuilt.
  *
  * INPUT:        handle       Handle to QCFF instance created previously.
- *               frontal      Degree of rotation in the frontal plane.
- *               half_profile Degree of rotation in the half profile plane.
- *               profile      Degree of rotation in the side profile plane.
+ *               frontal      Rotations to detect in the frontal plane.
+ *               half_profile Rotations to detect in the half profile plane.
+ *               profile      Rotations to detect in the side profile plane.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_FAILURE
  ************************************************************************/
 int qcff_set_detect_rot (qcff_handle_t      handle,
                          uint32_t           frontal,
                          uint32_t           half_profile,
                          uint32_t           profile);
 
+/*************************************************************************
+ * qcff_set_detect_rot_auto
+ *
+ * This function turns the orientation driven angles on or off. When on,
+ * the angles of qcff_set_detect_rot are taken relative to the upright of
+ * the display and turned into the frame by the orientation given with
+ * qcff_set_orientation, or with the transform of each submitted frame.
+ * With ROT_ANGLE_U45 only faces within 45 degrees of upright on display
+ * are searched for, whichever way the device is held.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               enable       Nonzero for on.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_FAILURE
+ ************************************************************************/
+int qcff_set_detect_rot_auto (qcff_handle_t      handle,
+                              uint32_t           enable);
+
+/*************************************************************************
+ * qcff_set_orientation
+ *
+ * This function gives the orientation on display of the frames passed to
+ * qcff_set_frame and qcff_set_frame_ref, as in qcff_transform_t. It is
+ * used by the orientation driven angles only.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               rotation     Clockwise rotation: 0, 90, 180 or 270.
+ *               mirrored     Nonzero when the frame is mirrored first.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_set_orientation (qcff_handle_t      handle,
+                          uint32_t           rotation,
+                          uint32_t           mirrored);
+
+/*************************************************************************
+ * qcff_set_downscale
+ *
+ * This function changes the downscale factor without reconfiguring. It
+ * takes effect from the next frame given; the detection handles are kept,
+ * but faces being tracked are searched for again at the new scale. It
+ * turns the adaptive downscale mode off.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               factor_q8    Downscale factor in 8.8 fixed point, from
+ *                            1.0 (256) to 8.0 (2048).
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_set_downscale (qcff_handle_t      handle,
+                        uint32_t           factor_q8);
+
+/*************************************************************************
+ * qcff_set_adaptive_downscale
+ *
+ * This function lets the downscale factor follow the content. After each
+ * frame, the largest factor at which faces of min_face_size pixels (or the
+ * smallest face seen recently, if smaller) are still above the detector's
+ * minimum face size is selected. When detection takes longer than
+ * target_time_us on average, the factor is raised further to meet the
+ * budget. Changes are applied as by qcff_set_downscale, with hysteresis
+ * so that the factor does not flip from frame to frame.
+ *
+ * INPUT:        handle         Handle to QCFF instance created previously.
+ *               min_face_size  Smallest face of interest, in input frame
+ *                              pixels. 0 turns the adaptive mode off.
+ *               target_time_us Detection time budget per frame, 0 for
+ *                              none.
+ *               max_factor_q8  Largest factor to select, 8.8 fixed
+ *                              point. 0 for 8.0.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_set_adaptive_downscale (qcff_handle_t      handle,
+                                 uint32_t           min_face_size,
+                                 uint32_t           target_time_us,
+                                 uint32_t           max_factor_q8);
+
+/*************************************************************************
+ * qcff_get_downscale
+ *
+ * This function retrieves the downscale factor the last frame was
+ * processed at.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ * OUTPUT:       p_factor_q8  Downscale factor in 8.8 fixed point.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_downscale (qcff_handle_t      handle,
+                        uint32_t          *p_factor_q8);
+
+/*************************************************************************
+ * qcff_set_static_skip
+ *
+ * This function turns the static scene skipping on or off. A coarse
+ * signature of each frame, the block means of a 16x16 grid, is taken
+ * while the frame is packed. When no block mean moved by more than
+ * threshold since the last frame detection ran on, detection is skipped
+ * and the faces of that frame are reused. All per-face queries still
+ * read the new frame.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               threshold    Largest change of a block mean, in luma
+ *                            levels, for a frame to count as unchanged.
+ *                            0 for off.
+ *               max_skip     Consecutive frames skipped at most before
+ *                            detection runs again, 0 for no limit.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_set_static_skip (qcff_handle_t      handle,
+                          uint32_t           threshold,
+                          uint32_t           max_skip);
+
+/*************************************************************************
+ * qcff_get_skip_stats
+ *
+ * This function retrieves the number of frames detection ran on and the
+ * number of frames it was skipped for since the handle was configured.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ * OUTPUT:       p_stats      The counters.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_skip_stats (qcff_handle_t        handle,
+                         qcff_skip_stats_t   *p_stats);
+
+/*************************************************************************
+ * qcff_set_motion_roi
+ *
+ * This function turns the motion guided detection masks on or off. The
+ * frame signature of qcff_set_static_skip is compared block by block
+ * with the one of the frame detection last ran on. New faces are only
+ * searched for around the blocks that changed by more than threshold
+ * and around the last faces; faces are tracked there as well. When
+ * nothing changed and no face is tracked, detection is skipped as for a
+ * static scene. Every full_scan_interval frames the whole image is
+ * searched.
+ *
+ * INPUT:        handle              Handle to QCFF instance created
+ *                                   previously.
+ *               threshold           Change of a block mean, in luma
+ *                                   levels, marking the block as moving.
+ *                                   0 for off.
+ *               full_scan_interval  Frames between two full scans, 0 for
+ *                                   the default of 30.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_set_motion_roi (qcff_handle_t      handle,
+                         uint32_t           threshold,
+                         uint32_t           full_scan_interval);
+
+/*************************************************************************
+ * qcff_get_mem_stats
+ *
+ * This function retrieves the memory used by the handle. The local
+ * frame, the luma of RGB frames, the downscaler's scratch and the face
+ * crop are carved out of one aligned block, which is kept across calls
+ * to qcff_config while large enough. The detector's work memory is
+ * bounded by its requirement for the configured crop.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ * OUTPUT:       p_stats      The memory figures.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_mem_stats (qcff_handle_t        handle,
+                        qcff_mem_stats_t    *p_stats);
+
+/*************************************************************************
+ * qcff_get_params
+ *
+ * This function retrieves the detection parameters of the handle.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ * OUTPUT:       p_params     The parameters.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_params (qcff_handle_t        handle,
+                     qcff_params_t       *p_params);
+
+/*************************************************************************
+ * qcff_set_params
+ *
+ * This function sets the detection parameters of the handle. They apply
+ * from the next frame on; a configured handle keeps its detector, only
+ * a change of max_faces drops the faces being tracked. Parameters are
+ * kept across calls to qcff_config. Typical use is to get the
+ * parameters, change some and set them back.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               p_params     The parameters.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_FAILURE
+ ************************************************************************/
+int qcff_set_params (qcff_handle_t          handle,
+                     const qcff_params_t   *p_params);
+
+/*************************************************************************
+ * qcff_get_tracking
+ *
+ * This function retrieves the tracking policy of the handle.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ * OUTPUT:       p_tracking   The policy.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_tracking (qcff_handle_t        handle,
+                       qcff_tracking_t     *p_tracking);
+
+/*************************************************************************
+ * qcff_set_tracking
+ *
+ * This function sets how faces are followed in video mode. Faces found
+ * once are tracked from frame to frame; the search for new faces is
+ * spread over refresh_count frames, over the whole frame at once, over
+ * thirds of it or a little at a time. A short refresh finds new faces
+ * sooner, at a higher cost per frame: a fixed camera can afford long
+ * refreshes and holds, a handheld one wants short ones and a large move
+ * rate. A face that is lost is looked for again for face_retry frames
+ * and still reported for hold_count frames. The policy is kept across
+ * calls to qcff_config and is not used in still mode.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               p_tracking   The policy.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_FAILURE
+ ************************************************************************/
+int qcff_set_tracking (qcff_handle_t            handle,
+                       const qcff_tracking_t   *p_tracking);
+
+/*************************************************************************
+ * qcff_set_deadline
+ *
+ * This function sets the time detection may take on a frame. The engine
+ * stops searching for new faces after non_tracking_ms and stops tracking
+ * the known ones after tracking_ms, and the faces found by then are
+ * returned; the next frame is searched again in full. The engine clocks
+ * the process time, so a detection preempted by other threads may still
+ * overrun: the wall time of each detection is measured as well and
+ * counted against the sum of the timeouts that apply to the mode, see
+ * qcff_get_deadline_stats. Timeouts are kept across calls to qcff_config.
+ *
+ * INPUT:        handle           Handle to QCFF instance created
+ *                                previously.
+ *               non_tracking_ms  Time to search for new faces, 0 for no
+ *                                limit.
+ *               tracking_ms      Time to track known faces in video
+ *                                mode, 0 for no limit.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_FAILURE
+ ************************************************************************/
+int qcff_set_deadline (qcff_handle_t      handle,
+                       uint32_t           non_tracking_ms,
+                       uint32_t           tracking_ms);
+
+/*************************************************************************
+ * qcff_get_deadline_stats
+ *
+ * This function retrieves the counters of the frame deadline since the
+ * handle was configured. It may be called while the asynchronous worker
+ * runs.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ * OUTPUT:       p_stats      The counters.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_get_deadline_stats (qcff_handle_t            handle,
+                             qcff_deadline_stats_t   *p_stats);
+
+/*************************************************************************
+ * qcff_set_tiling
+ *
+ * This function turns tiled detection of large still images on or off.
+ * In QCFF_MODE_STILL, an image of at least min_pixels pixels after
+ * downscaling is split into overlapping tiles, sized from the smallest
+ * face size so that the overlap holds any face the tiles look for.
+ * The tiles are searched on separate detectors by num_threads threads
+ * (the calling thread among them). Faces larger than the overlap are
+ * looked for in one more pass over the image, downscaled. Faces cut by
+ * a seam are dropped, since the neighbouring tile holds them whole, and
+ * the faces found twice are merged by non-maximum suppression on their
+ * bounding boxes. The faces are then queried as after a single pass.
+ * The detection parameters, angles and deadline of the handle apply to
+ * every tile; a deadline bounds each tile separately.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               num_threads  Threads searching the tiles, up to
+ *                            QCFF_MAX_THREADS; 0 for one per CPU.
+ *               min_pixels   Smallest image split into tiles, 0 to turn
+ *                            tiling off.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_NO_RESOURCE
+ ************************************************************************/
+int qcff_set_tiling (qcff_handle_t      handle,
+                     uint32_t           num_threads,
+                     uint32_t           min_pixels);
+
+/*************************************************************************
+ * qcff_set_refine
+ *
+ * This function turns coarse-to-fine detection on or off. In
+ * QCFF_MODE_STILL, faces are first looked for on the image downscaled by
+ * coarse_scale_q8, then looked for again at the resolution of the handle
+ * in a square around each of them, margin_pct of the face size wider on
+ * every side, and only at sizes close to the one found. The boxes and
+ * landmarks therefore keep the full precision while most of the image is
+ * only searched at the coarse scale. A face not found again keeps its
+ * coarse box. Unlike downscale_factor, the frame the facial parts, smile,
+ * gaze-blink, contour and recognition engines read is not downscaled.
+ *
+ * The coarse factor is lowered as needed to keep min_face_size at least
+ * the smallest size the engine detects; refinement does not apply when it
+ * ends up at 1.0. Tiled detection takes precedence on the images it
+ * applies to.
+ *
+ * INPUT:        handle           Handle to QCFF instance created
+ *                                previously.
+ *               coarse_scale_q8  Downscale factor of the coarse pass,
+ *                                8.8 fixed point above 1.0 and up to
+ *                                8.0; 0 turns refinement off.
+ *               margin_pct       Margin around the coarse faces, up to
+ *                                200.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_NO_RESOURCE
+ ************************************************************************/
+int qcff_set_refine (qcff_handle_t      handle,
+                     uint32_t           coarse_scale_q8,
+                     uint32_t           margin_pct);
+
+/*************************************************************************
+ * qcff_set_face_threads
+ *
+ * This function sets how many threads analyse the faces of one query.
+ * When a query asks for more than the rectangles of several faces, the
+ * parts, contour, smile and gaze-blink estimation of each face run on
+ * one of num_threads workers (the calling thread among them), each with
+ * its own engine handles. Every face is written to its own entries of
+ * the output arrays, so the results are the same as with one thread.
+ * Queries naming a face twice run on the calling thread.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               num_threads  Threads analysing faces, up to
+ *                            QCFF_MAX_RESULT_FACES; 0 for one per CPU,
+ *                            1 for the calling thread alone.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_NO_RESOURCE
+ ************************************************************************/
+int qcff_set_face_threads (qcff_handle_t      handle,
+                           uint32_t           num_threads);
+
+/*************************************************************************
+ * qcff_set_attr_rates
+ *
+ * This function sets how often the attributes of a tracked face are
+ * estimated in video mode. Faces are told apart by their tracking ID.
+ * Between estimates, qcff_get_complete_info and the per-attribute
+ * queries return the last smile, gaze-blink and direction of the face,
+ * and p_attr_ages tells how old they are. A face moving or resizing by
+ * more than move_percent of its size, or changing pose, since it was
+ * last forced is estimated again at once. Still mode and faces without
+ * history are always estimated.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               p_rates      The refresh rates, NULL to estimate every
+ *                            frame.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_set_attr_rates (qcff_handle_t              handle,
+                         const qcff_attr_rates_t   *p_rates);
+
+/*************************************************************************
+ * qcff_set_recog_cache
+ *
+ * This function lets qcff_identify_usr reuse the match of a tracked face
+ * in video mode. Faces are told apart by their tracking ID. A face is
+ * identified again once interval frames have passed, when it changes
+ * pose, and after the tracker lost it. Any change to the registered
+ * users drops all matches. The recognition threshold is applied to the
+ * kept score on every call.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               interval     Frames a match is reused for; 0 or 1 to
+ *                            identify on every call.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_set_recog_cache (qcff_handle_t             handle,
+                          uint32_t                  interval);
+
+/*************************************************************************
+ * qcff_set_face_budget
+ *
+ * This function sets how many faces of a frame are fully analysed. The
+ * faces are ranked as by qcff_get_ranked_faces, and those past the
+ * first max_faces only get their rectangle: qcff_get_complete_info and
+ * the per-attribute queries zero their other entries, and
+ * qcff_identify_usr returns QCFF_RET_SKIPPED for them.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               max_faces    Faces analysed per frame, 0 for all.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_set_face_budget (qcff_handle_t             handle,
+                          uint32_t                  max_faces);
+
+/*************************************************************************
+ * qcff_get_ranked_faces
+ *
+ * This function ranks the faces of the last frame, most important
+ * first. A face ranks higher the larger it is, the closer it is to the
+ * centre of the crop region and, in video mode, the longer it has been
+ * tracked.
+ *
+ * INPUT:        handle               Handle to QCFF instance created
+ *                                    previously.
+ *               max_faces            Maximum number of indices returned.
+ * OUTPUT:       p_num_faces_returned Number of indices returned.
+ *               p_face_indices       Zero-based face indices, by rank.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ ************************************************************************/
+int qcff_get_ranked_faces (qcff_handle_t            handle,
+                           uint32_t                 max_faces,
+                           uint32_t                *p_num_faces_returned,
+                           uint32_t                *p_face_indices);
+
 /*************************************************************************
  * qcff_set_frame
  *
@@ -355,16 +1020,235 @@ int qcff_set_detect_rot (qcff_handle_t      handle,
 int qcff_set_frame (qcff_handle_t   handle,
                     uint8_t        *p_frame);
 
+/*************************************************************************
+ * qcff_set_frame_ref
+ *
+ * This function provides the input to the QCFF instance without taking
+ * a copy of it. When no downscaling is configured, detection and all
+ * subsequent facial parts, smile, gaze-blink, contour and recognition
+ * queries read directly from the caller's luma plane.
+ *
+ * Lifetime contract: the buffer is borrowed, not owned. The caller must
+ * keep it allocated and must not modify it until the next call to
+ * qcff_set_frame / qcff_set_frame_ref, qcff_config or qcff_destroy on
+ * this handle, whichever comes first. Queries issued after the buffer
+ * has been released or recycled read undefined data.
+ *
+ * Padded buffers (stride larger than width) and crop rectangles are read
+ * in place as long as no downscaling is configured. The engines then
+ * read whole strides, so the buffer must hold stride * height bytes past
+ * the offset, the last row padded too. A buffer whose last row stops at
+ * the width, as the planes of android.media.Image do, must be given to
+ * qcff_set_frame instead.
+ *
+ * INPUT:        handle     Handle to QCFF instance created previously.
+ *               p_frame    Buffer laid out as described to qcff_config,
+ *                          of at least offset + stride * height bytes.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_set_frame_ref (qcff_handle_t   handle,
+                        uint8_t        *p_frame);
+
+/*************************************************************************
+ * qcff_async_start
+ *
+ * This function starts a worker thread that processes the frames given
+ * to qcff_submit_frame, so that detection never runs on the thread that
+ * delivers frames. Frames and results go through single-slot mailboxes:
+ * a frame submitted while the previous one still waits replaces it, and
+ * an unread result is replaced by the next one. Stale frames are dropped
+ * rather than queued.
+ *
+ * While the worker runs it owns the detection state of the handle:
+ * qcff_set_frame(_ref), qcff_get_* face queries, feature caching and
+ * identification return QCFF_RET_BUSY. qcff_config stops the worker and
+ * starts it again with the new configuration; qcff_destroy stops it.
+ * One thread may submit and one thread may poll at a time.
+ *
+ * INPUT:        handle     Handle to QCFF instance created and
+ *                          configured previously.
+ *               info_mask  QCFF_INFO_* information to gather per frame.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_NO_RESOURCE
+ ************************************************************************/
+int qcff_async_start (qcff_handle_t   handle,
+                      uint32_t        info_mask);
+
+/*************************************************************************
+ * qcff_async_stop
+ *
+ * This function stops the worker started by qcff_async_start. Frames
+ * and results not yet taken are discarded. It must not be called while
+ * another thread is inside qcff_submit_frame or qcff_poll_results.
+ *
+ * INPUT:        handle     Handle to QCFF instance created previously.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_async_stop (qcff_handle_t   handle);
+
+/*************************************************************************
+ * qcff_submit_frame
+ *
+ * This function hands a frame to the worker and returns without waiting
+ * for detection. The frame is laid out as described to qcff_config; its
+ * crop is packed (and downscaled) before the call returns, so the buffer
+ * can be reused right away.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               p_frame      Frame to process.
+ *               seq          Sequence number reported with the result.
+ *               timestamp    Timestamp reported with the result.
+ *               p_transform  Display transform applied to the result,
+ *                            see qcff_transform_complete_info. May be
+ *                            NULL.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_submit_frame (qcff_handle_t             handle,
+                       uint8_t                  *p_frame,
+                       uint32_t                  seq,
+                       uint64_t                  timestamp,
+                       const qcff_transform_t   *p_transform);
+
+/*************************************************************************
+ * qcff_poll_results
+ *
+ * This function takes the most recent result of the worker. When none
+ * is pending, it waits for one for up to timeout_ms milliseconds.
+ *
+ * INPUT:        handle       Handle to QCFF instance created previously.
+ *               timeout_ms   Time to wait for a result, 0 not to wait.
+ * OUTPUT:       p_result     The result.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_TIMEOUT
+ ************************************************************************/
+int qcff_poll_results (qcff_handle_t          handle,
+                       uint32_t               timeout_ms,
+                       qcff_frame_result_t   *p_result);
+
+/* Pool of handles processing still images on worker threads */
+typedef void* qcff_pool_t;
+
+/* Most threads and engine handles set up by one call: a pool, or the
+   detectors of tiled detection */
+#define QCFF_MAX_THREADS       64
+
+/* Pool configuration */
+typedef struct {
+    uint32_t              num_handles;  /* Worker threads, each owning a
+                                           handle, up to QCFF_MAX_THREADS;
+                                           0 for one per CPU             */
+    uint32_t              queue_depth;  /* Images taken in and not yet
+                                           handed back at most, up to
+                                           QCFF_MAX_THREADS; 0 for two
+                                           per handle, never fewer than
+                                           num_handles                   */
+    uint32_t              deadline_ms;  /* Detection time per image, 0
+                                           for none, see
+                                           qcff_set_deadline             */
+    const qcff_params_t  *p_params;     /* Detection parameters of the
+                                           handles, NULL for the defaults */
+} qcff_pool_config_t;
+
+/* Image of a batch */
+typedef struct {
+    uint8_t                  *p_frame;      /* Laid out as cfg tells      */
+    qcff_config_t             cfg;          /* Dimension, layout, format
+                                               and downscaling            */
+    const qcff_transform_t   *p_transform;  /* Applied to the result, may
+                                               be NULL                    */
+} qcff_batch_item_t;
+
+/* Supplier of the images of a batch and receiver of their results. Both
+   functions are called on the thread running qcff_process_batch, one
+   image at a time, so images can be produced and released lazily. */
+typedef struct {
+    void   *p_user;
+
+    /* Fills in image index; a failure skips the image */
+    int   (*get_image)  (void                       *p_user,
+                         uint32_t                    index,
+                         qcff_batch_item_t          *p_item);
+
+    /* Takes the result of image index, in order of completion. The
+       image is no longer used once this is called. */
+    void  (*put_result) (void                       *p_user,
+                         uint32_t                    index,
+                         const qcff_frame_result_t  *p_result);
+} qcff_batch_io_t;
+
+/*************************************************************************
+ * qcff_pool_create
+ *
+ * This function creates a pool of handles in QCFF_MODE_STILL, each
+ * driven by its own worker thread, for qcff_process_batch. A handle is
+ * configured again only when an image differs in dimension or layout
+ * from the previous one it processed.
+ *
+ * INPUT:        p_cfg      Pool configuration.
+ * OUTPUT:       p_pool     The pool.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_NO_RESOURCE
+ ************************************************************************/
+int qcff_pool_create (qcff_pool_t                *p_pool,
+                      const qcff_pool_config_t   *p_cfg);
+
+/*************************************************************************
+ * qcff_pool_destroy
+ *
+ * This function stops the workers of a pool and destroys its handles.
+ * It must not be called while a batch runs on the pool.
+ *
+ * INPUT:        p_pool     Pool created previously, NULL on return.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_pool_destroy (qcff_pool_t   *p_pool);
+
+/*************************************************************************
+ * qcff_process_batch
+ *
+ * This function runs detection on num_images images spread over the
+ * handles of the pool and returns once every result is handed back.
+ * Images are taken in through p_io->get_image as long as fewer than
+ * queue_depth are outstanding, and each result is handed back through
+ * p_io->put_result with the index of its image. Batches on one pool
+ * run one after the other.
+ *
+ * INPUT:        pool        Pool created previously.
+ *               num_images  Number of images in the batch.
+ *               info_mask   QCFF_INFO_* information to gather per image.
+ *               p_io        Image supplier and result receiver.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_process_batch (qcff_pool_t              pool,
+                        uint32_t                 num_images,
+                        uint32_t                 info_mask,
+                        const qcff_batch_io_t   *p_io);
+
 /*************************************************************************
  * qcff_set_mode
  *
  * This function sets the optional parameter: detection mode.
  * It should be configured differently when QCFF is used in still image
  * vs video sequence scenario. If unset, default is QCFF_MODE_VIDEO.
+ * The mode applies from the next frame on. Each handle keeps a
+ * few detectors set up for the frame sizes, downscale factors and modes
+ * it was last configured with, so switching back and forth between
+ * preview frames and still images does not set up a detector again.
+ * Faces being tracked are dropped on a switch.
  *
  * INPUT:        handle     Handle to QCFF instance created previously.
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
+ *               QCFF_RET_BUSY
+ *               QCFF_RET_FAILURE
  ************************************************************************/
 int qcff_set_mode (qcff_handle_t     handle,
                    qcff_mode_t       mode);
@@ -730,6 +1614,29 @@ int qcff_get_complete_info (qcff_handle_t               handle,
                             uint32_t                   *p_num_faces_returned,
                             qcff_complete_face_info_t  *p_complete_info);
 
+/*************************************************************************
+ * qcff_transform_complete_info
+ *
+ * This function applies a display transform to the information returned
+ * by qcff_get_complete_info, in place and in one pass over all the
+ * arrays present. Face rectangles stay sorted (x, y is the top left
+ * corner after the transform), facial parts keep their meaning: the
+ * left eye is the eye on the left side of the transformed image.
+ *
+ * INPUT:        handle               Handle to QCFF instance created
+ *                                    previously.
+ *               p_transform          Transform to apply.
+ *               num_faces            The number of entries in each of
+ *                                    the arrays of p_complete_info.
+ *               p_complete_info      The complete info to transform.
+ * RETURN VALUE: QCFF_RET_SUCCESS
+ *               QCFF_RET_INVALID_PARM
+ ************************************************************************/
+int qcff_transform_complete_info (qcff_handle_t               handle,
+                                  const qcff_transform_t     *p_transform,
+                                  uint32_t                    num_faces,
+                                  qcff_complete_face_info_t  *p_complete_info);
+
 
 int qcff_create_feature_cache  (qcff_handle_t           handle,
                                 uint32_t                face_index,
@@ -815,6 +1722,9 @@ int qcff_remove_ex_usr (qcff_handle_t        handle,
  * RETURN VALUE: QCFF_RET_SUCCESS
  *               QCFF_RET_INVALID_PARM
  *               QCFF_RET_NO_MATCH
+ *               QCFF_RET_SKIPPED   The face is past the budget set with
+ *                                  qcff_set_face_budget; nothing is
+ *                                  known of it.
  ************************************************************************/
 int qcff_identify_usr (qcff_handle_t        handle,
                        uint32_t             face_index,
@@ -933,7 +1843,10 @@ int qcff_destroy (qcff_handle_t *p_handle);
 /*************************************************************************
  * qcff_setThreshold
  *
- * This function sets the confidence threshold value.
+ * This function sets the confidence threshold value of the handles
+ * created afterwards, process wide; it may be called from any thread.
+ * Use fr_threshold of qcff_set_params to change the threshold of one
+ * handle.
  *
  * INPUT:        threshold     threshold value.
  *